@@ -0,0 +1,56 @@
+/**
+ * mbench_util - Harness for microbenchmarks of the library hot paths
+ *
+ * The benchmarks run against a device backed by a stub `struct nvm_be`, which
+ * completes every command without doing any I/O, thus measuring the CPU cost
+ * of the library itself. Each function under test is called repeatedly, the
+ * number of calls is calibrated such that a run lasts at least
+ * NVM_MBENCH_MSECS milliseconds, and the best of NVM_MBENCH_NRUNS runs is
+ * reported as ns/op and cycles/op.
+ *
+ * Results are exported as JSON, to the file given as the first argument of a
+ * benchmark program or to stdout.
+ */
+#ifndef __MBENCH_UTIL_H
+#define __MBENCH_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <liblightnvm.h>
+
+#define MBENCH_MSECS_DEF 200	///< Default minimum duration of a run
+#define MBENCH_NRUNS_DEF 5	///< Default number of runs
+#define MBENCH_NRES_MAX 64	///< Max. # of results of a benchmark program
+
+/**
+ * Function under test, called once per iteration with the argument given to
+ * `mbench_run`
+ */
+typedef void (*mbench_fn)(void *arg);
+
+/**
+ * Open a device of the given OCSSD version, 'verid', backed by the stub
+ * backend, returns NULL and sets errno on error
+ */
+struct nvm_dev *mbench_dev_open(int verid);
+
+void mbench_dev_close(struct nvm_dev *dev);
+
+/**
+ * Measure 'fn', each call performing 'nops' operations, and record the result
+ * under 'name', returns -1 and sets errno on error
+ */
+int mbench_run(const char *name, mbench_fn fn, void *arg, size_t nops);
+
+/**
+ * Record 'name' as skipped, e.g. when the build lacks what it exercises
+ */
+void mbench_skip(const char *name, const char *reason);
+
+/**
+ * Export the recorded results of the benchmark program 'bench' as JSON, to
+ * 'path' or to stdout when 'path' is NULL, returns -1 on error
+ */
+int mbench_json(const char *bench, const char *path);
+
+#endif /* __MBENCH_UTIL_H */
@@ -0,0 +1,122 @@
+/**
+ * mbench_addr - Address format conversion and validation
+ *
+ * Measures nvm_addr_gen2dev, nvm_addr_dev2gen and nvm_addr_check on OCSSD 1.2
+ * and 2.0 geometries, cycling through a set of random addresses
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <liblightnvm.h>
+#include "mbench_util.h"
+
+#define ADDR_NADDRS 1024	///< Power of two, cycled with a mask
+
+struct addr_arg {
+	struct nvm_dev *dev;
+	struct nvm_addr addrs[ADDR_NADDRS];
+	uint64_t devs[ADDR_NADDRS];
+	size_t cur;
+	uint64_t sink;
+};
+
+static void addr_fill(struct addr_arg *arg)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(arg->dev);
+
+	for (size_t i = 0; i < ADDR_NADDRS; ++i) {
+		struct nvm_addr *addr = &arg->addrs[i];
+
+		addr->val = 0;
+		switch (nvm_dev_get_verid(arg->dev)) {
+		case NVM_SPEC_VERID_12:
+			addr->g.ch = rand() % geo->g.nchannels;
+			addr->g.lun = rand() % geo->g.nluns;
+			addr->g.pl = rand() % geo->g.nplanes;
+			addr->g.blk = rand() % geo->g.nblocks;
+			addr->g.pg = rand() % geo->g.npages;
+			addr->g.sec = rand() % geo->g.nsectors;
+			break;
+
+		case NVM_SPEC_VERID_20:
+			addr->l.pugrp = rand() % geo->l.npugrp;
+			addr->l.punit = rand() % geo->l.npunit;
+			addr->l.chunk = rand() % geo->l.nchunk;
+			addr->l.sectr = rand() % geo->l.nsectr;
+			break;
+		}
+
+		arg->devs[i] = nvm_addr_gen2dev(arg->dev, *addr);
+	}
+}
+
+static void addr_gen2dev(void *opaque)
+{
+	struct addr_arg *arg = opaque;
+
+	arg->sink += nvm_addr_gen2dev(arg->dev, arg->addrs[arg->cur]);
+	arg->cur = (arg->cur + 1) & (ADDR_NADDRS - 1);
+}
+
+static void addr_dev2gen(void *opaque)
+{
+	struct addr_arg *arg = opaque;
+
+	arg->sink += nvm_addr_dev2gen(arg->dev, arg->devs[arg->cur]).val;
+	arg->cur = (arg->cur + 1) & (ADDR_NADDRS - 1);
+}
+
+static void addr_check(void *opaque)
+{
+	struct addr_arg *arg = opaque;
+
+	arg->sink += nvm_addr_check(arg->addrs[arg->cur], arg->dev);
+	arg->cur = (arg->cur + 1) & (ADDR_NADDRS - 1);
+}
+
+static int addr_bench(int verid, const char *sfx)
+{
+	struct addr_arg *arg;
+	char name[64];
+	int err = 0;
+
+	arg = calloc(1, sizeof(*arg));
+	if (!arg) {
+		perror("# FAILED: calloc");
+		return -1;
+	}
+
+	arg->dev = mbench_dev_open(verid);
+	if (!arg->dev) {
+		perror("# FAILED: mbench_dev_open");
+		free(arg);
+		return -1;
+	}
+
+	addr_fill(arg);
+
+	snprintf(name, sizeof(name), "addr_gen2dev_%s", sfx);
+	err |= mbench_run(name, addr_gen2dev, arg, 1);
+
+	snprintf(name, sizeof(name), "addr_dev2gen_%s", sfx);
+	err |= mbench_run(name, addr_dev2gen, arg, 1);
+
+	snprintf(name, sizeof(name), "addr_check_%s", sfx);
+	err |= mbench_run(name, addr_check, arg, 1);
+
+	mbench_dev_close(arg->dev);
+	free(arg);
+
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	err |= addr_bench(NVM_SPEC_VERID_12, "s12");
+	err |= addr_bench(NVM_SPEC_VERID_20, "s20");
+	if (err)
+		return 1;
+
+	return mbench_json("addr", argc > 1 ? argv[1] : NULL) ? 1 : 0;
+}
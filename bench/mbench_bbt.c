@@ -0,0 +1,100 @@
+/**
+ * mbench_bbt - Cached bad-block-tables
+ *
+ * Measures the updates of a cached bad-block-table of an OCSSD 1.2 LUN, that
+ * is, nvm_bbt_set, replacing the table as a whole, and nvm_bbt_mark, updating
+ * a single block. Both repack the table and refresh its counters, the
+ * popcount over the bit-sliced states, which is not callable on its own.
+ *
+ * Replaced tables are retired and reclaimed by the update publishing the
+ * next version, as part of the measured cost
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <liblightnvm.h>
+#include "mbench_util.h"
+
+struct bbt_arg {
+	struct nvm_dev *dev;
+	struct nvm_bbt *bbt;		///< Copy of the table of the LUN
+	struct nvm_addr addr;		///< Block address used by mark
+	size_t nerrs;
+};
+
+static void bbt_set(void *opaque)
+{
+	struct bbt_arg *arg = opaque;
+
+	if (nvm_bbt_set(arg->dev, arg->bbt, NULL))
+		++arg->nerrs;
+}
+
+static void bbt_mark(void *opaque)
+{
+	struct bbt_arg *arg = opaque;
+	const struct nvm_geo *geo = nvm_dev_get_geo(arg->dev);
+
+	arg->addr.g.blk = (arg->addr.g.blk + 1) % geo->g.nblocks;
+
+	if (nvm_bbt_mark(arg->dev, &arg->addr, 1, NVM_BBT_HMRK, NULL))
+		++arg->nerrs;
+}
+
+static void bbt_get(void *opaque)
+{
+	struct bbt_arg *arg = opaque;
+
+	if (!nvm_bbt_get(arg->dev, arg->addr, NULL))
+		++arg->nerrs;
+}
+
+int main(int argc, char **argv)
+{
+	struct bbt_arg arg = { 0 };
+	const struct nvm_bbt *bbt;
+	int err = 0;
+
+	arg.dev = mbench_dev_open(NVM_SPEC_VERID_12);
+	if (!arg.dev) {
+		perror("# FAILED: mbench_dev_open");
+		return 1;
+	}
+
+	if (nvm_dev_set_bbts_cached(arg.dev, 1)) {
+		perror("# FAILED: nvm_dev_set_bbts_cached");
+		mbench_dev_close(arg.dev);
+		return 1;
+	}
+
+	arg.addr.ppa = 0;		// The first LUN
+
+	bbt = nvm_bbt_get(arg.dev, arg.addr, NULL);
+	if (!bbt) {
+		perror("# FAILED: nvm_bbt_get");
+		mbench_dev_close(arg.dev);
+		return 1;
+	}
+
+	arg.bbt = nvm_bbt_alloc_cp(bbt);
+	if (!arg.bbt) {
+		perror("# FAILED: nvm_bbt_alloc_cp");
+		mbench_dev_close(arg.dev);
+		return 1;
+	}
+	for (uint64_t i = 0; i < arg.bbt->nblks; i += 64)
+		arg.bbt->blks[i] = NVM_BBT_BAD;
+
+	err |= mbench_run("bbt_set", bbt_set, &arg, 1);
+	err |= mbench_run("bbt_mark", bbt_mark, &arg, 1);
+	err |= mbench_run("bbt_get_cached", bbt_get, &arg, 1);
+
+	nvm_bbt_free(arg.bbt);
+	mbench_dev_close(arg.dev);
+
+	if (err || arg.nerrs) {
+		fprintf(stderr, "# FAILED: nerrs: %zu\n", arg.nerrs);
+		return 1;
+	}
+
+	return mbench_json("bbt", argc > 1 ? argv[1] : NULL) ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * mbench_buf - Buffer fill and compare
+ *
+ * Measures nvm_buf_fill and nvm_buf_diff, on equal buffers, for the size of a
+ * sector and of a vector command of NVM_NADDR_MAX sectors
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <liblightnvm.h>
+#include "mbench_util.h"
+
+struct buf_arg {
+	char *expected;
+	char *actual;
+	size_t nbytes;
+	size_t sink;
+};
+
+static void buf_fill(void *opaque)
+{
+	struct buf_arg *arg = opaque;
+
+	nvm_buf_fill(arg->actual, arg->nbytes);
+}
+
+static void buf_diff(void *opaque)
+{
+	struct buf_arg *arg = opaque;
+
+	arg->sink += nvm_buf_diff(arg->expected, arg->actual, arg->nbytes);
+}
+
+int main(int argc, char **argv)
+{
+	const size_t sizes[] = {4096, NVM_NADDR_MAX * 4096};
+	const size_t nbytes_max = sizes[1];
+	struct buf_arg arg = { 0 };
+	int err = 0;
+
+	arg.expected = nvm_buf_virt_alloc(4096, nbytes_max);
+	arg.actual = nvm_buf_virt_alloc(4096, nbytes_max);
+	if ((!arg.expected) || (!arg.actual)) {
+		perror("# FAILED: nvm_buf_virt_alloc");
+		nvm_buf_virt_free(arg.expected);
+		nvm_buf_virt_free(arg.actual);
+		return 1;
+	}
+	nvm_buf_fill(arg.expected, nbytes_max);
+	memcpy(arg.actual, arg.expected, nbytes_max);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		char name[64];
+
+		arg.nbytes = sizes[i];
+
+		snprintf(name, sizeof(name), "buf_fill_%zu", sizes[i]);
+		err |= mbench_run(name, buf_fill, &arg, 1);
+
+		snprintf(name, sizeof(name), "buf_diff_%zu", sizes[i]);
+		err |= mbench_run(name, buf_diff, &arg, 1);
+	}
+
+	nvm_buf_virt_free(arg.expected);
+	nvm_buf_virt_free(arg.actual);
+
+	if (err || arg.sink) {
+		fprintf(stderr, "# FAILED: buffers differ: %zu\n", arg.sink);
+		return 1;
+	}
+
+	return mbench_json("buf", argc > 1 ? argv[1] : NULL) ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * mbench_cmd_wrap - Command preparation
+ *
+ * Measures a nvm_cmd_wrap_setup and nvm_cmd_wrap_term pair, the preparation
+ * of the NVMe command, DMA-able address lists and DSM ranges, done for every
+ * command submitted to a backend
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <liblightnvm.h>
+#include <nvm_cmd.h>
+#include "mbench_util.h"
+
+struct wrap_arg {
+	struct nvm_dev *dev;
+	int opcode;
+	int naddrs;
+	int flags;
+	void *data;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_addr dst[NVM_NADDR_MAX];
+	int copy;
+	size_t nerrs;
+};
+
+static void wrap_setup_term(void *opaque)
+{
+	struct wrap_arg *arg = opaque;
+	struct nvm_cmd_wrap *wrap;
+
+	wrap = nvm_cmd_wrap_setup(arg->dev, arg->opcode, arg->data, NULL,
+				  arg->addrs, arg->copy ? arg->dst : NULL,
+				  arg->naddrs, arg->flags, NULL);
+	if (!wrap) {
+		++arg->nerrs;
+		return;
+	}
+
+	nvm_cmd_wrap_term(wrap);
+}
+
+int main(int argc, char **argv)
+{
+	const struct {
+		const char *name;
+		int opcode;
+		int naddrs;
+		int copy;
+	} cases[] = {
+		{"cmd_wrap_vwrite_1", NVM_DOPC_VECTOR_WRITE, 1, 0},
+		{"cmd_wrap_vwrite_8", NVM_DOPC_VECTOR_WRITE, 8, 0},
+		{"cmd_wrap_vwrite_64", NVM_DOPC_VECTOR_WRITE, NVM_NADDR_MAX, 0},
+		{"cmd_wrap_vread_64", NVM_DOPC_VECTOR_READ, NVM_NADDR_MAX, 0},
+		{"cmd_wrap_vcopy_64", NVM_DOPC_VECTOR_COPY, NVM_NADDR_MAX, 1},
+		{"cmd_wrap_serase_64", NVM_DOPC_SCALAR_ERASE, NVM_NADDR_MAX, 0},
+	};
+	const struct nvm_geo *geo;
+	struct wrap_arg arg = { 0 };
+	int err = 0;
+
+	arg.dev = mbench_dev_open(NVM_SPEC_VERID_20);
+	if (!arg.dev) {
+		perror("# FAILED: mbench_dev_open");
+		return 1;
+	}
+	geo = nvm_dev_get_geo(arg.dev);
+
+	arg.data = nvm_buf_alloc(arg.dev, NVM_NADDR_MAX * geo->l.nbytes, NULL);
+	if (!arg.data) {
+		perror("# FAILED: nvm_buf_alloc");
+		mbench_dev_close(arg.dev);
+		return 1;
+	}
+
+	for (int i = 0; i < NVM_NADDR_MAX; ++i) {
+		arg.addrs[i].val = 0;
+		arg.addrs[i].l.pugrp = i % geo->l.npugrp;
+		arg.addrs[i].l.punit = (i / geo->l.npugrp) % geo->l.npunit;
+		arg.addrs[i].l.sectr = i;
+
+		arg.dst[i].val = arg.addrs[i].val;
+		arg.dst[i].l.chunk = 1;
+	}
+	arg.flags = NVM_CMD_SYNC | NVM_CMD_VECTOR | NVM_CMD_PRP;
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+		arg.opcode = cases[i].opcode;
+		arg.naddrs = cases[i].naddrs;
+		arg.copy = cases[i].copy;
+
+		err |= mbench_run(cases[i].name, wrap_setup_term, &arg, 1);
+	}
+
+	nvm_buf_free(arg.dev, arg.data);
+	mbench_dev_close(arg.dev);
+
+	if (err || arg.nerrs) {
+		fprintf(stderr, "# FAILED: nerrs: %zu\n", arg.nerrs);
+		return 1;
+	}
+
+	return mbench_json("cmd_wrap", argc > 1 ? argv[1] : NULL) ? 1 : 0;
+}
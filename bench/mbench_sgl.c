@@ -0,0 +1,115 @@
+/**
+ * mbench_sgl - Scatter-gather lists
+ *
+ * Measures nvm_sgl_add, along with the allocation of SGLs from a pool and from
+ * the heap. Adding a buffer requires its physical address, which the stub
+ * backend, allocating buffers in virtual memory, cannot provide; nvm_sgl_add
+ * is thus skipped unless the buffers can be translated
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include "mbench_util.h"
+
+#define SGL_NBUFS 1024		///< # of entries added before a reset
+
+struct sgl_arg {
+	struct nvm_dev *dev;
+	struct nvm_sgl_pool *pool;
+	struct nvm_sgl *sgl;
+	char *buf;
+	size_t buf_nbytes;
+	size_t cur;
+	size_t nerrs;
+};
+
+static void sgl_add(void *opaque)
+{
+	struct sgl_arg *arg = opaque;
+
+	if (arg->cur == SGL_NBUFS) {
+		nvm_sgl_reset(arg->sgl);
+		arg->cur = 0;
+	}
+
+	if (nvm_sgl_add(arg->dev, arg->sgl, arg->buf, arg->buf_nbytes))
+		++arg->nerrs;
+
+	++arg->cur;
+}
+
+static void sgl_alloc_free(void *opaque)
+{
+	struct sgl_arg *arg = opaque;
+	struct nvm_sgl *sgl;
+
+	sgl = nvm_sgl_alloc(arg->pool);
+	if (!sgl) {
+		++arg->nerrs;
+		return;
+	}
+
+	nvm_sgl_free(arg->pool, sgl);
+}
+
+static void sgl_create_destroy(void *opaque)
+{
+	struct sgl_arg *arg = opaque;
+	struct nvm_sgl *sgl;
+
+	sgl = nvm_sgl_create(arg->dev, 0);
+	if (!sgl) {
+		++arg->nerrs;
+		return;
+	}
+
+	nvm_sgl_destroy(arg->dev, sgl);
+}
+
+int main(int argc, char **argv)
+{
+	struct sgl_arg arg = { 0 };
+	int err = 0;
+
+	arg.dev = mbench_dev_open(NVM_SPEC_VERID_20);
+	if (!arg.dev) {
+		perror("# FAILED: mbench_dev_open");
+		return 1;
+	}
+
+	arg.buf_nbytes = nvm_dev_get_geo(arg.dev)->l.nbytes;
+	arg.buf = nvm_buf_alloc(arg.dev, arg.buf_nbytes, NULL);
+	arg.pool = nvm_sgl_pool_create(arg.dev);
+	arg.sgl = nvm_sgl_create(arg.dev, SGL_NBUFS);
+	if ((!arg.buf) || (!arg.pool) || (!arg.sgl)) {
+		perror("# FAILED: allocating buf, pool or sgl");
+		err = -1;
+		goto exit;
+	}
+
+	if (nvm_sgl_add(arg.dev, arg.sgl, arg.buf, arg.buf_nbytes)) {
+		mbench_skip("sgl_add", "no physical address of buffers");
+	} else {
+		arg.cur = 1;
+		err |= mbench_run("sgl_add", sgl_add, &arg, 1);
+	}
+
+	err |= mbench_run("sgl_alloc_free", sgl_alloc_free, &arg, 1);
+	err |= mbench_run("sgl_create_destroy", sgl_create_destroy, &arg, 1);
+
+exit:
+	if (arg.sgl)
+		nvm_sgl_destroy(arg.dev, arg.sgl);
+	if (arg.pool)
+		nvm_sgl_pool_destroy(arg.pool);
+	nvm_buf_free(arg.dev, arg.buf);
+	mbench_dev_close(arg.dev);
+
+	if (err || arg.nerrs) {
+		fprintf(stderr, "# FAILED: nerrs: %zu\n", arg.nerrs);
+		return 1;
+	}
+
+	return mbench_json("sgl", argc > 1 ? argv[1] : NULL) ? 1 : 0;
+}
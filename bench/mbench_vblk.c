@@ -0,0 +1,107 @@
+/**
+ * mbench_vblk - Virtual block address generation
+ *
+ * Measures nvm_vblk_pwrite, one command per call, on virtual blocks spanning
+ * a block/chunk of each parallel unit of the first channel/group. The stub
+ * backend completes the command at once, thus the cost is that of generating
+ * the addresses of the command and submitting it through nvm_cmd_write.
+ *
+ * A write spanning multiple commands is spread over threads, the offsets are
+ * thus advanced by a single command per call to measure the serial path
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <liblightnvm.h>
+#include "mbench_util.h"
+
+struct vblk_arg {
+	struct nvm_vblk *vblk;
+	char *buf;
+	size_t cmd_nbytes;	///< # of bytes written by a call
+	size_t offset;
+	size_t nerrs;
+};
+
+static void vblk_pwrite(void *opaque)
+{
+	struct vblk_arg *arg = opaque;
+
+	if (nvm_vblk_pwrite(arg->vblk, arg->buf, arg->cmd_nbytes,
+			    arg->offset) < 0)
+		++arg->nerrs;
+
+	arg->offset += arg->cmd_nbytes;
+	if (arg->offset + arg->cmd_nbytes > nvm_vblk_get_nbytes(arg->vblk))
+		arg->offset = 0;
+}
+
+static int vblk_bench(int verid, const char *name)
+{
+	struct vblk_arg arg = { 0 };
+	const struct nvm_geo *geo;
+	struct nvm_dev *dev;
+	size_t naddrs;
+	int err = 0;
+
+	dev = mbench_dev_open(verid);
+	if (!dev) {
+		perror("# FAILED: mbench_dev_open");
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	switch (verid) {
+	case NVM_SPEC_VERID_12:		// Whole spages of NVM_NADDR_MAX addrs.
+		naddrs = NVM_NADDR_MAX;
+		arg.vblk = nvm_vblk_alloc_line(dev, 0, 0, 0,
+				naddrs / (geo->g.nplanes * geo->g.nsectors) - 1,
+				0);
+		arg.cmd_nbytes = naddrs * geo->g.sector_nbytes;
+		break;
+
+	default:			// A write unit of a single chunk
+		naddrs = nvm_dev_get_ws_opt(dev);
+		arg.vblk = nvm_vblk_alloc_line(dev, 0, 0, 0,
+					       geo->l.npunit - 1, 0);
+		arg.cmd_nbytes = naddrs * geo->l.nbytes;
+		break;
+	}
+	if (!arg.vblk) {
+		perror("# FAILED: nvm_vblk_alloc_line");
+		mbench_dev_close(dev);
+		return -1;
+	}
+
+	arg.buf = nvm_buf_alloc(dev, arg.cmd_nbytes, NULL);
+	if (!arg.buf) {
+		perror("# FAILED: nvm_buf_alloc");
+		nvm_vblk_free(arg.vblk);
+		mbench_dev_close(dev);
+		return -1;
+	}
+
+	err |= mbench_run(name, vblk_pwrite, &arg, 1);
+
+	nvm_buf_free(dev, arg.buf);
+	nvm_vblk_free(arg.vblk);
+	mbench_dev_close(dev);
+
+	if (arg.nerrs) {
+		fprintf(stderr, "# FAILED: nerrs: %zu\n", arg.nerrs);
+		return -1;
+	}
+
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	err |= vblk_bench(NVM_SPEC_VERID_12, "vblk_pwrite_s12");
+	err |= vblk_bench(NVM_SPEC_VERID_20, "vblk_pwrite_s20");
+	if (err)
+		return 1;
+
+	return mbench_json("vblk", argc > 1 ? argv[1] : NULL) ? 1 : 0;
+}
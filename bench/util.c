@@ -0,0 +1,454 @@
+/**
+ * util - Stub backend, device setup, measurement and JSON export shared by the
+ * microbenchmarks
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <liblightnvm.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_bbt.h>
+#include <nvm_stats.h>
+#include "mbench_util.h"
+
+struct mbench_res {
+	char name[64];			///< Name of the measured operation
+	const char *skip;		///< Reason when skipped, otherwise NULL
+	uint64_t ncalls;		///< # of calls of the best run
+	size_t nops;			///< # of operations per call
+	double ns_op;			///< Nanoseconds per operation
+	double cycles_op;		///< Ticks per operation
+};
+
+static struct mbench_res mbench_res[MBENCH_NRES_MAX];
+static int mbench_nres;
+
+static struct mbench_res mbench_overhead;	///< Cost of an empty call
+
+/**
+ * Stub backend
+ *
+ * The geometry is synthesized by 'idfy' for the version requested by
+ * `mbench_dev_open`, commands complete successfully without transferring
+ * data, bad-block-tables are reported with all blocks in the FREE state
+ */
+
+static int stub_verid = NVM_SPEC_VERID_20;
+
+static void stub_close(struct nvm_dev *NVM_UNUSED(dev))
+{
+	return;
+}
+
+static struct nvm_spec_idfy *stub_idfy(struct nvm_dev *dev,
+				       struct nvm_ret *NVM_UNUSED(ret))
+{
+	struct nvm_spec_idfy *idfy;
+
+	idfy = nvm_buf_alloc(dev, sizeof(*idfy), NULL);
+	if (!idfy)
+		return NULL;
+	memset(idfy, 0, sizeof(*idfy));
+
+	switch (stub_verid) {
+	case NVM_SPEC_VERID_12:
+		idfy->s12.verid = NVM_SPEC_VERID_12;
+		idfy->s12.cgroups = 1;
+
+		idfy->s12.grp[0].num_ch = 16;
+		idfy->s12.grp[0].num_lun = 8;
+		idfy->s12.grp[0].num_pln = 2;
+		idfy->s12.grp[0].num_blk = 1024;
+		idfy->s12.grp[0].num_pg = 512;
+		idfy->s12.grp[0].fpg_sz = 16384;
+		idfy->s12.grp[0].csecs = 4096;
+		idfy->s12.grp[0].sos = 16;
+
+		idfy->s12.ppaf.n.sec_off = 0;
+		idfy->s12.ppaf.n.sec_len = 2;
+		idfy->s12.ppaf.n.pl_off = 2;
+		idfy->s12.ppaf.n.pl_len = 1;
+		idfy->s12.ppaf.n.ch_off = 3;
+		idfy->s12.ppaf.n.ch_len = 4;
+		idfy->s12.ppaf.n.lun_off = 7;
+		idfy->s12.ppaf.n.lun_len = 3;
+		idfy->s12.ppaf.n.pg_off = 10;
+		idfy->s12.ppaf.n.pg_len = 9;
+		idfy->s12.ppaf.n.blk_off = 19;
+		idfy->s12.ppaf.n.blk_len = 10;
+		break;
+
+	case NVM_SPEC_VERID_20:
+		idfy->s20.verid = NVM_SPEC_VERID_20;
+
+		idfy->s20.lbaf.pugrp = 4;
+		idfy->s20.lbaf.punit = 3;
+		idfy->s20.lbaf.chunk = 10;
+		idfy->s20.lbaf.sectr = 12;
+
+		idfy->s20.lgeo.npugrp = 16;
+		idfy->s20.lgeo.npunit = 8;
+		idfy->s20.lgeo.nchunk = 1000;
+		idfy->s20.lgeo.nsectr = 4096;
+
+		idfy->s20.wrt.ws_min = 4;
+		idfy->s20.wrt.ws_opt = 8;
+		idfy->s20.wrt.mw_cunits = 24;
+		break;
+	}
+
+	return idfy;
+}
+
+static struct nvm_spec_bbt *stub_gbbt(struct nvm_dev *dev,
+				      struct nvm_addr NVM_UNUSED(addr),
+				      struct nvm_ret *NVM_UNUSED(ret))
+{
+	const uint32_t nblks = dev->geo.nblocks * dev->geo.nplanes;
+	struct nvm_spec_bbt *bbt;
+
+	bbt = calloc(1, sizeof(*bbt) + nblks);
+	if (!bbt)
+		return NULL;
+
+	bbt->tblid[0] = 'B';
+	bbt->tblid[1] = 'B';
+	bbt->tblid[2] = 'L';
+	bbt->tblid[3] = 'T';
+	bbt->verid = 1;
+	bbt->tblks = nblks;
+
+	return bbt;
+}
+
+static int stub_sbbt(struct nvm_dev *NVM_UNUSED(dev),
+		     struct nvm_addr *NVM_UNUSED(addrs), int NVM_UNUSED(naddrs),
+		     uint16_t NVM_UNUSED(flags),
+		     struct nvm_ret *NVM_UNUSED(ret))
+{
+	return 0;
+}
+
+static int stub_scalar_erase(struct nvm_dev *NVM_UNUSED(dev),
+			     struct nvm_addr NVM_UNUSED(addrs[]),
+			     int NVM_UNUSED(naddrs), uint16_t NVM_UNUSED(flags),
+			     struct nvm_ret *NVM_UNUSED(ret))
+{
+	return 0;
+}
+
+static int stub_scalar_write(struct nvm_dev *NVM_UNUSED(dev),
+			     struct nvm_addr NVM_UNUSED(addr),
+			     int NVM_UNUSED(naddrs),
+			     const void *NVM_UNUSED(data),
+			     const void *NVM_UNUSED(meta),
+			     uint16_t NVM_UNUSED(flags),
+			     struct nvm_ret *NVM_UNUSED(ret))
+{
+	return 0;
+}
+
+static int stub_scalar_read(struct nvm_dev *NVM_UNUSED(dev),
+			    struct nvm_addr NVM_UNUSED(addr),
+			    int NVM_UNUSED(naddrs), void *NVM_UNUSED(data),
+			    void *NVM_UNUSED(meta), uint16_t NVM_UNUSED(flags),
+			    struct nvm_ret *NVM_UNUSED(ret))
+{
+	return 0;
+}
+
+static int stub_vector_erase(struct nvm_dev *NVM_UNUSED(dev),
+			     struct nvm_addr NVM_UNUSED(addrs[]),
+			     int NVM_UNUSED(naddrs), void *NVM_UNUSED(meta),
+			     uint16_t NVM_UNUSED(flags),
+			     struct nvm_ret *NVM_UNUSED(ret))
+{
+	return 0;
+}
+
+static int stub_vector_write(struct nvm_dev *NVM_UNUSED(dev),
+			     struct nvm_addr NVM_UNUSED(addrs[]),
+			     int NVM_UNUSED(naddrs),
+			     const void *NVM_UNUSED(data),
+			     const void *NVM_UNUSED(meta),
+			     uint16_t NVM_UNUSED(flags),
+			     struct nvm_ret *NVM_UNUSED(ret))
+{
+	return 0;
+}
+
+static int stub_vector_read(struct nvm_dev *NVM_UNUSED(dev),
+			    struct nvm_addr NVM_UNUSED(addrs[]),
+			    int NVM_UNUSED(naddrs), void *NVM_UNUSED(data),
+			    void *NVM_UNUSED(meta), uint16_t NVM_UNUSED(flags),
+			    struct nvm_ret *NVM_UNUSED(ret))
+{
+	return 0;
+}
+
+static int stub_vector_copy(struct nvm_dev *NVM_UNUSED(dev),
+			    struct nvm_addr NVM_UNUSED(src[]),
+			    struct nvm_addr NVM_UNUSED(dst[]),
+			    int NVM_UNUSED(naddrs), uint16_t NVM_UNUSED(flags),
+			    struct nvm_ret *NVM_UNUSED(ret))
+{
+	return 0;
+}
+
+/**
+ * Identifies as the IOCTL backend such that buffers are allocated in virtual
+ * memory
+ */
+static struct nvm_be stub_be = {
+	.id = NVM_BE_IOCTL,
+	.name = "STUB",
+
+	.open = nvm_be_nosys_open,
+	.close = stub_close,
+
+	.pass = nvm_be_nosys_pass,
+	.idfy = stub_idfy,
+	.rprt = nvm_be_nosys_rprt,
+	.gfeat = nvm_be_nosys_gfeat,
+	.sfeat = nvm_be_nosys_sfeat,
+	.gbbt = stub_gbbt,
+	.sbbt = stub_sbbt,
+
+	.scalar_erase = stub_scalar_erase,
+	.scalar_write = stub_scalar_write,
+	.scalar_read = stub_scalar_read,
+
+	.vector_erase = stub_vector_erase,
+	.vector_write = stub_vector_write,
+	.vector_read = stub_vector_read,
+	.vector_copy = stub_vector_copy,
+
+	.async_init = nvm_be_nosys_async_init,
+	.async_term = nvm_be_nosys_async_term,
+	.async_poke = nvm_be_nosys_async_poke,
+	.async_wait = nvm_be_nosys_async_wait
+};
+
+/**
+ * Mirrors the setup done by the backend factory and `nvm_dev_openf`
+ */
+struct nvm_dev *mbench_dev_open(int verid)
+{
+	struct nvm_dev *dev;
+
+	switch (verid) {
+	case NVM_SPEC_VERID_12:
+	case NVM_SPEC_VERID_20:
+		break;
+
+	default:
+		errno = EINVAL;
+		return NULL;
+	}
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return NULL;
+
+	strncpy(dev->name, "stub", NVM_DEV_NAME_LEN);
+	strncpy(dev->path, "stub", NVM_DEV_PATH_LEN);
+	dev->fd = -1;
+	dev->nsid = 1;
+	dev->numa_node = -1;
+	dev->ns.flbas = 0;
+	dev->ns.lbaf[0].ds = 12;
+	dev->ns.lbaf[0].ms = 16;
+
+	stub_verid = verid;
+	if (nvm_be_populate(dev, &stub_be)) {
+		free(dev);
+		return NULL;			// Propagate errno
+	}
+
+	dev->bbts_cached = 0;
+	dev->nbbts = dev->geo.nchannels * dev->geo.nluns;
+	if (nvm_bbt_cache_init(dev)) {
+		free(dev);
+		return NULL;			// Propagate errno
+	}
+
+	dev->chunk_tbl = NULL;
+	nvm_stats_init(dev);
+
+	dev->affinity = NVM_DEV_AFFINITY_NONE;
+	dev->cmd_opts = NVM_CMD_DEF_IOMD | NVM_CMD_DEF_ADDR | NVM_CMD_DEF_PLOD;
+
+	return dev;
+}
+
+void mbench_dev_close(struct nvm_dev *dev)
+{
+	nvm_dev_close(dev);
+}
+
+static uint64_t mbench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t mbench_env(const char *name, uint64_t def)
+{
+	const char *val = getenv(name);
+
+	if ((!val) || (!strtoull(val, NULL, 10)))
+		return def;
+
+	return strtoull(val, NULL, 10);
+}
+
+static void mbench_noop(void *NVM_UNUSED(arg))
+{
+	__asm__ __volatile__("" ::: "memory");
+}
+
+/**
+ * Run 'fn' 'ncalls' times, returns the duration in nanoseconds and stores the
+ * elapsed ticks in 'ticks'
+ */
+static uint64_t mbench_calls(mbench_fn fn, void *arg, uint64_t ncalls,
+			     uint64_t *ticks)
+{
+	uint64_t ns, tsc;
+
+	ns = mbench_ns();
+	tsc = nvm_stats_tsc();
+	for (uint64_t i = 0; i < ncalls; ++i)
+		fn(arg);
+	*ticks = nvm_stats_tsc() - tsc;
+
+	return mbench_ns() - ns;
+}
+
+static void mbench_measure(struct mbench_res *res, mbench_fn fn, void *arg,
+			   size_t nops)
+{
+	const uint64_t msecs = mbench_env("NVM_MBENCH_MSECS", MBENCH_MSECS_DEF);
+	const uint64_t nruns = mbench_env("NVM_MBENCH_NRUNS", MBENCH_NRUNS_DEF);
+	uint64_t ncalls = 1;
+	uint64_t ns, ticks;
+
+	// Calibrate, grow the # of calls until a run lasts long enough
+	while ((ns = mbench_calls(fn, arg, ncalls, &ticks)) < msecs * 1000000) {
+		if (ns < msecs * 100000)
+			ncalls *= 10;
+		else
+			ncalls = ncalls * (msecs * 1000000) / ns + 1;
+	}
+
+	res->ncalls = ncalls;
+	res->nops = nops;
+	res->ns_op = (double)ns / (ncalls * nops);
+	res->cycles_op = (double)ticks / (ncalls * nops);
+
+	for (uint64_t run = 1; run < nruns; ++run) {
+		ns = mbench_calls(fn, arg, ncalls, &ticks);
+
+		if ((double)ns / (ncalls * nops) < res->ns_op) {
+			res->ns_op = (double)ns / (ncalls * nops);
+			res->cycles_op = (double)ticks / (ncalls * nops);
+		}
+	}
+}
+
+int mbench_run(const char *name, mbench_fn fn, void *arg, size_t nops)
+{
+	struct mbench_res *res;
+
+	if ((mbench_nres == MBENCH_NRES_MAX) || (!nops)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!mbench_overhead.ncalls) {
+		strncpy(mbench_overhead.name, "overhead", 63);
+		mbench_measure(&mbench_overhead, mbench_noop, NULL, 1);
+	}
+
+	res = &mbench_res[mbench_nres++];
+	memset(res, 0, sizeof(*res));
+	strncpy(res->name, name, sizeof(res->name) - 1);
+
+	mbench_measure(res, fn, arg, nops);
+
+	fprintf(stderr, "# %-32s %10.1f ns/op %10.1f cycles/op\n", res->name,
+		res->ns_op, res->cycles_op);
+
+	return 0;
+}
+
+void mbench_skip(const char *name, const char *reason)
+{
+	struct mbench_res *res;
+
+	if (mbench_nres == MBENCH_NRES_MAX)
+		return;
+
+	res = &mbench_res[mbench_nres++];
+	memset(res, 0, sizeof(*res));
+	strncpy(res->name, name, sizeof(res->name) - 1);
+	res->skip = reason;
+
+	fprintf(stderr, "# %-32s skipped: %s\n", res->name, reason);
+}
+
+static void mbench_res_pr(FILE *stream, const struct mbench_res *res)
+{
+	if (res->skip) {
+		fprintf(stream, "{\"name\": \"%s\", \"skip\": \"%s\"}",
+			res->name, res->skip);
+		return;
+	}
+
+	fprintf(stream, "{\"name\": \"%s\", \"ncalls\": %"PRIu64", "
+		"\"nops\": %zu, \"ns_op\": %.2f, \"cycles_op\": %.2f}",
+		res->name, res->ncalls, res->nops, res->ns_op, res->cycles_op);
+}
+
+int mbench_json(const char *bench, const char *path)
+{
+	FILE *stream = stdout;
+
+	if (path) {
+		stream = fopen(path, "w");
+		if (!stream) {
+			perror("# FAILED: fopen");
+			return -1;
+		}
+	}
+
+	fprintf(stream, "{\n");
+	fprintf(stream, "  \"liblightnvm\": {\"major\": %d, \"minor\": %d, "
+		"\"patch\": %d},\n", nvm_ver_major(), nvm_ver_minor(),
+		nvm_ver_patch());
+	fprintf(stream, "  \"bench\": \"%s\",\n", bench);
+	fprintf(stream, "  \"overhead\": ");
+	mbench_res_pr(stream, &mbench_overhead);
+	fprintf(stream, ",\n");
+	fprintf(stream, "  \"results\": [\n");
+	for (int i = 0; i < mbench_nres; ++i) {
+		fprintf(stream, "    ");
+		mbench_res_pr(stream, &mbench_res[i]);
+		fprintf(stream, "%s\n", i == mbench_nres - 1 ? "" : ",");
+	}
+	fprintf(stream, "  ]\n");
+	fprintf(stream, "}\n");
+
+	if (path)
+		fclose(stream);
+
+	return 0;
+}
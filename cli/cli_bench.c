@@ -0,0 +1,910 @@
+/**
+ * bench - CLI for running benchmark jobs against an Open-Channel SSD
+ *
+ * Jobs are described in an ini-style file, the section '[global]' sets the
+ * defaults of the jobs following it, e.g.
+ *
+ *   [global]
+ *   qd=32
+ *   nchunks=4
+ *
+ *   [horz-write]
+ *   rw=write
+ *   pattern=horz
+ *
+ *   [rand-read]
+ *   rw=read
+ *   pattern=rand
+ *   nthreads=4
+ *
+ * Results, throughput and latency percentiles, are printed as JSON
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <liblightnvm.h>
+#include <liblightnvm_spec.h>
+#include <nvm_omp.h>
+#include "liblightnvm_cli.h"
+
+#define BENCH_NJOBS_MAX 32
+#define BENCH_NAME_LEN 64
+
+static const char *op_str[] = {"erase", "write", "read", "copy"};
+
+enum bench_pattern {
+	BENCH_PATTERN_HORZ = 0,	///< Stripe commands across all chunks
+	BENCH_PATTERN_VERT,	///< Fill one chunk at a time, alias "seq"
+	BENCH_PATTERN_RAND,	///< Uniformly random chunk and offset
+};
+
+static const char *pattern_str[] = {"horz", "vert", "rand"};
+
+struct bench_job {
+	char name[BENCH_NAME_LEN];
+	int mix[NVM_DEV_STATS_NOPS];	///< Weight of each class of command
+	int pattern;			///< One of `enum bench_pattern`
+	int bs;				///< # of sectors per command, 0 = ws_opt
+	int qd;				///< Depth of each ASYNC context
+	int nthreads;			///< # of threads
+	int nctxs;			///< # of ASYNC contexts per thread
+	int npus;			///< # of parallel units, 0 = all
+	int chunk;			///< First chunk in each parallel unit
+	int nchunks;			///< # of chunks in each parallel unit
+	size_t ncmds;			///< # of commands per thread, 0 = a pass
+	double runtime;			///< Time limit in seconds, 0 = none
+	int sgl;			///< Use NVM_CMD_SGL instead of PRP
+	int scalar;			///< Use NVM_CMD_SCALAR instead of VECTOR
+	unsigned seed;			///< Seed of the random pattern
+};
+
+struct bench_chunk {
+	struct nvm_addr addr;		///< Address of the chunk
+	size_t wp;			///< Write pointer, in sectors
+};
+
+struct bench_cmd {
+	struct nvm_ret ret;		///< Must be first, see bench_cb
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct bench_thrd *thrd;
+	struct bench_chunk *chunk;	///< Chunk the command addresses
+	int ctx;			///< Index of the context it is issued on
+	int op;
+};
+
+struct bench_thrd {
+	const struct bench_job *job;
+	struct nvm_dev *dev;
+	const struct nvm_geo *geo;
+	int bs;
+
+	struct bench_chunk *chunks;	///< The chunks of the thread
+	size_t nchunks;
+
+	struct nvm_async_ctx **ctxs;
+	struct bench_cmd *cmds;		///< 'qd' commands per context
+	struct bench_cmd **free;	///< Stack of idle commands
+	size_t nfree;
+	char *buf;
+	struct nvm_sgl *sgl;		///< 'buf' when the job uses SGL
+	unsigned seed;
+
+	size_t ncmds[NVM_DEV_STATS_NOPS];
+	size_t nbytes[NVM_DEV_STATS_NOPS];
+	size_t nerrs;
+};
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void job_default(struct bench_job *job)
+{
+	memset(job, 0, sizeof(*job));
+	strcpy(job->name, "global");
+	job->mix[NVM_DEV_STATS_READ] = 1;
+	job->qd = 32;
+	job->nthreads = 1;
+	job->nctxs = 1;
+	job->nchunks = 1;
+	job->seed = 1;
+}
+
+static int job_mix_parse(struct bench_job *job, const char *val)
+{
+	int erase = 0, write = 0, read = 0;
+
+	if (!strcmp(val, "read")) {
+		read = 1;
+	} else if (!strcmp(val, "write")) {
+		write = 1;
+	} else if (!strcmp(val, "erase")) {
+		erase = 1;
+	} else if (sscanf(val, "%d:%d:%d", &read, &write, &erase) != 3) {
+		return -1;
+	}
+
+	if ((read < 0) || (write < 0) || (erase < 0) || !(read + write + erase))
+		return -1;
+
+	memset(job->mix, 0, sizeof(job->mix));
+	job->mix[NVM_DEV_STATS_READ] = read;
+	job->mix[NVM_DEV_STATS_WRITE] = write;
+	job->mix[NVM_DEV_STATS_ERASE] = erase;
+
+	return 0;
+}
+
+static int job_set(struct bench_job *job, const char *key, const char *val)
+{
+	if (!strcmp(key, "rw") || !strcmp(key, "mix"))
+		return job_mix_parse(job, val);
+
+	if (!strcmp(key, "pattern")) {
+		if (!strcmp(val, "seq")) {
+			job->pattern = BENCH_PATTERN_VERT;
+			return 0;
+		}
+		for (int i = 0; i <= BENCH_PATTERN_RAND; ++i) {
+			if (!strcmp(val, pattern_str[i])) {
+				job->pattern = i;
+				return 0;
+			}
+		}
+		return -1;
+	}
+
+	if (!strcmp(key, "runtime")) {
+		job->runtime = atof(val);
+		return job->runtime < 0 ? -1 : 0;
+	}
+	if (!strcmp(key, "ncmds")) {
+		job->ncmds = strtoull(val, NULL, 10);
+		return 0;
+	}
+	if (!strcmp(key, "seed")) {
+		job->seed = strtoul(val, NULL, 10);
+		return 0;
+	}
+
+	{
+		const struct {
+			const char *key;
+			int *val;
+			int min;
+		} ints[] = {
+			{"bs", &job->bs, 0},
+			{"qd", &job->qd, 1},
+			{"nthreads", &job->nthreads, 1},
+			{"nctxs", &job->nctxs, 1},
+			{"npus", &job->npus, 0},
+			{"chunk", &job->chunk, 0},
+			{"nchunks", &job->nchunks, 1},
+			{"sgl", &job->sgl, 0},
+			{"scalar", &job->scalar, 0},
+		};
+
+		for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i) {
+			if (strcmp(key, ints[i].key))
+				continue;
+
+			*ints[i].val = atoi(val);
+
+			return *ints[i].val < ints[i].min ? -1 : 0;
+		}
+	}
+
+	return -1;
+}
+
+static char *strip(char *str)
+{
+	char *end;
+
+	while (isspace((unsigned char)*str))
+		++str;
+
+	end = str + strlen(str);
+	while ((end > str) && isspace((unsigned char)end[-1]))
+		--end;
+	*end = '\0';
+
+	return str;
+}
+
+/**
+ * Parse the job file at 'path' into 'jobs', returns the number of jobs
+ */
+static int jobs_load(const char *path, struct bench_job jobs[])
+{
+	struct bench_job global;
+	struct bench_job *job = &global;
+	char line[256];
+	int njobs = 0;
+	int lineno = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		nvm_cli_perror("fopen");
+		return -1;
+	}
+
+	job_default(&global);
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *str = strip(line);
+		char *val;
+
+		++lineno;
+
+		if ((*str == '\0') || (*str == '#') || (*str == ';'))
+			continue;
+
+		if (*str == '[') {
+			char *end = strchr(str, ']');
+
+			if (!end)
+				goto invalid;
+			*end = '\0';
+			str = strip(str + 1);
+
+			if (!strcmp(str, "global")) {
+				job = &global;
+				continue;
+			}
+			if (njobs == BENCH_NJOBS_MAX)
+				goto invalid;
+
+			job = &jobs[njobs++];
+			*job = global;
+			strncpy(job->name, str, BENCH_NAME_LEN - 1);
+			continue;
+		}
+
+		val = strchr(str, '=');
+		if (!val)
+			goto invalid;
+		*val = '\0';
+
+		if (job_set(job, strip(str), strip(val + 1)))
+			goto invalid;
+	}
+
+	fclose(fp);
+
+	if (!njobs) {
+		errno = EINVAL;
+		nvm_cli_perror("no jobs");
+		return -1;
+	}
+
+	return njobs;
+
+invalid:
+	fclose(fp);
+	fprintf(stderr, "# %s:%d: invalid job description\n", path, lineno);
+	errno = EINVAL;
+
+	return -1;
+}
+
+/**
+ * Print 'str' as a JSON string, quoted and escaped
+ */
+static void json_str_pr(const char *str)
+{
+	putchar('"');
+	for (const unsigned char *c = (const unsigned char *)str; *c; ++c) {
+		switch (*c) {
+		case '"':
+		case '\\':
+			printf("\\%c", *c);
+			break;
+		case '\n':
+			printf("\\n");
+			break;
+		case '\t':
+			printf("\\t");
+			break;
+		default:
+			if (*c < 0x20)
+				printf("\\u%04x", *c);
+			else
+				putchar(*c);
+			break;
+		}
+	}
+	putchar('"');
+}
+
+static void job_pr(const struct bench_job *job)
+{
+	printf("      \"options\": {\"mix\": {\"read\": %d, \"write\": %d, "
+	       "\"erase\": %d}, \"pattern\": \"%s\", \"bs\": %d, \"qd\": %d, "
+	       "\"nthreads\": %d, \"nctxs\": %d, \"npus\": %d, \"chunk\": %d, "
+	       "\"nchunks\": %d, \"ncmds\": %zu, \"runtime\": %.3f, "
+	       "\"sgl\": %d, \"scalar\": %d, \"seed\": %u}",
+	       job->mix[NVM_DEV_STATS_READ], job->mix[NVM_DEV_STATS_WRITE],
+	       job->mix[NVM_DEV_STATS_ERASE], pattern_str[job->pattern],
+	       job->bs, job->qd, job->nthreads, job->nctxs, job->npus,
+	       job->chunk, job->nchunks, job->ncmds, job->runtime, job->sgl,
+	       job->scalar, job->seed);
+}
+
+static void bench_cb(struct nvm_ret *ret, void *NVM_UNUSED(opaque))
+{
+	struct bench_cmd *cmd = (struct bench_cmd *)ret;
+	struct bench_thrd *thrd = cmd->thrd;
+
+	if (ret->status) {
+		++(thrd->nerrs);
+	} else {
+		++(thrd->ncmds[cmd->op]);
+		if (cmd->op != NVM_DEV_STATS_ERASE)
+			thrd->nbytes[cmd->op] += thrd->bs * thrd->geo->l.nbytes;
+	}
+
+	thrd->free[thrd->nfree++] = cmd;
+}
+
+static int bench_op(struct bench_thrd *thrd)
+{
+	const int *mix = thrd->job->mix;
+	int total = 0;
+	int pick;
+
+	for (int op = 0; op < NVM_DEV_STATS_NOPS; ++op)
+		total += mix[op];
+
+	pick = rand_r(&thrd->seed) % total;
+	for (int op = 0; op < NVM_DEV_STATS_NOPS; ++op) {
+		if (pick < mix[op])
+			return op;
+		pick -= mix[op];
+	}
+
+	return NVM_DEV_STATS_READ;
+}
+
+/**
+ * Setup the addresses of the i'th command of the thread, returns 1 when the
+ * thread has nothing left to write. The write-pointer of the chunk is moved
+ * by bench_advance, once the command is submitted
+ */
+static int bench_addrs(struct bench_thrd *thrd, size_t i,
+		       struct bench_cmd *cmd)
+{
+	struct nvm_addr *addrs = cmd->addrs;
+	const int op = cmd->op;
+	const size_t nsectr = thrd->geo->l.nsectr;
+	const size_t nstrides = nsectr / thrd->bs;
+	const size_t n = thrd->nchunks;
+	struct bench_chunk *chunk;
+	size_t k, ofz;
+
+	switch (thrd->job->pattern) {
+	case BENCH_PATTERN_VERT:
+		k = (i / nstrides) % n;
+		ofz = (i % nstrides) * thrd->bs;
+		break;
+	case BENCH_PATTERN_RAND:
+		k = rand_r(&thrd->seed) % n;
+		ofz = (rand_r(&thrd->seed) % nstrides) * thrd->bs;
+		break;
+	case BENCH_PATTERN_HORZ:
+	default:
+		k = i % n;
+		ofz = ((i / n) % nstrides) * thrd->bs;
+		break;
+	}
+
+	// Writes go to the write-pointer, of the next chunk having room
+	if (op == NVM_DEV_STATS_WRITE) {
+		size_t probe;
+
+		for (probe = 0; probe < n; ++probe) {
+			if (thrd->chunks[(k + probe) % n].wp + thrd->bs <= nsectr)
+				break;
+		}
+		if (probe == n)
+			return 1;
+
+		k = (k + probe) % n;
+		ofz = thrd->chunks[k].wp;
+	}
+
+	chunk = &thrd->chunks[k];
+	cmd->chunk = chunk;
+
+	switch (op) {
+	case NVM_DEV_STATS_ERASE:
+		addrs[0] = chunk->addr;
+		break;
+
+	case NVM_DEV_STATS_WRITE:
+	case NVM_DEV_STATS_READ:
+		for (int s = 0; s < thrd->bs; ++s) {
+			addrs[s] = chunk->addr;
+			addrs[s].l.sectr = ofz + s;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * Move the write-pointer of 'chunk' past a submitted command of class 'op'
+ */
+static void bench_advance(struct bench_thrd *thrd, int op,
+			  struct bench_chunk *chunk)
+{
+	switch (op) {
+	case NVM_DEV_STATS_ERASE:
+		chunk->wp = 0;
+		break;
+	case NVM_DEV_STATS_WRITE:
+		chunk->wp += thrd->bs;
+		break;
+	}
+}
+
+static int bench_submit(struct bench_thrd *thrd, struct bench_cmd *cmd)
+{
+	const struct bench_job *job = thrd->job;
+	uint16_t flags = NVM_CMD_ASYNC;
+	void *data = job->sgl ? (void *)thrd->sgl : (void *)thrd->buf;
+
+	flags |= job->sgl ? NVM_CMD_SGL : NVM_CMD_PRP;
+	flags |= job->scalar ? NVM_CMD_SCALAR : NVM_CMD_VECTOR;
+
+	memset(&cmd->ret, 0, sizeof(cmd->ret));
+	cmd->ret.async.ctx = thrd->ctxs[cmd->ctx];
+	cmd->ret.async.cb = bench_cb;
+	cmd->ret.async.cb_arg = NULL;
+
+	switch (cmd->op) {
+	case NVM_DEV_STATS_ERASE:
+		return nvm_cmd_erase(thrd->dev, cmd->addrs, 1, NULL, flags,
+				     &cmd->ret);
+	case NVM_DEV_STATS_WRITE:
+		return nvm_cmd_write(thrd->dev, cmd->addrs, thrd->bs, data,
+				     NULL, flags, &cmd->ret);
+	case NVM_DEV_STATS_READ:
+		return nvm_cmd_read(thrd->dev, cmd->addrs, thrd->bs, data,
+				    NULL, flags, &cmd->ret);
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+static int bench_poke(struct bench_thrd *thrd)
+{
+	for (int c = 0; c < thrd->job->nctxs; ++c) {
+		if (nvm_async_poke(thrd->dev, thrd->ctxs[c], 0) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int bench_thrd_run(struct bench_thrd *thrd, uint64_t deadline)
+{
+	const struct bench_job *job = thrd->job;
+	const size_t nstrides = thrd->geo->l.nsectr / thrd->bs;
+	const int erase_only = job->mix[NVM_DEV_STATS_ERASE] &&
+			       !job->mix[NVM_DEV_STATS_WRITE] &&
+			       !job->mix[NVM_DEV_STATS_READ];
+	size_t limit = job->ncmds;
+	int err = 0;
+
+	if (!limit && !job->runtime)
+		limit = erase_only ? thrd->nchunks : thrd->nchunks * nstrides;
+
+	for (size_t i = 0; (!limit || (i < limit)) && !err; ++i) {
+		struct bench_chunk *chunk;
+		struct bench_cmd *cmd;
+		int op;
+
+		if (deadline && ((i % 64) == 0) && (bench_ns() > deadline))
+			break;
+
+		while (!thrd->nfree && !err)
+			err = bench_poke(thrd);
+		if (err)
+			break;
+
+		cmd = thrd->free[--(thrd->nfree)];
+		cmd->op = bench_op(thrd);
+		if (bench_addrs(thrd, i, cmd)) {
+			thrd->free[thrd->nfree++] = cmd;
+			break;
+		}
+
+		// Once submitted, bench_cb may complete and recycle cmd
+		op = cmd->op;
+		chunk = cmd->chunk;
+		if (bench_submit(thrd, cmd)) {
+			thrd->free[thrd->nfree++] = cmd;
+			++(thrd->nerrs);
+			continue;
+		}
+		bench_advance(thrd, op, chunk);
+	}
+
+	for (int c = 0; c < job->nctxs; ++c) {
+		if (nvm_async_wait(thrd->dev, thrd->ctxs[c]) < 0)
+			err = -1;
+	}
+
+	return err;
+}
+
+static void bench_thrd_term(struct bench_thrd *thrd)
+{
+	if (!thrd->dev)
+		return;
+
+	for (int c = 0; thrd->ctxs && (c < thrd->job->nctxs); ++c) {
+		if (thrd->ctxs[c])
+			nvm_async_term(thrd->dev, thrd->ctxs[c]);
+	}
+	if (thrd->sgl)
+		nvm_sgl_destroy(thrd->dev, thrd->sgl);
+	if (thrd->buf)
+		nvm_buf_free(thrd->dev, thrd->buf);
+	free(thrd->ctxs);
+	free(thrd->free);
+	free(thrd->cmds);
+	free(thrd->chunks);
+}
+
+static int bench_thrd_init(struct bench_thrd *thrd, const struct bench_job *job,
+			   struct nvm_cli *cli, int bs, int tid,
+			   const struct bench_chunk chunks[], size_t nchunks)
+{
+	const int async_opts = job->mix[NVM_DEV_STATS_WRITE] ? NVM_ASYNC_SEQ : 0;
+	const size_t ncmds = (size_t)job->qd * job->nctxs;
+	const size_t buf_nbytes = bs * cli->args.geo->l.nbytes;
+
+	memset(thrd, 0, sizeof(*thrd));
+	thrd->job = job;
+	thrd->dev = cli->args.dev;
+	thrd->geo = cli->args.geo;
+	thrd->bs = bs;
+	thrd->seed = job->seed + tid;
+
+	// The chunks of the thread are every nthreads'th of the job
+	thrd->chunks = calloc(nchunks / job->nthreads + 1, sizeof(*thrd->chunks));
+	thrd->ctxs = calloc(job->nctxs, sizeof(*thrd->ctxs));
+	thrd->cmds = calloc(ncmds, sizeof(*thrd->cmds));
+	thrd->free = calloc(ncmds, sizeof(*thrd->free));
+	thrd->buf = nvm_buf_alloc(thrd->dev, buf_nbytes, NULL);
+	if (!(thrd->chunks && thrd->ctxs && thrd->cmds && thrd->free &&
+	      thrd->buf)) {
+		errno = ENOMEM;
+		return -1;
+	}
+	nvm_buf_fill(thrd->buf, buf_nbytes);
+
+	for (size_t i = tid; i < nchunks; i += job->nthreads)
+		thrd->chunks[thrd->nchunks++] = chunks[i];
+	if (!thrd->nchunks) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (job->sgl) {
+		thrd->sgl = nvm_sgl_create(thrd->dev, 1);
+		if (!thrd->sgl ||
+		    nvm_sgl_add(thrd->dev, thrd->sgl, thrd->buf, buf_nbytes))
+			return -1;
+	}
+
+	for (int c = 0; c < job->nctxs; ++c) {
+		thrd->ctxs[c] = nvm_async_init(thrd->dev, job->qd, async_opts);
+		if (!thrd->ctxs[c])
+			return -1;
+	}
+
+	for (size_t i = 0; i < ncmds; ++i) {
+		thrd->cmds[i].thrd = thrd;
+		thrd->cmds[i].ctx = i % job->nctxs;
+		thrd->free[thrd->nfree++] = &thrd->cmds[i];
+	}
+
+	return 0;
+}
+
+/**
+ * Setup the chunks of the job, ordered such that consecutive chunks are on
+ * distinct parallel units, and their write-pointers from the chunk report
+ */
+static struct bench_chunk *bench_chunks(struct nvm_cli *cli,
+					const struct bench_job *job,
+					size_t *nchunks)
+{
+	const struct nvm_geo *geo = cli->args.geo;
+	const int tpunit = geo->l.npugrp * geo->l.npunit;
+	const int npus = job->npus ? job->npus : tpunit;
+	struct bench_chunk *chunks;
+
+	if ((npus > tpunit) || (job->chunk + job->nchunks > (int)geo->l.nchunk)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	*nchunks = (size_t)npus * job->nchunks;
+	chunks = calloc(*nchunks, sizeof(*chunks));
+	if (!chunks)
+		return NULL;
+
+	for (int pu = 0; pu < npus; ++pu) {
+		struct nvm_addr addr = { .val = 0 };
+		struct nvm_spec_rprt *rprt;
+
+		addr.l.pugrp = pu % geo->l.npugrp;
+		addr.l.punit = (pu / geo->l.npugrp) % geo->l.npunit;
+
+		rprt = nvm_cmd_rprt(cli->args.dev, &addr, 0x0, NULL);
+		if (!rprt) {
+			free(chunks);
+			return NULL;
+		}
+
+		for (int c = 0; c < job->nchunks; ++c) {
+			const struct nvm_spec_rprt_descr *descr;
+			struct bench_chunk *chunk = &chunks[c * npus + pu];
+
+			descr = &rprt->descr[job->chunk + c];
+
+			chunk->addr = addr;
+			chunk->addr.l.chunk = job->chunk + c;
+			chunk->wp = descr->wp;
+			if (descr->cs & (NVM_CHUNK_STATE_CLOSED |
+					 NVM_CHUNK_STATE_OFFLINE))
+				chunk->wp = geo->l.nsectr;
+		}
+
+		nvm_buf_free(cli->args.dev, rprt);
+	}
+
+	return chunks;
+}
+
+static int bench_job_run(struct nvm_cli *cli, const struct bench_job *job,
+			 int last)
+{
+	const struct nvm_geo *geo = cli->args.geo;
+	const int bs = job->bs ? job->bs : nvm_dev_get_ws_opt(cli->args.dev);
+	size_t ncmds[NVM_DEV_STATS_NOPS] = { 0 };
+	size_t nbytes[NVM_DEV_STATS_NOPS] = { 0 };
+	struct bench_thrd *thrds;
+	struct bench_chunk *chunks;
+	size_t nchunks, nerrs = 0;
+	uint64_t t0, elapsed, deadline = 0;
+	double secs;
+	int err = 0;
+
+	if ((bs < 1) || (bs > NVM_NADDR_MAX) || (geo->l.nsectr % bs)) {
+		errno = EINVAL;
+		nvm_cli_perror("bs");
+		return -1;
+	}
+
+	chunks = bench_chunks(cli, job, &nchunks);
+	if (!chunks) {
+		nvm_cli_perror("bench_chunks");
+		return -1;
+	}
+	if ((size_t)job->nthreads > nchunks) {
+		free(chunks);
+		errno = EINVAL;
+		nvm_cli_perror("nthreads exceeds the number of chunks");
+		return -1;
+	}
+
+	thrds = calloc(job->nthreads, sizeof(*thrds));
+	if (!thrds) {
+		free(chunks);
+		nvm_cli_perror("calloc");
+		return -1;
+	}
+
+	for (int t = 0; (t < job->nthreads) && !err; ++t) {
+		err = bench_thrd_init(&thrds[t], job, cli, bs, t, chunks,
+				      nchunks);
+		if (err)
+			nvm_cli_perror("bench_thrd_init");
+	}
+	free(chunks);
+
+	if (!err) {
+		nvm_dev_stats_reset(cli->args.dev);
+
+		t0 = bench_ns();
+		if (job->runtime)
+			deadline = t0 + job->runtime * 1e9;
+
+		#pragma omp parallel for num_threads(job->nthreads) schedule(static, 1) reduction(|:err)
+		for (int t = 0; t < job->nthreads; ++t)
+			err |= bench_thrd_run(&thrds[t], deadline);
+
+		elapsed = bench_ns() - t0;
+		secs = elapsed / 1e9;
+
+		for (int t = 0; t < job->nthreads; ++t) {
+			for (int op = 0; op < NVM_DEV_STATS_NOPS; ++op) {
+				ncmds[op] += thrds[t].ncmds[op];
+				nbytes[op] += thrds[t].nbytes[op];
+			}
+			nerrs += thrds[t].nerrs;
+		}
+
+		printf("    {\n");
+		printf("      \"name\": ");
+		json_str_pr(job->name);
+		printf(",\n");
+		job_pr(job);
+		printf(",\n");
+		printf("      \"bs\": %d,\n", bs);
+		printf("      \"elapsed_ns\": %"PRIu64",\n", elapsed);
+		printf("      \"nerrs\": %zu,\n", nerrs);
+		printf("      \"ops\": {");
+		for (int op = 0, first = 1; op < NVM_DEV_STATS_NOPS; ++op) {
+			struct nvm_dev_stats stats = { 0 };
+
+			if (!job->mix[op])
+				continue;
+
+			nvm_dev_stats_get(cli->args.dev, op, -1, &stats);
+
+			printf("%s\n        \"%s\": {\"ncmds\": %zu, "
+			       "\"nbytes\": %zu, \"iops\": %.0f, "
+			       "\"mib_s\": %.1f, \"lat_ns\": {\"min\": %"PRIu64
+			       ", \"mean\": %"PRIu64", \"max\": %"PRIu64
+			       ", \"p50\": %"PRIu64", \"p90\": %"PRIu64
+			       ", \"p99\": %"PRIu64", \"p999\": %"PRIu64
+			       ", \"p9999\": %"PRIu64"}}", first ? "" : ",",
+			       op_str[op], ncmds[op], nbytes[op],
+			       secs ? ncmds[op] / secs : 0.0,
+			       secs ? nbytes[op] / secs / (1 << 20) : 0.0,
+			       stats.min_ns, stats.mean_ns, stats.max_ns,
+			       stats.p50_ns, stats.p90_ns, stats.p99_ns,
+			       stats.p999_ns, stats.p9999_ns);
+			first = 0;
+		}
+		printf("\n      }\n");
+		printf("    }%s\n", last ? "" : ",");
+		fflush(stdout);
+	}
+
+	for (int t = 0; t < job->nthreads; ++t)
+		bench_thrd_term(&thrds[t]);
+	free(thrds);
+
+	return err;
+}
+
+static int cmd_run(struct nvm_cli *cli)
+{
+	struct bench_job jobs[BENCH_NJOBS_MAX];
+	const struct nvm_geo *geo = cli->args.geo;
+	int njobs;
+	int err = 0;
+
+	if (!cli->opts.file_input) {
+		errno = EINVAL;
+		nvm_cli_perror("missing -i FILE");
+		return -1;
+	}
+
+	njobs = jobs_load(cli->opts.file_input, jobs);
+	if (njobs < 0)
+		return -1;
+
+	if (nvm_dev_get_verid(cli->args.dev) != NVM_SPEC_VERID_20) {
+		errno = ENOTSUP;
+		nvm_cli_perror("nvm_bench requires an OCSSD 2.0 device");
+		return -1;
+	}
+
+	printf("{\n");
+	printf("  \"liblightnvm\": {\"major\": %d, \"minor\": %d, "
+	       "\"patch\": %d},\n", nvm_ver_major(), nvm_ver_minor(),
+	       nvm_ver_patch());
+	printf("  \"dev\": {\"name\": ");
+	json_str_pr(nvm_dev_get_name(cli->args.dev));
+	printf(", \"be_id\": %d, \"verid\": %d, "
+	       "\"npugrp\": %zu, \"npunit\": %zu, \"nchunk\": %zu, "
+	       "\"nsectr\": %zu, \"nbytes\": %zu, \"ws_opt\": %d},\n",
+	       nvm_dev_get_be_id(cli->args.dev),
+	       nvm_dev_get_verid(cli->args.dev), geo->l.npugrp,
+	       geo->l.npunit, geo->l.nchunk, geo->l.nsectr, geo->l.nbytes,
+	       nvm_dev_get_ws_opt(cli->args.dev));
+	printf("  \"jobs\": [\n");
+	for (int i = 0; (i < njobs) && !err; ++i)
+		err = bench_job_run(cli, &jobs[i], i == njobs - 1);
+	printf("  ]\n");
+	printf("}\n");
+
+	return err;
+}
+
+static int cmd_jobs(struct nvm_cli *cli)
+{
+	struct bench_job jobs[BENCH_NJOBS_MAX];
+	int njobs;
+
+	if (!cli->opts.file_input) {
+		errno = EINVAL;
+		nvm_cli_perror("missing -i FILE");
+		return -1;
+	}
+
+	njobs = jobs_load(cli->opts.file_input, jobs);
+	if (njobs < 0)
+		return -1;
+
+	printf("{\n");
+	printf("  \"jobs\": [\n");
+	for (int i = 0; i < njobs; ++i) {
+		printf("    {\n");
+		printf("      \"name\": ");
+		json_str_pr(jobs[i].name);
+		printf(",\n");
+		job_pr(&jobs[i]);
+		printf("\n    }%s\n", i == njobs - 1 ? "" : ",");
+	}
+	printf("  ]\n");
+	printf("}\n");
+
+	return 0;
+}
+
+/**
+ * Command-line interface (CLI) boiler-plate
+ */
+
+/* Define commands */
+static struct nvm_cli_cmd cmds[] = {
+	{"run", cmd_run, NVM_CLI_ARG_DEV_PATH, NVM_CLI_OPT_HELP | NVM_CLI_OPT_FILE_INPUT},
+	{"jobs", cmd_jobs, NVM_CLI_ARG_NONE, NVM_CLI_OPT_HELP | NVM_CLI_OPT_FILE_INPUT},
+};
+
+/* Define the CLI */
+static struct nvm_cli cli = {
+	.title = "NVM Benchmark",
+	.descr_short = "Run the jobs described in -i FILE and print throughput and latency as JSON, 'jobs' prints the parsed jobs",
+	.cmds = cmds,
+	.ncmds = sizeof(cmds) / sizeof(cmds[0]),
+};
+
+/* Initialize and run */
+int main(int argc, char **argv)
+{
+	int res = 0;
+
+	if (nvm_cli_init(&cli, argc, argv) < 0) {
+		perror("# FAILED");
+		return 1;
+	}
+
+	res = nvm_cli_run(&cli);
+
+	nvm_cli_destroy(&cli);
+
+	return res;
+}
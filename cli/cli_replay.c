@@ -0,0 +1,449 @@
+/**
+ * replay - CLI for re-issuing command traces recorded with nvm_dev_set_trace
+ *
+ * Traces are recorded by devices opened with NVM_DEV_TRACE=<prefix>, to
+ * <prefix>.<device name>, or enabled with nvm_dev_set_trace
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <liblightnvm.h>
+#include <nvm_trace.h>
+#include "liblightnvm_cli.h"
+
+#define REPLAY_DEPTH_DEF 64
+
+static const char *op_str[] = {"erase", "write", "read", "copy"};
+
+struct replay_cmd {
+	struct nvm_ret ret;		///< Must be first, see replay_cb
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+};
+
+struct replay {
+	struct nvm_dev *dev;
+	const struct nvm_geo *geo;
+	struct nvm_async_ctx *ctx;
+	struct nvm_trace_hdr hdr;
+	struct nvm_trace_rec *recs;	///< Records in submission order
+	size_t nrecs;
+
+	struct replay_cmd *cmds;	///< A command per unit of depth
+	struct replay_cmd **free;	///< Stack of idle commands
+	size_t nfree;
+	char *buf;			///< Data of reads and writes
+
+	size_t nissued;			///< # of commands issued
+	size_t nskipped;		///< # of records not replayable
+	size_t ninexact;		///< # of address lists not reproduced
+	size_t nerrs;			///< # of commands failed
+};
+
+static uint64_t replay_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int rec_cmp(const void *a, const void *b)
+{
+	const struct nvm_trace_rec *ra = a;
+	const struct nvm_trace_rec *rb = b;
+
+	return (ra->tsc > rb->tsc) - (ra->tsc < rb->tsc);
+}
+
+/**
+ * Load the header and records of the trace at 'path', records are sorted by
+ * submission as they are written in completion order
+ */
+static int trace_load(const char *path, struct nvm_trace_hdr *hdr,
+		      struct nvm_trace_rec **recs, size_t *nrecs)
+{
+	size_t nalloc = 1024;
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		nvm_cli_perror("fopen");
+		return -1;
+	}
+
+	if ((fread(hdr, sizeof(*hdr), 1, fp) != 1) ||
+	    (hdr->magic != NVM_TRACE_MAGIC) ||
+	    (hdr->version != NVM_TRACE_VERSION) ||
+	    (hdr->rec_nbytes != sizeof(**recs))) {
+		errno = EINVAL;
+		nvm_cli_perror("invalid trace");
+		fclose(fp);
+		return -1;
+	}
+
+	*nrecs = 0;
+	*recs = malloc(nalloc * sizeof(**recs));
+	while (*recs) {
+		if (*nrecs == nalloc) {
+			struct nvm_trace_rec *grown;
+
+			nalloc *= 2;
+			grown = realloc(*recs, nalloc * sizeof(**recs));
+			if (!grown) {
+				free(*recs);
+				*recs = NULL;
+				break;
+			}
+			*recs = grown;
+		}
+
+		if (fread(&(*recs)[*nrecs], sizeof(**recs), 1, fp) != 1)
+			break;
+
+		++(*nrecs);
+	}
+	fclose(fp);
+
+	if (!*recs) {
+		errno = ENOMEM;
+		nvm_cli_perror("malloc");
+		return -1;
+	}
+
+	qsort(*recs, *nrecs, sizeof(**recs), rec_cmp);
+
+	return 0;
+}
+
+static void trace_pr(const struct nvm_trace_hdr *hdr,
+		     const struct nvm_trace_rec *recs, size_t nrecs)
+{
+	uint64_t nops[NVM_DEV_STATS_NOPS] = { 0 };
+	uint64_t ticks[NVM_DEV_STATS_NOPS] = { 0 };
+	const double tps = hdr->tps ? hdr->tps : 1e9;
+
+	for (size_t i = 0; i < nrecs; ++i) {
+		if (recs[i].op >= NVM_DEV_STATS_NOPS)
+			continue;
+
+		++nops[recs[i].op];
+		ticks[recs[i].op] += recs[i].ticks;
+	}
+
+	printf("trace:\n");
+	printf("  dev: '%s'\n", hdr->name);
+	printf("  be_id: 0x%02x\n", hdr->be_id);
+	printf("  verid: 0x%02x\n", hdr->verid);
+	printf("  geo: {npugrp: %u, npunit: %u, nchunk: %u, nsectr: %u}\n",
+	       hdr->npugrp, hdr->npunit, hdr->nchunk, hdr->nsectr);
+	printf("  nrecs: %zu\n", nrecs);
+	printf("  ndropped: %"PRIu64"\n", hdr->ndropped);
+	printf("  duration_ns: %.0f\n",
+	       nrecs ? recs[nrecs - 1].tsc / tps * 1e9 : 0.0);
+	printf("  ops:\n");
+	for (int op = 0; op < NVM_DEV_STATS_NOPS; ++op) {
+		printf("    - {op: '%s', count: %"PRIu64", mean_ns: %.0f}\n",
+		       op_str[op], nops[op],
+		       nops[op] ? ticks[op] / tps * 1e9 / nops[op] : 0.0);
+	}
+}
+
+/**
+ * Reconstruct the address list of a record from its first address, assuming
+ * consecutive sectors, or chunks and planes for erase, as issued by nvm_vblk
+ */
+static void replay_expand(struct replay *replay,
+			  const struct nvm_trace_rec *rec,
+			  struct nvm_addr addrs[], int naddrs)
+{
+	const struct nvm_geo *geo = replay->geo;
+
+	addrs[0].val = rec->addr;
+	for (int i = 1; i < naddrs; ++i) {
+		struct nvm_addr addr = addrs[i - 1];
+
+		switch (nvm_dev_get_verid(replay->dev)) {
+		case NVM_SPEC_VERID_12:
+			if (rec->op == NVM_DEV_STATS_ERASE) {
+				addr.g.pl += 1;
+				break;
+			}
+			addr.g.sec += 1;
+			if (addr.g.sec < geo->nsectors)
+				break;
+			addr.g.sec = 0;
+			addr.g.pl += 1;
+			if (addr.g.pl < geo->nplanes)
+				break;
+			addr.g.pl = 0;
+			addr.g.pg += 1;
+			break;
+
+		case NVM_SPEC_VERID_20:
+			if (rec->op == NVM_DEV_STATS_ERASE)
+				addr.l.chunk += 1;
+			else
+				addr.l.sectr += 1;
+			break;
+		}
+
+		addrs[i] = addr;
+	}
+}
+
+static void replay_cb(struct nvm_ret *ret, void *opaque)
+{
+	struct replay_cmd *cmd = (struct replay_cmd *)ret;
+	struct replay *replay = opaque;
+
+	if (ret->status)
+		++(replay->nerrs);
+
+	replay->free[replay->nfree++] = cmd;
+}
+
+static int replay_issue(struct replay *replay, const struct nvm_trace_rec *rec)
+{
+	const int scalar = (rec->flags & NVM_CMD_MASK_ADDR) == NVM_CMD_SCALAR;
+	const int naddrs = rec->naddrs;
+	const uint16_t flags = rec->flags | NVM_CMD_ASYNC;
+	struct replay_cmd *cmd;
+	int err = -1;
+
+	if ((rec->op == NVM_DEV_STATS_COPY) || !naddrs ||
+	    (naddrs > NVM_NADDR_MAX)) {
+		++(replay->nskipped);
+		return 0;
+	}
+
+	while (!replay->nfree) {
+		if (nvm_async_poke(replay->dev, replay->ctx, 0) < 0)
+			return -1;
+	}
+	cmd = replay->free[--(replay->nfree)];
+
+	replay_expand(replay, rec, cmd->addrs, scalar ? 1 : naddrs);
+	for (int i = 0; i < (scalar ? 1 : naddrs); ++i) {
+		if (nvm_addr_check(cmd->addrs[i], replay->dev)) {
+			replay->free[replay->nfree++] = cmd;
+			++(replay->nskipped);
+			return 0;
+		}
+	}
+	if (nvm_trace_digest(cmd->addrs, scalar ? 1 : naddrs) != rec->digest)
+		++(replay->ninexact);
+
+	memset(&cmd->ret, 0, sizeof(cmd->ret));
+	cmd->ret.async.ctx = replay->ctx;
+	cmd->ret.async.cb = replay_cb;
+	cmd->ret.async.cb_arg = replay;
+
+	switch (rec->op) {
+	case NVM_DEV_STATS_ERASE:
+		err = nvm_cmd_erase(replay->dev, cmd->addrs, naddrs, NULL,
+				    flags, &cmd->ret);
+		break;
+	case NVM_DEV_STATS_WRITE:
+		err = nvm_cmd_write(replay->dev, cmd->addrs, naddrs,
+				    replay->buf, NULL, flags, &cmd->ret);
+		break;
+	case NVM_DEV_STATS_READ:
+		err = nvm_cmd_read(replay->dev, cmd->addrs, naddrs,
+				   replay->buf, NULL, flags, &cmd->ret);
+		break;
+	}
+
+	if (err) {
+		replay->free[replay->nfree++] = cmd;
+		++(replay->nerrs);
+		return 0;
+	}
+
+	++(replay->nissued);
+
+	return 0;
+}
+
+static void replay_term(struct replay *replay)
+{
+	if (replay->ctx)
+		nvm_async_term(replay->dev, replay->ctx);
+	nvm_buf_free(replay->dev, replay->buf);
+	free(replay->free);
+	free(replay->cmds);
+	free(replay->recs);
+}
+
+static int replay_init(struct nvm_cli *cli, struct replay *replay)
+{
+	const size_t depth = (cli->opts.mask & NVM_CLI_OPT_VAL_DEC) ?
+			     cli->opts.dec_val : REPLAY_DEPTH_DEF;
+
+	memset(replay, 0, sizeof(*replay));
+	replay->dev = cli->args.dev;
+	replay->geo = cli->args.geo;
+
+	if (!cli->opts.file_input || !depth) {
+		errno = EINVAL;
+		nvm_cli_perror("missing -i FILE or invalid -n depth");
+		return -1;
+	}
+
+	if (trace_load(cli->opts.file_input, &replay->hdr, &replay->recs,
+		       &replay->nrecs))
+		return -1;
+
+	if ((int)replay->hdr.verid != nvm_dev_get_verid(replay->dev))
+		nvm_cli_info_pr("WARN: trace and device verid differ");
+
+	replay->cmds = calloc(depth, sizeof(*replay->cmds));
+	replay->free = calloc(depth, sizeof(*replay->free));
+	replay->buf = nvm_buf_alloc(replay->dev,
+				    NVM_NADDR_MAX * replay->geo->sector_nbytes,
+				    NULL);
+	replay->ctx = nvm_async_init(replay->dev, depth, 0x0);
+	if (!(replay->cmds && replay->free && replay->buf && replay->ctx)) {
+		nvm_cli_perror("replay_init");
+		replay_term(replay);
+		return -1;
+	}
+
+	for (size_t i = 0; i < depth; ++i)
+		replay->free[replay->nfree++] = &replay->cmds[i];
+
+	return 0;
+}
+
+static int replay_run(struct nvm_cli *cli, int timed)
+{
+	struct replay replay;
+	uint64_t t0, elapsed;
+	double tps;
+	int err = 0;
+
+	if (replay_init(cli, &replay))
+		return -1;
+
+	tps = replay.hdr.tps ? replay.hdr.tps : 1e9;
+
+	nvm_cli_info_pr("replaying %zu records, %s", replay.nrecs,
+			timed ? "honoring inter-arrival times" : "afap");
+
+	nvm_dev_stats_reset(replay.dev);
+
+	t0 = replay_ns();
+	for (size_t i = 0; (i < replay.nrecs) && !err; ++i) {
+		const struct nvm_trace_rec *rec = &replay.recs[i];
+		const uint64_t due = rec->tsc / tps * 1e9;
+
+		while (timed && (replay_ns() - t0 < due)) {
+			if (nvm_async_poke(replay.dev, replay.ctx, 0) < 0) {
+				err = -1;
+				break;
+			}
+		}
+
+		if (!err)
+			err = replay_issue(&replay, rec);
+	}
+	if (nvm_async_wait(replay.dev, replay.ctx) < 0)
+		err = -1;
+	elapsed = replay_ns() - t0;
+
+	trace_pr(&replay.hdr, replay.recs, replay.nrecs);
+
+	printf("replay:\n");
+	printf("  mode: '%s'\n", timed ? "timed" : "afap");
+	printf("  elapsed_ns: %"PRIu64"\n", elapsed);
+	printf("  nissued: %zu\n", replay.nissued);
+	printf("  nskipped: %zu\n", replay.nskipped);
+	printf("  ninexact: %zu\n", replay.ninexact);
+	printf("  nerrs: %zu\n", replay.nerrs);
+	for (int op = 0; op < NVM_DEV_STATS_NOPS; ++op) {
+		struct nvm_dev_stats stats;
+
+		if (nvm_dev_stats_get(replay.dev, op, -1, &stats) ||
+		    !stats.count)
+			continue;
+
+		nvm_dev_stats_pr(&stats);
+	}
+
+	replay_term(&replay);
+
+	return err;
+}
+
+static int cmd_info(struct nvm_cli *cli)
+{
+	struct nvm_trace_hdr hdr;
+	struct nvm_trace_rec *recs;
+	size_t nrecs;
+
+	if (!cli->opts.file_input) {
+		errno = EINVAL;
+		nvm_cli_perror("missing -i FILE");
+		return -1;
+	}
+
+	if (trace_load(cli->opts.file_input, &hdr, &recs, &nrecs))
+		return -1;
+
+	trace_pr(&hdr, recs, nrecs);
+
+	free(recs);
+
+	return 0;
+}
+
+static int cmd_afap(struct nvm_cli *cli)
+{
+	return replay_run(cli, 0);
+}
+
+static int cmd_timed(struct nvm_cli *cli)
+{
+	return replay_run(cli, 1);
+}
+
+/**
+ * Command-line interface (CLI) boiler-plate
+ */
+
+/* Define commands */
+static struct nvm_cli_cmd cmds[] = {
+	{"info", cmd_info, NVM_CLI_ARG_NONE, NVM_CLI_OPT_HELP | NVM_CLI_OPT_FILE_INPUT},
+	{"afap", cmd_afap, NVM_CLI_ARG_DEV_PATH, NVM_CLI_OPT_HELP | NVM_CLI_OPT_FILE_INPUT | NVM_CLI_OPT_VAL_DEC},
+	{"timed", cmd_timed, NVM_CLI_ARG_DEV_PATH, NVM_CLI_OPT_HELP | NVM_CLI_OPT_FILE_INPUT | NVM_CLI_OPT_VAL_DEC},
+};
+
+/* Define the CLI */
+static struct nvm_cli cli = {
+	.title = "NVM Trace Replay (nvm_dev_set_trace)",
+	.descr_short = "Re-issue a command trace as fast as possible (afap) or at its original times (timed), -n sets the IO depth",
+	.cmds = cmds,
+	.ncmds = sizeof(cmds) / sizeof(cmds[0]),
+};
+
+/* Initialize and run */
+int main(int argc, char **argv)
+{
+	int res = 0;
+
+	if (nvm_cli_init(&cli, argc, argv) < 0) {
+		perror("# FAILED");
+		return 1;
+	}
+
+	res = nvm_cli_run(&cli);
+
+	nvm_cli_destroy(&cli);
+
+	return res;
+}
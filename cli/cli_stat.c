@@ -0,0 +1,349 @@
+/**
+ * stat - CLI for the live counters published by processes using liblightnvm
+ *
+ * Counters are published in shared-memory by devices opened with
+ * NVM_DEV_STATS_SHM=1 or enabled with nvm_dev_set_stats_shm
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <liblightnvm.h>
+#include <nvm_stats.h>
+#include "liblightnvm_cli.h"
+
+#define STAT_NSEGS_MAX 32
+
+struct stat_seg {
+	char name[NAME_MAX + 1];		///< Entry in /dev/shm
+	const struct nvm_stats_shm *shm;	///< Mapping of the segment
+	size_t nbytes;				///< Size of the mapping
+	struct nvm_stats_shm *prev;		///< Copy of the previous sample
+	uint64_t prev_tsc;			///< Tick of the previous sample
+};
+
+static const char *op_str[] = {"erase", "write", "read", "copy"};
+
+static uint64_t stat_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int seg_alive(const struct nvm_stats_shm *shm)
+{
+	return !kill(shm->pid, 0) || (errno == EPERM);
+}
+
+static void segs_detach(struct stat_seg segs[], int nsegs)
+{
+	for (int i = 0; i < nsegs; ++i) {
+		nvm_stats_shm_detach(segs[i].shm, segs[i].nbytes);
+		free(segs[i].prev);
+	}
+}
+
+/**
+ * Attach the segments in /dev/shm, those of the process given with '-n' when
+ * provided, returns the number of segments attached
+ */
+static int segs_attach(struct nvm_cli *cli, struct stat_seg segs[])
+{
+	const size_t prefix_len = strlen(NVM_STATS_SHM_PREFIX);
+	struct dirent *entry;
+	int nsegs = 0;
+	DIR *dir;
+
+	dir = opendir("/dev/shm");
+	if (!dir) {
+		nvm_cli_perror("opendir /dev/shm");
+		return -1;
+	}
+
+	while ((entry = readdir(dir)) && (nsegs < STAT_NSEGS_MAX)) {
+		struct stat_seg *seg = &segs[nsegs];
+
+		if (strncmp(entry->d_name, NVM_STATS_SHM_PREFIX, prefix_len))
+			continue;
+
+		memset(seg, 0, sizeof(*seg));
+		memcpy(seg->name, entry->d_name,
+		       strnlen(entry->d_name, NAME_MAX));
+
+		seg->shm = nvm_stats_shm_attach(seg->name, &seg->nbytes);
+		if (!seg->shm)
+			continue;
+
+		if ((cli->opts.mask & NVM_CLI_OPT_VAL_DEC) &&
+		    (seg->shm->pid != (int32_t)cli->opts.dec_val)) {
+			nvm_stats_shm_detach(seg->shm, seg->nbytes);
+			continue;
+		}
+
+		++nsegs;
+	}
+
+	closedir(dir);
+
+	return nsegs;
+}
+
+/**
+ * Ticks the parallel unit has been busy, including the current busy period
+ */
+static uint64_t pu_busy(const struct nvm_stats_shm_pu *pu, uint64_t tsc)
+{
+	uint64_t busy = atomic_load(&pu->busy);
+	uint64_t bgn = atomic_load(&pu->busy_bgn);
+
+	if (atomic_load(&pu->outstanding) && (tsc > bgn))
+		busy += tsc - bgn;
+
+	return busy;
+}
+
+static int cmd_ls(struct nvm_cli *cli)
+{
+	struct stat_seg segs[STAT_NSEGS_MAX];
+	int nsegs;
+
+	nsegs = segs_attach(cli, segs);
+	if (nsegs < 0)
+		return -1;
+
+	printf("stats_shm:");
+	if (!nsegs)
+		printf(" ~");
+	printf("\n");
+
+	for (int i = 0; i < nsegs; ++i) {
+		const struct nvm_stats_shm *shm = segs[i].shm;
+
+		printf("  - name: '%s'\n", segs[i].name);
+		printf("    pid: %d\n", shm->pid);
+		printf("    alive: %d\n", seg_alive(shm));
+		printf("    dev: '%s'\n", shm->name);
+		printf("    be_id: 0x%02x\n", shm->be_id);
+		printf("    npus: %u\n", shm->npus);
+	}
+
+	segs_detach(segs, nsegs);
+
+	return 0;
+}
+
+static int cmd_show(struct nvm_cli *cli)
+{
+	struct stat_seg segs[STAT_NSEGS_MAX];
+	int nsegs;
+
+	nsegs = segs_attach(cli, segs);
+	if (nsegs < 0)
+		return -1;
+
+	printf("stats_shm:");
+	if (!nsegs)
+		printf(" ~");
+	printf("\n");
+
+	for (int i = 0; i < nsegs; ++i) {
+		const struct nvm_stats_shm *shm = segs[i].shm;
+		const uint64_t tsc = nvm_stats_tsc();
+
+		printf("  - name: '%s'\n", segs[i].name);
+		printf("    pid: %d\n", shm->pid);
+		printf("    dev: '%s'\n", shm->name);
+		printf("    ops:\n");
+		for (int op = 0; op < NVM_DEV_STATS_NOPS; ++op) {
+			const struct nvm_stats_shm_op *sop = &shm->ops[op];
+
+			printf("      - {op: '%s', ncmds: %"PRIu64
+			       ", nbytes: %"PRIu64", nerrs: %"PRIu64"}\n",
+			       op_str[op], atomic_load(&sop->ncmds),
+			       atomic_load(&sop->nbytes),
+			       atomic_load(&sop->nerrs));
+		}
+		printf("    ctxs:\n");
+		for (uint32_t slot = 0; slot < shm->nctxs; ++slot) {
+			const struct nvm_stats_shm_ctx *ctx = &shm->ctxs[slot];
+
+			if (!atomic_load(&ctx->in_use))
+				continue;
+
+			printf("      - {slot: %u, depth: %u, outstanding: %u"
+			       ", ncmds: %"PRIu64"}\n", slot, ctx->depth,
+			       (uint32_t)atomic_load(&ctx->outstanding),
+			       atomic_load(&ctx->ncmds));
+		}
+		printf("    pus:\n");
+		for (uint32_t idx = 0; idx < shm->npus; ++idx) {
+			const struct nvm_stats_shm_pu *pu = &shm->pus[idx];
+
+			printf("      - {pu: %u, ncmds: %"PRIu64", nerrs: %"PRIu64
+			       ", busy: %"PRIu64", outstanding: %u}\n", idx,
+			       atomic_load(&pu->ncmds), atomic_load(&pu->nerrs),
+			       pu_busy(pu, tsc),
+			       (uint32_t)atomic_load(&pu->outstanding));
+		}
+	}
+
+	segs_detach(segs, nsegs);
+
+	return 0;
+}
+
+static void top_seg_pr(struct stat_seg *seg, uint64_t tsc, double secs)
+{
+	const struct nvm_stats_shm *shm = seg->shm;
+	const struct nvm_stats_shm *prev = seg->prev;
+	const uint64_t ticks = tsc - seg->prev_tsc;
+
+	printf("# %s, pid: %d%s, be_id: 0x%02x, npus: %u\n", seg->name,
+	       shm->pid, seg_alive(shm) ? "" : " (exited)", shm->be_id,
+	       shm->npus);
+
+	printf("%-6s %10s %10s %8s\n", "op", "iops", "MiB/s", "errs");
+	for (int op = 0; op < NVM_DEV_STATS_NOPS; ++op) {
+		const struct nvm_stats_shm_op *cur = &shm->ops[op];
+		const struct nvm_stats_shm_op *old = &prev->ops[op];
+		uint64_t ncmds, nbytes, nerrs;
+
+		ncmds = atomic_load(&cur->ncmds) - atomic_load(&old->ncmds);
+		nbytes = atomic_load(&cur->nbytes) - atomic_load(&old->nbytes);
+		nerrs = atomic_load(&cur->nerrs);
+
+		printf("%-6s %10.0f %10.1f %8"PRIu64"\n", op_str[op],
+		       ncmds / secs, nbytes / secs / (1 << 20), nerrs);
+	}
+
+	printf("%-6s %10s %10s %8s\n", "ctx", "depth", "qd", "iops");
+	for (uint32_t slot = 0; slot < shm->nctxs; ++slot) {
+		const struct nvm_stats_shm_ctx *cur = &shm->ctxs[slot];
+		uint64_t ncmds;
+
+		if (!atomic_load(&cur->in_use))
+			continue;
+
+		ncmds = atomic_load(&cur->ncmds) -
+			atomic_load(&prev->ctxs[slot].ncmds);
+
+		printf("%-6u %10u %10u %8.0f\n", slot, cur->depth,
+		       (uint32_t)atomic_load(&cur->outstanding), ncmds / secs);
+	}
+
+	printf("%-6s %10s %10s %8s %8s\n", "pu", "util", "qd", "iops",
+	       "errs");
+	for (uint32_t idx = 0; idx < shm->npus; ++idx) {
+		const struct nvm_stats_shm_pu *cur = &shm->pus[idx];
+		const struct nvm_stats_shm_pu *old = &prev->pus[idx];
+		uint64_t busy, ncmds;
+
+		busy = pu_busy(cur, tsc) - pu_busy(old, seg->prev_tsc);
+		ncmds = atomic_load(&cur->ncmds) - atomic_load(&old->ncmds);
+
+		printf("%-6u %9.1f%% %10u %8.0f %8"PRIu64"\n", idx,
+		       ticks ? 100.0 * busy / ticks : 0.0,
+		       (uint32_t)atomic_load(&cur->outstanding), ncmds / secs,
+		       (uint64_t)atomic_load(&cur->nerrs));
+	}
+}
+
+static int cmd_top(struct nvm_cli *cli)
+{
+	struct stat_seg segs[STAT_NSEGS_MAX];
+	uint64_t prev_ns;
+	int nsegs;
+
+	nsegs = segs_attach(cli, segs);
+	if (nsegs < 0)
+		return -1;
+	if (!nsegs) {
+		nvm_cli_info_pr("no counters published");
+		return 0;
+	}
+
+	for (int i = 0; i < nsegs; ++i) {
+		segs[i].prev = malloc(segs[i].nbytes);
+		if (!segs[i].prev) {
+			nvm_cli_perror("malloc");
+			segs_detach(segs, nsegs);
+			return -1;
+		}
+		memcpy(segs[i].prev, segs[i].shm, segs[i].nbytes);
+		segs[i].prev_tsc = nvm_stats_tsc();
+	}
+	prev_ns = stat_ns();
+
+	for (;;) {
+		uint64_t ns;
+		double secs;
+
+		sleep(1);
+
+		ns = stat_ns();
+		secs = (ns - prev_ns) / 1e9;
+		prev_ns = ns;
+
+		printf("\033[H\033[2J");
+		for (int i = 0; i < nsegs; ++i) {
+			const uint64_t tsc = nvm_stats_tsc();
+
+			top_seg_pr(&segs[i], tsc, secs);
+			printf("\n");
+
+			memcpy(segs[i].prev, segs[i].shm, segs[i].nbytes);
+			segs[i].prev_tsc = tsc;
+		}
+		fflush(stdout);
+	}
+
+	segs_detach(segs, nsegs);
+
+	return 0;
+}
+
+/**
+ * Command-line interface (CLI) boiler-plate
+ */
+
+/* Define commands */
+static struct nvm_cli_cmd cmds[] = {
+	{"ls", cmd_ls, NVM_CLI_ARG_NONE, NVM_CLI_OPT_HELP | NVM_CLI_OPT_VAL_DEC},
+	{"show", cmd_show, NVM_CLI_ARG_NONE, NVM_CLI_OPT_HELP | NVM_CLI_OPT_VAL_DEC},
+	{"top", cmd_top, NVM_CLI_ARG_NONE, NVM_CLI_OPT_HELP | NVM_CLI_OPT_VAL_DEC},
+};
+
+/* Define the CLI */
+static struct nvm_cli cli = {
+	.title = "NVM Live Counters (nvm_dev_set_stats_shm)",
+	.descr_short = "List, show, and watch the counters published by processes, -n PID selects a process",
+	.cmds = cmds,
+	.ncmds = sizeof(cmds) / sizeof(cmds[0]),
+};
+
+/* Initialize and run */
+int main(int argc, char **argv)
+{
+	int res = 0;
+
+	if (nvm_cli_init(&cli, argc, argv) < 0) {
+		perror("# FAILED");
+		return 1;
+	}
+
+	res = nvm_cli_run(&cli);
+
+	nvm_cli_destroy(&cli);
+
+	return res;
+}
@@ -9,12 +9,16 @@ static inline void _vblk_cmd_mode(struct nvm_vblk *vblk)
 	if (getenv("NVM_CLI_VBLK_ASYNC")) {
 		char *str;
 		uint32_t depth = 0;
+		uint16_t opts = 0;
 
 		if (NULL != (str = getenv("NVM_CLI_VBLK_ASYNC_DEPTH"))) {
 			sscanf(str, "%"SCNu32, &depth);
 		}
+		if (NULL != (str = getenv("NVM_CLI_VBLK_ASYNC_OPTS"))) {
+			sscanf(str, "%"SCNx16, &opts);
+		}
 
-		nvm_vblk_set_async(vblk, depth);
+		nvm_vblk_set_async_opts(vblk, depth, opts);
 	}
 
 	if (getenv("NVM_CLI_VBLK_SCALAR")) {
@@ -30,11 +30,16 @@ def gen_capi(args):
         "nvm_geo": "Geometry",
         "nvm_buf": "Buffer Allocation",
         "nvm_dev": "Device Management",
+        "nvm_dev_group": "Device Groups",
         "nvm_addr": "Addressing",
         "nvm_cmd": "Raw Commands",
+        "nvm_chunk": "Chunk Append",
         "nvm_async": "Async. Controls",
         "nvm_sgl": "Scather/Gather Lists",
         "nvm_vblk": "Virtual Block",
+        "nvm_place": "Stream Placement",
+        "nvm_gc": "Garbage-Collection",
+        "nvm_ftl": "Page-Mapped FTL",
         "nvm_bp": "Boilerplate",
         "nvm_bbt": "Bad-Block-Table"
     }
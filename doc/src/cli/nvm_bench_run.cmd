@@ -0,0 +1,2 @@
+nvm_bench run /dev/nvme0n1 -i nvm_bench_jobs.ini
+NVM_CLI_CMD_OPTS=0x4 nvm_bench run traddr:0000:01:00.0 -i nvm_bench_jobs.ini
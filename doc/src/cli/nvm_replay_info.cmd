@@ -0,0 +1 @@
+nvm_replay info -i /tmp/trace.nvme0n1
@@ -0,0 +1,2 @@
+NVM_DEV_TRACE=/tmp/trace nvm_vblk line_write /dev/nvme0n1 0 4 0 2 142
+nvm_replay timed /dev/nvme0n1 -i /tmp/trace.nvme0n1 -n 32
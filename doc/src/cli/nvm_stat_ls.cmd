@@ -0,0 +1 @@
+nvm_stat ls
@@ -0,0 +1 @@
+nvm_stat top -n 28500
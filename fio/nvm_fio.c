@@ -0,0 +1,591 @@
+/*
+ * nvm_fio - fio ioengine for Open-Channel SSDs via liblightnvm
+ *
+ * Copyright (C) 2015-2017 Javier Gonzáles <javier@cnexlabs.com>
+ * Copyright (C) 2015-2017 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2015-2017 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The byte-addressed file seen by fio is mapped onto the chunks of all parallel
+ * units, either striped in units of ws_opt sectors as done by nvm_vblk lines
+ * (stripe=vblk) or a chunk at a time (stripe=chunk). Consecutive units are on
+ * distinct parallel units in both cases. Trims reset the chunks they cover.
+ *
+ * Load it with: ioengine=external:/path/to/libnvm_fio.so
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <liblightnvm.h>
+
+#include "fio.h"
+#include "optgroup.h"
+
+enum nvm_fio_stripe {
+	NVM_FIO_STRIPE_VBLK = 0,	///< Units of ws_opt sectors
+	NVM_FIO_STRIPE_CHUNK = 1,	///< Units of a chunk
+};
+
+struct nvm_fio_options {
+	void *pad;			///< fio requires the first member be a pointer
+	unsigned int be;		///< Backend, see `enum nvm_be_id`
+	unsigned int stripe;		///< One of `enum nvm_fio_stripe`
+	unsigned int fixedbufs;		///< IO buffers allocated with nvm_buf_alloc
+	unsigned int hipri;		///< Busy-poll completions
+};
+
+/**
+ * A device and ASYNC context per file of the thread
+ */
+struct nvm_fio_file {
+	struct nvm_dev *dev;
+	const struct nvm_geo *geo;
+	struct nvm_async_ctx *ctx;
+	int stripe;			///< One of `enum nvm_fio_stripe`
+	uint64_t tpunit;		///< # of parallel units
+	uint64_t unit_nsectr;		///< # of sectors per stripe unit
+};
+
+struct nvm_fio_data {
+	struct io_u **events;		///< Completions reaped by getevents
+	unsigned int nevents;
+	struct nvm_fio_file *files;	///< Indexed by `fio_file.fileno`
+	unsigned int nfiles;
+};
+
+struct nvm_fio_cmd {
+	struct nvm_ret ret;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_fio_data *data;
+	struct nvm_dev *dev;		///< Owner of 'bounce'
+	void *bounce;			///< DMA buffer, when io_u buffers are not
+};
+
+static struct fio_option options[] = {
+	{
+		.name	= "be",
+		.lname	= "liblightnvm backend",
+		.type	= FIO_OPT_INT,
+		.off1	= offsetof(struct nvm_fio_options, be),
+		.help	= "Backend identifier, e.g. 0x1 IOCTL, 0x2 LBD, 0x4 SPDK",
+		.def	= "0",
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_INVALID,
+	},
+	{
+		.name	= "stripe",
+		.lname	= "liblightnvm stripe",
+		.type	= FIO_OPT_STR,
+		.off1	= offsetof(struct nvm_fio_options, stripe),
+		.help	= "Mapping of offsets onto chunks",
+		.def	= "vblk",
+		.posval	= {
+			{ .ival = "vblk",
+			  .oval = NVM_FIO_STRIPE_VBLK,
+			  .help = "Stripe units of ws_opt sectors across PUs",
+			},
+			{ .ival = "chunk",
+			  .oval = NVM_FIO_STRIPE_CHUNK,
+			  .help = "Stripe chunks across PUs",
+			},
+		},
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_INVALID,
+	},
+	{
+		.name	= "fixedbufs",
+		.lname	= "Fixed (pre-allocated) IO buffers",
+		.type	= FIO_OPT_STR_SET,
+		.off1	= offsetof(struct nvm_fio_options, fixedbufs),
+		.help	= "Allocate IO buffers with nvm_buf_alloc, no bouncing",
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_INVALID,
+	},
+	{
+		.name	= "hipri",
+		.lname	= "High Priority",
+		.type	= FIO_OPT_STR_SET,
+		.off1	= offsetof(struct nvm_fio_options, hipri),
+		.help	= "Busy-poll for completions instead of sleeping",
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_INVALID,
+	},
+	{
+		.name	= NULL,
+	},
+};
+
+static int nvm_fio_geo_check(const struct nvm_dev *dev, const char *fname)
+{
+	if (nvm_dev_get_verid(dev) != NVM_SPEC_VERID_20) {
+		log_err("nvm_fio: %s: only OCSSD 2.0 is supported\n", fname);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * Writes are sequenced per chunk and must not cross a stripe unit, as the
+ * sectors of the next unit are on another chunk. Holds when writes are of a
+ * fixed block size dividing the unit, at offsets aligned to it
+ */
+static int nvm_fio_bs_check(const struct thread_data *td,
+			    const struct nvm_fio_file *nf, const char *fname)
+{
+	const unsigned long long unit = nf->unit_nsectr * nf->geo->l.nbytes;
+	const unsigned long long ws_min = nvm_dev_get_ws_min(nf->dev) *
+					  nf->geo->l.nbytes;
+	const unsigned long long bs = td->o.min_bs[DDIR_WRITE];
+
+	if (td->o.max_bs[DDIR_WRITE] != bs) {
+		log_err("nvm_fio: %s: writes need a fixed bs, not a range\n",
+			fname);
+		return -EINVAL;
+	}
+	if ((!bs) || (bs % ws_min) || (unit % bs)) {
+		log_err("nvm_fio: %s: write bs: %llu must be a multiple of "
+			"ws_min: %llu and divide the stripe unit: %llu\n",
+			fname, bs, ws_min, unit);
+		return -EINVAL;
+	}
+	if ((td->o.ba[DDIR_WRITE] % bs) || (td->o.start_offset % bs)) {
+		log_err("nvm_fio: %s: write offsets must be aligned to bs: "
+			"%llu\n", fname, bs);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static uint64_t nvm_fio_nbytes(const struct nvm_geo *geo)
+{
+	return geo->l.npugrp * geo->l.npunit * geo->l.nchunk *
+	       geo->l.nsectr * geo->l.nbytes;
+}
+
+/**
+ * Address of the given sector of the file
+ */
+static struct nvm_addr nvm_fio_sectr2addr(const struct nvm_fio_file *nf,
+					  uint64_t sectr)
+{
+	const struct nvm_geo *geo = nf->geo;
+	const uint64_t unit = sectr / nf->unit_nsectr;
+	const uint64_t row = unit / nf->tpunit;
+	const uint64_t pu = unit % nf->tpunit;
+	const uint64_t units_per_chunk = geo->l.nsectr / nf->unit_nsectr;
+	struct nvm_addr addr = { .val = 0 };
+
+	addr.l.pugrp = pu % geo->l.npugrp;
+	addr.l.punit = pu / geo->l.npugrp;
+	addr.l.chunk = row / units_per_chunk;
+	addr.l.sectr = (row % units_per_chunk) * nf->unit_nsectr +
+		       sectr % nf->unit_nsectr;
+
+	return addr;
+}
+
+static void nvm_fio_cb(struct nvm_ret *ret, void *cb_arg)
+{
+	struct io_u *io_u = cb_arg;
+	struct nvm_fio_cmd *cmd = io_u->engine_data;
+	struct nvm_fio_data *data = cmd->data;
+
+	io_u->error = ret->status ? EIO : 0;
+	if (!io_u->error && cmd->bounce && (io_u->ddir == DDIR_READ))
+		memcpy(io_u->xfer_buf, cmd->bounce, io_u->xfer_buflen);
+
+	data->events[data->nevents++] = io_u;
+}
+
+/**
+ * Reset the chunks covered by the trimmed range, which must be aligned to the
+ * chunks of the stripe, that is, a row of chunks for stripe=vblk
+ */
+static int nvm_fio_trim(struct nvm_fio_file *nf, uint64_t sectr,
+			uint64_t nsectr)
+{
+	const struct nvm_geo *geo = nf->geo;
+	const uint64_t row_nsectr = nf->stripe == NVM_FIO_STRIPE_CHUNK ?
+				    geo->l.nsectr :
+				    geo->l.nsectr * nf->tpunit;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	int naddrs = 0;
+
+	if ((sectr % row_nsectr) || (nsectr % row_nsectr))
+		return EINVAL;
+
+	for (uint64_t s = sectr; s < sectr + nsectr; s += nf->unit_nsectr) {
+		struct nvm_addr addr = nvm_fio_sectr2addr(nf, s);
+
+		if (addr.l.sectr)
+			continue;		// Not the first unit of a chunk
+
+		if (naddrs == NVM_NADDR_MAX) {
+			if (nvm_cmd_erase(nf->dev, addrs, naddrs, NULL,
+					  NVM_CMD_SYNC | NVM_CMD_VECTOR, NULL))
+				return errno ? errno : EIO;
+			naddrs = 0;
+		}
+
+		addrs[naddrs++] = addr;
+	}
+
+	if (naddrs && nvm_cmd_erase(nf->dev, addrs, naddrs, NULL,
+				    NVM_CMD_SYNC | NVM_CMD_VECTOR, NULL))
+		return errno ? errno : EIO;
+
+	return 0;
+}
+
+static enum fio_q_status nvm_fio_queue(struct thread_data *td,
+				       struct io_u *io_u)
+{
+	struct nvm_fio_data *data = td->io_ops_data;
+	struct nvm_fio_file *nf = &data->files[io_u->file->fileno];
+	struct nvm_fio_cmd *cmd = io_u->engine_data;
+	const uint64_t nbytes = nf->geo->l.nbytes;
+	const uint64_t sectr = io_u->offset / nbytes;
+	const uint64_t nsectr = io_u->xfer_buflen / nbytes;
+	const uint16_t flags = NVM_CMD_ASYNC | NVM_CMD_VECTOR;
+	void *buf = io_u->xfer_buf;
+	int err;
+
+	fio_ro_check(td, io_u);
+
+	if ((io_u->offset % nbytes) || (io_u->xfer_buflen % nbytes)) {
+		io_u->error = EINVAL;
+		return FIO_Q_COMPLETED;
+	}
+
+	switch (io_u->ddir) {
+	case DDIR_READ:
+	case DDIR_WRITE:
+		break;
+
+	case DDIR_TRIM:
+		io_u->error = nvm_fio_trim(nf, sectr, nsectr);
+		return FIO_Q_COMPLETED;
+
+	default:
+		io_u->error = 0;
+		return FIO_Q_COMPLETED;
+	}
+
+	if (!nsectr || (nsectr > NVM_NADDR_MAX)) {
+		io_u->error = EINVAL;
+		return FIO_Q_COMPLETED;
+	}
+
+	if (nvm_async_get_outstanding(nf->ctx) >= nvm_async_get_depth(nf->ctx))
+		return FIO_Q_BUSY;
+
+	// Backends needing DMA memory bounce buffers not from nvm_buf_alloc
+	if (!cmd->bounce && !((struct nvm_fio_options *)td->eo)->fixedbufs &&
+	    (nvm_dev_get_be_id(nf->dev) == NVM_BE_SPDK)) {
+		cmd->bounce = nvm_buf_alloc(nf->dev,
+					    NVM_NADDR_MAX * nbytes, NULL);
+		if (!cmd->bounce) {
+			io_u->error = ENOMEM;
+			return FIO_Q_COMPLETED;
+		}
+		cmd->dev = nf->dev;
+	}
+	if (cmd->bounce) {
+		if (io_u->ddir == DDIR_WRITE)
+			memcpy(cmd->bounce, buf, io_u->xfer_buflen);
+		buf = cmd->bounce;
+	}
+
+	for (uint64_t i = 0; i < nsectr; ++i)
+		cmd->addrs[i] = nvm_fio_sectr2addr(nf, sectr + i);
+
+	memset(&cmd->ret, 0, sizeof(cmd->ret));
+	cmd->ret.async.ctx = nf->ctx;
+	cmd->ret.async.cb = nvm_fio_cb;
+	cmd->ret.async.cb_arg = io_u;
+
+	if (io_u->ddir == DDIR_WRITE)
+		err = nvm_cmd_write(nf->dev, cmd->addrs, nsectr, buf, NULL,
+				    flags, &cmd->ret);
+	else
+		err = nvm_cmd_read(nf->dev, cmd->addrs, nsectr, buf, NULL,
+				   flags, &cmd->ret);
+	if (err) {
+		if (errno == EAGAIN)		// Full, retried once reaped
+			return FIO_Q_BUSY;
+
+		io_u->error = errno ? errno : EIO;
+		return FIO_Q_COMPLETED;
+	}
+
+	return FIO_Q_QUEUED;
+}
+
+static int nvm_fio_getevents(struct thread_data *td, unsigned int min,
+			     unsigned int max, const struct timespec *t)
+{
+	struct nvm_fio_options *o = td->eo;
+	struct nvm_fio_data *data = td->io_ops_data;
+	const struct timespec nap = { 0, 1000 };
+	struct timespec bgn, now;
+
+	if (t)
+		clock_gettime(CLOCK_MONOTONIC, &bgn);
+
+	data->nevents = 0;
+	for (;;) {
+		for (unsigned int i = 0; i < data->nfiles; ++i) {
+			struct nvm_fio_file *nf = &data->files[i];
+
+			if (data->nevents >= max)
+				break;
+
+			if (nvm_async_poke(nf->dev, nf->ctx,
+					   max - data->nevents) < 0)
+				return -errno;
+		}
+
+		if (data->nevents >= min)
+			break;
+
+		if (t) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((now.tv_sec - bgn.tv_sec) * 1000000000LL +
+			    (now.tv_nsec - bgn.tv_nsec) >=
+			    t->tv_sec * 1000000000LL + t->tv_nsec)
+				break;
+		}
+
+		if (!o->hipri)
+			nanosleep(&nap, NULL);
+	}
+
+	return data->nevents;
+}
+
+static struct io_u *nvm_fio_event(struct thread_data *td, int event)
+{
+	struct nvm_fio_data *data = td->io_ops_data;
+
+	return data->events[event];
+}
+
+static void nvm_fio_cleanup(struct thread_data *td)
+{
+	struct nvm_fio_data *data = td->io_ops_data;
+
+	if (!data)
+		return;
+
+	for (unsigned int i = 0; i < data->nfiles; ++i) {
+		struct nvm_fio_file *nf = &data->files[i];
+
+		if (nf->ctx)
+			nvm_async_term(nf->dev, nf->ctx);
+		if (nf->dev)
+			nvm_dev_close(nf->dev);
+	}
+
+	free(data->files);
+	free(data->events);
+	free(data);
+	td->io_ops_data = NULL;
+}
+
+/**
+ * Devices are opened here, rather than in open_file, as io buffers are
+ * allocated, via iomem_alloc, before files are opened
+ */
+static int nvm_fio_init(struct thread_data *td)
+{
+	struct nvm_fio_options *o = td->eo;
+	struct nvm_fio_data *data;
+	struct fio_file *f;
+	unsigned int i;
+
+	data = calloc(1, sizeof(*data));
+	if (!data)
+		return 1;
+	td->io_ops_data = data;
+
+	data->events = calloc(td->o.iodepth, sizeof(*data->events));
+	data->files = calloc(td->o.nr_files, sizeof(*data->files));
+	if (!data->events || !data->files)
+		goto failed;
+
+	for_each_file(td, f, i) {
+		struct nvm_fio_file *nf = &data->files[i];
+		const uint16_t opts = td_write(td) ? NVM_ASYNC_SEQ : 0x0;
+
+		nf->dev = nvm_dev_openf(f->file_name, o->be);
+		if (!nf->dev) {
+			log_err("nvm_fio: nvm_dev_openf(%s) failed\n",
+				f->file_name);
+			goto failed;
+		}
+		++(data->nfiles);
+
+		if (nvm_fio_geo_check(nf->dev, f->file_name))
+			goto failed;
+
+		nf->geo = nvm_dev_get_geo(nf->dev);
+		nf->tpunit = nf->geo->l.npugrp * nf->geo->l.npunit;
+		nf->stripe = o->stripe;
+		nf->unit_nsectr = o->stripe == NVM_FIO_STRIPE_CHUNK ?
+				  nf->geo->l.nsectr :
+				  (uint64_t)nvm_dev_get_ws_opt(nf->dev);
+
+		if (td_write(td) && nvm_fio_bs_check(td, nf, f->file_name))
+			goto failed;
+
+		nf->ctx = nvm_async_init(nf->dev, td->o.iodepth, opts);
+		if (!nf->ctx) {
+			log_err("nvm_fio: nvm_async_init(%s) failed\n",
+				f->file_name);
+			goto failed;
+		}
+	}
+
+	return 0;
+
+failed:
+	nvm_fio_cleanup(td);
+	return 1;
+}
+
+static int nvm_fio_io_u_init(struct thread_data *td, struct io_u *io_u)
+{
+	struct nvm_fio_cmd *cmd;
+
+	cmd = calloc(1, sizeof(*cmd));
+	if (!cmd)
+		return 1;
+
+	cmd->data = td->io_ops_data;
+	io_u->engine_data = cmd;
+
+	return 0;
+}
+
+static void nvm_fio_io_u_free(struct thread_data *NVM_UNUSED(td),
+			      struct io_u *io_u)
+{
+	struct nvm_fio_cmd *cmd = io_u->engine_data;
+
+	if (!cmd)
+		return;
+
+	if (cmd->bounce)
+		nvm_buf_free(cmd->dev, cmd->bounce);
+	free(cmd);
+	io_u->engine_data = NULL;
+}
+
+static int nvm_fio_iomem_alloc(struct thread_data *td, size_t total_mem)
+{
+	struct nvm_fio_options *o = td->eo;
+	struct nvm_fio_data *data = td->io_ops_data;
+	void *buf;
+
+	if (o->fixedbufs) {
+		td->orig_buffer = nvm_buf_alloc(data->files[0].dev, total_mem,
+						NULL);
+		return td->orig_buffer == NULL;
+	}
+
+	return posix_memalign(&buf, sysconf(_SC_PAGESIZE), total_mem) ||
+	       !(td->orig_buffer = buf);
+}
+
+static void nvm_fio_iomem_free(struct thread_data *td)
+{
+	struct nvm_fio_options *o = td->eo;
+	struct nvm_fio_data *data = td->io_ops_data;
+
+	if (o->fixedbufs)
+		nvm_buf_free(data->files[0].dev, td->orig_buffer);
+	else
+		free(td->orig_buffer);
+}
+
+static int nvm_fio_open_file(struct thread_data *NVM_UNUSED(td),
+			     struct fio_file *NVM_UNUSED(f))
+{
+	return 0;
+}
+
+static int nvm_fio_close_file(struct thread_data *NVM_UNUSED(td),
+			      struct fio_file *NVM_UNUSED(f))
+{
+	return 0;
+}
+
+static int nvm_fio_get_file_size(struct thread_data *td, struct fio_file *f)
+{
+	struct nvm_fio_options *o = td->eo;
+	struct nvm_dev *dev;
+	int err;
+
+	if (fio_file_size_known(f))
+		return 0;
+
+	dev = nvm_dev_openf(f->file_name, o->be);
+	if (!dev) {
+		log_err("nvm_fio: nvm_dev_openf(%s) failed\n", f->file_name);
+		return -errno;
+	}
+
+	err = nvm_fio_geo_check(dev, f->file_name);
+	if (!err) {
+		f->real_file_size = nvm_fio_nbytes(nvm_dev_get_geo(dev));
+		fio_file_set_size_known(f);
+	}
+
+	nvm_dev_close(dev);
+
+	return err;
+}
+
+struct ioengine_ops ioengine = {
+	.name			= "liblightnvm",
+	.version		= FIO_IOOPS_VERSION,
+	.flags			= FIO_RAWIO | FIO_NOEXTEND | FIO_NODISKUTIL,
+	.init			= nvm_fio_init,
+	.queue			= nvm_fio_queue,
+	.getevents		= nvm_fio_getevents,
+	.event			= nvm_fio_event,
+	.cleanup		= nvm_fio_cleanup,
+	.open_file		= nvm_fio_open_file,
+	.close_file		= nvm_fio_close_file,
+	.get_file_size		= nvm_fio_get_file_size,
+	.io_u_init		= nvm_fio_io_u_init,
+	.io_u_free		= nvm_fio_io_u_free,
+	.iomem_alloc		= nvm_fio_iomem_alloc,
+	.iomem_free		= nvm_fio_iomem_free,
+	.options		= options,
+	.option_struct_size	= sizeof(struct nvm_fio_options),
+};
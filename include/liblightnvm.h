@@ -129,8 +129,9 @@ struct nvm_dev;
 struct nvm_sgl;
 
 /**
- * Opaque handle for a Scatter Gather List (SGL) pool. A seperate pool should
- * be used for each asynchronous context.
+ * Opaque handle for a Scatter Gather List (SGL) pool. A pool may be used by
+ * multiple threads, each thread allocates and frees through its own magazine
+ * of SGLs and descriptor segments.
  *
  * @struct nvm_sgl_pool
  */
@@ -214,6 +215,10 @@ void nvm_sgl_reset(struct nvm_sgl *sgl);
 /**
  * Add an entry to the SGL
  *
+ * Descriptors are stored in segments of 256, an SGL exceeding a segment is
+ * chained using Segment descriptors, allowing a single command to address any
+ * number of buffers
+ *
  * @see nvm_sgl_alloc
  * @see nvm_buf_alloc
  *
@@ -224,6 +229,28 @@ void nvm_sgl_reset(struct nvm_sgl *sgl);
  */
 int nvm_sgl_add(struct nvm_dev *dev, struct nvm_sgl *sgl, void *buf, size_t nbytes);
 
+/**
+ * Add a bit bucket to the SGL, the device discards the next 'nbytes' of a
+ * read instead of transferring them to the host
+ *
+ * Allows a single read of a contiguous range of sectors, of which only some
+ * are needed, without paying bus and memory bandwidth for the rest.
+ * Consecutive bit buckets are merged into one descriptor.
+ *
+ * @note The device must support SGL Bit Bucket descriptors, and they are only
+ * meaningful for reads. Skipped bytes are not included in the length of the
+ * SGL.
+ *
+ * @see nvm_sgl_add
+ *
+ * @param sgl Pointer to sgl as allocated by `nvm_sgl_alloc`
+ * @param nbytes Number of bytes to discard
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_sgl_add_skip(struct nvm_sgl *sgl, size_t nbytes);
+
 /**
  * Virtual block abstraction
  *
@@ -240,6 +267,139 @@ int nvm_sgl_add(struct nvm_dev *dev, struct nvm_sgl *sgl, void *buf, size_t nbyt
  */
 struct nvm_vblk;
 
+/**
+ * Placement engine, routing writes to the append points of write streams
+ *
+ * Each stream owns an open chunk in each parallel unit of its span, writes
+ * tagged with a stream are appended to the open chunks of that stream only,
+ * such that data of different lifetimes do not share chunks.
+ *
+ * @see nvm_place_alloc
+ * @see nvm_place_write
+ *
+ * @struct nvm_place
+ */
+struct nvm_place;
+
+/**
+ * Garbage-collector of the chunks of a placement engine
+ *
+ * The owner of the data, e.g. an FTL, marks sectors valid and invalid, the
+ * collector relocates the valid sectors of victim chunks and resets them.
+ *
+ * @see nvm_gc_alloc
+ * @see nvm_gc_run
+ *
+ * @struct nvm_gc
+ */
+struct nvm_gc;
+
+/**
+ * Host-side page-mapped FTL, exposing the chunks of an OCSSD 2.0 device as a
+ * conventional logical-block address space
+ *
+ * @see nvm_ftl_open
+ * @see nvm_ftl_write
+ *
+ * @struct nvm_ftl
+ */
+struct nvm_ftl;
+
+/**
+ * Group of devices with identical geometry, exposed as one logical device
+ * whose channels, or parallel unit groups, are the concatenation of those of
+ * the members
+ *
+ * @see nvm_dev_group_open
+ * @see nvm_dev_group_get_dev
+ *
+ * @struct nvm_dev_group
+ */
+struct nvm_dev_group;
+
+/**
+ * Options for `nvm_ftl_open`
+ */
+enum nvm_ftl_opts {
+	NVM_FTL_CREATE = 0x1 << 0,	///< Reset the device, start out empty
+};
+
+/**
+ * Placement of the worker threads of the library, e.g. those of `nvm_vblk`
+ *
+ * @see nvm_dev_set_affinity
+ */
+enum nvm_dev_affinity {
+	NVM_DEV_AFFINITY_NONE = 0x0,	///< Leave threads where the OS puts them
+	NVM_DEV_AFFINITY_NODE = 0x1,	///< Bind to the CPUs of the device node
+};
+
+/**
+ * Classes of commands accounted by the latency statistics of a device
+ *
+ * @see nvm_dev_stats_get
+ */
+enum nvm_dev_stats_op {
+	NVM_DEV_STATS_ERASE = 0x0,	///< Scalar and vector erase
+	NVM_DEV_STATS_WRITE = 0x1,	///< Scalar and vector write
+	NVM_DEV_STATS_READ = 0x2,	///< Scalar and vector read
+	NVM_DEV_STATS_COPY = 0x3,	///< Vector copy
+};
+
+#define NVM_DEV_STATS_NOPS 4		///< # of `enum nvm_dev_stats_op`
+
+/**
+ * Submission-to-completion latency of a class of commands on a parallel unit,
+ * or on all parallel units, of a device
+ *
+ * Percentiles are the upper bound of the histogram bucket holding them, the
+ * buckets are log-linear with a relative error of at most 1/16
+ *
+ * @see nvm_dev_stats_get
+ */
+struct nvm_dev_stats {
+	int be_id;		///< Backend of the device, see `enum nvm_be_id`
+	int op;			///< One of `enum nvm_dev_stats_op`
+	int pu;			///< Parallel unit, -1 for all of the device
+	uint64_t count;		///< # of completed commands
+	uint64_t min_ns;	///< Minimum latency in nanoseconds
+	uint64_t max_ns;	///< Maximum latency in nanoseconds
+	uint64_t mean_ns;	///< Mean latency in nanoseconds
+	uint64_t p50_ns;	///< Median latency in nanoseconds
+	uint64_t p90_ns;	///< 90th percentile in nanoseconds
+	uint64_t p99_ns;	///< 99th percentile in nanoseconds
+	uint64_t p999_ns;	///< 99.9th percentile in nanoseconds
+	uint64_t p9999_ns;	///< 99.99th percentile in nanoseconds
+};
+
+/**
+ * Phases of the host CPU cost of commands accounted by the probes of a device
+ *
+ * @see nvm_dev_probe_get
+ */
+enum nvm_dev_probe_phase {
+	NVM_DEV_PROBE_ADDR = 0x0,	///< Address generation and conversion
+	NVM_DEV_PROBE_WRAP = 0x1,	///< Setup and teardown of command wraps
+	NVM_DEV_PROBE_DMA = 0x2,	///< Allocation of address lists and ranges
+	NVM_DEV_PROBE_SUBMIT = 0x3,	///< Submission to the backend
+	NVM_DEV_PROBE_CPL = 0x4,	///< Reaping and dispatch of completions
+	NVM_DEV_PROBE_CB = 0x5,		///< User callbacks of ASYNC commands
+};
+
+#define NVM_DEV_PROBE_NPHASES 6		///< # of `enum nvm_dev_probe_phase`
+
+/**
+ * Host CPU cost of a phase of commands summed over the threads of a process
+ *
+ * @see nvm_dev_probe_get
+ */
+struct nvm_dev_probe {
+	int phase;		///< One of `enum nvm_dev_probe_phase`
+	uint64_t count;		///< # of times the phase was entered
+	uint64_t cycles;	///< Ticks spent in the phase
+	uint64_t ns;		///< Ticks spent in the phase, in nanoseconds
+};
+
 /**
  * Enumeration of pseudo meta mode
  * TODO: Fix this, this was an old VBLK-specific pseudo-meta-mode
@@ -300,6 +460,79 @@ struct nvm_async_cmd_ctx {
 	void *cb_arg;			///< User provided callback arguments
 };
 
+/**
+ * Options for asynchronous contexts
+ *
+ * @see nvm_async_init
+ */
+enum nvm_async_opts {
+	/**
+	 * Sequence writes per chunk in write-pointer order
+	 *
+	 * Writes submitted with NVM_CMD_ASYNC on a context with this option are
+	 * released to the device only once the write preceding it in the chunk
+	 * has been submitted, on this or any other context. Writes arriving ahead
+	 * of their predecessor are held back and released by `nvm_async_poke`
+	 * and `nvm_async_wait`. Writes to different chunks are not ordered.
+	 *
+	 * The write-pointers are rewound by synchronous erases, e.g.
+	 * `nvm_chunk_reset`, a chunk erased with NVM_CMD_ASYNC is not written
+	 * from its start until it has been reset synchronously.
+	 *
+	 * Only supported by OCSSD 2.0 devices.
+	 */
+	NVM_ASYNC_SEQ = 0x1 << 0,
+
+	/**
+	 * Limit outstanding commands per parallel unit
+	 *
+	 * The erase, write, read, and copy commands submitted with
+	 * NVM_CMD_ASYNC on a context with this option are limited per parallel
+	 * unit of their first address, commands beyond the limit fail with
+	 * `errno` EAGAIN, as when the context is full. The limit of each
+	 * parallel unit is adapted to the latency of its completions, growing
+	 * by one while latency stays flat and halving when latency climbs,
+	 * within [1, depth].
+	 *
+	 * @see nvm_async_get_pu_limit
+	 */
+	NVM_ASYNC_QDC = 0x1 << 1,
+
+	/**
+	 * Schedule reads ahead of writes and erases per parallel unit
+	 *
+	 * Writes and erases submitted with NVM_CMD_ASYNC on a context with this
+	 * option are held back while reads, submitted with NVM_CMD_ASYNC on any
+	 * context of the device with this option, are in flight on the
+	 * parallel unit of their first address. Copies count as writes on the
+	 * parallel unit of their first destination address. Reads are never
+	 * held back and thus overtake the writes and erases queued on the
+	 * parallel unit.
+	 *
+	 * Held back commands are released in order per parallel unit by
+	 * `nvm_async_poke` and `nvm_async_wait`, once the reads have completed,
+	 * or once a bounded number of reads have completed on the parallel unit
+	 * since it was held back, such that writes and erases are not starved.
+	 *
+	 * Only the reads of contexts of the same or a higher priority class
+	 * hold back the writes and erases of a context.
+	 *
+	 * @see nvm_async_set_prio
+	 */
+	NVM_ASYNC_SCHED = 0x1 << 2,
+};
+
+/**
+ * Priority classes of asynchronous contexts
+ *
+ * @see NVM_ASYNC_SCHED
+ */
+enum nvm_async_prio {
+	NVM_ASYNC_PRIO_HIGH = 0,	///< Held back by HIGH reads only
+	NVM_ASYNC_PRIO_NORMAL = 1,	///< Default, held back by HIGH and NORMAL
+	NVM_ASYNC_PRIO_LOW = 2,		///< Background e.g. GC, by all reads
+};
+
 /**
  * Allocate an asynchronous context for command submission of the given depth
  * for submission of commands to the given device
@@ -307,7 +540,7 @@ struct nvm_async_cmd_ctx {
  * @param dev Associated device
  * @param depth Maximum iodepth / qdepth, maximum number of outstanding commands
  * of the returned context
- * @param flags TBD
+ * @param flags Context options, see `enum nvm_async_opts`
  *
  * @return On success, pointer to async. context is returned. On error, NULL is
  * returned and `errno` set to indicate the error
@@ -339,9 +572,50 @@ uint32_t nvm_async_get_depth(struct nvm_async_ctx *ctx);
  */
 uint32_t nvm_async_get_outstanding(struct nvm_async_ctx *ctx);
 
+/**
+ * Get the limit of outstanding commands on a parallel unit
+ *
+ * @param ctx Asynchronous context
+ * @param pu Parallel unit, pugrp * npunit + punit
+ *
+ * @return The current limit of the parallel unit on a context initialized
+ * with NVM_ASYNC_QDC, otherwise the depth of the context. For an unknown 'pu'
+ * 0 is returned e.g. errors are silent
+ */
+uint32_t nvm_async_get_pu_limit(struct nvm_async_ctx *ctx, int pu);
+
+/**
+ * Set the priority class of the given context
+ *
+ * The class of a context initialized with NVM_ASYNC_SCHED determines which
+ * reads hold back its writes and erases, and which writes and erases its
+ * reads hold back. The class can only be changed while the context has no
+ * outstanding commands.
+ *
+ * @param ctx Asynchronous context
+ * @param prio One of `enum nvm_async_prio`
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_async_set_prio(struct nvm_async_ctx *ctx, int prio);
+
+/**
+ * Get the priority class of the given context
+ *
+ * @param ctx Asynchronous context
+ *
+ * @return The priority class, one of `enum nvm_async_prio`
+ */
+int nvm_async_get_prio(struct nvm_async_ctx *ctx);
+
 /**
  * Tear down the given ASYNC context
  *
+ * Commands still held back by NVM_ASYNC_SEQ or NVM_ASYNC_SCHED are not
+ * submitted, their callbacks are invoked with an error status, and the chunks
+ * of held back writes are marked failed with ECANCELED.
+ *
  * @return On success, 0 is returned. On error, -1 is returned and `errno` set
  * to indicate the error
  */
@@ -361,6 +635,12 @@ int nvm_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
 /**
  * Wait for completion of all outstanding commands in the given 'ctx'
  *
+ * Commands held back by NVM_ASYNC_SEQ or NVM_ASYNC_SCHED wait on other
+ * contexts for at most a second without progress. Then held back writes and
+ * erases are released regardless of reads in flight, and held back writes
+ * whose predecessor was never submitted are completed with an error status,
+ * failing the remaining writes of their chunk until it is reset.
+ *
  * @return On success, number of completions processed, may be 0, is returned.
  * On error, -1 is returned and `errno` set to indicate the error
  */
@@ -385,6 +665,23 @@ struct nvm_ret {
 	uint16_t status;		///< NVMe command status
 
 	struct nvm_async_cmd_ctx async;	///< ASYNC command context
+
+	/**
+	 * Latency accounting of ASYNC commands, private to the library
+	 */
+	struct {
+		uint64_t tsc;		///< Submission timestamp
+		nvm_async_cb cb;	///< User callback, restored on completion
+		void *cb_arg;		///< User callback argument
+		struct nvm_dev *dev;	///< Device accounting the command
+		uint32_t pu;		///< Parallel unit of the command
+		uint32_t op;		///< One of `enum nvm_dev_stats_op`
+		uint32_t naddrs;	///< # of addresses of the command
+		int32_t slot;		///< Context slot in shared-memory
+		uint64_t addr;		///< First address of the command
+		uint32_t digest;	///< Digest of addresses, when tracing
+		uint16_t flags;		///< Command flags
+	} stats;
 };
 
 /**
@@ -678,6 +975,64 @@ int nvm_cmd_copy(struct nvm_dev *dev, struct nvm_addr src[],
 		 struct nvm_addr dst[], int naddrs, uint16_t flags,
 		 struct nvm_ret *ret);
 
+/**
+ * Append 'nsectr' sectors to the OCSSD 2.0 chunk at 'chunk'
+ *
+ * The sectors are reserved by atomically advancing a host-side write-pointer,
+ * initialized from a chunk report on first use of the parallel unit, and the
+ * write is submitted once all writes reserved before it in the chunk have been
+ * submitted. Multiple threads can thus append to the same chunk without
+ * coordinating write-pointers, much like zone-append.
+ *
+ * @note
+ * The host-side write-pointer assumes that all writes to the chunk go through
+ * `nvm_chunk_append` and resets through `nvm_chunk_reset`. A failed write
+ * leaves the chunk in error and subsequent appends fail until it is reset.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param chunk Address of the chunk to append to, the sector is ignored
+ * @param data Buffer of 'nsectr' sectors to write
+ * @param meta Buffer of 'nsectr' sectors of meta-data or NULL
+ * @param nsectr Number of sectors to append, a multiple of ws_min and at most
+ *               NVM_NADDR_MAX
+ * @param addr Pointer in which to store the address of the first sector
+ *             assigned to the append, or NULL
+ * @param flags Command options, see `enum nvm_cmd_opts`
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, ENOSPC when the chunk cannot fit 'nsectr' sectors and
+ * EBUSY when the chunk is being reset
+ */
+int nvm_chunk_append(struct nvm_dev *dev, struct nvm_addr chunk,
+		     const void *data, const void *meta, int nsectr,
+		     struct nvm_addr *addr, uint16_t flags,
+		     struct nvm_ret *ret);
+
+/**
+ * Reset the OCSSD 2.0 chunk at 'chunk' and rewind its host-side write-pointer
+ *
+ * The reset is always executed synchronously and fails with EBUSY when appends
+ * to the chunk are in the process of being submitted, or when another reset of
+ * it is. The chunk is claimed before the erase, appends racing with the reset
+ * fail with EBUSY instead of landing before the erase.
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error and ret filled with lower-level result codes
+ */
+int nvm_chunk_reset(struct nvm_dev *dev, struct nvm_addr chunk,
+		    uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Returns the host-side write-pointer of the OCSSD 2.0 chunk at 'chunk'
+ *
+ * @return On success, the next sector to be reserved by `nvm_chunk_append` is
+ * returned. On error, -1 is returned and `errno` set to indicate the error,
+ * EBUSY when the chunk is being reset.
+ */
+int nvm_chunk_get_wp(struct nvm_dev *dev, struct nvm_addr chunk);
+
 /**
  * @return the "major" version of the library
  */
@@ -720,6 +1075,12 @@ void nvm_ret_clear(struct nvm_ret *ret);
 /**
  * Retrieves a bad block table from device
  *
+ * @note The returned table is never modified, `nvm_bbt_set` and
+ * `nvm_bbt_mark` publish a new version, thus cached tables are read without
+ * locking while other threads update them. A returned table remains valid
+ * until the calling thread retrieves the table of the same LUN again, or the
+ * device is closed. Replaced versions are freed once no thread holds them.
+ *
  * @param dev Device handle obtained with `nvm_dev_open`
  * @param addr Address of the LUN to retrieve bad-block-table for
  * @param ret Pointer to structure in which to store lower-level status and
@@ -796,6 +1157,51 @@ int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
  */
 int nvm_bbt_flush_all(struct nvm_dev *dev, struct nvm_ret *ret);
 
+/**
+ * Retrieve the bad-block-tables of all LUNs into the managed memory, fetching
+ * the tables of multiple LUNs concurrently. Tables already cached are kept.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result of the first failing fetch
+ *
+ * @return On success, 0 is returned. On error, -1 is returned, `errno` set to
+ * indicate the error and ret filled with lower-level result codes
+ */
+int nvm_bbt_get_all(struct nvm_dev *dev, struct nvm_ret *ret);
+
+/**
+ * Save the bad-block-tables in managed memory to a snapshot file at `path`,
+ * keyed by the identity and geometry of the device and the given generation
+ *
+ * @note The file is written to `path`.tmp and renamed into place
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param path Path of the snapshot file
+ * @param gen Generation of the tables, e.g. bumped by the user on every flush
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_bbt_save(struct nvm_dev *dev, const char *path, uint64_t gen);
+
+/**
+ * Load bad-block-tables from a snapshot file saved with `nvm_bbt_save` into
+ * the managed memory, filling only tables not already cached. Loaded tables
+ * are validated against the device when first modified.
+ *
+ * @note Requires the bad-block-tables to be cached, see `nvm_dev_set_bbts_cached`
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param path Path of the snapshot file
+ * @param gen Generation the snapshot is expected to have
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, ESTALE when the snapshot is of another device,
+ * geometry or generation
+ */
+int nvm_bbt_load(struct nvm_dev *dev, const char *path, uint64_t gen);
+
 /**
  * Allocate a copy of the given bad-block-table
  *
@@ -1101,6 +1507,174 @@ int nvm_dev_get_bbts_cached(const struct nvm_dev *dev);
  */
 int nvm_dev_set_bbts_cached(struct nvm_dev *dev, int bbts_cached);
 
+/**
+ * Returns the NUMA node of the given device, that is, the node of the PCIe
+ * root of the device as reported by sysfs or SPDK
+ *
+ * Buffers allocated with `nvm_buf_alloc` are placed on this node
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ *
+ * @return The NUMA node, or -1 when unknown
+ */
+int nvm_dev_get_numa_node(const struct nvm_dev *dev);
+
+/**
+ * Returns the placement of worker threads used with the given device
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ *
+ * @return One of `enum nvm_dev_affinity`
+ */
+int nvm_dev_get_affinity(const struct nvm_dev *dev);
+
+/**
+ * Sets the placement of worker threads used with the given device, the
+ * default is NVM_DEV_AFFINITY_NONE or NVM_DEV_AFFINITY_NODE when the
+ * environment variable NVM_DEV_AFFINITY is set to "node"
+ *
+ * @note Workers are the threads of OpenMP parallel regions in the library,
+ * the calling thread is never bound. The OpenMP thread pool is shared with
+ * the application, thus workers are bound for the duration of a region of the
+ * library only and get their previous CPUs back when it ends.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param affinity One of `enum nvm_dev_affinity`
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error,
+ * EINVAL for NVM_DEV_AFFINITY_NODE when the node of the device is unknown.
+ */
+int nvm_dev_set_affinity(struct nvm_dev *dev, int affinity);
+
+/**
+ * Retrieve the latency statistics of a class of commands on the given device
+ *
+ * The latency of every erase, write, read, and copy command, from submission
+ * to completion, is accounted in a histogram per parallel unit and class of
+ * command. Parallel unit is that of the first address of the command.
+ * Timestamps are taken with the time-stamp counter where available, thus
+ * accounting costs a few nanoseconds per command.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param op One of `enum nvm_dev_stats_op`
+ * @param pu Parallel unit, pugrp * npunit + punit, or -1 for the sum of all
+ * @param stats Pointer to the statistics to fill
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error,
+ * EINVAL for an unknown 'op' or 'pu'.
+ */
+int nvm_dev_stats_get(struct nvm_dev *dev, int op, int pu,
+		      struct nvm_dev_stats *stats);
+
+/**
+ * Reset the latency statistics of the given device
+ *
+ * Resets the counters of the probes as well, see `nvm_dev_probe_get`
+ *
+ * @note Commands in flight while resetting may be accounted partially, that
+ * is, in the histogram but not in the minimum or maximum
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ */
+void nvm_dev_stats_reset(struct nvm_dev *dev);
+
+/**
+ * Publish live counters of the given device in POSIX shared-memory, named
+ * "liblightnvm-<pid>-<seq>-<dev name>", for inspection by the `nvm_stat` tool
+ *
+ * Counters are IOPS and bytes per class of command, outstanding commands per
+ * ASYNC context, busy time per parallel unit and error counts. Publishing is
+ * enabled on `nvm_dev_open` when the environment variable NVM_DEV_STATS_SHM
+ * is set to "1", the segment is removed on `nvm_dev_close`.
+ *
+ * @note Must not be called with commands outstanding on the device
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param enabled 1 = publish counters, 0 = remove the segment
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error.
+ */
+int nvm_dev_set_stats_shm(struct nvm_dev *dev, int enabled);
+
+/**
+ * Returns whether live counters of the given device are published
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ *
+ * @return 1 when published, 0 otherwise
+ */
+int nvm_dev_get_stats_shm(const struct nvm_dev *dev);
+
+/**
+ * Trace the erase, write, read, and copy commands of the given device to a
+ * binary file, for replay with the `nvm_replay` tool
+ *
+ * Each completed command is recorded with its submission time, class, first
+ * address, a digest of its address list, flags, latency, and status. Records
+ * are buffered in per-thread rings and written to file by a background thread
+ * as they fill, and periodically, records are dropped rather than blocking
+ * submission or completion when the file cannot keep up.
+ * Tracing is enabled on `nvm_dev_open` when the environment variable
+ * NVM_DEV_TRACE is set, each device is traced to a file named by it suffixed
+ * with the name of the device, e.g. NVM_DEV_TRACE=/tmp/trace gives
+ * "/tmp/trace.nvme0n1". The trace is completed on `nvm_dev_close`.
+ *
+ * @note Must not be called with commands outstanding on the device
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param path Path of the trace file, NULL to stop tracing
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error.
+ */
+int nvm_dev_set_trace(struct nvm_dev *dev, const char *path);
+
+/**
+ * Returns the path of the file the given device is traced to
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ *
+ * @return Path of the trace file, NULL when not tracing
+ */
+const char *nvm_dev_get_trace(const struct nvm_dev *dev);
+
+/**
+ * Prints a humanly readable representation of the given latency statistics
+ *
+ * @param stats The statistics to print
+ */
+void nvm_dev_stats_pr(const struct nvm_dev_stats *stats);
+
+/**
+ * Retrieve the host CPU cost of a phase of the commands of the given device
+ *
+ * Probes around address generation, command wrapping, DMA allocation,
+ * submission, completion, and callbacks accumulate the ticks spent in each
+ * phase in per-thread counters. Phases nest, e.g. callbacks run within
+ * completion, and the ticks of a phase exclude those of the phases nested
+ * within it. Waiting on the device is accounted as submission by backends
+ * completing commands within the system call, that is, IOCTL and LBD, and as
+ * completion by backends polling for completions, that is, SPDK.
+ *
+ * The probes are compiled in by configuring with NVM_PROBES_ENABLED and cost
+ * nothing otherwise. The counters are reset by `nvm_dev_stats_reset`.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param phase One of `enum nvm_dev_probe_phase`
+ * @param probe Pointer to the probe counters to fill
+ *
+ * @return 0 on success, -1 on error and `errno` set to indicate the error,
+ * EINVAL for an unknown 'phase', ENOSYS when built without NVM_PROBES_ENABLED.
+ */
+int nvm_dev_probe_get(struct nvm_dev *dev, int phase,
+		      struct nvm_dev_probe *probe);
+
+/**
+ * Prints a humanly readable representation of the given probe counters
+ *
+ * @param probe The probe counters to print
+ */
+void nvm_dev_probe_pr(const struct nvm_dev_probe *probe);
+
 /**
  * Returns the 'meta-mode' of the given device
  *
@@ -1344,6 +1918,69 @@ int nvm_buf_to_file(char *buf, size_t nbytes, const char *path);
  */
 int nvm_buf_from_file(char *buf, size_t nbytes, const char *path);
 
+/**
+ * Pool of equally sized IO buffers, allocated up front from a slab backed by
+ * hugepages, such that IO does not pay for page-faults, TLB-misses and the
+ * pinning of many small pages
+ *
+ * @see nvm_buf_pool_create
+ *
+ * @struct nvm_buf_pool
+ */
+struct nvm_buf_pool;
+
+/**
+ * Create a pool of 'count' buffers of 'obj_size' bytes for IO with the given
+ * device, 'obj_size' is rounded up to the sector size of the device
+ *
+ * The slab is allocated with `spdk_dma_malloc` for SPDK backends, otherwise it
+ * is mapped using 1 GiB hugepages when the slab spans at least 1 GiB, 2 MiB
+ * hugepages, or transparent hugepages, in that order of preference. The slab
+ * is placed on the NUMA node of the device and faulted in up front.
+ *
+ * @note Buffers are cached per thread, a thread may get buffers put by
+ * another thread
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`
+ * @param obj_size Size of each buffer in bytes
+ * @param count Number of buffers in the pool
+ *
+ * @return On success, the pool is returned. On error, NULL and `errno` set to
+ * indicate the error.
+ */
+struct nvm_buf_pool *nvm_buf_pool_create(const struct nvm_dev *dev,
+					 size_t obj_size, size_t count);
+
+/**
+ * Destroy the given pool, buffers gotten from it must not be used afterwards
+ */
+void nvm_buf_pool_destroy(struct nvm_buf_pool *pool);
+
+/**
+ * Get a buffer from the given pool, may be called concurrently
+ *
+ * @return On success, a buffer of `nvm_buf_pool_get_obj_size` bytes is
+ * returned. On error, NULL and `errno` set to indicate the error, ENOMEM when
+ * all buffers of the pool are in use.
+ */
+void *nvm_buf_pool_get(struct nvm_buf_pool *pool);
+
+/**
+ * Put a buffer obtained with `nvm_buf_pool_get` back into the given pool, may
+ * be called concurrently
+ */
+void nvm_buf_pool_put(struct nvm_buf_pool *pool, void *buf);
+
+/**
+ * Returns the size in bytes of the buffers of the given pool
+ */
+size_t nvm_buf_pool_get_obj_size(const struct nvm_buf_pool *pool);
+
+/**
+ * Returns the number of buffers in the given pool
+ */
+size_t nvm_buf_pool_get_count(const struct nvm_buf_pool *pool);
+
 /**
  * Encapsulation of a IO buffer-set for common-case setup
  *
@@ -1554,6 +2191,24 @@ struct nvm_vblk *nvm_vblk_alloc_line(struct nvm_dev *dev, int ch_bgn,
  */
 int nvm_vblk_set_async(struct nvm_vblk *vblk, uint32_t depth);
 
+/**
+ * Set the command mode for the virtual block to async, with the given options
+ * for its ASYNC context.
+ *
+ * With NVM_ASYNC_SEQ, writes keep more than one stripe per chunk in flight,
+ * otherwise each round of stripes is waited for to preserve write-pointer
+ * order.
+ *
+ * @param vblk The virtual block to set the command mode of
+ * @param depth IO depth of the ASYNC context, 0 for the default
+ * @param opts Bitwise OR of `enum nvm_async_opts`
+ *
+ * @returns 0 on success, -1 on error and `errno` set to indicate the error
+ * @see nvm_async_init
+ */
+int nvm_vblk_set_async_opts(struct nvm_vblk *vblk, uint32_t depth,
+			    uint16_t opts);
+
 /**
  * Set the command mode for the virtual block to scalar.
  */
@@ -1724,6 +2379,336 @@ int nvm_vblk_set_pos_write(struct nvm_vblk *vblk, size_t pos);
  */
 void nvm_vblk_pr(struct nvm_vblk *vblk);
 
+/**
+ * Allocate a placement engine with 'nstreams' write streams
+ *
+ * The free chunks of the device are found via chunk reports and pooled per
+ * parallel unit, the pools are shared by all streams. Each stream spans
+ * 'width' consecutive parallel units, the spans of the streams are laid out
+ * after each other wrapping around the device.
+ *
+ * @note
+ * Chunks are exclusively owned by the engine, chunks taken from the pools are
+ * written through `nvm_chunk_append`, see its notes.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`, OCSSD 2.0 only
+ * @param nstreams Number of write streams
+ * @param width Number of parallel units spanned by each stream, 0 for all
+ *
+ * @return On success, an opaque pointer to the initialized placement engine is
+ * returned. On error, NULL and `errno` set to indicate the error.
+ */
+struct nvm_place *nvm_place_alloc(struct nvm_dev *dev, int nstreams,
+				  int width);
+
+/**
+ * Destroys the given placement engine, the chunks are left as is on the device
+ */
+void nvm_place_free(struct nvm_place *place);
+
+/**
+ * Write 'nsectr' sectors to the given stream
+ *
+ * The write is appended to the open chunk of the next parallel unit of the
+ * stream, round-robin, full chunks are replaced by chunks from the pool of
+ * their parallel unit.
+ *
+ * @param place Placement engine obtained with `nvm_place_alloc`
+ * @param sid Stream identifier in the range [0, nstreams[
+ * @param data Buffer of 'nsectr' sectors to write
+ * @param meta Buffer of 'nsectr' sectors of meta-data or NULL
+ * @param nsectr Number of sectors to write, see `nvm_chunk_append`
+ * @param addr Pointer in which to store the address of the first sector
+ *             written, or NULL
+ * @param flags Command options, see `enum nvm_cmd_opts`
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, ENOSPC when the stream has no room left
+ */
+int nvm_place_write(struct nvm_place *place, int sid, const void *data,
+		    const void *meta, int nsectr, struct nvm_addr *addr,
+		    uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Take a free chunk, from the pool of the given parallel unit, out of the
+ * placement engine e.g. for meta-data kept outside of the streams
+ *
+ * @return On success, 0 is returned and the chunk address stored in 'chunk'.
+ * On error, -1 is returned and `errno` set to indicate the error.
+ */
+int nvm_place_chunk_get(struct nvm_place *place, int punit,
+			struct nvm_addr *chunk);
+
+/**
+ * Reset the given chunk and return it to the pool of its parallel unit, e.g.
+ * once its data has been relocated or invalidated
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_place_chunk_put(struct nvm_place *place, struct nvm_addr chunk);
+
+/**
+ * Returns the number of write streams of the given placement engine
+ */
+int nvm_place_get_nstreams(const struct nvm_place *place);
+
+/**
+ * Returns the number of free chunks in the pools of the placement engine
+ */
+int nvm_place_get_nfree(struct nvm_place *place);
+
+/**
+ * Callbacks from the garbage-collector to the owner of the data
+ */
+struct nvm_gc_ops {
+	/**
+	 * Valid sector 'src' has been copied to 'dst', return 0 when the owner
+	 * now refers to 'dst', non-zero when 'src' was invalidated meanwhile
+	 */
+	int (*reloc)(void *arg, struct nvm_addr src, struct nvm_addr dst);
+
+	/**
+	 * Persist the relocations, called once per run before the victims are
+	 * reset, NULL when not needed
+	 */
+	int (*sync)(void *arg);
+
+	/**
+	 * The out-of-bound meta-data of the 'nvalid' valid sectors in 'src' has
+	 * been read and is about to be written to the destination, such that
+	 * the owner can re-stamp it, e.g. with a fresh sequence #. Only called
+	 * when the sectors pass through the host, i.e. when the backend lacks
+	 * copy, return non-zero on error, NULL when not needed
+	 */
+	int (*stamp)(void *arg, const struct nvm_addr src[], int nvalid,
+		     void *meta);
+};
+
+/**
+ * Allocate a garbage-collector for the chunks of the given placement engine
+ *
+ * Victims are chosen by cost-benefit, the ratio (1 - u) * age / (1 + u) where
+ * u is the fraction of valid sectors and age is the time since the chunk was
+ * last written, among written chunks which are not open in a stream. Valid
+ * sectors are relocated with batched `nvm_cmd_copy` when the backend supports
+ * it and via reads and writes through the host otherwise, where the read of a
+ * batch overlaps with the write of the previous one.
+ *
+ * @note
+ * A free chunk is kept aside such that relocation can make progress when the
+ * pools of the engine are empty.
+ *
+ * @param place Placement engine obtained with `nvm_place_alloc`
+ * @param ops Callbacks to the owner of the data, see `struct nvm_gc_ops`
+ * @param arg Argument passed to the callbacks
+ *
+ * @return On success, an opaque pointer to the initialized garbage-collector
+ * is returned. On error, NULL and `errno` set to indicate the error.
+ */
+struct nvm_gc *nvm_gc_alloc(struct nvm_place *place,
+			    const struct nvm_gc_ops *ops, void *arg);
+
+/**
+ * Destroys the given garbage-collector
+ */
+void nvm_gc_free(struct nvm_gc *gc);
+
+/**
+ * Mark 'nsectr' sectors, starting at 'addr' and within its chunk, as valid or
+ * invalid, may be called concurrently with itself and with `nvm_gc_run`
+ *
+ * @param gc Garbage-collector obtained with `nvm_gc_alloc`
+ * @param addr Address of the first sector
+ * @param nsectr Number of sectors
+ * @param valid Non-zero to mark valid, zero to mark invalid
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_gc_mark(struct nvm_gc *gc, struct nvm_addr addr, int nsectr,
+		int valid);
+
+/**
+ * Reclaim up to 'nchunks' victim chunks, relocating their valid sectors and
+ * returning them to the pools of the placement engine
+ *
+ * Victims after the first are only taken while their valid sectors fit in the
+ * free space left, such that a run does not fail half-way for the lack of
+ * destination chunks.
+ *
+ * @return On success, the number of chunks reclaimed is returned, 0 when
+ * there are no candidates. On error, -1 is returned and `errno` set to
+ * indicate the error
+ */
+int nvm_gc_run(struct nvm_gc *gc, int nchunks);
+
+/**
+ * Limit the relocation bandwidth, such that the remainder is left for
+ * foreground I/O
+ *
+ * @param gc Garbage-collector obtained with `nvm_gc_alloc`
+ * @param nbytes Bytes relocated per second, 0 for unlimited
+ */
+void nvm_gc_set_rate(struct nvm_gc *gc, uint64_t nbytes);
+
+/**
+ * Returns the number of valid sectors of the given chunk
+ *
+ * @return On success, the number of valid sectors is returned. On error, -1
+ * is returned and `errno` set to indicate the error.
+ */
+int nvm_gc_get_nvalid(struct nvm_gc *gc, struct nvm_addr chunk);
+
+/**
+ * Open the FTL on the given device
+ *
+ * The mapping table, from LBA to sector, lives in host memory. It is persisted
+ * by checkpoints in two slots of reserved chunks, written alternately. On open
+ * the newest valid checkpoint is loaded and writes not covered by it are
+ * replayed from the out-of-bound meta-data of the written sectors, which
+ * requires reading all data on the device.
+ *
+ * Writes are striped over all parallel units via `nvm_place`, the logical
+ * capacity is the capacity of the device, minus the checkpoint slots, minus
+ * over-provisioning.
+ *
+ * @note
+ * The FTL owns all chunks of the device, and requires at least 16 bytes of
+ * out-of-bound meta-data per sector. Trims are only persisted by checkpoints.
+ *
+ * @param dev Device handle obtained with `nvm_dev_open`, OCSSD 2.0 only
+ * @param flags Options, see `enum nvm_ftl_opts`
+ *
+ * @return On success, an opaque pointer to the FTL is returned. On error,
+ * NULL and `errno` set to indicate the error.
+ */
+struct nvm_ftl *nvm_ftl_open(struct nvm_dev *dev, int flags);
+
+/**
+ * Checkpoint the mapping table and close the FTL
+ */
+void nvm_ftl_close(struct nvm_ftl *ftl);
+
+/**
+ * Persist the mapping table, including trims, in a checkpoint
+ *
+ * Writes are held back while the table is copied, not while the checkpoint is
+ * written.
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_ftl_flush(struct nvm_ftl *ftl);
+
+/**
+ * Read 'nlbas' logical blocks starting at 'lba', unwritten logical blocks
+ * read as zeroes
+ *
+ * @param ftl FTL obtained with `nvm_ftl_open`
+ * @param lba First logical block to read
+ * @param nlbas Number of logical blocks to read
+ * @param buf Buffer allocated with `nvm_buf_alloc` of 'nlbas' sectors
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_ftl_read(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas, void *buf);
+
+/**
+ * Write 'nlbas' logical blocks starting at 'lba'
+ *
+ * The write is durable when the function returns. Concurrent writes to the
+ * same logical blocks are not ordered with respect to each other.
+ *
+ * @param ftl FTL obtained with `nvm_ftl_open`
+ * @param lba First logical block to write
+ * @param nlbas Number of logical blocks to write, a multiple of ws_min
+ * @param buf Buffer allocated with `nvm_buf_alloc` of 'nlbas' sectors
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, ENOSPC when the device has no free chunks left
+ */
+int nvm_ftl_write(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+		  const void *buf);
+
+/**
+ * Unmap 'nlbas' logical blocks starting at 'lba', they read as zeroes
+ *
+ * @return On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error
+ */
+int nvm_ftl_trim(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas);
+
+/**
+ * Returns the number of logical blocks of the given FTL
+ */
+uint64_t nvm_ftl_get_nlbas(const struct nvm_ftl *ftl);
+
+/**
+ * Returns the garbage-collector of the given FTL
+ *
+ * Writes reclaim a chunk themselves when the device runs out of free chunks,
+ * run `nvm_gc_run` from a background thread to keep that off the write path,
+ * and bound its bandwidth with `nvm_gc_set_rate`.
+ *
+ * @return On success, the garbage-collector is returned. On error, NULL and
+ * `errno` set to indicate the error.
+ */
+struct nvm_gc *nvm_ftl_get_gc(const struct nvm_ftl *ftl);
+
+/**
+ * Opens a group of the given devices, the logical device of the group has the
+ * channels / PUGs of 'devs[0]' followed by those of 'devs[1]' and so forth
+ *
+ * Commands on the logical device, and thereby vblks and ASYNC CTXs created
+ * with it, are routed to the members. A vector command spanning members is
+ * split into one command per member, except ASYNC commands which must address
+ * a single member. Copies must not cross members.
+ *
+ * The NUMA node of the logical device is that of the members when they share
+ * one, otherwise -1. Its affinity is NVM_DEV_AFFINITY_NODE when the node is
+ * known and all members have that affinity, otherwise NVM_DEV_AFFINITY_NONE.
+ *
+ * @note The members must have identical geometry and backend, they are not
+ * closed by `nvm_dev_group_close`
+ *
+ * @param devs Devices to group, as obtained with `nvm_dev_open`
+ * @param ndevs Number of devices in 'devs'
+ *
+ * @return On success, the group is returned. On error, NULL and `errno` set
+ * to indicate the error.
+ */
+struct nvm_dev_group *nvm_dev_group_open(struct nvm_dev *devs[], int ndevs);
+
+/**
+ * Closes the group and its logical device, the members remain open
+ *
+ * @param group The group to close
+ */
+void nvm_dev_group_close(struct nvm_dev_group *group);
+
+/**
+ * Returns the logical device of the given group
+ */
+struct nvm_dev *nvm_dev_group_get_dev(const struct nvm_dev_group *group);
+
+/**
+ * Returns the number of members in the given group
+ */
+int nvm_dev_group_get_ndevs(const struct nvm_dev_group *group);
+
+/**
+ * Returns member 'idx' of the given group
+ *
+ * @return On success, the member is returned. On error, NULL and `errno` set
+ * to indicate the error.
+ */
+struct nvm_dev *nvm_dev_group_get_member(const struct nvm_dev_group *group,
+					 int idx);
+
 /**
  * Boilerplate for working with the API
  *
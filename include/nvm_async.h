@@ -29,12 +29,180 @@
 #ifndef __INTERNAL_NVM_ASYNC_H
 #define __INTERNAL_NVM_ASYNC_H
 
+#include <stdatomic.h>
+#include <bsd/sys/queue.h>
+#include <liblightnvm.h>
+#include <nvm_chunk.h>
+
+/**
+ * A write held back by the sequencer until its predecessor in the chunk has
+ * been submitted
+ */
+struct nvm_async_seq_cmd {
+	struct nvm_chunk_wp *chk;	///< State of the chunk written to
+	uint32_t sectr;			///< First sector written
+	int naddrs;			///< Number of sectors written
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	const void *data;
+	const void *meta;
+	uint16_t flags;
+	struct nvm_ret *ret;
+
+	TAILQ_ENTRY(nvm_async_seq_cmd) link;
+};
+
+/**
+ * Latency window of a parallel unit, one per limit completions
+ */
+struct nvm_async_qdc_pu {
+	uint32_t limit;		///< Limit of outstanding commands
+	uint32_t outstanding;	///< Commands in flight on the parallel unit
+	uint32_t ncpls;		///< Completions in the current window
+	uint64_t sum;		///< Sum of their latencies, in ticks
+	uint64_t base;		///< Baseline of the mean latency, in ticks
+};
+
+/**
+ * Per parallel unit queue-depth controller, see NVM_ASYNC_QDC
+ */
+struct nvm_async_qdc {
+	uint32_t npus;
+	struct nvm_async_qdc_pu pus[];
+};
+
+#define NVM_ASYNC_NPRIOS (NVM_ASYNC_PRIO_LOW + 1)
+
+/**
+ * Reads in flight on a parallel unit, shared by the contexts of a device
+ */
+struct nvm_async_sched_pu {
+	_Alignas(64) atomic_uint_least32_t nreads[NVM_ASYNC_NPRIOS];
+	atomic_uint_least32_t ncpls;	///< Reads completed, wraps
+};
+
+/**
+ * Read-priority scheduling state of a device, see NVM_ASYNC_SCHED
+ */
+struct nvm_async_sched {
+	uint32_t npus;
+	struct nvm_async_sched_pu pus[];
+};
+
+/**
+ * A write, erase or copy held back by the scheduler while reads are in flight
+ * on its parallel unit
+ */
+struct nvm_async_sched_cmd {
+	int op;				///< NVM_DEV_STATS_{WRITE,ERASE,COPY}
+	int pu;				///< Parallel unit of the command
+	uint32_t ncpls;			///< Reads completed on it when held
+	int naddrs;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_addr src[NVM_NADDR_MAX];	///< Source of a COPY
+	const void *data;
+	const void *meta;
+	uint16_t flags;
+	struct nvm_ret *ret;
+
+	TAILQ_ENTRY(nvm_async_sched_cmd) link;
+};
+
 struct nvm_async_ctx {
 	uint32_t depth;		///< IO depth of the ASYNC CTX
 	uint32_t outstanding;	///< Outstanding IO on the ASYNC CTX
+	uint16_t flags;		///< Options given to nvm_async_init
+	int stats_slot;		///< Slot in shared-memory counters, or -1
+
+	// Writes held back by the sequencer, see NVM_ASYNC_SEQ
+	TAILQ_HEAD(, nvm_async_seq_cmd) seq_pending;
+	uint32_t seq_npending;
+
+	struct nvm_async_qdc *qdc;	///< See NVM_ASYNC_QDC, or NULL
+
+	// Writes and erases held back by the scheduler, see NVM_ASYNC_SCHED
+	TAILQ_HEAD(, nvm_async_sched_cmd) sched_held;
+	uint32_t sched_nheld;
+	uint32_t *sched_nheld_pu;	///< Held back per parallel unit
+	struct nvm_async_sched *sched;	///< Of the device, or NULL
+	int sched_release;		///< Set while releasing held back cmds
+	int prio;			///< See nvm_async_set_prio
 
 	// Lower-layer context, e.g. for the implementation of nvm_be_*_async_*
 	void *be_ctx;
 };
 
+/**
+ * Submit a write through the sequencer of the ASYNC CTX in 'ret'
+ */
+int nvm_async_seq_write(struct nvm_dev *dev, struct nvm_addr addrs[],
+			int naddrs, const void *data, const void *meta,
+			uint16_t flags, struct nvm_ret *ret);
+
+static inline int nvm_async_seq_enabled(const struct nvm_ret *ret)
+{
+	return ret && ret->async.ctx && (ret->async.ctx->flags & NVM_ASYNC_SEQ);
+}
+
+/**
+ * Admit an ASYNC command on the parallel unit of 'addr', by the controller of
+ * the context in 'ret'. Commands are admitted as is when the context has no
+ * controller.
+ *
+ * @returns 0 when admitted, -1 and errno EAGAIN when the parallel unit is at
+ * its limit
+ */
+int nvm_async_qdc_enter(struct nvm_dev *dev, struct nvm_addr addr,
+			uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Finish the admission of a command by `nvm_async_qdc_enter`, 'err' is the
+ * result of its submission, failed submissions are returned to the limit
+ */
+void nvm_async_qdc_leave(struct nvm_dev *dev, struct nvm_addr addr,
+			 uint16_t flags, struct nvm_ret *ret, int err);
+
+/**
+ * Account the completion of a command admitted on parallel unit 'pu' of
+ * 'ctx' after 'ticks', adapting the limit of the parallel unit
+ */
+void nvm_async_qdc_cpl(struct nvm_async_ctx *ctx, int pu, uint64_t ticks);
+
+/**
+ * Hold back the write, erase or copy 'op' when reads are in flight on its
+ * parallel unit, by the scheduler of the context in 'ret'. For a copy 'addrs'
+ * are the destination, and 'src' the source addresses, otherwise 'src' is NULL
+ *
+ * @returns 1 when held back, 0 when it is to be submitted, -1 and errno set
+ * on error, EAGAIN when the context is full
+ */
+int nvm_async_sched_hold(struct nvm_dev *dev, int op, struct nvm_addr addrs[],
+			 const struct nvm_addr src[], int naddrs,
+			 const void *data, const void *meta, uint16_t flags,
+			 struct nvm_ret *ret);
+
+/**
+ * Account an ASYNC read on the parallel unit of 'addr' as in flight, for
+ * the scheduler of the context in 'ret'
+ */
+void nvm_async_sched_enter(struct nvm_dev *dev, struct nvm_addr addr,
+			   uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Finish the accounting of a read by `nvm_async_sched_enter`, 'err' is the
+ * result of its submission, failed submissions are no longer in flight
+ */
+void nvm_async_sched_leave(struct nvm_dev *dev, struct nvm_addr addr,
+			   uint16_t flags, struct nvm_ret *ret, int err);
+
+/**
+ * Account the completion of a read accounted on parallel unit 'pu' of 'ctx'
+ */
+void nvm_async_sched_cpl(struct nvm_async_ctx *ctx, int pu);
+
+/**
+ * Free the scheduling state of 'dev', allocated by the first context
+ * initialized with NVM_ASYNC_SCHED
+ */
+void nvm_async_sched_free(struct nvm_dev *dev);
+
 #endif /* __INTERNAL_NVM_ASYNC_H */
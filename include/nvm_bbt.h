@@ -0,0 +1,95 @@
+/*
+ * nvm_bbt - Internal header for the packed bad-block-table cache
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_BBT_H
+#define __INTERNAL_NVM_BBT_H
+
+#include <stdatomic.h>
+#include <liblightnvm.h>
+#include <nvm_rcu.h>
+
+#define NVM_BBT_NCODES 5	///< # of states, see `enum nvm_bbt_state`
+#define NVM_BBT_NSLICES 3	///< # of bits needed to encode a state
+#define NVM_BBT_NTHREADS 16	///< Max. # of threads of nvm_bbt_get_all
+#define NVM_BBT_SNAP_PATH_LEN 4096
+
+/**
+ * Cached bad-block-table of a LUN, the state of each block is encoded as a
+ * 3-bit code and stored bit-sliced: bit 'i' of slice 's' is bit 's' of the
+ * code of block 'i', such that each state is counted with popcount
+ */
+struct nvm_bbt_pack {
+	struct nvm_rcu_node node;	///< Retirement once replaced
+	struct nvm_addr addr;		///< Address of the LUN
+	uint64_t nblks;			///< # of blocks x planes in the LUN
+	size_t nwords;			///< # of words per slice
+	uint32_t nbad;			///< # of manufacturer marked bad blocks
+	uint32_t ngbad;			///< # of grown bad blocks
+	uint32_t ndmrk;			///< # of device reserved/marked blocks
+	uint32_t nhmrk;			///< # of host reserved/marked blocks
+	int loaded;			///< From a snapshot, not yet validated
+	struct nvm_bbt *_Atomic view;	///< Unpacked table from nvm_bbt_get
+	uint64_t slices[];		///< NVM_BBT_NSLICES x nwords
+};
+
+/**
+ * Cache entry of a LUN. Once published, a pack is immutable: readers enter
+ * 'rcu' and load 'pack' without locking, writers serialize on 'lock',
+ * publish a modified copy and retire the replaced pack, which is freed once
+ * no reader can reference it
+ */
+struct nvm_bbt_slot {
+	struct nvm_bbt_pack *_Atomic pack;	///< Current version, or NULL
+	atomic_flag lock;			///< Serializes writers
+	struct nvm_rcu rcu;			///< Replaced versions of 'pack'
+};
+
+int nvm_bbt_cache_init(struct nvm_dev *dev);
+
+void nvm_bbt_cache_free(struct nvm_dev *dev);
+
+#define NVM_BBT_SNAP_MAGIC 0x50414e5354424256ULL	///< "VBBTSNAP"
+#define NVM_BBT_SNAP_VERSION 1
+
+/**
+ * Header of a bad-block-table snapshot file, followed by one record per LUN
+ * consisting of a present-flag, the counters and the slices
+ */
+struct nvm_bbt_snap {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t verid;
+	uint64_t gen;			///< Generation given by the user
+	uint8_t nguid[16];		///< Identity of the namespace
+	uint8_t eui64[8];
+	uint32_t nchannels;		///< Geometry the snapshot was taken of
+	uint32_t nluns;
+	uint32_t nplanes;
+	uint32_t nblocks;
+	uint64_t nbbts;
+};
+
+#endif /* __INTERNAL_NVM_BBT_H */
@@ -264,9 +264,57 @@ int nvm_be_populate_quirks(struct nvm_dev *dev, const char serial[]);
 
 /**
  * Produce a device with a backend attached
+ *
+ * When the environment variable `NVM_DEV_CACHE` names a directory, the
+ * backend and identify data of successfully opened devices are stored there.
+ * Re-opening a device then tries the remembered backend first and skips the
+ * identify commands, see `nvm_be_cache_get`
  */
 struct nvm_dev *nvm_be_factory(const char *dev_ident, int flags);
 
+#define NVM_BE_CACHE_MAGIC 0x4548434143454256ULL	///< "VBECACHE"
+#define NVM_BE_CACHE_VERSION 2
+#define NVM_BE_CACHE_SN_LEN 24		///< NVMe serial number and terminator
+
+/**
+ * Identify data of a device as stored in the open cache, keyed by the device
+ * identifier and the serial number of its controller. When the identifier is
+ * a device node, also by its device number and inode change time, which
+ * change when the node is re-created
+ */
+struct nvm_be_cache {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t bid;			///< Backend which opened the device
+	char ident[NVM_DEV_PATH_LEN];	///< Device identifier
+	uint64_t rdev;			///< Device number of the node, or 0
+	int64_t ctime_sec;		///< Inode change time of the node, or 0
+	int64_t ctime_nsec;
+	char serial[NVM_BE_CACHE_SN_LEN];///< Serial number, or empty
+	int nsid;			///< NVMe namespace identifier
+	struct nvm_nvme_ns ns;		///< NVMe namespace identify content
+	struct nvm_spec_idfy idfy;	///< Content from IDFY commands
+};
+
+/**
+ * Retrieve the cached identify data of the device currently being opened by
+ * `nvm_be_factory`, backends use it in place of issuing identify commands
+ *
+ * @returns The cache entry when it matches the path and nsid of the given
+ * device, NULL otherwise
+ */
+const struct nvm_be_cache *nvm_be_cache_get(const struct nvm_dev *dev);
+
+/**
+ * Report the serial number of the controller of the device being opened, for
+ * backends which learn it only once attached e.g. SPDK. It is stored with the
+ * cache entry of the device, and a cached entry of another serial number is
+ * dropped, such that the device is identified anew
+ *
+ * @returns 0 when the cached entry, if any, matches, -1 otherwise
+ */
+int nvm_be_cache_serial(const char *sn, size_t len);
+
 extern struct nvm_be nvm_be_ioctl;
 extern struct nvm_be nvm_be_lbd;
 extern struct nvm_be nvm_be_spdk;
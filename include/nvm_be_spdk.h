@@ -34,21 +34,36 @@
 #define NVM_BE_SPDK_QPAIR_MAX 64
 #define NVM_BE_SPDK_ALIGN 0x1000
 
+/**
+ * Controller attached on behalf of one or more devices, shared by all
+ * namespaces and handles of the controller within the process
+ */
+struct nvm_be_spdk_ctrlr {
+	struct spdk_nvme_transport_id trid;
+	struct spdk_nvme_ctrlr *ctrlr;
+	int nrefs;			///< # of devices using the controller
+
+	struct spdk_nvme_qpair *qpair;	///< QPAIR for SYNC IO commands
+	omp_lock_t qpair_lock;		///< LOCK for SYNC IO commands
+
+	struct nvm_be_spdk_ctrlr *next;	///< Next in the registry
+};
+
 /**
  * Internal representation of NVM_BE_SPDK state
  */
 struct nvm_be_spdk_state {
 	struct spdk_nvme_transport_id trid;
-	struct spdk_env_opts opts;
+	struct nvm_be_spdk_ctrlr *shared;///< Registry entry of 'ctrlr'
 	struct spdk_nvme_ctrlr *ctrlr;
 	struct spdk_nvme_ns *ns;
 	struct spdk_nvme_ns_data nsdata;
 	uint16_t nsid;
-	int attached;
+	int socket;			///< NUMA node of 'ctrlr', or -1
 
 	int vam_outstanding;		///< Outstanding SYNC ADMIN commands
 	struct spdk_nvme_qpair *qpair;	///< QPAIR for SYNC IO commands
-	omp_lock_t qpair_lock;		///< LOCK for SYNC IO commands
+	omp_lock_t *qpair_lock;		///< LOCK for SYNC IO commands
 };
 
 struct nvm_be_spdk_state *nvm_be_spdk_state_init(const char *ident, int flags);
@@ -0,0 +1,78 @@
+/*
+ * nvm_buf_pool - Internal header for pools of IO buffers
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_BUF_POOL_H
+#define __INTERNAL_NVM_BUF_POOL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <liblightnvm.h>
+#include <nvm_thrd.h>
+
+#define NVM_BUF_POOL_NCACHES NVM_THRD_NSLOTS	///< One per thread slot
+#define NVM_BUF_POOL_CACHE_LEN 32	///< Objects held by a cache
+#define NVM_BUF_POOL_HPAGE_NBYTES (2ULL << 20)
+#define NVM_BUF_POOL_GPAGE_NBYTES (1ULL << 30)
+
+/**
+ * Memory backing the slab of a pool
+ */
+enum nvm_buf_pool_backing {
+	NVM_BUF_POOL_DMA = 0x1,		///< spdk_dma_malloc, for SPDK backends
+	NVM_BUF_POOL_HUGETLB = 0x2,	///< mmap of 2 MiB or 1 GiB hugepages
+	NVM_BUF_POOL_THP = 0x3,		///< mmap advised for transparent hugepages
+};
+
+/**
+ * Cache of free objects, a thread uses the cache of its slot such that it
+ * rarely contends on the shared free-list, nor on the lock of the cache
+ */
+struct nvm_buf_pool_cache {
+	_Alignas(64) atomic_flag lock;
+	uint32_t nobjs;
+	uint32_t objs[NVM_BUF_POOL_CACHE_LEN];	///< Object index + 1
+};
+
+struct nvm_buf_pool {
+	const struct nvm_dev *dev;
+	char *slab;			///< 'count' objects of 'obj_size' bytes
+	size_t slab_nbytes;		///< # bytes mapped at 'slab'
+	size_t obj_size;
+	uint32_t count;
+	int backing;			///< See enum nvm_buf_pool_backing
+
+	/**
+	 * Lock-free free-list of objects not held by a cache, the lower 32 bits
+	 * is the index + 1 of the first object, the upper 32 bits is a tag
+	 * bumped on every update, preventing ABA
+	 */
+	_Atomic uint64_t head;
+	_Atomic uint32_t *next;		///< Successor on free-list, index + 1
+
+	struct nvm_buf_pool_cache caches[NVM_BUF_POOL_NCACHES];
+};
+
+#endif /* __INTERNAL_NVM_BUF_POOL_H */
@@ -0,0 +1,97 @@
+/*
+ * nvm_chunk - internal header for liblightnvm
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_CHUNK_H
+#define __INTERNAL_NVM_CHUNK_H
+
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+enum nvm_chunk_punit_state {
+	NVM_CHUNK_PUNIT_UNINIT = 0,	///< Write-pointers not yet loaded
+	NVM_CHUNK_PUNIT_LOADING = 1,	///< A thread is loading write-pointers
+	NVM_CHUNK_PUNIT_READY = 2	///< Write-pointers loaded
+};
+
+#define NVM_CHUNK_WP_RESET UINT32_MAX	///< 'wp' and 'sub' of a chunk being reset
+
+/**
+ * Host-side state of a chunk used by `nvm_chunk_append`
+ *
+ * 'wp' is advanced by reservation, 'sub' trails it and is advanced once the
+ * write covering the sectors in front of it has been submitted, thus a writer
+ * holding the reservation [wp, wp + nsectr) submits when 'sub' equals 'wp'.
+ * `nvm_chunk_reset` claims the chunk by setting both to NVM_CHUNK_WP_RESET.
+ */
+struct nvm_chunk_wp {
+	atomic_uint_least32_t wp;	///< Next sector to reserve
+	atomic_uint_least32_t sub;	///< Next sector to submit
+	atomic_int err;			///< Sticky errno of a failed submission
+};
+
+struct nvm_chunk_tbl {
+	size_t npunits;			///< Total # of parallel units
+	size_t nchunks;			///< Total # of chunks
+	atomic_int *punits;		///< Load state of each parallel unit
+	struct nvm_chunk_wp *chunks;	///< State of each chunk
+};
+
+/**
+ * Retrieve the host-side state of the chunk at 'addr', loading the
+ * write-pointers of its parallel unit from the device on first use
+ */
+struct nvm_chunk_wp *nvm_chunk_wp_get(struct nvm_dev *dev,
+				      struct nvm_addr addr);
+
+void nvm_chunk_tbl_free(struct nvm_dev *dev);
+
+/**
+ * Advance the host-side state of the chunks written by a successful write,
+ * chunks of parallel units not yet loaded are left alone
+ */
+void nvm_chunk_tbl_advance(struct nvm_dev *dev, struct nvm_addr addrs[],
+			   int naddrs, int scalar);
+
+/**
+ * Rewind the host-side state of the chunks reset by a successful synchronous
+ * erase, chunks of parallel units not yet loaded are left alone
+ */
+void nvm_chunk_tbl_rewind(struct nvm_dev *dev, struct nvm_addr addrs[],
+			  int naddrs);
+
+/**
+ * Raise the value of 'wp' to 'val', when it is below it
+ */
+static inline void nvm_chunk_wp_max(atomic_uint_least32_t *wp,
+				    uint_least32_t val)
+{
+	uint_least32_t cur = atomic_load(wp);
+
+	while ((cur < val) && !atomic_compare_exchange_weak(wp, &cur, val))
+		;
+}
+
+#endif /* __INTERNAL_NVM_CHUNK_H */
@@ -71,6 +71,26 @@ struct nvm_cmd_wrap *nvm_cmd_wrap_pass(struct nvm_dev *dev,
 
 void nvm_cmd_wrap_term(struct nvm_cmd_wrap *wrap);
 
+/**
+ * Returns the addressing mode, NVM_CMD_SCALAR or NVM_CMD_VECTOR, of a command
+ * with the given 'flags', falling back to the device default
+ */
+int nvm_cmd_addr_mode(const struct nvm_dev *dev, uint16_t flags);
+
+/**
+ * Returns the opcode of a command of class 'op', one of enum
+ * nvm_dev_stats_op, issued with the given 'flags'
+ */
+uint16_t nvm_cmd_opcode(const struct nvm_dev *dev, int op, uint16_t flags);
+
+/**
+ * Submit a write directly to the backend, bypassing the ASYNC sequencer and
+ * without updating host-side chunk state
+ */
+int nvm_cmd_write_be(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		     const void *data, const void *meta, uint16_t flags,
+		     struct nvm_ret *ret);
+
 void nvm_cmd_wrap_cpl(struct nvm_cmd_wrap *wrap,
 		      const struct nvm_nvme_cpl *cpl);
 
@@ -56,8 +56,17 @@ struct nvm_dev {
 	} vblk_opts;
 	int bbts_cached;		///< Whether to cache bbts
 	size_t nbbts;			///< Number of entries in cache
-	struct nvm_bbt **bbts;		///< Cache of bad-block-tables
+	struct nvm_bbt_slot *bbts;	///< Cache of bad-block-tables
+	struct nvm_chunk_tbl *_Atomic chunk_tbl;///< Host-side chunk state
+	struct nvm_stats *_Atomic stats;///< Latency histograms
+	struct nvm_stats_shm *stats_shm;///< Live counters in shared-memory
+	struct nvm_trace *trace;	///< Command trace, see nvm_dev_set_trace
+	struct nvm_probes *probes;	///< CPU cost per phase, see nvm_probe.h
+	struct nvm_async_sched *_Atomic sched;///< See NVM_ASYNC_SCHED
 	int quirks;			///< Mask representing known quirks
+	int numa_node;			///< NUMA node of the device, or -1
+	struct nvm_numa_cpus *numa_cpus;///< CPUs of 'numa_node', or NULL
+	int affinity;			///< See enum nvm_dev_affinity
 	struct nvm_be *be;		///< Backend interface
 	void *be_state;			///< Backend state
 	int cmd_opts;			///< Default options for CMD execution
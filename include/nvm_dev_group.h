@@ -0,0 +1,65 @@
+/*
+ * nvm_dev_group - Internal header for multi-device groups
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_DEV_GROUP_H
+#define __INTERNAL_NVM_DEV_GROUP_H
+
+#include <liblightnvm.h>
+#include <nvm_be.h>
+
+/**
+ * Group of devices with identical geometry, exposed as a logical device whose
+ * channels, or PUGs, are the concatenation of those of the members
+ */
+struct nvm_dev_group {
+	struct nvm_dev *dev;		///< Logical device of the group
+	struct nvm_be be;		///< Backend routing commands to members
+	size_t nchannels;		///< # of channels / PUGs of each member
+	int ndevs;			///< # of members
+	struct nvm_dev *devs[];		///< Members, in order of their channels
+};
+
+/**
+ * ASYNC command submitted to a member, restores the command context of the
+ * group once the member completes it
+ */
+struct nvm_dev_group_cmd {
+	struct nvm_async_ctx *ctx;	///< ASYNC CTX of the group
+	nvm_async_cb cb;		///< Callback given by the user
+	void *cb_arg;			///< Callback arguments given by the user
+};
+
+/**
+ * Lower-layer context of an ASYNC CTX of a group, one ASYNC CTX per member
+ */
+struct nvm_dev_group_async {
+	struct nvm_dev_group_cmd *cmds;	///< One per command in flight
+	struct nvm_dev_group_cmd **free;///< Stack of unused 'cmds'
+	uint32_t nfree;
+	struct nvm_async_ctx *ctxs[];	///< Per member ASYNC CTX
+};
+
+#endif /* __INTERNAL_NVM_DEV_GROUP_H */
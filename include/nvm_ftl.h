@@ -0,0 +1,90 @@
+/*
+ * nvm_ftl - Internal header for the host-side page-mapped FTL
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_FTL_H
+#define __INTERNAL_NVM_FTL_H
+
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+#define NVM_FTL_UNMAPPED UINT64_MAX	///< Map entry of an unwritten LBA
+#define NVM_FTL_CP_MAGIC 0x50434c54464d564eULL	///< "NVMFTLCP"
+#define NVM_FTL_CP_VERSION 1
+#define NVM_FTL_CP_NSLOTS 2		///< Checkpoints alternate between slots
+#define NVM_FTL_OP 10			///< Over-provisioning, in percent
+#define NVM_FTL_GC_NCHUNKS 4		///< Chunks reclaimed by a full writer
+
+enum nvm_ftl_stream {
+	NVM_FTL_STREAM_USER = 0,	///< Writes issued via nvm_ftl_write
+	NVM_FTL_STREAM_NR
+};
+
+/**
+ * Meta-data written to the out-of-bound area of every sector of user data
+ */
+struct nvm_ftl_oob {
+	uint64_t lba;			///< LBA of the sector
+	uint64_t seq;			///< Sequence # of the write of the sector
+};
+
+/**
+ * Header and footer of a checkpoint, a checkpoint is valid when both are
+ * present and equal
+ */
+struct nvm_ftl_cp {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t map_nsectr;		///< # of sectors of the mapping table
+	uint64_t gen;			///< Generation, the newest valid wins
+	uint64_t seq;			///< Writes from this seq. # are not covered
+	uint64_t nlbas;
+};
+
+struct nvm_ftl {
+	struct nvm_dev *dev;
+	struct nvm_place *place;	///< Striped append of user data
+	uint64_t nlbas;			///< Logical capacity, in sectors
+	atomic_uint_least64_t *map;	///< LBA to addr.val, or NVM_FTL_UNMAPPED
+	uint64_t *p2l;			///< Sector of the device to LBA
+	struct nvm_gc *gc;		///< Fed with the validity of sectors
+
+	atomic_uint_least64_t seq;	///< Sequence # of the next write
+	atomic_int nwriters;		///< # of writes updating the map
+	atomic_int gate;		///< Holds back writers while non-zero
+
+	uint64_t gc_seq;		///< Sequence # + 1 of stamped relocations
+	int gc_dirty;			///< Relocations not covered by the scan
+
+	atomic_flag cp_lock;		///< Serializes checkpoints
+	atomic_uint_least64_t cp_seq;	///< Sequence # of the latest snapshot
+	char *cp_buf;			///< Bounce buffer of the checkpoints
+	uint64_t cp_gen;		///< Generation of the latest checkpoint
+	int cp_slot;			///< Slot of the latest checkpoint
+	int cp_nchunks;			///< # of reserved chunks per slot
+	size_t cp_nsectr;		///< # of sectors per checkpoint
+};
+
+#endif /* __INTERNAL_NVM_FTL_H */
@@ -0,0 +1,74 @@
+/*
+ * nvm_gc - Internal header for garbage-collection of chunks
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_GC_H
+#define __INTERNAL_NVM_GC_H
+
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+struct nvm_gc_chunk {
+	atomic_uint_least32_t nvalid;	///< # of bits set in the valid bitmap
+	atomic_uint_least64_t stamp;	///< Clock of the latest write, 0: unused
+};
+
+struct nvm_gc {
+	struct nvm_dev *dev;
+	struct nvm_place *place;	///< Source of destination chunks
+	struct nvm_gc_ops ops;
+	void *arg;			///< Argument to the ops
+
+	size_t nchunks;			///< Total # of chunks of the device
+	size_t nwords;			///< # of bitmap words per chunk
+	struct nvm_gc_chunk *chunks;
+	atomic_uint_least64_t *valid;	///< Valid bitmaps, 'nwords' per chunk
+	atomic_uint_least64_t clock;	///< Logical clock, ticks on every write
+
+	atomic_flag lock;		///< Serializes nvm_gc_run
+	int copy;			///< Backend supports vector copy
+	struct nvm_addr dst;		///< Chunk being filled by relocation
+	struct nvm_addr spare;		///< Kept for when the pools run dry
+	size_t cursor;			///< PU to take the next chunk from
+
+	uint64_t rate;			///< Sectors per second, 0: unlimited
+	double tokens;			///< Sectors that can be moved right now
+	uint64_t tstamp;		///< Time of the latest refill, in nsec
+
+	int nbatch;			///< Sectors per command, ws_min multiple
+	struct nvm_addr *src;		///< Sectors of the victim to relocate
+
+	char *data;			///< Bounce buffers when copy is missing,
+	char *meta;			///< two halves of 'nbatch' sectors
+};
+
+/**
+ * Make the chunks written before the placement engine was loaded, e.g. left
+ * open by a prior session, candidates for reclaim, their sectors count as
+ * invalid unless the owner marks them valid
+ */
+void nvm_gc_adopt(struct nvm_gc *gc);
+
+#endif /* __INTERNAL_NVM_GC_H */
@@ -0,0 +1,71 @@
+/*
+ * nvm_numa - Internal header for NUMA placement of buffers and threads
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_NUMA_H
+#define __INTERNAL_NVM_NUMA_H
+
+#include <liblightnvm.h>
+
+/**
+ * Returns the NUMA node of the block device named 'name' e.g. "nvme0n1", as
+ * reported by sysfs, or -1 when unknown
+ */
+int nvm_numa_node_sysfs(const char *name);
+
+/**
+ * Prefer allocating the pages of 'buf' on 'node', must be called before the
+ * pages are touched. Pages only partially covered by 'buf' are left alone.
+ */
+int nvm_numa_bind(void *buf, size_t nbytes, int node);
+
+/**
+ * Parse the CPUs of the node of 'dev' from sysfs, once per device, for
+ * nvm_numa_affinity_apply. When the node or its CPUs are unknown, -1 is
+ * returned and the CPUs of 'dev' are left NULL
+ */
+int nvm_numa_cpus_init(struct nvm_dev *dev);
+
+/**
+ * Free the CPUs parsed by nvm_numa_cpus_init
+ */
+void nvm_numa_cpus_free(struct nvm_dev *dev);
+
+/**
+ * Bind the calling OpenMP worker to the CPUs of the node of 'dev' when the
+ * affinity of 'dev' is NVM_DEV_AFFINITY_NODE, the calling thread of a team is
+ * left alone. The mask of the worker is saved for nvm_numa_affinity_restore,
+ * which the worker must call before leaving the parallel region, as the
+ * thread pool is shared with the application.
+ */
+int nvm_numa_affinity_apply(const struct nvm_dev *dev);
+
+/**
+ * Restore the mask saved by nvm_numa_affinity_apply, a no-op when the calling
+ * thread was not bound
+ */
+int nvm_numa_affinity_restore(void);
+
+#endif /* __INTERNAL_NVM_NUMA_H */
@@ -0,0 +1,76 @@
+/*
+ * nvm_place - internal header for liblightnvm
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_PLACE_H
+#define __INTERNAL_NVM_PLACE_H
+
+#include <stdatomic.h>
+#include <liblightnvm.h>
+
+#define NVM_PLACE_NONE UINT64_MAX	///< Open-chunk slot without a chunk
+
+/**
+ * Pool of free chunks in a parallel unit, shared by all streams
+ */
+struct nvm_place_pu {
+	atomic_flag lock;		///< Guards 'nfree' and 'free'
+	uint32_t nfree;			///< # of chunks in 'free'
+	uint32_t *free;			///< Stack of free chunk indexes
+	uint32_t nleft;			///< # of chunks in 'left'
+	uint32_t *left;			///< Written before the engine was loaded
+};
+
+struct nvm_place_stream {
+	atomic_uint_least64_t cursor;	///< Round-robin over the PUs
+	size_t *punits;			///< Index of the PUs of the stream
+	atomic_uint_least64_t *open;	///< Open chunk in each PU, as addr.val
+};
+
+struct nvm_place {
+	struct nvm_dev *dev;
+	int nstreams;			///< # of streams
+	int width;			///< # of PUs of each stream
+	size_t npunits;			///< Total # of parallel units
+	struct nvm_place_pu *pus;	///< Free chunks, per parallel unit
+	struct nvm_place_stream *streams;
+};
+
+/**
+ * Take the given chunk out of the pool of its parallel unit, or out of the
+ * chunks written before the engine was loaded, e.g. a chunk reserved by the
+ * user of the engine at a fixed address
+ *
+ * @returns 0 when the chunk was taken, -1 when it was in neither
+ */
+int nvm_place_chunk_take(struct nvm_place *place, struct nvm_addr chunk);
+
+/**
+ * Determine whether the given chunk is the open chunk of a stream, a full chunk
+ * which is not open never becomes open again
+ */
+int nvm_place_chunk_is_open(struct nvm_place *place, struct nvm_addr chunk);
+
+#endif /* __INTERNAL_NVM_PLACE_H */
@@ -0,0 +1,121 @@
+/*
+ * nvm_probe - Host CPU cost of commands broken down by phase
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_PROBE_H
+#define __INTERNAL_NVM_PROBE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_stats.h>
+#include <nvm_thrd.h>
+
+/**
+ * Probes bracket the phases of a command with NVM_PROBE_BGN and NVM_PROBE_END,
+ * they are compiled in with NVM_PROBES_ENABLED and expand to nothing without.
+ *
+ * Phases nest, e.g. the user callback runs within completion dispatch, the
+ * ticks of a phase exclude those of the phases nested within it such that the
+ * phases of a thread add up to the time spent in the probed code.
+ */
+#ifdef NVM_PROBES_ENABLED
+
+#define NVM_PROBE_NSLOTS NVM_THRD_NSLOTS	///< One per thread slot
+
+/**
+ * Counters of a thread, threads are assigned slots round-robin
+ */
+struct nvm_probe_slot {
+	_Alignas(64) atomic_uint_least64_t count[NVM_DEV_PROBE_NPHASES];
+	atomic_uint_least64_t ticks[NVM_DEV_PROBE_NPHASES];
+};
+
+struct nvm_probes {
+	uint64_t tsc0;			///< Tick at allocation
+	uint64_t ns0;			///< Nanosecond at allocation
+	struct nvm_probe_slot slots[NVM_PROBE_NSLOTS];
+};
+
+struct nvm_probe_clk {
+	uint64_t tsc;			///< Tick at the beginning of the phase
+	uint64_t acct;			///< Ticks accounted by the thread then
+};
+
+extern _Thread_local uint64_t nvm_probe_acct;	///< Ticks accounted
+
+static inline void nvm_probe_bgn(struct nvm_probe_clk *clk)
+{
+	clk->tsc = nvm_stats_tsc();
+	clk->acct = nvm_probe_acct;
+}
+
+static inline void nvm_probe_end(struct nvm_dev *dev, int phase,
+				 const struct nvm_probe_clk *clk)
+{
+	const uint64_t ticks = nvm_stats_tsc() - clk->tsc;
+	const uint64_t nested = nvm_probe_acct - clk->acct;
+	struct nvm_probe_slot *slot;
+
+	nvm_probe_acct = clk->acct + ticks;	// Enclosing phases exclude it
+
+	if (!dev->probes)
+		return;
+
+	// Only shared by threads beyond NVM_THRD_NSLOTS, thus uncontended
+	slot = &dev->probes->slots[nvm_thrd_slot()];
+	atomic_fetch_add_explicit(&slot->count[phase], 1,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&slot->ticks[phase],
+				  ticks > nested ? ticks - nested : 0,
+				  memory_order_relaxed);
+}
+
+#define NVM_PROBE_BGN(clk)						\
+	struct nvm_probe_clk clk;					\
+	nvm_probe_bgn(&clk)
+
+#define NVM_PROBE_END(dev, phase, clk)					\
+	nvm_probe_end(dev, phase, &clk)
+
+#else
+
+#define NVM_PROBE_BGN(clk)
+#define NVM_PROBE_END(dev, phase, clk)
+
+#endif
+
+/**
+ * Setup, reset, and teardown of the probes of a device, no-ops without
+ * NVM_PROBES_ENABLED
+ */
+void nvm_probe_init(struct nvm_dev *dev);
+
+void nvm_probe_reset(struct nvm_dev *dev);
+
+void nvm_probe_free(struct nvm_dev *dev);
+
+#endif /* __INTERNAL_NVM_PROBE_H */
@@ -0,0 +1,109 @@
+/*
+ * nvm_rcu - Internal header for deferred reclamation of published versions
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_RCU_H
+#define __INTERNAL_NVM_RCU_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <nvm_thrd.h>
+
+/**
+ * Header embedded in objects published to lock-free readers. Writers never
+ * modify a published object, they publish a modified copy and retire the
+ * replaced object, which is destroyed once no reader can hold a reference,
+ * see `nvm_rcu_reclaim`
+ */
+struct nvm_rcu_node {
+	struct nvm_rcu_node *next;		///< Next on the retired list
+	void (*dtor)(struct nvm_rcu_node *node);///< Destroys the object
+};
+
+/**
+ * Record of a reader without an exclusive thread slot, claimed by the reader
+ * on first use and released by `nvm_rcu_reclaim` once the reader has exited
+ */
+struct nvm_rcu_rec {
+	struct nvm_rcu_rec *next;		///< Immutable once pushed
+	struct nvm_thrd_life *_Atomic owner;	///< Reader, or NULL when free
+	struct nvm_rcu_node *_Atomic held;	///< Or NULL
+};
+
+/**
+ * Objects retired from a published pointer, awaiting reclamation, and the
+ * objects held by its readers.
+ *
+ * A reader announces the object it holds in the record of its thread slot,
+ * then verifies that the object is still published, a retired object is
+ * destroyed once no record announces it. Each reader holds at most one object,
+ * thus at most one retired object per reader is kept. Records carry the
+ * generation of the slot, those left by exited threads are ignored.
+ *
+ * Readers without an exclusive thread slot announce what they hold in a record
+ * of 'recs' instead, owned by the reader until it exits, after which the
+ * record is reused by another such reader.
+ */
+struct nvm_rcu {
+	struct nvm_rcu_node *_Atomic held[NVM_THRD_NSLOTS];	///< Or NULL
+	atomic_uint gens[NVM_THRD_NSLOTS];	///< Generation of 'held' slots
+	struct nvm_rcu_rec *_Atomic recs;	///< Readers sharing slots
+	struct nvm_rcu_node *_Atomic retired;	///< Lock-free list of retired
+};
+
+void nvm_rcu_init(struct nvm_rcu *rcu);
+
+/**
+ * Announce that the calling thread holds 'node', replacing the object it held
+ * before, NULL announces none.
+ *
+ * The caller must load the published pointer again afterwards, 'node' is
+ * protected from reclamation when it is still published, otherwise it may
+ * already be retired and the caller must retry with the one published
+ *
+ * @returns 0 on success, -1 and errno set when a reader without an exclusive
+ * slot cannot allocate its record, then 'node' is not protected
+ */
+int nvm_rcu_protect(struct nvm_rcu *rcu, struct nvm_rcu_node *node);
+
+/**
+ * Defer destruction of a replaced object, may be called concurrently
+ */
+void nvm_rcu_retire(struct nvm_rcu *rcu, struct nvm_rcu_node *node);
+
+/**
+ * Destroy the retired objects which no reader can hold a reference to, and
+ * release the records of exited readers. Calls are serialized by the caller,
+ * e.g. by the lock of the writers
+ */
+void nvm_rcu_reclaim(struct nvm_rcu *rcu);
+
+/**
+ * Destroy all retired objects, the caller guarantees that there are no
+ * readers, e.g. when the device is closed
+ */
+void nvm_rcu_term(struct nvm_rcu *rcu);
+
+#endif /* __INTERNAL_NVM_RCU_H */
@@ -29,22 +29,73 @@
 #ifndef __INTERNAL_NVM_SGL_H
 #define __INTERNAL_NVM_SGL_H
 
+#include <stdatomic.h>
 #include <nvm_dev.h>
+#include <nvm_thrd.h>
 
-#include <bsd/sys/queue.h>
+#define NVM_SGL_SEG_NDESCR 256	///< Descriptors in a segment, one 4K page
+#define NVM_SGL_SEG_NDATA (NVM_SGL_SEG_NDESCR - 1)	///< Last chains
+#define NVM_SGL_POOL_SLAB_NSEGS 16	///< Segments allocated at a time
+#define NVM_SGL_POOL_NMAGS NVM_THRD_NSLOTS	///< One per thread slot
+#define NVM_SGL_POOL_MAG_LEN 16		///< SGLs / segments in a magazine
+
+/**
+ * Segment of SGL descriptors, the last descriptor of a segment followed by
+ * another is a Segment or Last Segment descriptor of its successor
+ */
+struct nvm_sgl_seg {
+	struct nvm_nvme_sgl_descriptor *descr;	///< NVM_SGL_SEG_NDESCR
+	uint64_t phys;				///< Bus address of 'descr'
+	struct nvm_sgl_seg *next;
+};
 
 struct nvm_sgl {
-	struct nvm_nvme_sgl_descriptor *indirect, *descriptors;
-	int ndescr, nalloc;
+	struct nvm_dev *dev;
+	struct nvm_sgl_pool *pool;	///< Owner of 'segs', NULL if none
+	struct nvm_nvme_sgl_descriptor *indirect;
+	struct nvm_sgl_seg *segs;	///< Chain of segments
+	struct nvm_sgl_seg *cur;	///< Segment receiving descriptors
+	int ndescr;			///< # data descriptors
 	size_t len;
 
-	SLIST_ENTRY(nvm_sgl) free_list;
+	struct nvm_sgl *next;		///< Linkage on pool free-lists
+};
+
+/**
+ * Descriptor pages of a pool, allocated at once
+ */
+struct nvm_sgl_slab {
+	void *pages;
+	struct nvm_sgl_seg segs[NVM_SGL_POOL_SLAB_NSEGS];
+	struct nvm_sgl_slab *next;
+};
+
+/**
+ * Magazine of free SGLs and segments, a thread uses the magazine of its slot
+ * and only takes the lock of the depot to exchange half a magazine
+ */
+struct nvm_sgl_mag {
+	_Alignas(64) atomic_flag lock;
+	struct nvm_sgl *sgls;
+	int nsgls;
+	struct nvm_sgl_seg *segs;
+	int nsegs;
 };
 
 struct nvm_sgl_pool {
 	struct nvm_dev *dev;
 
-	SLIST_HEAD(, nvm_sgl) free_list;
+	atomic_flag lock;		///< Protects the depot and 'slabs'
+	struct nvm_sgl *sgls;		///< Depot of free SGLs
+	struct nvm_sgl_seg *segs;	///< Depot of free segments
+	struct nvm_sgl_slab *slabs;
+
+	struct nvm_sgl_mag mags[NVM_SGL_POOL_NMAGS];
 };
 
+/**
+ * Fill 'dptr' with the descriptor of the entire SGL, chaining its segments
+ */
+void nvm_sgl_dptr(struct nvm_sgl *sgl, struct nvm_nvme_sgl_descriptor *dptr);
+
 #endif /* __INTERNAL_NVM_SGL_H */
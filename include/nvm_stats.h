@@ -0,0 +1,198 @@
+/*
+ * nvm_stats - Per-command latency histograms
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_STATS_H
+#define __INTERNAL_NVM_STATS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+
+/**
+ * Histograms are log-linear: values below NVM_STATS_SUB have a bucket each,
+ * each power of two above is split in NVM_STATS_SUB buckets, values of
+ * 2^NVM_STATS_MAG and above land in the last bucket
+ */
+#define NVM_STATS_SUB_BITS 4
+#define NVM_STATS_SUB (1 << NVM_STATS_SUB_BITS)
+#define NVM_STATS_MAG 40
+#define NVM_STATS_NBUCKETS ((NVM_STATS_MAG - NVM_STATS_SUB_BITS + 1) * \
+			    NVM_STATS_SUB)
+
+/**
+ * Latency histogram of a class of commands on a parallel unit, in ticks
+ */
+struct nvm_stats_hist {
+	atomic_uint_least64_t count;	///< # of commands
+	atomic_uint_least64_t sum;	///< Sum of latencies
+	atomic_uint_least64_t min;	///< Minimum latency
+	atomic_uint_least64_t max;	///< Maximum latency
+	atomic_uint_least64_t buckets[NVM_STATS_NBUCKETS];
+};
+
+/**
+ * Live counters published in POSIX shared-memory, see nvm_dev_set_stats_shm.
+ * The segment is named NVM_STATS_SHM_PREFIX<pid>-<seq>-<dev name>, where seq
+ * numbers the segments of a process, and is read by the nvm_stat tool.
+ */
+#define NVM_STATS_SHM_PREFIX "liblightnvm-"
+#define NVM_STATS_SHM_MAGIC 0x4c4e564d
+#define NVM_STATS_SHM_VERSION 2
+#define NVM_STATS_SHM_NCTXS 64
+#define NVM_STATS_SHM_NRETRIES 16	///< Names tried when taken already
+
+struct nvm_stats_shm_op {
+	atomic_uint_least64_t ncmds;	///< # of completed commands
+	atomic_uint_least64_t nbytes;	///< # of bytes transferred
+	atomic_uint_least64_t nerrs;	///< # of commands completed with error
+};
+
+struct nvm_stats_shm_ctx {
+	atomic_int in_use;		///< Claimed by an ASYNC context
+	uint32_t depth;			///< IO depth of the context
+	atomic_uint_least32_t outstanding;///< Commands in flight
+	atomic_uint_least64_t ncmds;	///< # of completed commands
+};
+
+/**
+ * Counters of a parallel unit, busy time is the time with at least one
+ * command outstanding, approximate when commands race on the transitions
+ */
+struct nvm_stats_shm_pu {
+	atomic_uint_least64_t ncmds;	///< # of completed commands
+	atomic_uint_least64_t nerrs;	///< # of commands completed with error
+	atomic_uint_least64_t busy;	///< Ticks with commands outstanding
+	atomic_uint_least64_t busy_bgn;	///< Tick at which the PU became busy
+	atomic_uint_least32_t outstanding;///< Commands in flight
+};
+
+struct nvm_stats_shm {
+	uint32_t magic;			///< NVM_STATS_SHM_MAGIC
+	uint32_t version;		///< NVM_STATS_SHM_VERSION
+	int32_t pid;			///< Process publishing the counters
+	int32_t be_id;			///< Backend of the device
+	char name[NVM_DEV_NAME_LEN];	///< Device name
+	uint32_t seq;			///< Sequence # in the segment name
+	uint32_t npus;			///< # of entries in 'pus'
+	uint32_t nctxs;			///< # of entries in 'ctxs'
+	struct nvm_stats_shm_op ops[NVM_DEV_STATS_NOPS];
+	struct nvm_stats_shm_ctx ctxs[NVM_STATS_SHM_NCTXS];
+	struct nvm_stats_shm_pu pus[];
+};
+
+struct nvm_stats {
+	uint64_t tsc0;			///< Tick at allocation
+	uint64_t ns0;			///< Nanosecond at allocation
+	size_t npus;			///< Total # of parallel units
+	struct nvm_stats_hist hists[];	///< [npus][NVM_DEV_STATS_NOPS]
+};
+
+/**
+ * Returns the current tick, the time-stamp counter on x86 and nanoseconds of
+ * the monotonic clock elsewhere
+ */
+static inline uint64_t nvm_stats_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Returns the parallel unit of 'addr', pugrp * npunit + punit, or -1 when
+ * outside the geometry
+ */
+static inline int nvm_stats_pu(const struct nvm_dev *dev, struct nvm_addr addr)
+{
+	const struct nvm_geo *geo = &dev->geo;
+
+	if ((addr.l.pugrp >= geo->l.npugrp) || (addr.l.punit >= geo->l.npunit))
+		return -1;
+
+	return addr.l.pugrp * geo->l.npunit + addr.l.punit;
+}
+
+/**
+ * Start accounting a command of class 'op' addressing 'addrs', returns the
+ * submission tick. For ASYNC commands the callback of 'ret' is interposed to
+ * account the completion.
+ */
+uint64_t nvm_stats_enter(struct nvm_dev *dev, int op,
+			 const struct nvm_addr addrs[], int naddrs,
+			 uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Finish accounting a command started with `nvm_stats_enter`, 'err' is the
+ * result of its submission. Synchronous commands are accounted here, for
+ * ASYNC commands failing submission the callback of 'ret' is restored.
+ *
+ * 'ret' must not be NULL, its status tells failed commands from commands which
+ * were never submitted.
+ */
+void nvm_stats_leave(struct nvm_dev *dev, int op,
+		     const struct nvm_addr addrs[], int naddrs,
+		     uint16_t flags, struct nvm_ret *ret, uint64_t tsc,
+		     int err);
+
+/**
+ * Setup statistics of a device being opened, publishing counters in
+ * shared-memory when the environment variable NVM_DEV_STATS_SHM is "1" and
+ * tracing commands to the file named by NVM_DEV_TRACE, suffixed with the name
+ * of the device
+ */
+void nvm_stats_init(struct nvm_dev *dev);
+
+void nvm_stats_free(struct nvm_dev *dev);
+
+/**
+ * Claim a slot for an ASYNC context of the given depth in the shared-memory
+ * counters of 'dev', returns the slot or -1 when none is available
+ */
+int nvm_stats_shm_ctx_claim(struct nvm_dev *dev, uint32_t depth);
+
+void nvm_stats_shm_ctx_release(struct nvm_dev *dev, int slot);
+
+/**
+ * Map the shared-memory counters named 'name' read-only, the name is that of
+ * an entry in /dev/shm e.g. "liblightnvm-1234-nvme0n1"
+ */
+const struct nvm_stats_shm *nvm_stats_shm_attach(const char *name,
+						 size_t *nbytes);
+
+void nvm_stats_shm_detach(const struct nvm_stats_shm *shm, size_t nbytes);
+
+#endif /* __INTERNAL_NVM_STATS_H */
@@ -0,0 +1,98 @@
+/*
+ * nvm_thrd - Internal header for per-thread slots
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_THRD_H
+#define __INTERNAL_NVM_THRD_H
+
+#include <stdatomic.h>
+
+#define NVM_THRD_NSLOTS 64	///< Threads beyond this share slots
+
+/**
+ * Slots index per-thread state, e.g. caches, magazines, trace rings, probe
+ * counters and reader epochs, such that threads rarely contend on it.
+ *
+ * A thread claims a slot on first use and releases it when it exits, such
+ * that the slot is reused by threads created later. Slots are exclusive to a
+ * thread while fewer than NVM_THRD_NSLOTS threads hold one, threads beyond
+ * that are assigned shared slots round-robin.
+ */
+extern _Thread_local int nvm_thrd_excl;	///< Exclusive slot, or -1
+extern _Thread_local int nvm_thrd_any;	///< Exclusive or shared, -1 unclaimed
+
+/**
+ * Generation of each exclusive slot, bumped when its thread exits, such that
+ * per-thread state left behind by an exited thread is told apart from that of
+ * the thread reusing the slot
+ */
+extern atomic_uint nvm_thrd_gens[NVM_THRD_NSLOTS];
+
+void nvm_thrd_claim(void);
+
+/**
+ * Liveness of a thread, referenced by per-thread state it claims outside of
+ * the slots, e.g. the reader records of `struct nvm_rcu`, such that the state
+ * left behind by an exited thread is told apart. Freed with the last reference
+ * once the thread has exited
+ */
+struct nvm_thrd_life {
+	atomic_uint nrefs;	///< Held by the thread and by the state
+	atomic_int alive;	///< Cleared when the thread exits
+};
+
+/**
+ * Returns the liveness of the calling thread, allocated on first use, or NULL
+ * when it cannot be allocated
+ */
+struct nvm_thrd_life *nvm_thrd_life(void);
+
+void nvm_thrd_life_get(struct nvm_thrd_life *life);
+
+void nvm_thrd_life_put(struct nvm_thrd_life *life);
+
+/**
+ * Returns the slot of the calling thread, exclusive or shared with others
+ */
+static inline int nvm_thrd_slot(void)
+{
+	if (nvm_thrd_any < 0)
+		nvm_thrd_claim();
+
+	return nvm_thrd_any;
+}
+
+/**
+ * Returns the slot of the calling thread when exclusive to it, otherwise -1
+ */
+static inline int nvm_thrd_slot_excl(void)
+{
+	if (nvm_thrd_any < 0)
+		nvm_thrd_claim();
+
+	return nvm_thrd_excl;
+}
+
+#endif /* __INTERNAL_NVM_THRD_H */
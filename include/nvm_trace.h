@@ -0,0 +1,137 @@
+/*
+ * nvm_trace - Binary command trace
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_TRACE_H
+#define __INTERNAL_NVM_TRACE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include <nvm_thrd.h>
+
+#define NVM_TRACE_MAGIC 0x4543415254564e4eULL	///< "NNVTRACE"
+#define NVM_TRACE_VERSION 1
+#define NVM_TRACE_NRINGS NVM_THRD_NSLOTS	///< Rings, one per thread slot
+#define NVM_TRACE_RING_NRECS 1024		///< Records per ring, power of 2
+#define NVM_TRACE_PATH_LEN 256			///< Max. length of a trace path
+#define NVM_TRACE_FLUSH_MS 100			///< Flush period of the flusher
+
+/**
+ * Trace file header, followed by `struct nvm_trace_rec` until end-of-file.
+ * 'tps', 'nrecs' and 'ndropped' are filled in when the trace is closed.
+ */
+struct nvm_trace_hdr {
+	uint64_t magic;			///< NVM_TRACE_MAGIC
+	uint32_t version;		///< NVM_TRACE_VERSION
+	uint32_t rec_nbytes;		///< sizeof(struct nvm_trace_rec)
+	char name[NVM_DEV_NAME_LEN];	///< Device traced
+	int32_t be_id;			///< Backend of the device traced
+	uint32_t verid;			///< Open-Channel SSD version
+	uint32_t npugrp;		///< Geometry of the device traced
+	uint32_t npunit;
+	uint32_t nchunk;
+	uint32_t nsectr;
+	uint32_t nplanes;		///< OCSSD 1.2 only
+	uint32_t nsectors;		///< OCSSD 1.2 only
+	uint64_t tps;			///< Ticks per second of the trace clock
+	uint64_t nrecs;			///< # of records in the file
+	uint64_t ndropped;		///< # of records dropped on full rings
+};
+
+/**
+ * A completed command, records are written in completion order per thread
+ */
+struct nvm_trace_rec {
+	uint64_t tsc;			///< Submission, ticks since trace start
+	uint64_t ticks;			///< Submission-to-completion latency
+	uint64_t addr;			///< First address of the command
+	uint32_t digest;		///< FNV-1a of the address list
+	uint16_t flags;			///< Command flags, address mode resolved
+	uint16_t status;		///< NVMe completion status
+	uint16_t naddrs;		///< # of addresses of the command
+	uint8_t op;			///< One of `enum nvm_dev_stats_op`
+	uint8_t rsvd[5];
+};
+
+struct nvm_trace_cell {
+	atomic_uint_least64_t seq;	///< Position the cell is ready for
+	struct nvm_trace_rec rec;
+};
+
+/**
+ * Bounded multi-producer ring, producers reserve a cell by compare-and-swap
+ * on 'head' and drop the record when the ring is full. The single consumer,
+ * the flusher thread or nvm_trace_close once it has stopped, advances 'tail'.
+ */
+struct nvm_trace_ring {
+	atomic_uint_least64_t head;
+	uint64_t tail;
+	struct nvm_trace_cell cells[NVM_TRACE_RING_NRECS];
+};
+
+struct nvm_trace {
+	int fd;				///< Trace file
+	char path[NVM_TRACE_PATH_LEN];	///< Path of the trace file
+	uint64_t tsc0;			///< Tick at trace start
+	uint64_t ns0;			///< Nanosecond at trace start
+	pthread_t flusher;		///< Drains the rings to file
+	pthread_mutex_t mutex;		///< Protects 'kick' and 'stop'
+	pthread_cond_t cond;		///< Wakes the flusher
+	int kick;			///< A ring is half full
+	int stop;			///< The trace is being closed
+	atomic_uint_least64_t nrecs;	///< # of records written
+	atomic_uint_least64_t ndropped;	///< # of records dropped
+	struct nvm_trace_hdr hdr;	///< Completed and rewritten on close
+	struct nvm_trace_ring rings[NVM_TRACE_NRINGS];
+};
+
+/**
+ * Start tracing the commands of 'dev' into the file at 'path'
+ */
+struct nvm_trace *nvm_trace_open(const struct nvm_dev *dev, const char *path);
+
+/**
+ * Flush remaining records, complete the header, and close the trace
+ *
+ * @returns 0 on success, -1 when the trace file is incomplete, with `errno`
+ * set to indicate the error
+ */
+int nvm_trace_close(struct nvm_trace *trace);
+
+/**
+ * Append a record to the ring of the calling thread, waking the flusher when
+ * the ring is half full. The flusher otherwise drains the rings every
+ * NVM_TRACE_FLUSH_MS, the calling thread never writes to the file
+ */
+void nvm_trace_rec(struct nvm_trace *trace, const struct nvm_trace_rec *rec);
+
+/**
+ * FNV-1a digest of an address list
+ */
+uint32_t nvm_trace_digest(const struct nvm_addr addrs[], int naddrs);
+
+#endif /* __INTERNAL_NVM_TRACE_H */
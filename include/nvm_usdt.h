@@ -0,0 +1,63 @@
+/*
+ * nvm_usdt - User-level statically defined tracepoints
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __INTERNAL_NVM_USDT_H
+#define __INTERNAL_NVM_USDT_H
+
+/**
+ * USDT probes of the provider "liblightnvm", compiled in with
+ * NVM_USDT_ENABLED. A probe is a single nop until a tracer such as bpftrace
+ * or perf attaches to it, the arguments are evaluated regardless, thus keep
+ * them cheap to compute.
+ *
+ * The probes and their arguments are listed in doc/src/usdt/index.rst
+ */
+#ifdef NVM_USDT_ENABLED
+#include <sys/sdt.h>
+#include <nvm_stats.h>
+
+/**
+ * Declares 'tsc' holding the current tick, for latency arguments of probes
+ */
+#define NVM_USDT_TSC(tsc) const uint64_t tsc = nvm_stats_tsc()
+
+#define NVM_USDT4(name, a1, a2, a3, a4)					\
+	DTRACE_PROBE4(liblightnvm, name, a1, a2, a3, a4)
+#define NVM_USDT5(name, a1, a2, a3, a4, a5)				\
+	DTRACE_PROBE5(liblightnvm, name, a1, a2, a3, a4, a5)
+#define NVM_USDT6(name, a1, a2, a3, a4, a5, a6)				\
+	DTRACE_PROBE6(liblightnvm, name, a1, a2, a3, a4, a5, a6)
+
+#else
+
+#define NVM_USDT_TSC(tsc)
+#define NVM_USDT4(name, a1, a2, a3, a4)
+#define NVM_USDT5(name, a1, a2, a3, a4, a5)
+#define NVM_USDT6(name, a1, a2, a3, a4, a5, a6)
+
+#endif
+
+#endif /* __INTERNAL_NVM_USDT_H */
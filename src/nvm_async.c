@@ -26,32 +26,749 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <sched.h>
+#include <time.h>
 #include <liblightnvm.h>
 #include <nvm_be.h>
 #include <nvm_dev.h>
+#include <nvm_cmd.h>
+#include <nvm_chunk.h>
 #include <nvm_async.h>
+#include <nvm_stats.h>
+
+// NVMe Generic Command Status: Internal Error, for cmds failed by seq./sched.
+#define NVM_ASYNC_STATUS_ERR 0x6
+
+// Initial limit of outstanding commands per parallel unit, see NVM_ASYNC_QDC
+#define NVM_ASYNC_QDC_LIMIT0 2
+
+/**
+ * Latency is flat while the mean of a window is within base + base/2^GROW
+ * and climbing when above base + base/2^SHRINK. The baseline follows higher
+ * means by 1/2^DRIFT per window, such that it adapts to a change of workload
+ */
+#define NVM_ASYNC_QDC_GROW 2
+#define NVM_ASYNC_QDC_SHRINK 1
+#define NVM_ASYNC_QDC_DRIFT 4
+
+// Reads completing on a parallel unit before a held back cmd. is released
+#define NVM_ASYNC_SCHED_OVERTAKE 16
+
+// Time nvm_async_wait waits on other contexts for held back cmds., in nsec.
+#define NVM_ASYNC_WAIT_STALL 1000000000ULL
+
+static uint64_t async_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct nvm_async_qdc *qdc_alloc(const struct nvm_geo *geo,
+				       uint32_t depth)
+{
+	const uint32_t npus = geo->l.npugrp * geo->l.npunit;
+	struct nvm_async_qdc *qdc;
+
+	qdc = calloc(1, sizeof(*qdc) + npus * sizeof(*qdc->pus));
+	if (!qdc) {
+		NVM_DEBUG("FAILED: calloc qdc");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	qdc->npus = npus;
+	for (uint32_t pu = 0; pu < npus; ++pu) {
+		qdc->pus[pu].limit = NVM_MIN(NVM_ASYNC_QDC_LIMIT0, depth);
+		qdc->pus[pu].limit = NVM_MAX(qdc->pus[pu].limit, 1);
+	}
+
+	return qdc;
+}
+
+/**
+ * Returns the state of the parallel unit of 'addr' when the command is
+ * subject to the controller, that is, an ASYNC command with a callback on a
+ * context with a controller, and NULL otherwise
+ */
+static inline struct nvm_async_qdc_pu *qdc_pu(struct nvm_dev *dev,
+					      struct nvm_addr addr,
+					      uint16_t flags,
+					      struct nvm_ret *ret)
+{
+	struct nvm_async_qdc *qdc;
+	int pu;
+
+	if (!(flags & NVM_CMD_ASYNC) || !ret || !ret->async.ctx)
+		return NULL;
+
+	qdc = ret->async.ctx->qdc;
+	if (!qdc || !ret->async.cb)	// Completion cannot be observed
+		return NULL;
+
+	pu = nvm_stats_pu(dev, addr);
+	if (pu < 0)
+		return NULL;
+
+	return &qdc->pus[pu];
+}
+
+int nvm_async_qdc_enter(struct nvm_dev *dev, struct nvm_addr addr,
+			uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_async_qdc_pu *qpu = qdc_pu(dev, addr, flags, ret);
+
+	if (!qpu)
+		return 0;
+
+	if (qpu->outstanding >= qpu->limit) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	++(qpu->outstanding);
+
+	return 0;
+}
+
+void nvm_async_qdc_leave(struct nvm_dev *dev, struct nvm_addr addr,
+			 uint16_t flags, struct nvm_ret *ret, int err)
+{
+	struct nvm_async_qdc_pu *qpu;
+
+	if (!err)
+		return;
+
+	qpu = qdc_pu(dev, addr, flags, ret);
+	if (qpu)
+		--(qpu->outstanding);
+}
+
+void nvm_async_qdc_cpl(struct nvm_async_ctx *ctx, int pu, uint64_t ticks)
+{
+	struct nvm_async_qdc_pu *qpu = &ctx->qdc->pus[pu];
+	uint64_t mean;
+
+	--(qpu->outstanding);
+	++(qpu->ncpls);
+	qpu->sum += ticks;
+
+	if (qpu->ncpls < qpu->limit)	// Window of a limit of completions
+		return;
+
+	mean = qpu->sum / qpu->ncpls;
+	qpu->ncpls = 0;
+	qpu->sum = 0;
+
+	if ((!qpu->base) || (mean < qpu->base)) {
+		qpu->base = mean;
+	} else {
+		qpu->base += (mean - qpu->base) >> NVM_ASYNC_QDC_DRIFT;
+	}
+
+	if (mean <= qpu->base + (qpu->base >> NVM_ASYNC_QDC_GROW)) {
+		if (qpu->limit < ctx->depth)		// Additive increase
+			++(qpu->limit);
+	} else if (mean > qpu->base + (qpu->base >> NVM_ASYNC_QDC_SHRINK)) {
+		qpu->limit = NVM_MAX(qpu->limit / 2, 1);// Multiplicative decr.
+	}
+}
+
+/**
+ * Submit the write of [sectr, sectr + naddrs) whose turn it is in the chunk.
+ *
+ * On success, or on failure other than EAGAIN, the turn is passed on to the
+ * successor, a failure is recorded on the chunk such that successors fail
+ * instead of waiting for a predecessor which never arrives.
+ */
+static int seq_submit(struct nvm_dev *dev, struct nvm_chunk_wp *chk,
+		      uint32_t sectr, struct nvm_addr addrs[], int naddrs,
+		      const void *data, const void *meta, uint16_t flags,
+		      struct nvm_ret *ret)
+{
+	int err = atomic_load(&chk->err);
+
+	if (!err) {
+		if (!nvm_cmd_write_be(dev, addrs, naddrs, data, meta, flags,
+				      ret)) {
+			nvm_chunk_wp_max(&chk->wp, sectr + naddrs);
+			atomic_store_explicit(&chk->sub, sectr + naddrs,
+					      memory_order_release);
+			return 0;
+		}
+
+		if (errno == EAGAIN)		// Keep the turn and retry
+			return -1;
+
+		NVM_DEBUG("FAILED: nvm_cmd_write_be");
+		err = errno ? errno : EIO;
+		atomic_store(&chk->err, err);
+	}
+
+	atomic_store_explicit(&chk->sub, sectr + naddrs, memory_order_release);
+
+	errno = err;
+	return -1;
+}
+
+/**
+ * Submit the held back writes of 'ctx' whose predecessors have been
+ * submitted. Writes which fail are completed with an error status.
+ *
+ * @returns Number of writes completed with an error status
+ */
+static int seq_release(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
+{
+	int nfailed = 0;
+	int progress = 1;
+
+	while (progress && ctx->seq_npending) {
+		struct nvm_async_seq_cmd *cmd, *tmp;
+
+		progress = 0;
+
+		TAILQ_FOREACH_SAFE(cmd, &ctx->seq_pending, link, tmp) {
+			if (atomic_load_explicit(&cmd->chk->sub,
+						 memory_order_acquire) != cmd->sectr)
+				continue;
+
+			if (seq_submit(dev, cmd->chk, cmd->sectr, cmd->addrs,
+				       cmd->naddrs, cmd->data, cmd->meta,
+				       cmd->flags, cmd->ret)) {
+				if (errno == EAGAIN)
+					return nfailed;
+
+				cmd->ret->status = NVM_ASYNC_STATUS_ERR;
+				cmd->ret->async.cb(cmd->ret,
+						   cmd->ret->async.cb_arg);
+				++nfailed;
+			}
+
+			TAILQ_REMOVE(&ctx->seq_pending, cmd, link);
+			--(ctx->seq_npending);
+			free(cmd);
+
+			progress = 1;
+		}
+	}
+
+	return nfailed;
+}
+
+/**
+ * Complete the held back writes of 'ctx' with an error status, as their
+ * predecessors have not been submitted, ETIMEDOUT, or as 'ctx' is torn down,
+ * ECANCELED. The chunks are marked failed with 'err', such that the
+ * predecessors and successors fail instead of waiting on them
+ *
+ * @returns Number of writes completed with an error status
+ */
+static int seq_abandon(struct nvm_async_ctx *ctx, int err)
+{
+	int nfailed = 0;
+
+	while (!TAILQ_EMPTY(&ctx->seq_pending)) {
+		struct nvm_async_seq_cmd *cmd = TAILQ_FIRST(&ctx->seq_pending);
+		int none = 0;
+
+		NVM_DEBUG("FAILED: abandoning write at sectr: %u, err: %d",
+			  cmd->sectr, err);
+		atomic_compare_exchange_strong(&cmd->chk->err, &none, err);
+
+		cmd->ret->status = NVM_ASYNC_STATUS_ERR;
+		cmd->ret->async.cb(cmd->ret, cmd->ret->async.cb_arg);
+		++nfailed;
+
+		TAILQ_REMOVE(&ctx->seq_pending, cmd, link);
+		--(ctx->seq_npending);
+		free(cmd);
+	}
+
+	return nfailed;
+}
+
+int nvm_async_seq_write(struct nvm_dev *dev, struct nvm_addr addrs[],
+			int naddrs, const void *data, const void *meta,
+			uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_async_ctx *ctx = ret->async.ctx;
+	const int scalar = nvm_cmd_addr_mode(dev, flags) == NVM_CMD_SCALAR;
+	struct nvm_async_seq_cmd *cmd;
+	struct nvm_chunk_wp *chk;
+	uint32_t sectr;
+	uint32_t sub;
+
+	if ((naddrs < 1) || (naddrs > NVM_NADDR_MAX)) {
+		NVM_DEBUG("FAILED: invalid naddrs: %d", naddrs);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (int idx = 1; idx < (scalar ? 1 : naddrs); ++idx) {
+		struct nvm_addr expected = addrs[0];
+
+		expected.l.sectr += idx;
+		if (addrs[idx].val != expected.val) {
+			NVM_DEBUG("FAILED: addrs not consecutive in one chunk");
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	chk = nvm_chunk_wp_get(dev, addrs[0]);
+	if (!chk) {
+		NVM_DEBUG("FAILED: nvm_chunk_wp_get");
+		return -1;
+	}
+
+	sectr = addrs[0].l.sectr;
+	sub = atomic_load_explicit(&chk->sub, memory_order_acquire);
+
+	if (sectr < sub) {	// Behind the write-pointer, let the device judge
+		return nvm_cmd_write_be(dev, addrs, naddrs, data, meta, flags,
+					ret);
+	}
+
+	if (sectr == sub) {	// Our turn, and possibly that of held back ones
+		if (seq_submit(dev, chk, sectr, addrs, naddrs, data, meta,
+			       flags, ret))
+			return -1;
+
+		seq_release(dev, ctx);
+
+		return 0;
+	}
+
+	// Ahead of predecessor, hold it back within the depth of the ctx
+	if ((ctx->outstanding + ctx->seq_npending) >= ctx->depth) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	cmd = malloc(sizeof(*cmd));
+	if (!cmd) {
+		NVM_DEBUG("FAILED: malloc seq. cmd");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	cmd->chk = chk;
+	cmd->sectr = sectr;
+	cmd->naddrs = naddrs;
+	for (int idx = 0; idx < (scalar ? 1 : naddrs); ++idx)
+		cmd->addrs[idx] = addrs[idx];
+	cmd->data = data;
+	cmd->meta = meta;
+	cmd->flags = flags;
+	cmd->ret = ret;
+
+	TAILQ_INSERT_TAIL(&ctx->seq_pending, cmd, link);
+	++(ctx->seq_npending);
+
+	return 0;
+}
+
+/**
+ * Returns the scheduling state of the given device, allocating it on first
+ * use. Concurrent first users race on a compare-and-swap, the loser frees its
+ * copy
+ */
+static struct nvm_async_sched *sched_get(struct nvm_dev *dev)
+{
+	struct nvm_async_sched *sched = atomic_load(&dev->sched);
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const uint32_t npus = geo->l.npugrp * geo->l.npunit;
+	struct nvm_async_sched *cur = NULL;
+
+	if (sched)
+		return sched;
+
+	sched = aligned_alloc(64, sizeof(*sched) + npus * sizeof(*sched->pus));
+	if (!sched) {
+		NVM_DEBUG("FAILED: aligned_alloc sched");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	sched->npus = npus;
+	for (uint32_t pu = 0; pu < npus; ++pu) {
+		for (int prio = 0; prio < NVM_ASYNC_NPRIOS; ++prio)
+			atomic_init(&sched->pus[pu].nreads[prio], 0);
+		atomic_init(&sched->pus[pu].ncpls, 0);
+	}
+
+	if (!atomic_compare_exchange_strong(&dev->sched, &cur, sched)) {
+		free(sched);
+		return cur;
+	}
+
+	return sched;
+}
+
+void nvm_async_sched_free(struct nvm_dev *dev)
+{
+	free(atomic_load(&dev->sched));
+	atomic_store(&dev->sched, NULL);
+}
+
+/**
+ * Whether reads of priority class 'prio' or higher are in flight on 'pu'
+ */
+static inline int sched_blocked(const struct nvm_async_sched *sched, int pu,
+				int prio)
+{
+	for (int cls = 0; cls <= prio; ++cls) {
+		if (atomic_load_explicit(&sched->pus[pu].nreads[cls],
+					 memory_order_relaxed))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Returns the context of 'ret' when the command is subject to its scheduler,
+ * that is, an ASYNC command on a context with NVM_ASYNC_SCHED which is not
+ * releasing held back commands, and NULL otherwise
+ */
+static inline struct nvm_async_ctx *sched_ctx(uint16_t flags,
+					      struct nvm_ret *ret)
+{
+	struct nvm_async_ctx *ctx;
+
+	if (!(flags & NVM_CMD_ASYNC) || !ret || !ret->async.ctx)
+		return NULL;
+
+	ctx = ret->async.ctx;
+	if (!ctx->sched || ctx->sched_release)
+		return NULL;
+
+	return ctx;
+}
+
+int nvm_async_sched_hold(struct nvm_dev *dev, int op, struct nvm_addr addrs[],
+			 const struct nvm_addr src[], int naddrs,
+			 const void *data, const void *meta, uint16_t flags,
+			 struct nvm_ret *ret)
+{
+	struct nvm_async_ctx *ctx = sched_ctx(flags, ret);
+	const int scalar = (op != NVM_DEV_STATS_COPY) &&
+			   (nvm_cmd_addr_mode(dev, flags) == NVM_CMD_SCALAR);
+	struct nvm_async_sched_cmd *cmd;
+	int pu;
+
+	if (!ctx || (naddrs < 1) || (naddrs > NVM_NADDR_MAX))
+		return 0;
+
+	pu = nvm_stats_pu(dev, addrs[0]);
+	if (pu < 0)
+		return 0;
+
+	// Behind neither reads nor held back commands of the parallel unit
+	if (!ctx->sched_nheld_pu[pu] && !sched_blocked(ctx->sched, pu, ctx->prio))
+		return 0;
+
+	if ((ctx->outstanding + ctx->seq_npending + ctx->sched_nheld) >=
+	    ctx->depth) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	cmd = malloc(sizeof(*cmd));
+	if (!cmd) {
+		NVM_DEBUG("FAILED: malloc sched. cmd");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	cmd->op = op;
+	cmd->pu = pu;
+	cmd->ncpls = atomic_load_explicit(&ctx->sched->pus[pu].ncpls,
+					  memory_order_relaxed);
+	cmd->naddrs = naddrs;
+	for (int idx = 0; idx < (scalar ? 1 : naddrs); ++idx)
+		cmd->addrs[idx] = addrs[idx];
+	for (int idx = 0; src && (idx < naddrs); ++idx)
+		cmd->src[idx] = src[idx];
+	cmd->data = data;
+	cmd->meta = meta;
+	cmd->flags = flags;
+	cmd->ret = ret;
+
+	TAILQ_INSERT_TAIL(&ctx->sched_held, cmd, link);
+	++(ctx->sched_nheld_pu[pu]);
+	++(ctx->sched_nheld);
+
+	return 1;
+}
+
+void nvm_async_sched_enter(struct nvm_dev *dev, struct nvm_addr addr,
+			   uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_async_ctx *ctx = sched_ctx(flags, ret);
+	int pu;
+
+	if (!ctx || !ret->async.cb)	// Completion cannot be observed
+		return;
+
+	pu = nvm_stats_pu(dev, addr);
+	if (pu < 0)
+		return;
+
+	atomic_fetch_add_explicit(&ctx->sched->pus[pu].nreads[ctx->prio], 1,
+				  memory_order_relaxed);
+}
+
+void nvm_async_sched_leave(struct nvm_dev *dev, struct nvm_addr addr,
+			   uint16_t flags, struct nvm_ret *ret, int err)
+{
+	struct nvm_async_ctx *ctx;
+	int pu;
+
+	if (!err)
+		return;
+
+	ctx = sched_ctx(flags, ret);
+	if (!ctx || !ret->async.cb)
+		return;
+
+	pu = nvm_stats_pu(dev, addr);
+	if (pu < 0)
+		return;
+
+	atomic_fetch_sub_explicit(&ctx->sched->pus[pu].nreads[ctx->prio], 1,
+				  memory_order_relaxed);
+}
+
+void nvm_async_sched_cpl(struct nvm_async_ctx *ctx, int pu)
+{
+	struct nvm_async_sched_pu *spu = &ctx->sched->pus[pu];
+
+	atomic_fetch_sub_explicit(&spu->nreads[ctx->prio], 1,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&spu->ncpls, 1, memory_order_relaxed);
+}
+
+/**
+ * Submit the held back commands of 'ctx' whose parallel unit has no reads in
+ * flight, or which have been overtaken by NVM_ASYNC_SCHED_OVERTAKE reads, or
+ * all of them when 'force' is set. Commands of a parallel unit are released
+ * in the order they were held back, as the oldest is the most overtaken.
+ * Commands which fail are completed with an error status.
+ *
+ * @returns Number of commands completed with an error status
+ */
+static int sched_release(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+			 int force)
+{
+	struct nvm_async_sched_cmd *cmd, *tmp;
+	int nfailed = 0;
+
+	TAILQ_FOREACH_SAFE(cmd, &ctx->sched_held, link, tmp) {
+		const uint32_t ncpls = atomic_load_explicit(
+			&ctx->sched->pus[cmd->pu].ncpls, memory_order_relaxed);
+		int err;
+
+		if ((!force) && sched_blocked(ctx->sched, cmd->pu, ctx->prio) &&
+		    ((ncpls - cmd->ncpls) < NVM_ASYNC_SCHED_OVERTAKE))
+			continue;
+
+		ctx->sched_release = 1;
+		switch (cmd->op) {
+		case NVM_DEV_STATS_ERASE:
+			err = nvm_cmd_erase(dev, cmd->addrs, cmd->naddrs,
+					    (void *)cmd->meta, cmd->flags,
+					    cmd->ret);
+			break;
+		case NVM_DEV_STATS_COPY:
+			err = nvm_cmd_copy(dev, cmd->src, cmd->addrs,
+					   cmd->naddrs, cmd->flags, cmd->ret);
+			break;
+		default:
+			err = nvm_cmd_write(dev, cmd->addrs, cmd->naddrs,
+					    cmd->data, cmd->meta, cmd->flags,
+					    cmd->ret);
+			break;
+		}
+		ctx->sched_release = 0;
+
+		if (err) {
+			if (errno == EAGAIN)	// Keep it and retry
+				return nfailed;
+
+			NVM_DEBUG("FAILED: releasing held back cmd.");
+			cmd->ret->status = NVM_ASYNC_STATUS_ERR;
+			cmd->ret->async.cb(cmd->ret, cmd->ret->async.cb_arg);
+			++nfailed;
+		}
+
+		TAILQ_REMOVE(&ctx->sched_held, cmd, link);
+		--(ctx->sched_nheld_pu[cmd->pu]);
+		--(ctx->sched_nheld);
+		free(cmd);
+	}
+
+	return nfailed;
+}
 
 struct nvm_async_ctx *nvm_async_init(struct nvm_dev *dev, uint32_t depth,
 				     uint16_t flags)
 {
-	return dev->be->async_init(dev, depth, flags);
+	struct nvm_async_ctx *ctx;
+
+	ctx = dev->be->async_init(dev, depth, flags);
+	if (!ctx)
+		return NULL;
+
+	ctx->qdc = NULL;
+	if (flags & NVM_ASYNC_QDC) {
+		ctx->qdc = qdc_alloc(nvm_dev_get_geo(dev), ctx->depth);
+		if (!ctx->qdc) {
+			NVM_DEBUG("FAILED: qdc_alloc");
+			dev->be->async_term(dev, ctx);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	ctx->sched = NULL;
+	ctx->sched_nheld_pu = NULL;
+	if (flags & NVM_ASYNC_SCHED) {
+		const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+
+		ctx->sched = sched_get(dev);
+		ctx->sched_nheld_pu = calloc(geo->l.npugrp * geo->l.npunit,
+					     sizeof(*ctx->sched_nheld_pu));
+		if (!(ctx->sched && ctx->sched_nheld_pu)) {
+			NVM_DEBUG("FAILED: sched_get or calloc sched_nheld_pu");
+			free(ctx->sched_nheld_pu);
+			free(ctx->qdc);
+			dev->be->async_term(dev, ctx);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	ctx->flags = flags;
+	ctx->stats_slot = nvm_stats_shm_ctx_claim(dev, depth);
+	TAILQ_INIT(&ctx->seq_pending);
+	ctx->seq_npending = 0;
+	TAILQ_INIT(&ctx->sched_held);
+	ctx->sched_nheld = 0;
+	ctx->sched_release = 0;
+	ctx->prio = NVM_ASYNC_PRIO_NORMAL;
+
+	return ctx;
+}
+
+/**
+ * Complete the held back commands of 'ctx' with an error status, without
+ * submitting them, as 'ctx' is torn down
+ */
+static void sched_cancel(struct nvm_async_ctx *ctx)
+{
+	while (!TAILQ_EMPTY(&ctx->sched_held)) {
+		struct nvm_async_sched_cmd *cmd = TAILQ_FIRST(&ctx->sched_held);
+
+		NVM_DEBUG("FAILED: cancelling held back cmd. on pu: %d",
+			  cmd->pu);
+		cmd->ret->status = NVM_ASYNC_STATUS_ERR;
+		cmd->ret->async.cb(cmd->ret, cmd->ret->async.cb_arg);
+
+		TAILQ_REMOVE(&ctx->sched_held, cmd, link);
+		--(ctx->sched_nheld_pu[cmd->pu]);
+		--(ctx->sched_nheld);
+		free(cmd);
+	}
 }
 
 int nvm_async_term(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
 {
+	seq_abandon(ctx, ECANCELED);
+	sched_cancel(ctx);
+	free(ctx->sched_nheld_pu);
+	ctx->sched_nheld_pu = NULL;
+
+	free(ctx->qdc);
+	ctx->qdc = NULL;
+
+	nvm_stats_shm_ctx_release(dev, ctx->stats_slot);
+
 	return dev->be->async_term(dev, ctx);
 }
 
 int nvm_async_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
 {
-	return dev->be->async_wait(dev, ctx);
+	uint64_t stall = 0;
+	int nevents = 0;
+	int res;
+
+	// Held back writes may wait on predecessors from other contexts, and
+	// held back writes and erases on the reads of other contexts, for at
+	// most NVM_ASYNC_WAIT_STALL without progress
+	while (ctx->seq_npending || ctx->sched_nheld) {
+		uint64_t now;
+
+		res = nvm_async_poke(dev, ctx, 0);
+		if (res < 0)
+			return -1;
+
+		nevents += res;
+
+		if (res || ctx->outstanding) {
+			stall = 0;
+			if (!res)
+				sched_yield();
+			continue;
+		}
+
+		now = async_ns();
+		if (!stall) {
+			stall = now;
+		} else if ((now - stall) >= NVM_ASYNC_WAIT_STALL) {
+			NVM_DEBUG("FAILED: no progress, seq_npending: %u",
+				  ctx->seq_npending);
+			nevents += sched_release(dev, ctx, 1);
+			nevents += seq_abandon(ctx, ETIMEDOUT);
+			stall = 0;
+			continue;
+		}
+
+		sched_yield();
+	}
+
+	res = dev->be->async_wait(dev, ctx);
+	if (res < 0)
+		return res;
+
+	return nevents + res;
 }
 
 int nvm_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx, uint32_t max)
 {
-	return dev->be->async_poke(dev, ctx, max);
+	int nevents = ctx->sched_nheld ? sched_release(dev, ctx, 0) : 0;
+	int res;
+
+	nevents += ctx->seq_npending ? seq_release(dev, ctx) : 0;
+
+	res = dev->be->async_poke(dev, ctx, max);
+	if (res < 0)
+		return res;
+
+	nevents += res;
+
+	if (ctx->sched_nheld)		// Completed reads might unblock them
+		nevents += sched_release(dev, ctx, 0);
+	if (ctx->seq_npending)		// Completions might have made room
+		nevents += seq_release(dev, ctx);
+
+	return nevents;
 }
 
 uint32_t nvm_async_get_depth(struct nvm_async_ctx *ctx) {
@@ -61,3 +778,39 @@ uint32_t nvm_async_get_depth(struct nvm_async_ctx *ctx) {
 uint32_t nvm_async_get_outstanding(struct nvm_async_ctx *ctx) {
 	return ctx->outstanding;
 }
+
+uint32_t nvm_async_get_pu_limit(struct nvm_async_ctx *ctx, int pu)
+{
+	if (!ctx->qdc)
+		return ctx->depth;
+
+	if ((pu < 0) || ((uint32_t)pu >= ctx->qdc->npus))
+		return 0;
+
+	return ctx->qdc->pus[pu].limit;
+}
+
+int nvm_async_set_prio(struct nvm_async_ctx *ctx, int prio)
+{
+	if ((prio < NVM_ASYNC_PRIO_HIGH) || (prio > NVM_ASYNC_PRIO_LOW)) {
+		NVM_DEBUG("FAILED: invalid prio: %d", prio);
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Reads in flight are accounted in the class of the context
+	if (ctx->outstanding || ctx->seq_npending || ctx->sched_nheld) {
+		NVM_DEBUG("FAILED: ctx has outstanding cmds.");
+		errno = EBUSY;
+		return -1;
+	}
+
+	ctx->prio = prio;
+
+	return 0;
+}
+
+int nvm_async_get_prio(struct nvm_async_ctx *ctx)
+{
+	return ctx->prio;
+}
@@ -30,10 +30,14 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <sched.h>
 #include <liblightnvm.h>
 #include <nvm_be.h>
 #include <nvm_dev.h>
 #include <nvm_spec.h>
+#include <nvm_omp.h>
+#include <nvm_numa.h>
+#include <nvm_bbt.h>
 
 static inline int _bbt_idx(const struct nvm_dev *dev,
 			   const struct nvm_addr addr)
@@ -47,34 +51,148 @@ static inline int _blk_idx(const struct nvm_dev *dev,
 	return addr.g.blk * dev->geo.nplanes + addr.g.pl;
 }
 
-static inline int _refresh_counters(struct nvm_dev *dev, struct nvm_bbt *bbt)
+/**
+ * Inverse of _bbt_idx, the address of the LUN of cache entry 'idx'
+ */
+static inline struct nvm_addr _bbt_addr(const struct nvm_dev *dev, size_t idx)
 {
-	int nbad = 0;
-	int ngbad = 0;
-	int ndmrk = 0;
-	int nhmrk = 0;
+	struct nvm_addr addr;
 
-	for (uint64_t i = 0; i < bbt->nblks; ++i) {
-		switch (bbt->blks[i]) {
-		case NVM_BBT_FREE:
-			break;
-		case NVM_BBT_BAD:
-			++nbad;
-			break;
-		case NVM_BBT_GBAD:
-			++ngbad;
-			break;
-		case NVM_BBT_DMRK:
-			++ndmrk;
-			break;
-		case NVM_BBT_HMRK:
-			++nhmrk;
-			break;
+	addr.ppa = 0;
+	addr.g.ch = idx / dev->geo.nluns;
+	addr.g.lun = idx % dev->geo.nluns;
 
-		default:
-			errno = EINVAL;
-			return -1;
-		}
+	return addr;
+}
+
+static inline int _bbt_code(int state)
+{
+	switch (state) {
+	case NVM_BBT_FREE:
+		return 0;
+	case NVM_BBT_BAD:
+		return 1;
+	case NVM_BBT_GBAD:
+		return 2;
+	case NVM_BBT_DMRK:
+		return 3;
+	case NVM_BBT_HMRK:
+		return 4;
+
+	default:
+		return -1;
+	}
+}
+
+static const uint8_t _bbt_states[NVM_BBT_NCODES] = {
+	NVM_BBT_FREE, NVM_BBT_BAD, NVM_BBT_GBAD, NVM_BBT_DMRK, NVM_BBT_HMRK
+};
+
+static inline int _pack_get(const struct nvm_bbt_pack *pack, uint64_t i)
+{
+	int code = 0;
+
+	for (int s = 0; s < NVM_BBT_NSLICES; ++s) {
+		const uint64_t word = pack->slices[s * pack->nwords + i / 64];
+
+		code |= ((word >> (i % 64)) & 0x1) << s;
+	}
+
+	return _bbt_states[code];
+}
+
+static inline void _pack_set(struct nvm_bbt_pack *pack, uint64_t i, int code)
+{
+	for (int s = 0; s < NVM_BBT_NSLICES; ++s) {
+		uint64_t *word = &pack->slices[s * pack->nwords + i / 64];
+
+		if (code & (0x1 << s))
+			*word |= 1ULL << (i % 64);
+		else
+			*word &= ~(1ULL << (i % 64));
+	}
+}
+
+static inline void _pack_free(struct nvm_bbt_pack *pack)
+{
+	if (!pack)
+		return;
+
+	free(atomic_load(&pack->view));
+	free(pack);
+}
+
+static void _pack_dtor(struct nvm_rcu_node *node)
+{
+	_pack_free((struct nvm_bbt_pack *)node);
+}
+
+static struct nvm_bbt_pack *_pack_alloc(const struct nvm_dev *dev,
+					struct nvm_addr addr)
+{
+	const uint64_t nblks = dev->geo.nblocks * dev->geo.nplanes;
+	const size_t nwords = (nblks + 63) / 64;
+	struct nvm_bbt_pack *pack;
+
+	pack = calloc(1, sizeof(*pack) +
+		      sizeof(*pack->slices) * NVM_BBT_NSLICES * nwords);
+	if (!pack) {
+		NVM_DEBUG("FAILED: calloc of pack failed");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	pack->node.dtor = _pack_dtor;
+	pack->addr = addr;
+	pack->nblks = nblks;
+	pack->nwords = nwords;
+	atomic_init(&pack->view, NULL);
+
+	return pack;
+}
+
+/**
+ * Allocate a private copy of a published pack for a writer to modify
+ */
+static struct nvm_bbt_pack *_pack_dup(const struct nvm_dev *dev,
+				      const struct nvm_bbt_pack *pack)
+{
+	struct nvm_bbt_pack *dup;
+
+	dup = _pack_alloc(dev, pack->addr);
+	if (!dup)
+		return NULL;
+
+	memcpy(dup->slices, pack->slices,
+	       sizeof(*pack->slices) * NVM_BBT_NSLICES * pack->nwords);
+	dup->nbad = pack->nbad;
+	dup->ngbad = pack->ngbad;
+	dup->ndmrk = pack->ndmrk;
+	dup->nhmrk = pack->nhmrk;
+
+	return dup;
+}
+
+/**
+ * Count the blocks in each state, unused bits of the last word encode FREE
+ * and are thus never counted
+ */
+static inline void _refresh_counters(struct nvm_dev *dev,
+				     struct nvm_bbt_pack *pack)
+{
+	const uint64_t *s0 = &pack->slices[0];
+	const uint64_t *s1 = &pack->slices[pack->nwords];
+	const uint64_t *s2 = &pack->slices[2 * pack->nwords];
+	uint32_t nbad = 0;
+	uint32_t ngbad = 0;
+	uint32_t ndmrk = 0;
+	uint32_t nhmrk = 0;
+
+	for (size_t w = 0; w < pack->nwords; ++w) {
+		nbad += __builtin_popcountll(s0[w] & ~s1[w] & ~s2[w]);
+		ngbad += __builtin_popcountll(~s0[w] & s1[w] & ~s2[w]);
+		ndmrk += __builtin_popcountll(s0[w] & s1[w] & ~s2[w]);
+		nhmrk += __builtin_popcountll(~s0[w] & ~s1[w] & s2[w]);
 	}
 
 	if (dev->verid == NVM_SPEC_VERID_20) {
@@ -84,71 +202,223 @@ static inline int _refresh_counters(struct nvm_dev *dev, struct nvm_bbt *bbt)
 		nhmrk = nhmrk / dev->geo.nplanes;
 	}
 
-	bbt->nbad = nbad;
-	bbt->ngbad = ngbad;
-	bbt->ndmrk = ndmrk;
-	bbt->nhmrk = nhmrk;
+	pack->nbad = nbad;
+	pack->ngbad = ngbad;
+	pack->ndmrk = ndmrk;
+	pack->nhmrk = nhmrk;
+}
 
-	return 0;
+/**
+ * Unpack the cached table into the representation handed out by nvm_bbt_get,
+ * which is only allocated once asked for. Published packs are immutable, so
+ * readers racing to unpack the same pack produce equal views and all but the
+ * first discard theirs
+ */
+static const struct nvm_bbt *_pack_view(struct nvm_dev *dev,
+					struct nvm_bbt_pack *pack)
+{
+	struct nvm_bbt *view = atomic_load(&pack->view);
+	struct nvm_bbt *cur = NULL;
+
+	if (view)
+		return view;
+
+	view = malloc(sizeof(*view) + sizeof(*view->blks) * pack->nblks);
+	if (!view) {
+		NVM_DEBUG("FAILED: malloc of view failed");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	view->dev = dev;
+	view->addr = pack->addr;
+	view->nblks = pack->nblks;
+	for (uint64_t i = 0; i < pack->nblks; ++i)
+		view->blks[i] = _pack_get(pack, i);
+
+	view->nbad = pack->nbad;
+	view->ngbad = pack->ngbad;
+	view->ndmrk = pack->ndmrk;
+	view->nhmrk = pack->nhmrk;
+
+	if (!atomic_compare_exchange_strong(&pack->view, &cur, view)) {
+		free(view);
+		return cur;
+	}
+
+	return view;
 }
 
-int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
-		  struct nvm_ret *ret)
+static inline struct nvm_bbt_slot *_bbt_slot(struct nvm_dev *dev,
+					     struct nvm_addr addr)
 {
-	const struct nvm_bbt *cached;
-	struct nvm_spec_bbt *spec;
-	size_t bbt_idx;
+	return &dev->bbts[_bbt_idx(dev, addr)];
+}
 
-	if ((!dev) || (nvm_addr_check(addr, dev))) {
-		NVM_DEBUG("FAILED: !dev or nvm_addr_check failed");
-		errno = EINVAL;
+static inline void _slot_lock(struct nvm_bbt_slot *slot)
+{
+	while (atomic_flag_test_and_set_explicit(&slot->lock,
+						 memory_order_acquire))
+		sched_yield();
+}
+
+static inline void _slot_unlock(struct nvm_bbt_slot *slot)
+{
+	atomic_flag_clear_explicit(&slot->lock, memory_order_release);
+}
+
+/**
+ * Publish 'pack' as the current version of the slot, retire the version it
+ * replaces and reclaim those no longer referenced by readers, the caller
+ * holds the slot lock
+ */
+static inline void _slot_publish(struct nvm_bbt_slot *slot,
+				 struct nvm_bbt_pack *pack)
+{
+	struct nvm_bbt_pack *old = atomic_exchange(&slot->pack, pack);
+
+	if (old)
+		nvm_rcu_retire(&slot->rcu, &old->node);
+
+	nvm_rcu_reclaim(&slot->rcu);
+}
+
+int nvm_bbt_cache_init(struct nvm_dev *dev)
+{
+	dev->bbts = malloc(sizeof(*dev->bbts) * dev->nbbts);
+	if (!dev->bbts) {
+		NVM_DEBUG("FAILED: malloc dev->bbts");
+		errno = ENOMEM;
 		return -1;
 	}
 
-	bbt_idx = _bbt_idx(dev, addr);
+	for (size_t i = 0; i < dev->nbbts; ++i) {
+		atomic_init(&dev->bbts[i].pack, NULL);
+		atomic_flag_clear(&dev->bbts[i].lock);
+		nvm_rcu_init(&dev->bbts[i].rcu);
+	}
 
-	cached = dev->bbts[bbt_idx];
-	if (!cached)
-		return 0;			// Nothing to flush
+	return 0;
+}
 
-	spec = nvm_cmd_gbbt(dev, addr, ret);
+void nvm_bbt_cache_free(struct nvm_dev *dev)
+{
+	if (!dev->bbts)
+		return;
+
+	for (size_t i = 0; i < dev->nbbts; ++i) {
+		_slot_publish(&dev->bbts[i], NULL);
+		nvm_rcu_term(&dev->bbts[i].rcu);
+	}
+
+	free(dev->bbts);
+	dev->bbts = NULL;
+}
+
+/**
+ * Submit the blocks collected for the state with the given code
+ */
+static int _flush_batch(struct nvm_dev *dev, struct nvm_addr addrs[],
+			int *naddrs, int code, struct nvm_ret *ret)
+{
+	if (!*naddrs)
+		return 0;
+
+	if (nvm_cmd_sbbt(dev, addrs, *naddrs, _bbt_states[code], ret)) {
+		NVM_DEBUG("FAILED: nvm_cmd_sbbt");
+		return -1;		// Propagate `errno`
+	}
+
+	*naddrs = 0;
+
+	return 0;
+}
+
+/**
+ * Write the blocks whose state in 'pack' differs from the device
+ */
+static int _pack_write(struct nvm_dev *dev, const struct nvm_bbt_pack *pack,
+		       struct nvm_ret *ret)
+{
+	struct nvm_addr addrs[NVM_BBT_NCODES][NVM_NADDR_MAX];
+	int naddrs[NVM_BBT_NCODES] = { 0 };
+	struct nvm_spec_bbt *spec;
+
+	spec = nvm_cmd_gbbt(dev, pack->addr, ret);
 	if (!spec) {
 		NVM_DEBUG("FAILED: nvm_cmd_gbbt failed spec");
 		return -1;			// Propagate `errno`
 	}
 
-	if (cached->nblks != spec->tblks) {
-		NVM_DEBUG("FAILED: cached->nblks(%lu) != spec->tblks(%u)",
-			  cached->nblks, spec->tblks);
+	if (pack->nblks != spec->tblks) {
+		NVM_DEBUG("FAILED: pack->nblks(%lu) != spec->tblks(%u)",
+			  pack->nblks, spec->tblks);
 		errno = EINVAL;
 		free(spec);
 		return -1;
 	}
-	
-	for (uint64_t i = 0; i < cached->nblks; ++i) {	// Update on device
-		struct nvm_addr blk_addr;
 
-		if (cached->blks[i] == spec->blk[i])
+	// Changed blocks are batched per state into vector commands
+	for (uint64_t i = 0; i < pack->nblks; ++i) {	// Update on device
+		const int state = _pack_get(pack, i);
+		const int code = _bbt_code(state);
+		struct nvm_addr *blk_addr;
+
+		if (state == spec->blk[i])
 			continue;		// Ignore same state
 
-		// Convert "i -> (blk, pl)" and submit changed state
-		blk_addr.ppa = cached->addr.ppa;
-		blk_addr.g.blk = i / dev->geo.nplanes;
-		blk_addr.g.pl = i % dev->geo.nplanes;
+		// Convert "i -> (blk, pl)" and collect changed state
+		blk_addr = &addrs[code][naddrs[code]++];
+		blk_addr->ppa = pack->addr.ppa;
+		blk_addr->g.blk = i / dev->geo.nplanes;
+		blk_addr->g.pl = i % dev->geo.nplanes;
+
+		if ((naddrs[code] == NVM_NADDR_MAX) &&
+		    _flush_batch(dev, addrs[code], &naddrs[code], code, ret)) {
+			free(spec);
+			return -1;
+		}
+	}
 
-		if (nvm_cmd_sbbt(dev, &blk_addr, 1, cached->blks[i],
-					ret)) {
-			NVM_DEBUG("FAILED: nvm_cmd_sbbt");
+	for (int code = 0; code < NVM_BBT_NCODES; ++code) {
+		if (_flush_batch(dev, addrs[code], &naddrs[code], code, ret)) {
 			free(spec);
-			return -1;		// Propagate `errno`
+			return -1;
 		}
 	}
 
 	free(spec);
 
-	/* Deallocate the bbt entry */
-	nvm_bbt_free(dev->bbts[bbt_idx]);
-	dev->bbts[bbt_idx] = NULL;
+	return 0;
+}
+
+int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
+		  struct nvm_ret *ret)
+{
+	struct nvm_bbt_slot *slot;
+	struct nvm_bbt_pack *cached;
+
+	if ((!dev) || (nvm_addr_check(addr, dev))) {
+		NVM_DEBUG("FAILED: !dev or nvm_addr_check failed");
+		errno = EINVAL;
+		return -1;
+	}
+
+	slot = _bbt_slot(dev, addr);
+
+	_slot_lock(slot);
+
+	// Tables loaded from a snapshot, and not modified since, are not written
+	cached = atomic_load(&slot->pack);
+	if (cached && (!cached->loaded) && _pack_write(dev, cached, ret)) {
+		_slot_unlock(slot);
+		return -1;
+	}
+
+	/* Deallocate the bbt entry, once no longer referenced by readers */
+	_slot_publish(slot, NULL);
+
+	_slot_unlock(slot);
 
 	return 0;
 }
@@ -156,14 +426,9 @@ int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
 int nvm_bbt_flush_all(struct nvm_dev *dev, struct nvm_ret *ret)
 {
 	for (size_t i = 0; i < dev->nbbts; ++i) {
-		struct nvm_addr addr;
 		int err;
 
-		addr.ppa = 0;
-		addr.g.ch = i % dev->geo.nchannels;
-		addr.g.lun = (i / dev->geo.nchannels) % dev->geo.nluns;
-
-		err = nvm_bbt_flush(dev, addr, ret);
+		err = nvm_bbt_flush(dev, _bbt_addr(dev, i), ret);
 		if (err) {
 			NVM_DEBUG("FAILED: nvm_bbt_flush failed");
 			return err;
@@ -173,98 +438,205 @@ int nvm_bbt_flush_all(struct nvm_dev *dev, struct nvm_ret *ret)
 	return 0;
 }
 
-const struct nvm_bbt *nvm_bbt_get(struct nvm_dev *dev, struct nvm_addr addr,
-				  struct nvm_ret *ret)
+/**
+ * Overwrite the given private pack with the table of the device
+ */
+static int _pack_refresh(struct nvm_dev *dev, struct nvm_bbt_pack *pack,
+			 struct nvm_ret *ret)
 {
 	struct nvm_spec_bbt *spec;
-	size_t bbt_idx;
 
-	if ((!dev) || (nvm_addr_check(addr, dev))) {
-		NVM_DEBUG("FAILED: invalid input");
+	spec = nvm_cmd_gbbt(dev, pack->addr, ret);
+	if (!spec)
+		return -1;			// Propagate `errno`
+
+	if (pack->nblks != spec->tblks) {
+		free(spec);
 		errno = EINVAL;
-		return NULL;
+		return -1;
 	}
-	
-	bbt_idx = _bbt_idx(dev, addr);
 
-	/* Return bbt from cache */
-	if (dev->bbts_cached && dev->bbts[bbt_idx])
-		return dev->bbts[bbt_idx];
+	for (uint64_t i = 0 ; i < pack->nblks; ++i) {
+		const int code = _bbt_code(spec->blk[i]);
 
-	/* Allocate bbt entry in managed memory area */
-	if (!dev->bbts[bbt_idx]) {
-		int nblks = dev->geo.nblocks * dev->geo.nplanes;
+		if (code < 0) {
+			NVM_DEBUG("FAILED: unknown state: %u", spec->blk[i]);
+			free(spec);
+			errno = EINVAL;
+			return -1;
+		}
 
-		struct nvm_bbt *bbt;
+		_pack_set(pack, i, code);
+	}
 
-		bbt = malloc(sizeof(*bbt) + sizeof(*bbt->blks) * nblks);
-		if (!bbt) {
-			NVM_DEBUG("FAILED: malloc of bbt failed");
-			errno = ENOMEM;
-			return NULL;
-		}
+	pack->nbad = spec->tfact;
+	pack->ngbad = spec->tgrown;
+	pack->ndmrk = spec->tdresv;
+	pack->nhmrk = spec->thresv;
+	pack->loaded = 0;
 
-		bbt->dev = dev;
-		bbt->addr = addr;
-		bbt->nblks = nblks;
+	free(spec);
 
-		dev->bbts[bbt_idx] = bbt;
-	}
+	return 0;
+}
 
-	/* Update bbt entry in managed memory area with bbt from device */
-	spec = nvm_cmd_gbbt(dev, addr, ret);
-	if (!spec) {
-		free(dev->bbts[bbt_idx]);
-		dev->bbts[bbt_idx] = NULL;
+/**
+ * Allocate a pack holding the table of the device for the LUN at 'addr'
+ */
+static struct nvm_bbt_pack *_pack_fetch(struct nvm_dev *dev,
+					struct nvm_addr addr,
+					struct nvm_ret *ret)
+{
+	struct nvm_bbt_pack *pack;
+
+	pack = _pack_alloc(dev, addr);
+	if (!pack)
+		return NULL;
 
+	if (_pack_refresh(dev, pack, ret)) {
+		_pack_free(pack);
 		return NULL;
 	}
 
-	if (dev->bbts[bbt_idx]->nblks != spec->tblks) {
-		free(dev->bbts[bbt_idx]);
-		free(spec);
-		dev->bbts[bbt_idx] = NULL;
+	return pack;
+}
+
+/**
+ * Retrieve the current table of the slot, fetching it from the device when
+ * missing or when caching is disabled, the caller holds the slot lock
+ */
+static struct nvm_bbt_pack *_slot_fetch(struct nvm_dev *dev,
+					struct nvm_bbt_slot *slot,
+					struct nvm_addr addr,
+					struct nvm_ret *ret)
+{
+	struct nvm_bbt_pack *pack = atomic_load(&slot->pack);
 
+	if (dev->bbts_cached && pack)
+		return pack;
+
+	pack = _pack_fetch(dev, addr, ret);
+	if (!pack)
 		return NULL;
+
+	_slot_publish(slot, pack);
+
+	return pack;
+}
+
+/**
+ * Load the current table of the slot and announce that the calling thread
+ * holds it, until it retrieves the table of the slot again. NULL when none is
+ * published, or when it cannot be announced
+ */
+static struct nvm_bbt_pack *_slot_acquire(struct nvm_bbt_slot *slot)
+{
+	struct nvm_bbt_pack *pack = atomic_load(&slot->pack);
+	struct nvm_bbt_pack *cur;
+
+	for (;;) {
+		if (nvm_rcu_protect(&slot->rcu, pack ? &pack->node : NULL))
+			return NULL;
+
+		cur = atomic_load(&slot->pack);
+		if (cur == pack)
+			return pack;
+
+		pack = cur;
 	}
+}
 
-	for (uint64_t i = 0 ; i < dev->bbts[bbt_idx]->nblks; ++i)
-		dev->bbts[bbt_idx]->blks[i] = spec->blk[i];
+/**
+ * Retrieve the table of the LUN at 'addr', cached tables are read without
+ * locking. The table is held by the calling thread, see _slot_acquire
+ */
+static struct nvm_bbt_pack *_bbt_fetch(struct nvm_dev *dev,
+				       struct nvm_addr addr,
+				       struct nvm_ret *ret)
+{
+	struct nvm_bbt_slot *slot = _bbt_slot(dev, addr);
+	struct nvm_bbt_pack *pack;
 
-	dev->bbts[bbt_idx]->nbad = spec->tfact;
-	dev->bbts[bbt_idx]->ngbad = spec->tgrown;
-	dev->bbts[bbt_idx]->ndmrk = spec->tdresv;
-	dev->bbts[bbt_idx]->nhmrk = spec->thresv;
+	/* Return bbt from cache */
+	pack = _slot_acquire(slot);
+	if (dev->bbts_cached && pack)
+		return pack;
+
+	_slot_lock(slot);
+	pack = _slot_fetch(dev, slot, addr, ret);
+	// Writers retire it only while holding the lock
+	if (pack && nvm_rcu_protect(&slot->rcu, &pack->node)) {
+		NVM_DEBUG("FAILED: nvm_rcu_protect");
+		pack = NULL;
+	}
+	_slot_unlock(slot);
 
-	free(spec);
+	return pack;
+}
 
-	return dev->bbts[bbt_idx];
+const struct nvm_bbt *nvm_bbt_get(struct nvm_dev *dev, struct nvm_addr addr,
+				  struct nvm_ret *ret)
+{
+	struct nvm_bbt_pack *pack;
+
+	if ((!dev) || (nvm_addr_check(addr, dev))) {
+		NVM_DEBUG("FAILED: invalid input");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pack = _bbt_fetch(dev, addr, ret);
+	if (!pack)
+		return NULL;
+
+	return _pack_view(dev, pack);
 }
 
 int nvm_bbt_set(struct nvm_dev *dev, const struct nvm_bbt *bbt,
 		struct nvm_ret *ret)
 {
-	struct nvm_addr addr = bbt->addr;
-	size_t bbt_idx;
+	struct nvm_bbt_slot *slot;
+	struct nvm_bbt_pack *pack;
+	struct nvm_addr addr;
 
 	if ((!dev) || (!bbt) || (nvm_addr_check(bbt->addr, dev))) {
 		NVM_DEBUG("FAILED: invalid input");
 		errno = EINVAL;
 		return -1;
 	}
+	addr = bbt->addr;
 
-	/* Refresh bbt entry in managed memory */
-	if (!nvm_bbt_get(dev, addr, ret)) {
-		NVM_DEBUG("FAILED: nvm_bbt_get failed");
+	for (uint64_t i = 0; i < bbt->nblks; ++i) {
+		if (_bbt_code(bbt->blks[i]) < 0) {
+			NVM_DEBUG("FAILED: unknown state: %u", bbt->blks[i]);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	/* The given bbt replaces the entry in managed memory as a whole */
+	pack = _pack_alloc(dev, addr);
+	if (!pack) {
+		NVM_DEBUG("FAILED: _pack_alloc failed");
+		return -1;
+	}
+
+	if (pack->nblks != bbt->nblks) {
+		NVM_DEBUG("FAILED: nblks mismatch");
+		_pack_free(pack);
+		errno = EINVAL;
 		return -1;
 	}
 
-	/* Update bbt entry in managed memory with given bbt */
-	bbt_idx = _bbt_idx(dev, addr);
 	for (uint64_t i = 0; i < bbt->nblks; ++i)
-		dev->bbts[bbt_idx]->blks[i] = bbt->blks[i];
+		_pack_set(pack, i, _bbt_code(bbt->blks[i]));
 
-	_refresh_counters(dev, dev->bbts[bbt_idx]);
+	_refresh_counters(dev, pack);
+
+	slot = _bbt_slot(dev, addr);
+	_slot_lock(slot);
+	_slot_publish(slot, pack);
+	_slot_unlock(slot);
 
 	if (dev->bbts_cached)
 		return 0;
@@ -276,29 +648,309 @@ int nvm_bbt_set(struct nvm_dev *dev, const struct nvm_bbt *bbt,
 int nvm_bbt_mark(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 		 uint16_t flags, struct nvm_ret *ret)
 {
+	const int code = _bbt_code(flags);
+
 	if (!dev->bbts_cached)
 		return nvm_cmd_sbbt(dev, addrs, naddrs, flags, ret);
 
-	/* Update bbt entries in managed memory */
-	for (int i = 0; i < naddrs; ++i) {
-		struct nvm_addr addr = addrs[i];
+	if (code < 0) {
+		NVM_DEBUG("FAILED: unknown state: 0x%x", flags);
+		errno = EINVAL;
+		return -1;
+	}
 
-		size_t bbt_idx = _bbt_idx(dev, addr);
-		size_t blk_idx = _blk_idx(dev, addr);
+	// Addresses index the shared cache, all are checked before any update
+	for (int i = 0; i < naddrs; ++i) {
+		if (nvm_addr_check(addrs[i], dev)) {
+			NVM_DEBUG("FAILED: nvm_addr_check failed, i: %d", i);
+			errno = EINVAL;
+			return -1;
+		}
+	}
 
-		if (!nvm_bbt_get(dev, addr, ret)) {
-			NVM_DEBUG("FAILED: nvm_bbt_get failed");
+	/* Update bbt entries in managed memory, one copy per touched table */
+	for (int i = 0; i < naddrs; ++i) {
+		const int bbt_idx = _bbt_idx(dev, addrs[i]);
+		struct nvm_bbt_slot *slot = &dev->bbts[bbt_idx];
+		struct nvm_bbt_pack *pack, *new;
+		int seen = 0;
+
+		for (int j = 0; (j < i) && (!seen); ++j)
+			seen = _bbt_idx(dev, addrs[j]) == bbt_idx;
+		if (seen)
+			continue;		// Table updated along with 'j'
+
+		_slot_lock(slot);
+
+		// Tables loaded from a snapshot are validated by replacing
+		// them with the table of the device before they are modified
+		pack = _slot_fetch(dev, slot, addrs[i], ret);
+		if (pack && pack->loaded)
+			new = _pack_fetch(dev, addrs[i], ret);
+		else
+			new = pack ? _pack_dup(dev, pack) : NULL;
+		if (!new) {
+			NVM_DEBUG("FAILED: _slot_fetch / _pack_dup failed");
+			_slot_unlock(slot);
 			return -1;
 		}
 
-		dev->bbts[bbt_idx]->blks[blk_idx] = flags;
+		for (int j = i; j < naddrs; ++j) {
+			if (_bbt_idx(dev, addrs[j]) == bbt_idx)
+				_pack_set(new, _blk_idx(dev, addrs[j]), code);
+		}
+		_refresh_counters(dev, new);
+
+		_slot_publish(slot, new);
+		_slot_unlock(slot);
+	}
+
+	return 0;
+}
+
+int nvm_bbt_get_all(struct nvm_dev *dev, struct nvm_ret *ret)
+{
+	int NTHREADS;
+	int err = 0;
+
+	if (!dev) {
+		NVM_DEBUG("FAILED: invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+	NTHREADS = NVM_MIN((int)dev->nbbts, NVM_BBT_NTHREADS);
+
+	// Each thread fetches distinct LUNs, thus touches distinct cache entries
+	#pragma omp parallel num_threads(NTHREADS) if(NTHREADS>1)
+	{
+		nvm_numa_affinity_apply(dev);
+
+		#pragma omp for schedule(dynamic,1)
+		for (int i = 0; i < (int)dev->nbbts; ++i) {
+			const struct nvm_addr addr = _bbt_addr(dev, i);
+			struct nvm_bbt_slot *slot = _bbt_slot(dev, addr);
+			struct nvm_ret thr_ret = { 0 };
+			int fetched;
+
+			// Fetched under the lock, tables held by the thread are kept
+			_slot_lock(slot);
+			fetched = _slot_fetch(dev, slot, addr, &thr_ret) != NULL;
+			_slot_unlock(slot);
+			if (fetched)
+				continue;
+
+			#pragma omp critical
+			{
+				if (!err) {
+					err = errno ? errno : EIO;
+					if (ret)
+						*ret = thr_ret;
+				}
+			}
+		}
+
+		nvm_numa_affinity_restore();
+	}
 
-		_refresh_counters(dev, dev->bbts[bbt_idx]);
+	if (err) {
+		NVM_DEBUG("FAILED: _bbt_fetch err: %d", err);
+		errno = err;
+		return -1;
 	}
 
 	return 0;
 }
 
+/**
+ * Fill 'snap' with the identity and geometry of the given device
+ */
+static void _snap_fill(const struct nvm_dev *dev, struct nvm_bbt_snap *snap,
+		       uint64_t gen)
+{
+	memset(snap, 0, sizeof(*snap));
+
+	snap->magic = NVM_BBT_SNAP_MAGIC;
+	snap->version = NVM_BBT_SNAP_VERSION;
+	snap->verid = dev->verid;
+	snap->gen = gen;
+	memcpy(snap->nguid, dev->ns.nguid, sizeof(snap->nguid));
+	memcpy(snap->eui64, dev->ns.eui64, sizeof(snap->eui64));
+	snap->nchannels = dev->geo.nchannels;
+	snap->nluns = dev->geo.nluns;
+	snap->nplanes = dev->geo.nplanes;
+	snap->nblocks = dev->geo.nblocks;
+	snap->nbbts = dev->nbbts;
+}
+
+int nvm_bbt_save(struct nvm_dev *dev, const char *path, uint64_t gen)
+{
+	struct nvm_bbt_snap snap;
+	char tmp[NVM_BBT_SNAP_PATH_LEN];
+	FILE *fp;
+	int err = 0;
+
+	if ((!dev) || (!path)) {
+		NVM_DEBUG("FAILED: invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+		NVM_DEBUG("FAILED: path too long");
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		NVM_DEBUG("FAILED: fopen(%s)", tmp);
+		return -1;			// Propagate `errno`
+	}
+
+	_snap_fill(dev, &snap, gen);
+	if (fwrite(&snap, sizeof(snap), 1, fp) != 1)
+		err = -1;
+
+	for (size_t i = 0; !err && i < dev->nbbts; ++i) {
+		struct nvm_bbt_slot *slot = &dev->bbts[i];
+		const struct nvm_bbt_pack *pack;
+		uint8_t present;
+		uint64_t cntrs[4];
+
+		// Writers retire the table only while holding the lock
+		_slot_lock(slot);
+		pack = atomic_load(&slot->pack);
+		present = pack != NULL;
+
+		if (fwrite(&present, sizeof(present), 1, fp) != 1) {
+			_slot_unlock(slot);
+			err = -1;
+			break;
+		}
+		if (!present) {
+			_slot_unlock(slot);
+			continue;
+		}
+
+		cntrs[0] = pack->nbad;
+		cntrs[1] = pack->ngbad;
+		cntrs[2] = pack->ndmrk;
+		cntrs[3] = pack->nhmrk;
+
+		if ((fwrite(cntrs, sizeof(cntrs), 1, fp) != 1) ||
+		    (fwrite(pack->slices, sizeof(*pack->slices),
+			    NVM_BBT_NSLICES * pack->nwords, fp) !=
+		     NVM_BBT_NSLICES * pack->nwords))
+			err = -1;
+
+		_slot_unlock(slot);
+	}
+
+	if (fclose(fp))
+		err = -1;
+
+	if ((!err) && rename(tmp, path))
+		err = -1;
+
+	if (err) {
+		const int errno_saved = errno ? errno : EIO;
+
+		NVM_DEBUG("FAILED: writing snapshot to %s", path);
+		remove(tmp);
+		errno = errno_saved;
+	}
+
+	return err;
+}
+
+int nvm_bbt_load(struct nvm_dev *dev, const char *path, uint64_t gen)
+{
+	struct nvm_bbt_snap expected, snap;
+	FILE *fp;
+	int err = 0;
+
+	if ((!dev) || (!path)) {
+		NVM_DEBUG("FAILED: invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+	if (!dev->bbts_cached) {
+		NVM_DEBUG("FAILED: bbts are not cached");
+		errno = EINVAL;
+		return -1;
+	}
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		NVM_DEBUG("FAILED: fopen(%s)", path);
+		return -1;			// Propagate `errno`
+	}
+
+	if (fread(&snap, sizeof(snap), 1, fp) != 1) {
+		NVM_DEBUG("FAILED: reading snapshot header");
+		fclose(fp);
+		errno = EIO;
+		return -1;
+	}
+
+	// The snapshot must be of this very device and generation
+	_snap_fill(dev, &expected, gen);
+	if (memcmp(&snap, &expected, sizeof(snap))) {
+		NVM_DEBUG("FAILED: snapshot does not match device or gen");
+		fclose(fp);
+		errno = ESTALE;
+		return -1;
+	}
+
+	for (size_t i = 0; i < dev->nbbts; ++i) {
+		struct nvm_bbt_pack *pack, *cur = NULL;
+		uint64_t cntrs[4];
+		uint8_t present;
+
+		if (fread(&present, sizeof(present), 1, fp) != 1) {
+			err = -1;
+			break;
+		}
+		if (!present)
+			continue;
+
+		pack = _pack_alloc(dev, _bbt_addr(dev, i));
+		if (!pack) {
+			err = -1;
+			break;
+		}
+
+		if ((fread(cntrs, sizeof(cntrs), 1, fp) != 1) ||
+		    (fread(pack->slices, sizeof(*pack->slices),
+			   NVM_BBT_NSLICES * pack->nwords, fp) !=
+		     NVM_BBT_NSLICES * pack->nwords)) {
+			_pack_free(pack);
+			err = -1;
+			break;
+		}
+
+		pack->nbad = cntrs[0];
+		pack->ngbad = cntrs[1];
+		pack->ndmrk = cntrs[2];
+		pack->nhmrk = cntrs[3];
+		pack->loaded = 1;
+
+		// Never replace what is cached
+		if (!atomic_compare_exchange_strong(&dev->bbts[i].pack, &cur,
+						    pack))
+			_pack_free(pack);
+	}
+
+	fclose(fp);
+
+	if (err) {
+		NVM_DEBUG("FAILED: reading snapshot from %s", path);
+		if (errno != ENOMEM)
+			errno = EIO;
+	}
+
+	return err;
+}
+
 struct nvm_bbt *nvm_bbt_alloc_cp(const struct nvm_bbt *bbt)
 {
 	struct nvm_bbt *new;
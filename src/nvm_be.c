@@ -28,11 +28,17 @@
  */
 #include <errno.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 #include <dirent.h>
+#include <sys/stat.h>
 #include <liblightnvm.h>
 #include <nvm_be.h>
 #include <nvm_dev.h>
 
+#define NVM_BE_CACHE_PATH_LEN 4096
+
 static struct nvm_be *nvm_be_imps[] = {
 	&nvm_be_ioctl,
 	&nvm_be_lbd,
@@ -416,12 +422,20 @@ int nvm_be_populate_derived(struct nvm_dev *dev)
 int nvm_be_populate(struct nvm_dev *dev, struct nvm_be *be)
 {
 	struct nvm_geo *geo = &dev->geo;
+	const struct nvm_be_cache *cache;
 	struct nvm_spec_idfy *idfy = NULL;
 	int err;
 
 	dev->be = be;			// TODO: Clean the init. process
 
-	idfy = be->idfy(dev, NULL);
+	cache = nvm_be_cache_get(dev);
+	if (cache) {			// Skip the identify round-trip
+		idfy = nvm_buf_alloc(dev, sizeof(*idfy), NULL);
+		if (idfy)
+			*idfy = cache->idfy;
+	} else {
+		idfy = be->idfy(dev, NULL);
+	}
 	if (!idfy) {
 		NVM_DEBUG("FAILED: be->idfy(...)");
 		return -1;
@@ -513,8 +527,231 @@ failed:
 	return -1;
 }
 
+/**
+ * Entry of the device currently being opened by this thread, if any
+ */
+static _Thread_local const struct nvm_be_cache *nvm_be_cache_cur;
+
+/**
+ * Serial number reported by the backend opening a device on this thread, and
+ * whether it differs from that of the entry in use
+ */
+static _Thread_local char nvm_be_cache_sn[NVM_BE_CACHE_SN_LEN];
+static _Thread_local int nvm_be_cache_stale;
+
+/**
+ * Copy the serial number 'sn' of at most 'len' bytes, e.g. space-padded as in
+ * the identify controller data or newline terminated as in sysfs, into 'dst'
+ */
+static void nvm_be_cache_sn_copy(char dst[NVM_BE_CACHE_SN_LEN],
+				 const char *sn, size_t len)
+{
+	size_t n = 0;
+
+	while ((n < len) && (n < NVM_BE_CACHE_SN_LEN - 1) && sn[n] &&
+	       (sn[n] != '\n'))
+		++n;
+	while (n && (sn[n - 1] == ' '))
+		--n;
+
+	memset(dst, 0, NVM_BE_CACHE_SN_LEN);
+	memcpy(dst, sn, n);
+}
+
+int nvm_be_cache_serial(const char *sn, size_t len)
+{
+	nvm_be_cache_sn_copy(nvm_be_cache_sn, sn, len);
+
+	if (nvm_be_cache_cur &&
+	    strncmp(nvm_be_cache_cur->serial, nvm_be_cache_sn,
+		    NVM_BE_CACHE_SN_LEN)) {
+		NVM_DEBUG("INFO: stale cache entry, serial: %s",
+			  nvm_be_cache_sn);
+		nvm_be_cache_cur = NULL;
+		nvm_be_cache_stale = 1;
+		return -1;
+	}
+
+	return 0;
+}
+
+const struct nvm_be_cache *nvm_be_cache_get(const struct nvm_dev *dev)
+{
+	const struct nvm_be_cache *cache = nvm_be_cache_cur;
+
+	if ((!cache) || strncmp(cache->ident, dev->path, NVM_DEV_PATH_LEN) ||
+	    (cache->nsid != dev->nsid))
+		return NULL;
+
+	return cache;
+}
+
+/**
+ * Produce the path of the cache entry of the given device identifier, the
+ * cache is disabled when NVM_DEV_CACHE is not set
+ */
+static int nvm_be_cache_path(const char *dev_ident, char *path, size_t len)
+{
+	const char *dir = getenv("NVM_DEV_CACHE");
+	int n;
+
+	if ((!dir) || (!dir[0]))
+		return -1;
+
+	n = snprintf(path, len, "%s/", dir);
+	if ((n < 0) || ((size_t)n >= len))
+		return -1;
+
+	for (const char *c = dev_ident; *c && ((size_t)n < len - 1); ++c)
+		path[n++] = isalnum((unsigned char)*c) ? *c : '_';
+	path[n] = '\0';
+
+	return 0;
+}
+
+/**
+ * Read the serial number of the controller of the device node 'dev_ident'
+ * from sysfs, the node is either a namespace e.g. "/dev/nvme0n1" or a
+ * controller e.g. "/dev/nvme0"
+ */
+static void nvm_be_cache_sn_sysfs(const char *dev_ident,
+				  char sn[NVM_BE_CACHE_SN_LEN])
+{
+	const char *fmts[] = {
+		"/sys/class/block/%s/device/serial",
+		"/sys/class/nvme/%s/serial",
+	};
+	const char *name = strrchr(dev_ident, '/');
+	char path[NVM_BE_CACHE_PATH_LEN];
+	char buf[NVM_BE_CACHE_SN_LEN];
+
+	name = name ? name + 1 : dev_ident;
+
+	for (size_t i = 0; i < sizeof(fmts) / sizeof(*fmts); ++i) {
+		FILE *fp;
+
+		snprintf(path, sizeof(path), fmts[i], name);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+
+		if (fgets(buf, sizeof(buf), fp))
+			nvm_be_cache_sn_copy(sn, buf, sizeof(buf));
+		fclose(fp);
+		return;
+	}
+}
+
+/**
+ * Fill the key of the cache entry of 'dev_ident'
+ */
+static void nvm_be_cache_key(const char *dev_ident, struct nvm_be_cache *cache)
+{
+	struct stat st;
+
+	memset(cache, 0, sizeof(*cache));
+	cache->magic = NVM_BE_CACHE_MAGIC;
+	cache->version = NVM_BE_CACHE_VERSION;
+	strncpy(cache->ident, dev_ident, NVM_DEV_PATH_LEN - 1);
+
+	if (stat(dev_ident, &st))
+		return;			// E.g. an SPDK transport identifier
+
+	cache->rdev = st.st_rdev;
+	cache->ctime_sec = st.st_ctim.tv_sec;
+	cache->ctime_nsec = st.st_ctim.tv_nsec;
+	nvm_be_cache_sn_sysfs(dev_ident, cache->serial);
+}
+
+static int nvm_be_cache_load(const char *dev_ident, struct nvm_be_cache *cache)
+{
+	char path[NVM_BE_CACHE_PATH_LEN];
+	struct nvm_be_cache key;
+	FILE *fp;
+	size_t nread;
+
+	if (nvm_be_cache_path(dev_ident, path, sizeof(path)))
+		return -1;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return -1;
+
+	nread = fread(cache, sizeof(*cache), 1, fp);
+	fclose(fp);
+	if (nread != 1)
+		return -1;
+
+	nvm_be_cache_key(dev_ident, &key);
+	if ((cache->magic != key.magic) || (cache->version != key.version) ||
+	    strncmp(cache->ident, key.ident, NVM_DEV_PATH_LEN) ||
+	    (cache->rdev != key.rdev) || (cache->ctime_sec != key.ctime_sec) ||
+	    (cache->ctime_nsec != key.ctime_nsec) ||
+	    (key.serial[0] &&
+	     strncmp(cache->serial, key.serial, NVM_BE_CACHE_SN_LEN))) {
+		NVM_DEBUG("INFO: stale cache entry: %s", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void nvm_be_cache_store(const char *dev_ident, const struct nvm_dev *dev)
+{
+	char path[NVM_BE_CACHE_PATH_LEN], tmp[NVM_BE_CACHE_PATH_LEN + 4];
+	struct nvm_be_cache *cache;
+	FILE *fp;
+	int err;
+
+	if (nvm_be_cache_path(dev_ident, path, sizeof(path)))
+		return;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	cache = malloc(sizeof(*cache));
+	if (!cache)
+		return;
+
+	nvm_be_cache_key(dev_ident, cache);
+	if (!cache->serial[0])		// Reported by the backend, if any
+		memcpy(cache->serial, nvm_be_cache_sn, NVM_BE_CACHE_SN_LEN);
+	cache->bid = dev->be->id;
+	cache->nsid = dev->nsid;
+	cache->ns = dev->ns;
+	cache->idfy = dev->idfy;
+
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		NVM_DEBUG("INFO: cannot store cache entry: %s", path);
+		free(cache);
+		return;
+	}
+	err = fwrite(cache, sizeof(*cache), 1, fp) != 1;
+	err |= fclose(fp);
+	if (err || rename(tmp, path)) {
+		NVM_DEBUG("INFO: cannot store cache entry: %s", path);
+		remove(tmp);
+	}
+
+	free(cache);
+}
+
+/**
+ * Open the device using the given backend
+ */
+static struct nvm_dev *nvm_be_open(struct nvm_be *be, const char *dev_ident,
+				   int flags)
+{
+	struct nvm_dev *dev = be->open(dev_ident, flags);
+
+	if (dev)
+		dev->be = be;
+
+	return dev;
+}
+
 struct nvm_dev *nvm_be_factory(const char *dev_ident, int flags)
 {
+	struct nvm_be_cache *cache;
 	int bid;
 
 	bid = flags & NVM_BE_ALL;
@@ -535,6 +772,35 @@ struct nvm_dev *nvm_be_factory(const char *dev_ident, int flags)
 		return NULL;
 	}
 
+	// Try the backend remembered for the device, using its cached identify
+	cache = malloc(sizeof(*cache));
+	if (cache && (!nvm_be_cache_load(dev_ident, cache))) {
+		for (int i = 0; nvm_be_imps[i]; ++i) {
+			struct nvm_dev *dev = NULL;
+
+			if ((nvm_be_imps[i]->id != cache->bid) ||
+			    (bid && !(nvm_be_imps[i]->id & bid))) {
+				continue;
+			}
+
+			nvm_be_cache_sn[0] = '\0';
+			nvm_be_cache_stale = 0;
+			nvm_be_cache_cur = cache;
+			dev = nvm_be_open(nvm_be_imps[i], dev_ident, flags);
+			nvm_be_cache_cur = NULL;
+			if (dev) {
+				if (nvm_be_cache_stale)
+					nvm_be_cache_store(dev_ident, dev);
+				free(cache);
+				return dev;
+			}
+
+			NVM_DEBUG("INFO: cached backend failed, probing all");
+			break;
+		}
+	}
+	free(cache);
+
 	for (int i = 0; nvm_be_imps[i]; ++i) {
 		struct nvm_dev *dev = NULL;
 
@@ -542,12 +808,13 @@ struct nvm_dev *nvm_be_factory(const char *dev_ident, int flags)
 			continue;
 		}
 
-		dev = nvm_be_imps[i]->open(dev_ident, flags);
+		nvm_be_cache_sn[0] = '\0';
+		dev = nvm_be_open(nvm_be_imps[i], dev_ident, flags);
 		if (!dev) {
 			continue;
 		}
 
-		dev->be = nvm_be_imps[i];
+		nvm_be_cache_store(dev_ident, dev);
 		return dev;
 	}
 
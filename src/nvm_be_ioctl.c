@@ -74,6 +74,8 @@ struct nvm_be nvm_be_ioctl = {
 #include <nvm_be.h>
 #include <nvm_be_ioctl.h>
 #include <nvm_dev.h>
+#include <nvm_numa.h>
+#include <nvm_probe.h>
 
 #ifdef NVM_DEBUG_ENABLED
 static const char *ioctl_request_to_str(unsigned long req)
@@ -98,8 +100,11 @@ static const char *ioctl_request_to_str(unsigned long req)
 static inline int ioctl_vio(struct nvm_dev *dev, struct nvm_cmd *cmd,
 			    struct nvm_ret *ret)
 {
+	NVM_PROBE_BGN(clk);
 	const int err = ioctl(dev->fd, NVME_NVM_IOCTL_SUBMIT_VIO, cmd);
 
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
+
 	if (ret) {
 		ret->result.vio.cs = cmd->vuser.status;
 		ret->status = cmd->vuser.result;
@@ -448,17 +453,23 @@ int nvm_be_ioctl_scalar_erase(struct nvm_dev *dev, struct nvm_addr *addrs,
 		return -1;
 	}
 
-	dsmr = nvm_buf_alloc(dev, dsmr_len, NULL);
+	{
+		NVM_PROBE_BGN(clk_dma);
+		dsmr = nvm_buf_alloc(dev, dsmr_len, NULL);
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_DMA, clk_dma);
+	}
 	if (!dsmr) {
 		NVM_DEBUG("FAILED: nvm_buf_alloc of DSM range");
 		return -1;
 	}
 
+	NVM_PROBE_BGN(clk_addr);
 	for(int idx = 0; idx < naddrs; ++idx) {
 		dsmr[idx].cattr = 0;
 		dsmr[idx].nlb = geo->l.nsectr;
 		dsmr[idx].slba = nvm_addr_gen2dev(dev, addrs[idx]);
 	}
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_ADDR, clk_addr);
 
 	cmd.passthru.opcode = NVM_DOPC_SCALAR_ERASE;
 	cmd.passthru.nsid = dev->nsid;
@@ -467,7 +478,9 @@ int nvm_be_ioctl_scalar_erase(struct nvm_dev *dev, struct nvm_addr *addrs,
 	cmd.passthru.cdw10 = naddrs - 1;
 	cmd.passthru.cdw11 = 0x1 << 2; // Assign Bit: Attribute Deallocate (AD)
 
+	NVM_PROBE_BGN(clk);
 	int err = ioctl_wrap(dev, NVME_IOCTL_IO_CMD, &cmd, ret);
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
 	if (err) {
 		nvm_buf_free(dev, dsmr);
 		return -1;
@@ -545,8 +558,10 @@ static inline int cmd_scalar_wr(struct nvm_dev *dev, struct nvm_addr addr,
 	cmd.passthru.cdw12 = naddrs - 1;
 
 	int err;
+	NVM_PROBE_BGN(clk);
 
 	err = ioctl_wrap(dev, NVME_IOCTL_IO_CMD, &cmd, ret);
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
 	if (err) {
 		return -1;
 	}
@@ -600,9 +615,11 @@ static inline int cmd_vector_ewr(struct nvm_dev *dev, struct nvm_addr addrs[],
 	cmd.vuser.control = flags | NVM_FLAG_DEFAULT;
 
 	// Setup PPAs: Convert address format from generic to device specific
+	NVM_PROBE_BGN(clk);
 	for (i = 0; i < naddrs; ++i) {
 		dev_addrs[i] = nvm_addr_gen2dev(dev, addrs[i]);
 	}
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_ADDR, clk);
 
 	// Unnatural numbers: counting from zero
 	cmd.vuser.nppas = naddrs - 1;
@@ -724,17 +741,23 @@ struct nvm_dev *nvm_be_ioctl_open(const char *dev_path, int flags)
 		return NULL;
 	}
 
-	struct nvm_cmd cmd = { 0 };
+	if (nvm_be_cache_get(dev)) {	// Skip the identify round-trip
+		dev->ns = nvm_be_cache_get(dev)->ns;
+	} else {
+		struct nvm_cmd cmd = { 0 };
 
-	cmd.admin.opcode = 0x06; // identify
-	cmd.admin.nsid = dev->nsid;
-	cmd.admin.addr = (uint64_t)(uintptr_t) &dev->ns;
-	cmd.admin.data_len = 0x1000;
+		cmd.admin.opcode = 0x06; // identify
+		cmd.admin.nsid = dev->nsid;
+		cmd.admin.addr = (uint64_t)(uintptr_t) &dev->ns;
+		cmd.admin.data_len = 0x1000;
 
-	if (ioctl_wrap(dev, NVME_IOCTL_ADMIN_CMD, &cmd, NULL)) {
-		return NULL;
+		if (ioctl_wrap(dev, NVME_IOCTL_ADMIN_CMD, &cmd, NULL)) {
+			return NULL;
+		}
 	}
 
+	dev->numa_node = nvm_numa_node_sysfs(dev->name);
+
 	err = nvm_be_populate(dev, &nvm_be_ioctl);
 	if (err) {
 		NVM_DEBUG("FAILED: nvm_be_populate");
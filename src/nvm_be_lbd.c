@@ -74,6 +74,7 @@ struct nvm_be nvm_be_lbd = {
 #include <nvm_be_ioctl.h>
 #include <nvm_dev.h>
 #include <nvm_async.h>
+#include <nvm_probe.h>
 
 #ifdef HAVE_LIBAIO
 #include <libaio.h>
@@ -140,14 +141,20 @@ int nvm_be_lbd_async_term(struct nvm_dev *NVM_UNUSED(dev),
 	return 0;
 }
 
-int cmd_async_getevents(struct nvm_async_ctx *ctx, unsigned int min,
-			unsigned int max, struct timespec *timeout)
+int cmd_async_getevents(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+			unsigned int min, unsigned int max,
+			struct timespec *timeout)
 {
 	struct nvm_be_lbd_async_state *state = ctx->be_ctx;
 
 	int r, nevents = 0;
 	while (ctx->outstanding) {
-		if (0 == (r = io_getevents(state->aio_ctx, min, max, state->aio_events, timeout))) {
+		NVM_PROBE_BGN(clk);
+
+		r = io_getevents(state->aio_ctx, min, max, state->aio_events,
+				 timeout);
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_CPL, clk);
+		if (0 == r) {
 			break;
 		}
 
@@ -160,7 +167,11 @@ int cmd_async_getevents(struct nvm_async_ctx *ctx, unsigned int min,
 			struct nvm_ret *ret = event->data;
 
 			ret->status = event->res2;
-			ret->async.cb(ret, ret->async.cb_arg);
+			{
+				NVM_PROBE_BGN(clk_cb);
+				ret->async.cb(ret, ret->async.cb_arg);
+				NVM_PROBE_END(dev, NVM_DEV_PROBE_CB, clk_cb);
+			}
 
 			state->iocbs[--(ctx->outstanding)] = event->obj;
 		}
@@ -169,21 +180,21 @@ int cmd_async_getevents(struct nvm_async_ctx *ctx, unsigned int min,
 	return nevents;
 }
 
-int nvm_be_lbd_async_poke(struct nvm_dev *NVM_UNUSED(dev),
-			  struct nvm_async_ctx *ctx, uint32_t max)
+int nvm_be_lbd_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+			  uint32_t max)
 {
 	struct timespec timeout = { 0, 0 };
 	if (!max) {
 		max = ctx->depth;
 	}
 
-	return cmd_async_getevents(ctx, 0, max, &timeout);
+	return cmd_async_getevents(dev, ctx, 0, max, &timeout);
 }
 
-int nvm_be_lbd_async_wait(struct nvm_dev *NVM_UNUSED(dev),
-			  struct nvm_async_ctx *ctx)
+int nvm_be_lbd_async_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
 {
-	return cmd_async_getevents(ctx, ctx->outstanding, ctx->depth, NULL);
+	return cmd_async_getevents(dev, ctx, ctx->outstanding, ctx->depth,
+				   NULL);
 }
 
 int cmd_async_scalar_wr(struct nvm_dev *dev, int naddrs, void *data,
@@ -218,7 +229,9 @@ int cmd_async_scalar_wr(struct nvm_dev *dev, int naddrs, void *data,
 
 	iocb->data = ret;
 
+	NVM_PROBE_BGN(clk);
 	int r = io_submit(state->aio_ctx, 1, &iocb);
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
 	if (r < 0) {
 		errno = -r;
 		return -1;
@@ -251,10 +264,13 @@ static int nvm_be_lbd_scalar_erase(struct nvm_dev *dev, struct nvm_addr addrs[],
 		uint64_t range[2];
 		int err;
 
+		NVM_PROBE_BGN(clk);
+
 		range[0] = nvm_addr_gen2off(dev, addrs[i]);
 		range[1] = dev->geo.l.nsectr << dev->ssw;
 
 		err = ioctl(dev->fd, BLKDISCARD, &range);
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
 		if (err) {
 			NVM_DEBUG("FAILED: BLKDISCARD, err: %d, %s", err,
 				  strerror(errno));
@@ -284,7 +300,9 @@ int nvm_be_lbd_scalar_read(struct nvm_dev *dev, struct nvm_addr addr,
 					   ret, NVM_DOPC_SCALAR_READ);
 	}
 
+	NVM_PROBE_BGN(clk);
 	res = pread(dev->fd, data, dev->geo.l.nbytes * naddrs, offset);
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
 	if (res < 0) {
 		NVM_DEBUG("FAILED: res: %zd, errno: %s", res, strerror(errno));
 		// Propagate errno
@@ -312,7 +330,9 @@ int nvm_be_lbd_scalar_write(struct nvm_dev *dev, struct nvm_addr addr,
 					   ret, NVM_DOPC_SCALAR_WRITE);
 	}
 
+	NVM_PROBE_BGN(clk);
 	res = pwrite(dev->fd, data, dev->geo.l.nbytes * naddrs, offset);
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
 	if (res < 0) {
 		NVM_DEBUG("FAILED: res: %zd, errno: %s", res, strerror(errno));
 		// Propagate errno
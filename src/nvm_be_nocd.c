@@ -134,6 +134,7 @@ struct nvm_dev *nvm_be_nocd_open(const char *dev_path, int flags)
 
 	dev->be_state = spdk;
 	dev->nsid = spdk->nsid;
+	dev->numa_node = spdk->socket;
 	memcpy(&dev->ns, &spdk->nsdata, sizeof(dev->ns));
 
 	err = nvm_be_populate(dev, &nvm_be_nocd);
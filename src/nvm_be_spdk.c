@@ -59,12 +59,16 @@ struct nvm_be nvm_be_spdk = {
 };
 #else
 #include <assert.h>
+#include <ctype.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <nvm_async.h>
 #include <nvm_dev.h>
 #include <nvm_cmd.h>
 #include <nvm_sgl.h>
+#include <nvm_probe.h>
 #include <nvm_be.h>
 #include <nvm_be_spdk.h>
 #ifdef NVM_BE_SPDK_CHOKE_PRINTING
@@ -117,77 +121,249 @@ static inline int submit_ioc(struct spdk_nvme_ctrlr *ctrlr,
 }
 
 /**
- * Attach to the device matching the traddr and only if we have not yet attached
+ * Registry of attached controllers, guarded by 'registry_lock', which also
+ * guards initialization of the SPDK environment
+ */
+static struct nvm_be_spdk_ctrlr *registry;
+static atomic_flag registry_lock = ATOMIC_FLAG_INIT;
+
+static inline void registry_acquire(void)
+{
+	while (atomic_flag_test_and_set(&registry_lock))
+		sched_yield();
+}
+
+static inline void registry_release(void)
+{
+	atomic_flag_clear(&registry_lock);
+}
+
+/**
+ * Attach to the controller matching the traddr and only if we have not yet
+ * attached
  */
 static bool probe_cb(void *cb_ctx, const struct spdk_nvme_transport_id *trid,
 		     struct spdk_nvme_ctrlr_opts *opts)
 {
-	struct nvm_be_spdk_state *state = cb_ctx;
+	struct nvm_be_spdk_ctrlr *entry = cb_ctx;
 
-	if (spdk_nvme_transport_id_compare(&state->trid, trid)) {
-		NVM_DEBUG("trid->traddr: %s != state->trid.traddr: %s",
-			  trid->traddr, state->trid.traddr);
+	if (spdk_nvme_transport_id_compare(&entry->trid, trid)) {
+		NVM_DEBUG("trid->traddr: %s != entry->trid.traddr: %s",
+			  trid->traddr, entry->trid.traddr);
 		return false;
 	}
 
 	/* Disable CMB sqs / cqs for now due to shared PMR / CMB */
 	opts->use_cmb_sqs = false;
 
-	return !state->attached;
+	return !entry->ctrlr;
 }
 
-/**
- * Sets up the state{ns, nsid, ctrlr, attached} given via the cb_ctx
- * using the first available name-space.
- */
 static void attach_cb(void *cb_ctx,
 		      const struct spdk_nvme_transport_id *NVM_UNUSED(trid),
 		      struct spdk_nvme_ctrlr *ctrlr,
 		      const struct spdk_nvme_ctrlr_opts *NVM_UNUSED(opts))
 {
-	const int num_ns = spdk_nvme_ctrlr_get_num_ns(ctrlr);
-	struct nvm_be_spdk_state *state = cb_ctx;
+	struct nvm_be_spdk_ctrlr *entry = cb_ctx;
 
-	for (int nsid = 1; nsid <= num_ns; nsid++) {
-		struct spdk_nvme_ns *ns = NULL;
+	entry->ctrlr = ctrlr;
+}
 
-		ns = spdk_nvme_ctrlr_get_ns(ctrlr, nsid);
-		if (ns == NULL) {
-			NVM_DEBUG("skipping invalid nsid: %d", nsid);
-			continue;
+/**
+ * Initialize the SPDK environment, once per process, the caller holds the
+ * registry lock
+ */
+static int env_init(void)
+{
+	static struct spdk_env_opts opts;
+
+	if (!_do_spdk_env_init) {
+		return 0;
+	}
+
+#ifdef NVM_BE_SPDK_CHOKE_PRINTING
+	// SPDK and DPDK are very chatty, this makes them less so.
+	spdk_log_set_print_level(SPDK_LOG_ERROR);
+	rte_log_set_global_level(RTE_LOG_EMERG);
+#endif
+
+	/*
+	 * SPDK relies on an abstraction around the local environment named env
+	 * that handles memory allocation and PCI device operations.  This
+	 * library must be initialized first.
+	 */
+	spdk_env_opts_init(&opts);
+	opts.name = "liblightnvm";
+	opts.shm_id = 0;
+	opts.master_core = 0;
+
+	if (spdk_env_init(&opts)) {
+		NVM_DEBUG("FAILED: spdk_env_init");
+		return -1;
+	}
+
+	_do_spdk_env_init = 0;
+
+	return 0;
+}
+
+/**
+ * Release a reference to the given controller, detaching from it and freeing
+ * its SYNC qpair when it was the last
+ */
+static void ctrlr_put(struct nvm_be_spdk_ctrlr *entry)
+{
+	struct nvm_be_spdk_ctrlr **link;
+
+	registry_acquire();
+
+	if (--entry->nrefs) {
+		registry_release();
+		return;
+	}
+
+	for (link = &registry; *link; link = &(*link)->next) {
+		if (*link == entry) {
+			*link = entry->next;
+			break;
 		}
-		if (!spdk_nvme_ns_is_active(ns)) {
-			NVM_DEBUG("skipping inactive nsid: %d", nsid);
-			continue;
+	}
+
+	registry_release();
+
+	if (entry->qpair) {
+		spdk_nvme_ctrlr_free_io_qpair(entry->qpair);
+		omp_destroy_lock(&entry->qpair_lock);
+	}
+
+	if (entry->ctrlr) {
+		spdk_nvme_detach(entry->ctrlr);
+	}
+
+	free(entry);
+}
+
+/**
+ * Retrieve a reference to the controller matching 'trid', attaching to it and
+ * setting up its SYNC qpair when it is not yet in the registry
+ */
+static struct nvm_be_spdk_ctrlr *ctrlr_get(
+				const struct spdk_nvme_transport_id *trid)
+{
+	struct nvm_be_spdk_ctrlr *entry;
+	int err;
+
+	registry_acquire();
+
+	for (entry = registry; entry; entry = entry->next) {
+		if (!spdk_nvme_transport_id_compare(&entry->trid, trid)) {
+			++entry->nrefs;
+			registry_release();
+			return entry;
 		}
+	}
 
-		state->ns = ns;
-		state->nsid = nsid;
-		state->ctrlr = ctrlr;
-		state->attached = 1;
+	if (env_init()) {
+		registry_release();
+		return NULL;
+	}
 
-		break;
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		NVM_DEBUG("FAILED: calloc(nvm_be_spdk_ctrlr)");
+		registry_release();
+		return NULL;
 	}
+	entry->trid = *trid;
+
+	/*
+	 * Start the SPDK NVMe enumeration process.
+	 *
+	 * probe_cb will be called for each NVMe controller found, giving our
+	 * application a choice on whether to attach to each controller.
+	 *
+	 * attach_cb will then be called for each controller after the SPDK NVMe
+	 * driver has completed initializing the controller we chose to attach.
+	 */
+	for (int i = 0; !entry->ctrlr; ++i) {
+		if (NVM_BE_SPDK_MAX_PROBE_ATTEMPTS == i) {
+			NVM_DEBUG("FAILED: max attempts exceeded");
+			registry_release();
+			free(entry);
+			return NULL;
+		}
+
+		err = spdk_nvme_probe(&entry->trid, entry, probe_cb, attach_cb,
+				      NULL);
+		if ((err) || (!entry->ctrlr)) {
+			NVM_DEBUG("FAILED: spdk_nvme_probe, a:%d, e:%d, i:%d",
+				  !!entry->ctrlr, err, i);
+		}
+	}
+
+	// Setup NVMe IO qpair for SYNC commands, shared by all namespaces
+	entry->qpair = spdk_nvme_ctrlr_alloc_io_qpair(entry->ctrlr, NULL, 0);
+	if (!entry->qpair) {
+		NVM_DEBUG("FAILED: allocating qpair");
+		registry_release();
+		spdk_nvme_detach(entry->ctrlr);
+		free(entry);
+		return NULL;
+	}
+
+	// Setup IO qpair lock for SYNC commands
+	omp_init_lock(&entry->qpair_lock);
+
+	entry->nrefs = 1;
+	entry->next = registry;
+	registry = entry;
+
+	registry_release();
+
+	return entry;
 }
 
-void nvm_be_spdk_close(struct nvm_dev *dev)
+/**
+ * Split 'ident' into a transport identifier and an optional namespace
+ * identifier given as the key "ns", e.g. "traddr:0000:01:00.0 ns:2"
+ */
+static int ident_parse(const char *ident, struct spdk_nvme_transport_id *trid,
+		       uint16_t *nsid)
 {
-	struct nvm_be_spdk_state *state = dev ? dev->be_state : NULL;
+	char buf[NVM_DEV_PATH_LEN] = { 0 };
+	char *key;
+	int err;
 
-	if (!state) {
-		return;
+	strncpy(buf, ident, sizeof(buf) - 1);
+
+	*nsid = 0;
+	key = strstr(buf, "ns:");
+	if (key && ((key == buf) || isspace((unsigned char)key[-1]))) {
+		*nsid = strtoul(key + 3, NULL, 10);
+		*key = '\0';
 	}
 
-	if (state->qpair) {
-		spdk_nvme_ctrlr_free_io_qpair(state->qpair);
-		omp_destroy_lock(&state->qpair_lock);
+	trid->trtype = SPDK_NVME_TRANSPORT_PCIE;
+
+	err = spdk_nvme_transport_id_parse(trid, buf);
+	if (err) {
+		NVM_DEBUG("FAILED: *_id_parse ident(%s), err: %d", ident, err);
+		errno = -err;
+		return -1;
 	}
 
-	if (state->ctrlr) {
-		spdk_nvme_detach(state->ctrlr);
+	return 0;
+}
+
+void nvm_be_spdk_close(struct nvm_dev *dev)
+{
+	struct nvm_be_spdk_state *state = dev ? dev->be_state : NULL;
+
+	if (!state) {
+		return;
 	}
 
-	free(state);
+	nvm_be_spdk_state_term(state);
 	dev->be_state = NULL;
 }
 
@@ -197,13 +373,8 @@ void nvm_be_spdk_state_term(struct nvm_be_spdk_state *state)
 		return;
 	}
 
-	if (state->qpair) {
-		spdk_nvme_ctrlr_free_io_qpair(state->qpair);
-		omp_destroy_lock(&state->qpair_lock);
-	}
-
-	if (state->ctrlr) {
-		spdk_nvme_detach(state->ctrlr);
+	if (state->shared) {
+		ctrlr_put(state->shared);
 	}
 
 	free(state);
@@ -212,89 +383,77 @@ void nvm_be_spdk_state_term(struct nvm_be_spdk_state *state)
 /**
  * Enumerates NVMe devices as seen by SPDK and grabs the first matching 'ident'
  *
- * - Attaches to a single controller matching 'ident'
- * - Associates first available namespace
+ * - Shares the controller matching 'ident' with other devices, attaching to
+ *   it, and creating the IO qpair for SYNC commands, only on first use
+ * - Associates the namespace given by 'ident', or the first available
  * - Copies namespace data
- * - Creates an IO qpair for SYNC commands and allocates associated lock
  */
 struct nvm_be_spdk_state *nvm_be_spdk_state_init(const char *ident,
 						 int NVM_UNUSED(flags))
 {
 	const struct spdk_nvme_ns_data *nsdata;
 	struct nvm_be_spdk_state *state;
-	int err;
+	int num_ns;
 
-	state = malloc(sizeof(*state));
+	state = calloc(1, sizeof(*state));
 	if (!state) {
-		NVM_DEBUG("FAILED: malloc(spdk_be_state)");
+		NVM_DEBUG("FAILED: calloc(spdk_be_state)");
 		return NULL;
 	}
-	memset(state, 0, sizeof(*state));
-
-	state->opts.name = "liblightnvm";
-	state->opts.shm_id = 0;
-	state->opts.master_core = 0;
 
-	if (_do_spdk_env_init) {
-#ifdef NVM_BE_SPDK_CHOKE_PRINTING
-		// SPDK and DPDK are very chatty, this makes them less so.
-		spdk_log_set_print_level(SPDK_LOG_ERROR);
-		rte_log_set_global_level(RTE_LOG_EMERG);
-#endif
-
-		/*
-		 * SPDK relies on an abstraction around the local environment named env
-		 * that handles memory allocation and PCI device operations.  This
-		 * library must be initialized first.
-		 */
-		spdk_env_opts_init(&(state->opts));
-
-		err = spdk_env_init(&(state->opts));
-		if (err) {
-			NVM_DEBUG("FAILED: spdk_env_init");
-			nvm_be_spdk_state_term(state);
-			return NULL;
-		}
-
-		_do_spdk_env_init = 0;
+	if (ident_parse(ident, &state->trid, &state->nsid)) {
+		nvm_be_spdk_state_term(state);
+		return NULL;
 	}
 
-	/*
-	 * Parse 'ident' into transport_id so we can use it to compare to the
-	 * probed controller
-	 */
-	state->trid.trtype = SPDK_NVME_TRANSPORT_PCIE;
-
-	err = spdk_nvme_transport_id_parse(&state->trid, ident);
-	if (err) {
-		NVM_DEBUG("FAILED: *_id_parse ident(%s), err: %d", ident, err);
-		errno = -err;
+	state->shared = ctrlr_get(&state->trid);
+	if (!state->shared) {
+		NVM_DEBUG("FAILED: ctrlr_get");
 		nvm_be_spdk_state_term(state);
 		return NULL;
 	}
+	state->ctrlr = state->shared->ctrlr;
+	state->qpair = state->shared->qpair;
+	state->qpair_lock = &state->shared->qpair_lock;
 
-	/*
-	 * Start the SPDK NVMe enumeration process.
-	 *
-	 * probe_cb will be called for each NVMe controller found, giving our
-	 * application a choice on whether to attach to each controller.
-	 *
-	 * attach_cb will then be called for each controller after the SPDK NVMe
-	 * driver has completed initializing the controller we chose to attach.
-	 */
-	for (int i = 0; !state->attached; ++i) {
-		if (NVM_BE_SPDK_MAX_PROBE_ATTEMPTS == i) {
-			NVM_DEBUG("FAILED: max attempts exceeded");
-			nvm_be_spdk_state_term(state);
-			return NULL;
+	// Another controller may answer at the trid of a cached entry
+	nvm_be_cache_serial(
+		(const char *)spdk_nvme_ctrlr_get_data(state->ctrlr)->sn,
+		sizeof(spdk_nvme_ctrlr_get_data(state->ctrlr)->sn));
+
+	state->socket = -1;
+	if (spdk_nvme_ctrlr_get_pci_device(state->ctrlr)) {
+		state->socket = spdk_pci_device_get_socket_id(
+				spdk_nvme_ctrlr_get_pci_device(state->ctrlr));
+	}
+
+	num_ns = spdk_nvme_ctrlr_get_num_ns(state->ctrlr);
+	for (int nsid = 1; nsid <= num_ns; nsid++) {
+		struct spdk_nvme_ns *ns = NULL;
+
+		if (state->nsid && (state->nsid != nsid)) {
+			continue;
 		}
 
-		err = spdk_nvme_probe(&state->trid, state, probe_cb, attach_cb,
-				      NULL);
-		if ((err) || (!state->attached)) {
-			NVM_DEBUG("FAILED: spdk_nvme_probe, a:%d, e:%d, i:%d",
-				  state->attached, err, i);
+		ns = spdk_nvme_ctrlr_get_ns(state->ctrlr, nsid);
+		if (ns == NULL) {
+			NVM_DEBUG("skipping invalid nsid: %d", nsid);
+			continue;
+		}
+		if (!spdk_nvme_ns_is_active(ns)) {
+			NVM_DEBUG("skipping inactive nsid: %d", nsid);
+			continue;
 		}
+
+		state->ns = ns;
+		state->nsid = nsid;
+		break;
+	}
+	if (!state->ns) {
+		NVM_DEBUG("FAILED: no usable namespace, nsid: %d", state->nsid);
+		errno = ENODEV;
+		nvm_be_spdk_state_term(state);
+		return NULL;
 	}
 
 	// Copy namespace information
@@ -306,17 +465,6 @@ struct nvm_be_spdk_state *nvm_be_spdk_state_init(const char *ident,
 	}
 	state->nsdata = *nsdata;
 
-	// Setup NVMe IO qpair for SYNC commands
-	state->qpair = spdk_nvme_ctrlr_alloc_io_qpair(state->ctrlr, NULL, 0);
-	if (!state->qpair) {
-		NVM_DEBUG("FAILED: allocating qpair");
-		nvm_be_spdk_state_term(state);
-		return NULL;
-	}
-
-	// Setup IO qpair lock for SYNC commands
-	omp_init_lock(&state->qpair_lock);
-
 	return state;
 }
 
@@ -347,6 +495,7 @@ struct nvm_dev *nvm_be_spdk_open(const char *dev_path, int flags)
 
 	dev->be_state = state;
 	dev->nsid = state->nsid;
+	dev->numa_node = state->socket;
 	memcpy(&dev->ns, &state->nsdata, sizeof(dev->ns));
 
 	err = nvm_be_populate(dev, &nvm_be_spdk);
@@ -447,13 +596,15 @@ int nvm_be_spdk_async_term(struct nvm_dev *NVM_UNUSED(dev),
 	return 0;
 }
 
-int nvm_be_spdk_async_poke(struct nvm_dev *NVM_UNUSED(dev),
-			   struct nvm_async_ctx *ctx, uint32_t max)
+int nvm_be_spdk_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+			   uint32_t max)
 {
 	struct spdk_nvme_qpair *qpair = ctx->be_ctx;
 	int32_t res;
+	NVM_PROBE_BGN(clk);
 
 	res = spdk_nvme_qpair_process_completions(qpair, max);
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_CPL, clk);
 	if (res < 0) {
 		NVM_DEBUG("FAILED: processing completions: res: %d", res);
 		return -1;
@@ -752,7 +903,11 @@ static void cmd_async_cb(void *cb_arg, const struct spdk_nvme_cpl *cpl)
 	wrap->ret->async.ctx->outstanding -= 1;
 
 	nvm_cmd_wrap_cpl(wrap, (const struct nvm_nvme_cpl*)cpl);
-	wrap->ret->async.cb(wrap->ret, wrap->ret->async.cb_arg);
+	{
+		NVM_PROBE_BGN(clk);
+		wrap->ret->async.cb(wrap->ret, wrap->ret->async.cb_arg);
+		NVM_PROBE_END(wrap->dev, NVM_DEV_PROBE_CB, clk);
+	}
 	nvm_cmd_wrap_term(wrap);
 }
 
@@ -783,9 +938,11 @@ static inline int cmd_async_ewrc(struct nvm_dev *dev, struct nvm_addr addrs[],
 	// Submit command
 	ret->async.ctx->outstanding += 1;
 
+	NVM_PROBE_BGN(clk);
 	err = submit_ioc(state->ctrlr, qpair, &wrap->cmd,
 			 wrap->data, wrap->data_len, wrap->meta,
 			 cmd_async_cb, wrap);
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
 	if (err) {
 		ret->async.ctx->outstanding -= 1;
 		NVM_DEBUG("FAILED: submission failed");
@@ -808,7 +965,7 @@ static inline int cmd_sync_ewrc(struct nvm_dev *dev,
 {
 	struct nvm_be_spdk_state *state = dev->be_state;
 	struct spdk_nvme_qpair *qpair = state->qpair;
-	omp_lock_t *qpair_lock = &state->qpair_lock;
+	omp_lock_t *qpair_lock = state->qpair_lock;
 
 	struct nvm_cmd_wrap *wrap = NULL;
 	int res = 0;
@@ -823,11 +980,15 @@ static inline int cmd_sync_ewrc(struct nvm_dev *dev,
 	}
 
 	// Submit command
-	omp_set_lock(qpair_lock);
-	err = submit_ioc(state->ctrlr, qpair, &wrap->cmd,
-			 wrap->data, wrap->data_len, wrap->meta,
-			 cmd_sync_cb, wrap);
-	omp_unset_lock(qpair_lock);
+	{
+		NVM_PROBE_BGN(clk);
+		omp_set_lock(qpair_lock);
+		err = submit_ioc(state->ctrlr, qpair, &wrap->cmd,
+				 wrap->data, wrap->data_len, wrap->meta,
+				 cmd_sync_cb, wrap);
+		omp_unset_lock(qpair_lock);
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_SUBMIT, clk);
+	}
 
 	if (err) {
 		NVM_DEBUG("FAILED: cmd_sync_ewrc, err: %d", err);
@@ -835,11 +996,15 @@ static inline int cmd_sync_ewrc(struct nvm_dev *dev,
 		goto out;
 	}
 
-	// Wait for completion
-	while (!wrap->completed) {
-		omp_set_lock(qpair_lock);
-		spdk_nvme_qpair_process_completions(qpair, 0);
-		omp_unset_lock(qpair_lock);
+	// Wait for completion, accounting the polling as completion
+	{
+		NVM_PROBE_BGN(clk);
+		while (!wrap->completed) {
+			omp_set_lock(qpair_lock);
+			spdk_nvme_qpair_process_completions(qpair, 0);
+			omp_unset_lock(qpair_lock);
+		}
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_CPL, clk);
 	}
 
 	if (wrap->completed < 0) {
@@ -1071,7 +1236,7 @@ static inline int cmd_sync_pass(struct nvm_dev *dev, struct nvm_nvme_cmd *cmd,
 {
 	struct nvm_be_spdk_state *state = dev->be_state;
 	struct spdk_nvme_qpair *qpair = state->qpair;
-	omp_lock_t *qpair_lock = &state->qpair_lock;
+	omp_lock_t *qpair_lock = state->qpair_lock;
 
 	struct nvm_cmd_wrap *wrap = NULL;
 	int res = 0;
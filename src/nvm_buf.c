@@ -31,6 +31,7 @@
 #include <liblightnvm.h>
 #include <nvm_dev.h>
 #include <nvm_be.h>
+#include <nvm_numa.h>
 
 #ifdef NVM_BE_SPDK_ENABLED
 #include <spdk/stdinc.h>
@@ -44,6 +45,14 @@ static inline void* spdk_dma_malloc(size_t NVM_UNUSED(size),
 	errno = ENOSYS;
 	return NULL;
 }
+static inline void* spdk_dma_malloc_socket(size_t NVM_UNUSED(size),
+					   size_t NVM_UNUSED(align),
+					   uint64_t *NVM_UNUSED(phys_addr),
+					   int NVM_UNUSED(socket_id))
+{
+	errno = ENOSYS;
+	return NULL;
+}
 static inline void spdk_dma_free(void *NVM_UNUSED(buf)) { }
 #define SPDK_VTOPHYS_ERROR	(0xFFFFFFFFFFFFFFFFULL)
 uint64_t spdk_vtophys(void *NVM_UNUSED(buf)) { return SPDK_VTOPHYS_ERROR; }
@@ -88,6 +97,7 @@ void nvm_buf_virt_free(void *buf)
 void *nvm_buf_alloc(const struct nvm_dev *dev, size_t nbytes, uint64_t *phys)
 {
 	size_t alignment = 4096;
+	void *buf;
 
 	switch(dev->geo.verid) {
 	case NVM_SPEC_VERID_12:
@@ -107,11 +117,17 @@ void *nvm_buf_alloc(const struct nvm_dev *dev, size_t nbytes, uint64_t *phys)
 	switch(dev->be->id) {
 	case NVM_BE_IOCTL:
 	case NVM_BE_LBD:
-		return nvm_buf_virt_alloc(alignment, nbytes);
+		buf = nvm_buf_virt_alloc(alignment, nbytes);
+		if (buf && (dev->numa_node >= 0) &&
+		    nvm_numa_bind(buf, nbytes, dev->numa_node)) {
+			NVM_DEBUG("FAILED: nvm_numa_bind, buf left unbound");
+		}
+		return buf;
 
 	case NVM_BE_SPDK:
-	case NVM_BE_NOCD:
-		return spdk_dma_malloc(nbytes, alignment, phys);
+	case NVM_BE_NOCD:	// SPDK_ENV_SOCKET_ID_ANY when the node is unknown
+		return spdk_dma_malloc_socket(nbytes, alignment, phys,
+					      dev->numa_node);
 
 	case NVM_BE_ANY:
 		errno = EINVAL;
@@ -0,0 +1,333 @@
+/*
+ * nvm_buf_pool - Pools of IO buffers backed by hugepages
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <liblightnvm.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_numa.h>
+#include <nvm_buf_pool.h>
+
+#ifdef NVM_BE_SPDK_ENABLED
+#include <spdk/stdinc.h>
+#include <spdk/env.h>
+#else
+static inline void* spdk_dma_malloc_socket(size_t NVM_UNUSED(size),
+					   size_t NVM_UNUSED(align),
+					   uint64_t *NVM_UNUSED(phys_addr),
+					   int NVM_UNUSED(socket_id))
+{
+	errno = ENOSYS;
+	return NULL;
+}
+static inline void spdk_dma_free(void *NVM_UNUSED(buf)) { }
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static inline size_t nbytes_align(size_t nbytes, size_t alignment)
+{
+	return ((nbytes + alignment - 1) / alignment) * alignment;
+}
+
+static inline struct nvm_buf_pool_cache *pool_cache(struct nvm_buf_pool *pool)
+{
+	return &pool->caches[nvm_thrd_slot()];
+}
+
+static inline void cache_lock(struct nvm_buf_pool_cache *cache)
+{
+	while (atomic_flag_test_and_set_explicit(&cache->lock,
+						 memory_order_acquire))
+		sched_yield();
+}
+
+static inline void cache_unlock(struct nvm_buf_pool_cache *cache)
+{
+	atomic_flag_clear_explicit(&cache->lock, memory_order_release);
+}
+
+/**
+ * Pop an object from the free-list, returns its index + 1, or 0 when empty
+ */
+static uint32_t pool_pop(struct nvm_buf_pool *pool)
+{
+	uint64_t head = atomic_load(&pool->head);
+	uint64_t repl;
+	uint32_t obj;
+
+	do {
+		obj = head & UINT32_MAX;
+		if (!obj)
+			return 0;
+
+		repl = (((head >> 32) + 1) << 32) |
+		       atomic_load_explicit(&pool->next[obj - 1],
+					    memory_order_relaxed);
+	} while (!atomic_compare_exchange_weak(&pool->head, &head, repl));
+
+	return obj;
+}
+
+static void pool_push(struct nvm_buf_pool *pool, uint32_t obj)
+{
+	uint64_t head = atomic_load(&pool->head);
+	uint64_t repl;
+
+	do {
+		atomic_store_explicit(&pool->next[obj - 1], head & UINT32_MAX,
+				      memory_order_relaxed);
+		repl = (((head >> 32) + 1) << 32) | obj;
+	} while (!atomic_compare_exchange_weak(&pool->head, &head, repl));
+}
+
+/**
+ * Map 'nbytes' for the slab, preferring 1 GiB hugepages for slabs of at least
+ * that size, then 2 MiB hugepages, then transparent hugepages
+ */
+static int pool_map(struct nvm_buf_pool *pool, size_t nbytes)
+{
+	const int prot = PROT_READ | PROT_WRITE;
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+	if (nbytes >= NVM_BUF_POOL_GPAGE_NBYTES) {
+		pool->slab_nbytes = nbytes_align(nbytes,
+						 NVM_BUF_POOL_GPAGE_NBYTES);
+		pool->slab = mmap(NULL, pool->slab_nbytes, prot,
+				  flags | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+		if (pool->slab != MAP_FAILED) {
+			pool->backing = NVM_BUF_POOL_HUGETLB;
+			return 0;
+		}
+		NVM_DEBUG("no 1 GiB hugepages, trying 2 MiB");
+	}
+
+	pool->slab_nbytes = nbytes_align(nbytes, NVM_BUF_POOL_HPAGE_NBYTES);
+	pool->slab = mmap(NULL, pool->slab_nbytes, prot, flags | MAP_HUGETLB,
+			  -1, 0);
+	if (pool->slab != MAP_FAILED) {
+		pool->backing = NVM_BUF_POOL_HUGETLB;
+		return 0;
+	}
+	NVM_DEBUG("no 2 MiB hugepages, trying transparent hugepages");
+
+	pool->slab = mmap(NULL, pool->slab_nbytes, prot, flags, -1, 0);
+	if (pool->slab == MAP_FAILED) {
+		NVM_DEBUG("FAILED: mmap slab_nbytes: %zu", pool->slab_nbytes);
+		pool->slab = NULL;
+		return -1;
+	}
+	pool->backing = NVM_BUF_POOL_THP;
+
+	if (madvise(pool->slab, pool->slab_nbytes, MADV_HUGEPAGE)) {
+		NVM_DEBUG("FAILED: madvise(MADV_HUGEPAGE), using small pages");
+	}
+
+	return 0;
+}
+
+static void pool_unmap(struct nvm_buf_pool *pool)
+{
+	if (!pool->slab)
+		return;
+
+	switch (pool->backing) {
+	case NVM_BUF_POOL_DMA:
+		spdk_dma_free(pool->slab);
+		break;
+
+	case NVM_BUF_POOL_HUGETLB:
+	case NVM_BUF_POOL_THP:
+		munmap(pool->slab, pool->slab_nbytes);
+		break;
+	}
+}
+
+struct nvm_buf_pool *nvm_buf_pool_create(const struct nvm_dev *dev,
+					 size_t obj_size, size_t count)
+{
+	const size_t alignment = dev->geo.sector_nbytes ?
+				 dev->geo.sector_nbytes : 4096;
+	struct nvm_buf_pool *pool;
+
+	if ((!obj_size) || (!count) || (count >= UINT32_MAX)) {
+		NVM_DEBUG("FAILED: invalid obj_size: %zu, count: %zu",
+			  obj_size, count);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pool = aligned_alloc(_Alignof(struct nvm_buf_pool), sizeof(*pool));
+	if (!pool) {
+		NVM_DEBUG("FAILED: aligned_alloc pool");
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(pool, 0, sizeof(*pool));
+
+	pool->dev = dev;
+	pool->obj_size = nbytes_align(obj_size, alignment);
+	pool->count = count;
+	for (int i = 0; i < NVM_BUF_POOL_NCACHES; ++i)
+		atomic_flag_clear(&pool->caches[i].lock);
+
+	pool->next = malloc(count * sizeof(*pool->next));
+	if (!pool->next) {
+		NVM_DEBUG("FAILED: malloc next");
+		nvm_buf_pool_destroy(pool);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	switch (dev->be->id) {
+	case NVM_BE_SPDK:
+	case NVM_BE_NOCD:	// DMA memory is pinned and backed by hugepages
+		pool->slab_nbytes = pool->obj_size * count;
+		pool->slab = spdk_dma_malloc_socket(pool->slab_nbytes,
+						    alignment, NULL,
+						    dev->numa_node);
+		if (!pool->slab) {
+			NVM_DEBUG("FAILED: spdk_dma_malloc_socket");
+			nvm_buf_pool_destroy(pool);
+			errno = ENOMEM;
+			return NULL;
+		}
+		pool->backing = NVM_BUF_POOL_DMA;
+		break;
+
+	default:
+		if (pool_map(pool, pool->obj_size * count)) {
+			nvm_buf_pool_destroy(pool);
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		// Bind before the first touch, then fault in the entire slab
+		if ((dev->numa_node >= 0) &&
+		    nvm_numa_bind(pool->slab, pool->slab_nbytes,
+				  dev->numa_node)) {
+			NVM_DEBUG("FAILED: nvm_numa_bind, slab left unbound");
+		}
+		memset(pool->slab, 0, pool->slab_nbytes);
+		break;
+	}
+
+	for (uint32_t obj = count; obj; --obj)
+		pool_push(pool, obj);
+
+	return pool;
+}
+
+void nvm_buf_pool_destroy(struct nvm_buf_pool *pool)
+{
+	if (!pool)
+		return;
+
+	pool_unmap(pool);
+	free(pool->next);
+	free(pool);
+}
+
+void *nvm_buf_pool_get(struct nvm_buf_pool *pool)
+{
+	struct nvm_buf_pool_cache *cache = pool_cache(pool);
+	uint32_t obj = 0;
+
+	cache_lock(cache);
+	if (!cache->nobjs) {	// Refill half of the cache from the free-list
+		uint32_t refill;
+
+		while ((cache->nobjs < NVM_BUF_POOL_CACHE_LEN / 2) &&
+		       (refill = pool_pop(pool)))
+			cache->objs[cache->nobjs++] = refill;
+	}
+	if (cache->nobjs)
+		obj = cache->objs[--cache->nobjs];
+	cache_unlock(cache);
+
+	// The free-list is drained, take one from the cache of another thread
+	for (int i = 0; (!obj) && (i < NVM_BUF_POOL_NCACHES); ++i) {
+		struct nvm_buf_pool_cache *other = &pool->caches[i];
+
+		if (other == cache)
+			continue;
+
+		cache_lock(other);
+		if (other->nobjs)
+			obj = other->objs[--other->nobjs];
+		cache_unlock(other);
+	}
+
+	if (!obj) {
+		NVM_DEBUG("FAILED: pool exhausted, count: %u", pool->count);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return pool->slab + (obj - 1) * pool->obj_size;
+}
+
+void nvm_buf_pool_put(struct nvm_buf_pool *pool, void *buf)
+{
+	struct nvm_buf_pool_cache *cache = pool_cache(pool);
+	const size_t ofz = (char *)buf - pool->slab;
+	uint32_t obj;
+
+	if ((!buf) || ((char *)buf < pool->slab) ||
+	    (ofz >= pool->obj_size * pool->count) || (ofz % pool->obj_size)) {
+		NVM_DEBUG("FAILED: buf: %p not from pool", buf);
+		return;
+	}
+	obj = ofz / pool->obj_size + 1;
+
+	cache_lock(cache);
+	if (cache->nobjs == NVM_BUF_POOL_CACHE_LEN) {
+		while (cache->nobjs > NVM_BUF_POOL_CACHE_LEN / 2)
+			pool_push(pool, cache->objs[--cache->nobjs]);
+	}
+	cache->objs[cache->nobjs++] = obj;
+	cache_unlock(cache);
+}
+
+size_t nvm_buf_pool_get_obj_size(const struct nvm_buf_pool *pool)
+{
+	return pool->obj_size;
+}
+
+size_t nvm_buf_pool_get_count(const struct nvm_buf_pool *pool)
+{
+	return pool->count;
+}
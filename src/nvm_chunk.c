@@ -0,0 +1,436 @@
+/*
+ * nvm_chunk - Host-side chunk write-pointers and append
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_chunk.h>
+
+static void chunk_tbl_free(struct nvm_chunk_tbl *tbl)
+{
+	if (!tbl)
+		return;
+
+	free(tbl->punits);
+	free(tbl->chunks);
+	free(tbl);
+}
+
+static struct nvm_chunk_tbl *chunk_tbl_alloc(const struct nvm_geo *geo)
+{
+	struct nvm_chunk_tbl *tbl;
+
+	tbl = calloc(1, sizeof(*tbl));
+	if (!tbl) {
+		NVM_DEBUG("FAILED: calloc tbl");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	tbl->npunits = geo->l.npugrp * geo->l.npunit;
+	tbl->nchunks = tbl->npunits * geo->l.nchunk;
+	tbl->punits = calloc(tbl->npunits, sizeof(*tbl->punits));
+	tbl->chunks = calloc(tbl->nchunks, sizeof(*tbl->chunks));
+	if (!(tbl->punits && tbl->chunks)) {
+		NVM_DEBUG("FAILED: calloc tbl->punits / tbl->chunks");
+		chunk_tbl_free(tbl);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (size_t idx = 0; idx < tbl->npunits; ++idx)
+		atomic_init(&tbl->punits[idx], NVM_CHUNK_PUNIT_UNINIT);
+
+	for (size_t idx = 0; idx < tbl->nchunks; ++idx) {
+		atomic_init(&tbl->chunks[idx].wp, 0);
+		atomic_init(&tbl->chunks[idx].sub, 0);
+		atomic_init(&tbl->chunks[idx].err, 0);
+	}
+
+	return tbl;
+}
+
+/**
+ * Returns the chunk table of the given device, allocating it on first use.
+ * Concurrent first users race on a compare-and-swap, the loser frees its copy
+ */
+static struct nvm_chunk_tbl *chunk_tbl_get(struct nvm_dev *dev)
+{
+	struct nvm_chunk_tbl *tbl = atomic_load(&dev->chunk_tbl);
+	struct nvm_chunk_tbl *cur = NULL;
+
+	if (tbl)
+		return tbl;
+
+	tbl = chunk_tbl_alloc(nvm_dev_get_geo(dev));
+	if (!tbl)
+		return NULL;
+
+	if (!atomic_compare_exchange_strong(&dev->chunk_tbl, &cur, tbl)) {
+		chunk_tbl_free(tbl);
+		return cur;
+	}
+
+	return tbl;
+}
+
+/**
+ * Load write-pointers of all chunks in the parallel unit of 'addr' using a
+ * single report
+ */
+static int chunk_punit_load(struct nvm_dev *dev, struct nvm_chunk_tbl *tbl,
+			    struct nvm_addr addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const size_t punit = addr.l.pugrp * geo->l.npunit + addr.l.punit;
+	struct nvm_spec_rprt *rprt;
+
+	addr.l.chunk = 0;
+	addr.l.sectr = 0;
+
+	rprt = nvm_cmd_rprt(dev, &addr, 0x0, NULL);
+	if (!rprt) {
+		NVM_DEBUG("FAILED: nvm_cmd_rprt");
+		return -1;
+	}
+	if (rprt->ndescr != geo->l.nchunk) {
+		NVM_DEBUG("FAILED: rprt->ndescr: %u != nchunk: %zu",
+			  rprt->ndescr, geo->l.nchunk);
+		nvm_buf_free(dev, rprt);
+		errno = EIO;
+		return -1;
+	}
+
+	for (size_t idx = 0; idx < rprt->ndescr; ++idx) {
+		struct nvm_chunk_wp *chk = &tbl->chunks[punit * geo->l.nchunk + idx];
+		const struct nvm_spec_rprt_descr *descr = &rprt->descr[idx];
+		uint32_t wp;
+		int err = 0;
+
+		switch (descr->cs) {
+		case NVM_CHUNK_STATE_FREE:
+			wp = 0;
+			break;
+
+		case NVM_CHUNK_STATE_OPEN:
+			wp = descr->wp;
+			break;
+
+		case NVM_CHUNK_STATE_OFFLINE:
+			err = EIO;
+			/* FALLTHRU */
+
+		default:		// Nothing left to append in the chunk
+			wp = geo->l.nsectr;
+			break;
+		}
+
+		atomic_store(&chk->wp, wp);
+		atomic_store(&chk->sub, wp);
+		atomic_store(&chk->err, err);
+	}
+
+	nvm_buf_free(dev, rprt);
+
+	return 0;
+}
+
+struct nvm_chunk_wp *nvm_chunk_wp_get(struct nvm_dev *dev,
+				      struct nvm_addr addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_chunk_tbl *tbl;
+	size_t punit;
+	int state;
+
+	if (dev->verid != NVM_SPEC_VERID_20) {
+		NVM_DEBUG("FAILED: unsupported verid: %d", dev->verid);
+		errno = ENOSYS;
+		return NULL;
+	}
+
+	addr.l.sectr = 0;
+	if (nvm_addr_check(addr, dev)) {
+		NVM_DEBUG("FAILED: nvm_addr_check");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	tbl = chunk_tbl_get(dev);
+	if (!tbl) {
+		NVM_DEBUG("FAILED: chunk_tbl_get");
+		return NULL;
+	}
+
+	punit = addr.l.pugrp * geo->l.npunit + addr.l.punit;
+
+	state = atomic_load(&tbl->punits[punit]);
+	while (state != NVM_CHUNK_PUNIT_READY) {
+		int expected = NVM_CHUNK_PUNIT_UNINIT;
+
+		if ((state == NVM_CHUNK_PUNIT_UNINIT) &&
+		    atomic_compare_exchange_strong(&tbl->punits[punit],
+						   &expected,
+						   NVM_CHUNK_PUNIT_LOADING)) {
+			if (chunk_punit_load(dev, tbl, addr)) {
+				NVM_DEBUG("FAILED: chunk_punit_load");
+				atomic_store(&tbl->punits[punit],
+					     NVM_CHUNK_PUNIT_UNINIT);
+				return NULL;
+			}
+
+			atomic_store(&tbl->punits[punit], NVM_CHUNK_PUNIT_READY);
+			break;
+		}
+
+		sched_yield();
+		state = atomic_load(&tbl->punits[punit]);
+	}
+
+	return &tbl->chunks[punit * geo->l.nchunk + addr.l.chunk];
+}
+
+void nvm_chunk_tbl_free(struct nvm_dev *dev)
+{
+	chunk_tbl_free(atomic_exchange(&dev->chunk_tbl, NULL));
+}
+
+/**
+ * Returns the state of the chunk at 'addr' when its parallel unit is loaded,
+ * NULL otherwise. Never issues commands.
+ */
+static struct nvm_chunk_wp *chunk_wp_peek(struct nvm_dev *dev,
+					  struct nvm_chunk_tbl *tbl,
+					  struct nvm_addr addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	size_t punit;
+
+	addr.l.sectr = 0;
+	if (nvm_addr_check(addr, dev))
+		return NULL;
+
+	punit = addr.l.pugrp * geo->l.npunit + addr.l.punit;
+	if (atomic_load(&tbl->punits[punit]) != NVM_CHUNK_PUNIT_READY)
+		return NULL;
+
+	return &tbl->chunks[punit * geo->l.nchunk + addr.l.chunk];
+}
+
+void nvm_chunk_tbl_advance(struct nvm_dev *dev, struct nvm_addr addrs[],
+			   int naddrs, int scalar)
+{
+	struct nvm_chunk_tbl *tbl = atomic_load(&dev->chunk_tbl);
+
+	if (!tbl)
+		return;
+
+	for (int idx = 0; idx < (scalar ? 1 : naddrs); ++idx) {
+		struct nvm_chunk_wp *chk = chunk_wp_peek(dev, tbl, addrs[idx]);
+		uint32_t end = addrs[idx].l.sectr + (scalar ? naddrs : 1);
+
+		if (!chk)
+			continue;
+
+		nvm_chunk_wp_max(&chk->sub, end);
+		nvm_chunk_wp_max(&chk->wp, end);
+	}
+}
+
+void nvm_chunk_tbl_rewind(struct nvm_dev *dev, struct nvm_addr addrs[],
+			  int naddrs)
+{
+	struct nvm_chunk_tbl *tbl = atomic_load(&dev->chunk_tbl);
+
+	if (!tbl)
+		return;
+
+	for (int idx = 0; idx < naddrs; ++idx) {
+		struct nvm_chunk_wp *chk = chunk_wp_peek(dev, tbl, addrs[idx]);
+
+		if (!chk)
+			continue;
+
+		atomic_store(&chk->err, 0);
+		atomic_store(&chk->sub, 0);
+		atomic_store(&chk->wp, 0);
+	}
+}
+
+int nvm_chunk_append(struct nvm_dev *dev, struct nvm_addr chunk,
+		     const void *data, const void *meta, int nsectr,
+		     struct nvm_addr *addr, uint16_t flags,
+		     struct nvm_ret *ret)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_chunk_wp *chk;
+	uint_least32_t wp;
+	int err;
+
+	if ((nsectr < 1) || (nsectr > NVM_NADDR_MAX) ||
+	    (nsectr % nvm_dev_get_ws_min(dev))) {
+		NVM_DEBUG("FAILED: invalid nsectr: %d", nsectr);
+		errno = EINVAL;
+		return -1;
+	}
+
+	chk = nvm_chunk_wp_get(dev, chunk);
+	if (!chk) {
+		NVM_DEBUG("FAILED: nvm_chunk_wp_get");
+		return -1;
+	}
+
+	// Reserve [wp, wp + nsectr) without exceeding the chunk
+	wp = atomic_load(&chk->wp);
+	do {
+		if (wp == NVM_CHUNK_WP_RESET) {
+			NVM_DEBUG("FAILED: chunk is being reset");
+			errno = EBUSY;
+			return -1;
+		}
+		if (wp + nsectr > geo->l.nsectr) {
+			NVM_DEBUG("FAILED: chunk full, wp: %u", (uint32_t)wp);
+			errno = ENOSPC;
+			return -1;
+		}
+	} while (!atomic_compare_exchange_weak(&chk->wp, &wp, wp + nsectr));
+
+	for (int idx = 0; idx < nsectr; ++idx) {
+		addrs[idx].val = chunk.val;
+		addrs[idx].l.sectr = wp + idx;
+	}
+
+	if (addr)
+		*addr = addrs[0];
+
+	// Wait for the predecessors to submit, then submit in wp-order
+	while (atomic_load_explicit(&chk->sub, memory_order_acquire) != wp)
+		sched_yield();
+
+	err = atomic_load(&chk->err);
+	if (!err) {
+		while (nvm_cmd_write(dev, addrs, nsectr, data, meta, flags,
+				     ret)) {
+			if ((errno == EAGAIN) && (flags & NVM_CMD_ASYNC) &&
+			    ret && ret->async.ctx) {
+				nvm_async_poke(dev, ret->async.ctx, 0);
+				continue;
+			}
+
+			NVM_DEBUG("FAILED: nvm_cmd_write");
+			err = errno ? errno : EIO;
+			atomic_store(&chk->err, err);
+			break;
+		}
+	}
+
+	atomic_store_explicit(&chk->sub, wp + nsectr, memory_order_release);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+int nvm_chunk_reset(struct nvm_dev *dev, struct nvm_addr chunk,
+		    uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_chunk_wp *chk;
+	uint_least32_t wp, cur;
+
+	chk = nvm_chunk_wp_get(dev, chunk);
+	if (!chk) {
+		NVM_DEBUG("FAILED: nvm_chunk_wp_get");
+		return -1;
+	}
+
+	// Claim the chunk, 'sub' first such that appends in flight fail the
+	// claim, then 'wp' such that no append reserves while erasing
+	wp = atomic_load(&chk->wp);
+	if ((wp == NVM_CHUNK_WP_RESET) ||
+	    !atomic_compare_exchange_strong(&chk->sub, &wp,
+					    NVM_CHUNK_WP_RESET)) {
+		NVM_DEBUG("FAILED: chunk has appends in flight");
+		errno = EBUSY;
+		return -1;
+	}
+	cur = wp;
+	if (!atomic_compare_exchange_strong(&chk->wp, &cur,
+					    NVM_CHUNK_WP_RESET)) {
+		atomic_store(&chk->sub, wp);	// Reserved meanwhile
+		NVM_DEBUG("FAILED: chunk has appends in flight");
+		errno = EBUSY;
+		return -1;
+	}
+
+	// The host-side wp is rewound on completion, hence always SYNC
+	flags = (flags & ~NVM_CMD_MASK_IOMD) | NVM_CMD_SYNC;
+	chunk.l.sectr = 0;
+
+	if (nvm_cmd_erase(dev, &chunk, 1, NULL, flags, ret)) {
+		NVM_DEBUG("FAILED: nvm_cmd_erase");
+		atomic_store(&chk->wp, wp);
+		atomic_store(&chk->sub, wp);
+		return -1;
+	}
+
+	// The rewind of nvm_cmd_erase publishes wp = sub = 0 already, done
+	// here when it did not, 'sub' before 'wp' as appends reserve on 'wp'
+	if (atomic_load(&chk->wp) == NVM_CHUNK_WP_RESET) {
+		atomic_store(&chk->err, 0);
+		atomic_store(&chk->sub, 0);
+		atomic_store(&chk->wp, 0);
+	}
+
+	return 0;
+}
+
+int nvm_chunk_get_wp(struct nvm_dev *dev, struct nvm_addr chunk)
+{
+	struct nvm_chunk_wp *chk;
+	uint_least32_t wp;
+
+	chk = nvm_chunk_wp_get(dev, chunk);
+	if (!chk) {
+		NVM_DEBUG("FAILED: nvm_chunk_wp_get");
+		return -1;
+	}
+
+	wp = atomic_load(&chk->wp);
+	if (wp == NVM_CHUNK_WP_RESET) {
+		NVM_DEBUG("FAILED: chunk is being reset");
+		errno = EBUSY;
+		return -1;
+	}
+
+	return wp;
+}
@@ -252,6 +252,9 @@ static void opts_mask_pr(int mask)
 		case NVM_CLI_OPT_FILE_META:
 			printf(" [-m FILE]");
 			break;
+		case NVM_CLI_OPT_FILE_INPUT:
+			printf(" [-i FILE]");
+			break;
 		case NVM_CLI_OPT_FILE_OUTPUT:
 			printf(" [-o FILE]");
 			break;
@@ -1661,8 +1664,9 @@ int nvm_cli_init(struct nvm_cli *cli, int argc, char *argv[])
 		return -1;
 	}
 
-	// Grab the option arguments
-	ret = parse_opts(argc - state, argv + state, cli);
+	// Grab the option arguments, getopt skips argv[0] so start at the
+	// sub-command, otherwise the first option of ARG_NONE commands is lost
+	ret = parse_opts(argc - state + 1, argv + state - 1, cli);
 	if (ret < 0) {
 		errno = EINVAL;
 		return -1;
@@ -30,6 +30,11 @@
 #include <nvm_dev.h>
 #include <nvm_cmd.h>
 #include <nvm_sgl.h>
+#include <nvm_async.h>
+#include <nvm_chunk.h>
+#include <nvm_stats.h>
+#include <nvm_probe.h>
+#include <nvm_usdt.h>
 
 int nvm_cmd_is_scalar(uint16_t opcode)
 {
@@ -45,10 +50,19 @@ int nvm_cmd_is_scalar(uint16_t opcode)
 
 void nvm_cmd_wrap_term(struct nvm_cmd_wrap *wrap)
 {
-	nvm_buf_free(wrap->dev, wrap->dsmr_dma);
-	nvm_buf_free(wrap->dev, wrap->addrs_dma);
-	nvm_buf_free(wrap->dev, wrap->dst_dma);
+	struct nvm_dev *dev = wrap->dev;
+	NVM_PROBE_BGN(clk);
+
+	{
+		NVM_PROBE_BGN(clk_dma);
+		nvm_buf_free(dev, wrap->dsmr_dma);
+		nvm_buf_free(dev, wrap->addrs_dma);
+		nvm_buf_free(dev, wrap->dst_dma);
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_DMA, clk_dma);
+	}
 	free(wrap);
+
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_WRAP, clk);
 }
 
 void nvm_cmd_wrap_cpl(struct nvm_cmd_wrap *wrap,
@@ -77,15 +91,7 @@ static inline void cmd_wrap_setup_sgl(struct nvm_cmd_wrap *wrap, void *data,
 
 	wrap->cmd.psdt = NVM_NVME_PSDT_SGL_MPTR_CONTIGUOUS;
 
-	if (sgl->ndescr == 1) {
-		wrap->cmd.dptr.sgl = sgl->descriptors[0];
-	} else {
-		nvm_buf_vtophys(wrap->dev, sgl->descriptors, &phys);
-
-		wrap->cmd.dptr.sgl.unkeyed.type = NVM_NVME_SGL_DESCR_TYPE_LAST_SEGMENT;
-		wrap->cmd.dptr.sgl.unkeyed.len = sgl->ndescr * sizeof(struct nvm_nvme_sgl_descriptor);
-		wrap->cmd.dptr.sgl.addr = phys;
-	}
+	nvm_sgl_dptr(sgl, &wrap->cmd.dptr.sgl);
 
 	wrap->data = NULL;
 	wrap->data_len = 0;
@@ -95,13 +101,10 @@ static inline void cmd_wrap_setup_sgl(struct nvm_cmd_wrap *wrap, void *data,
 
 		sgl = meta;
 
-		nvm_buf_vtophys(wrap->dev, sgl->descriptors, &phys);
 		if (sgl->ndescr == 1) {
-			wrap->cmd.mptr = phys;
+			wrap->cmd.mptr = sgl->segs->phys;
 		} else {
-			sgl->indirect->unkeyed.type = NVM_NVME_SGL_DESCR_TYPE_LAST_SEGMENT;
-			sgl->indirect->unkeyed.len = sgl->ndescr * sizeof(struct nvm_nvme_sgl_descriptor);
-			sgl->indirect->addr = phys;
+			nvm_sgl_dptr(sgl, sgl->indirect);
 
 			nvm_buf_vtophys(wrap->dev, sgl->indirect, &phys);
 			wrap->cmd.mptr = phys;
@@ -112,16 +115,13 @@ static inline void cmd_wrap_setup_sgl(struct nvm_cmd_wrap *wrap, void *data,
 	}
 }
 
-/**
- * Setup submission entry and virt_allocate DMA memory for the given opcode
- */
-struct nvm_cmd_wrap *nvm_cmd_wrap_setup(struct nvm_dev *dev, int opcode,
-					void *data, void *meta,
-					struct nvm_addr addrs[],
-					struct nvm_addr dst[],
-					int naddrs,
-					int flags,
-					struct nvm_ret *ret)
+static struct nvm_cmd_wrap *cmd_wrap_setup(struct nvm_dev *dev, int opcode,
+					   void *data, void *meta,
+					   struct nvm_addr addrs[],
+					   struct nvm_addr dst[],
+					   int naddrs,
+					   int flags,
+					   struct nvm_ret *ret)
 {
 	const struct nvm_geo *geo = &dev->geo;
 	struct nvm_cmd_wrap *wrap;
@@ -146,8 +146,10 @@ struct nvm_cmd_wrap *nvm_cmd_wrap_setup(struct nvm_dev *dev, int opcode,
 	wrap->cmd.nsid = nvm_dev_get_nsid(dev);
 
 	if (NVM_DOPC_SCALAR_ERASE == opcode) {
+		NVM_PROBE_BGN(clk_dma);
 		wrap->dsmr_len = sizeof(*wrap->dsmr_dma) * naddrs;
 		wrap->dsmr_dma = nvm_buf_alloc(dev, wrap->dsmr_len, NULL);
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_DMA, clk_dma);
 		if (!wrap->dsmr_dma) {
 			NVM_DEBUG("FAILED: nvm_buf_alloc of DSM range");
 			goto failed;
@@ -156,6 +158,7 @@ struct nvm_cmd_wrap *nvm_cmd_wrap_setup(struct nvm_dev *dev, int opcode,
 		wrap->data = wrap->dsmr_dma;
 		wrap->data_len = wrap->dsmr_len;
 
+		NVM_PROBE_BGN(clk_addr);
 		for(int idx = 0; idx < naddrs; ++idx) {
 			const uint64_t slba = nvm_addr_gen2dev(dev, addrs[idx]);
 
@@ -163,6 +166,7 @@ struct nvm_cmd_wrap *nvm_cmd_wrap_setup(struct nvm_dev *dev, int opcode,
 			wrap->dsmr_dma[idx].nlb = geo->l.nsectr;
 			wrap->dsmr_dma[idx].slba = slba;
 		}
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_ADDR, clk_addr);
 
 		wrap->cmd.dsm.nr = naddrs - 1;
 		wrap->cmd.dsm.ad = 1;
@@ -226,17 +230,21 @@ struct nvm_cmd_wrap *nvm_cmd_wrap_setup(struct nvm_dev *dev, int opcode,
 	// DMA allocation and address translation for VECTOR commands
 	if (naddrs > 1) {
 		uint64_t addrs_phys = 0;
+		NVM_PROBE_BGN(clk_dma);
 
 		wrap->addrs_dma = nvm_buf_alloc(dev, wrap->addrs_len,
 						&addrs_phys);
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_DMA, clk_dma);
 		if (!wrap->addrs_dma) {
 			NVM_DEBUG("FAILED: nvm_buf_alloc(addrs)");
 			goto failed;
 		}
 
+		NVM_PROBE_BGN(clk_addr);
 		for (int i = 0; i < naddrs; ++i) {
 			wrap->addrs_dma[i] = nvm_addr_gen2dev(dev, addrs[i]);
 		}
+		NVM_PROBE_END(dev, NVM_DEV_PROBE_ADDR, clk_addr);
 
 		wrap->cmd.addrs = addrs_phys;
 	} else {
@@ -246,17 +254,21 @@ struct nvm_cmd_wrap *nvm_cmd_wrap_setup(struct nvm_dev *dev, int opcode,
 	if (dst) {		// Addrs. for COPY(DST)
 		if (naddrs > 1) {
 			uint64_t dst_phys = 0;
+			NVM_PROBE_BGN(clk_dma);
 
 			wrap->dst_dma = nvm_buf_alloc(dev, wrap->addrs_len,
 							&dst_phys);
+			NVM_PROBE_END(dev, NVM_DEV_PROBE_DMA, clk_dma);
 			if (!wrap->dst_dma) {
 				NVM_DEBUG("FAILED: nvm_buf_alloc(dst)");
 				goto failed;
 			}
 
+			NVM_PROBE_BGN(clk_addr);
 			for (int i = 0; i < naddrs; ++i) {
 				wrap->dst_dma[i] = nvm_addr_gen2dev(dev, dst[i]);
 			}
+			NVM_PROBE_END(dev, NVM_DEV_PROBE_ADDR, clk_addr);
 			wrap->cmd.addrs_dst = dst_phys;
 		} else {
 			wrap->cmd.addrs_dst = nvm_addr_gen2dev(dev, dst[0]);
@@ -271,6 +283,28 @@ failed:
 	return NULL;
 }
 
+/**
+ * Setup submission entry and virt_allocate DMA memory for the given opcode
+ */
+struct nvm_cmd_wrap *nvm_cmd_wrap_setup(struct nvm_dev *dev, int opcode,
+					void *data, void *meta,
+					struct nvm_addr addrs[],
+					struct nvm_addr dst[],
+					int naddrs,
+					int flags,
+					struct nvm_ret *ret)
+{
+	struct nvm_cmd_wrap *wrap;
+	NVM_PROBE_BGN(clk);
+
+	wrap = cmd_wrap_setup(dev, opcode, data, meta, addrs, dst, naddrs,
+			      flags, ret);
+
+	NVM_PROBE_END(dev, NVM_DEV_PROBE_WRAP, clk);
+
+	return wrap;
+}
+
 struct nvm_cmd_wrap *nvm_cmd_wrap_pass(struct nvm_dev *dev,
 				       struct nvm_nvme_cmd *NVM_UNUSED(cmd),
 				       void *data, size_t data_nbytes,
@@ -315,7 +349,15 @@ struct nvm_spec_idfy *nvm_cmd_idfy(struct nvm_dev *dev, struct nvm_ret *ret)
 struct nvm_spec_rprt *nvm_cmd_rprt(struct nvm_dev *dev, struct nvm_addr *addr,
 				   int opt, struct nvm_ret *ret)
 {
-	return dev->be->rprt(dev, addr, opt, ret);
+	struct nvm_spec_rprt *rprt;
+	NVM_USDT_TSC(tsc);
+
+	rprt = dev->be->rprt(dev, addr, opt, ret);
+
+	NVM_USDT6(admin, dev->name, NVM_AOPC_RPRT, addr ? addr->val : 0,
+		  addr ? 1 : 0, ret ? ret->status : 0, nvm_stats_tsc() - tsc);
+
+	return rprt;
 }
 
 int nvm_cmd_rprt_arbs(struct nvm_dev *dev, int cs, int naddrs,
@@ -372,7 +414,15 @@ int nvm_cmd_rprt_arbs(struct nvm_dev *dev, int cs, int naddrs,
 struct nvm_spec_bbt *nvm_cmd_gbbt(struct nvm_dev *dev, struct nvm_addr addr,
 				  struct nvm_ret *ret)
 {
-	return dev->be->gbbt(dev, addr, ret);
+	struct nvm_spec_bbt *bbt;
+	NVM_USDT_TSC(tsc);
+
+	bbt = dev->be->gbbt(dev, addr, ret);
+
+	NVM_USDT6(admin, dev->name, NVM_AOPC_GBBT, addr.val, 1,
+		  ret ? ret->status : 0, nvm_stats_tsc() - tsc);
+
+	return bbt;
 }
 
 int nvm_cmd_gbbt_arbs(struct nvm_dev *dev, int bs, int naddrs,
@@ -428,7 +478,15 @@ int nvm_cmd_gbbt_arbs(struct nvm_dev *dev, int bs, int naddrs,
 int nvm_cmd_sbbt(struct nvm_dev *dev, struct nvm_addr *addrs, int naddrs,
 		 uint16_t flags, struct nvm_ret *ret)
 {
-	return dev->be->sbbt(dev, addrs, naddrs, flags, ret);
+	int err;
+	NVM_USDT_TSC(tsc);
+
+	err = dev->be->sbbt(dev, addrs, naddrs, flags, ret);
+
+	NVM_USDT6(admin, dev->name, NVM_AOPC_SBBT, addrs[0].val, naddrs,
+		  ret ? ret->status : 0, nvm_stats_tsc() - tsc);
+
+	return err;
 }
 
 int nvm_cmd_gfeat(struct nvm_dev *dev, enum nvm_nvme_feat_id id, union nvm_nvme_feat *feat,
@@ -447,8 +505,17 @@ int nvm_cmd_erase(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 		  void *meta, uint16_t flags, struct nvm_ret *ret)
 {
 	int opt = flags & NVM_CMD_MASK_ADDR;
+	struct nvm_ret _ret = { 0 };
+	uint64_t tsc;
+	int err;
 
 	opt = opt ? opt : (dev->cmd_opts & NVM_CMD_MASK_ADDR);
+	ret = ret ? ret : &_ret;	// Status of failures for the stats
+
+	err = nvm_async_sched_hold(dev, NVM_DEV_STATS_ERASE, addrs, NULL,
+				   naddrs, NULL, meta, flags, ret);
+	if (err)
+		return err < 0 ? -1 : 0;
 
 	switch(opt) {
 	case NVM_CMD_SCALAR:
@@ -457,35 +524,122 @@ int nvm_cmd_erase(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 			return -1;
 		}
 
-		return dev->be->scalar_erase(dev, addrs, naddrs, flags, ret);
+		if (nvm_async_qdc_enter(dev, addrs[0], flags, ret))
+			return -1;
+		tsc = nvm_stats_enter(dev, NVM_DEV_STATS_ERASE, addrs, naddrs,
+				      flags, ret);
+		err = dev->be->scalar_erase(dev, addrs, naddrs, flags, ret);
+		break;
 	case NVM_CMD_VECTOR:
-		return dev->be->vector_erase(dev, addrs, naddrs, meta, flags,
-					     ret);
+		if (nvm_async_qdc_enter(dev, addrs[0], flags, ret))
+			return -1;
+		tsc = nvm_stats_enter(dev, NVM_DEV_STATS_ERASE, addrs, naddrs,
+				      flags, ret);
+		err = dev->be->vector_erase(dev, addrs, naddrs, meta, flags,
+					    ret);
+		break;
 	default:
 		errno = EINVAL;
 		return -1;
 	}
+
+	nvm_stats_leave(dev, NVM_DEV_STATS_ERASE, addrs, naddrs, flags, ret,
+			tsc, err);
+	nvm_async_qdc_leave(dev, addrs[0], flags, ret, err);
+
+	// An ASYNC erase is in flight, rewinding would release writes on it
+	if (!err && !(flags & NVM_CMD_ASYNC))
+		nvm_chunk_tbl_rewind(dev, addrs, naddrs);
+
+	return err;
 }
 
-int nvm_cmd_write(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
-		  const void *data, const void *meta, uint16_t flags,
-		  struct nvm_ret *ret)
+int nvm_cmd_addr_mode(const struct nvm_dev *dev, uint16_t flags)
 {
 	int opt = flags & NVM_CMD_MASK_ADDR;
 
-	opt = opt ? opt : (dev->cmd_opts & NVM_CMD_MASK_ADDR);
+	return opt ? opt : (dev->cmd_opts & NVM_CMD_MASK_ADDR);
+}
 
-	switch(opt) {
+uint16_t nvm_cmd_opcode(const struct nvm_dev *dev, int op, uint16_t flags)
+{
+	const int scalar = nvm_cmd_addr_mode(dev, flags) == NVM_CMD_SCALAR;
+
+	switch (op) {
+	case NVM_DEV_STATS_ERASE:
+		return scalar ? NVM_DOPC_SCALAR_ERASE : NVM_DOPC_VECTOR_ERASE;
+	case NVM_DEV_STATS_WRITE:
+		return scalar ? NVM_DOPC_SCALAR_WRITE : NVM_DOPC_VECTOR_WRITE;
+	case NVM_DEV_STATS_READ:
+		return scalar ? NVM_DOPC_SCALAR_READ : NVM_DOPC_VECTOR_READ;
+	case NVM_DEV_STATS_COPY:
+		return NVM_DOPC_VECTOR_COPY;
+	}
+
+	return 0;
+}
+
+int nvm_cmd_write_be(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		     const void *data, const void *meta, uint16_t flags,
+		     struct nvm_ret *ret)
+{
+	struct nvm_ret _ret = { 0 };
+	uint64_t tsc;
+	int err;
+
+	ret = ret ? ret : &_ret;	// Status of failures for the stats
+
+	switch(nvm_cmd_addr_mode(dev, flags)) {
 	case NVM_CMD_SCALAR:
-		return dev->be->scalar_write(dev, *addrs, naddrs, data, meta,
-					     flags, ret);
+		if (nvm_async_qdc_enter(dev, addrs[0], flags, ret))
+			return -1;
+		tsc = nvm_stats_enter(dev, NVM_DEV_STATS_WRITE, addrs, naddrs,
+				      flags, ret);
+		err = dev->be->scalar_write(dev, *addrs, naddrs, data, meta,
+					    flags, ret);
+		break;
 	case NVM_CMD_VECTOR:
-		return dev->be->vector_write(dev, addrs, naddrs, data, meta,
-					     flags, ret);
+		if (nvm_async_qdc_enter(dev, addrs[0], flags, ret))
+			return -1;
+		tsc = nvm_stats_enter(dev, NVM_DEV_STATS_WRITE, addrs, naddrs,
+				      flags, ret);
+		err = dev->be->vector_write(dev, addrs, naddrs, data, meta,
+					    flags, ret);
+		break;
 	default:
 		errno = EINVAL;
 		return -1;
 	}
+
+	nvm_stats_leave(dev, NVM_DEV_STATS_WRITE, addrs, naddrs, flags, ret,
+			tsc, err);
+	nvm_async_qdc_leave(dev, addrs[0], flags, ret, err);
+
+	return err;
+}
+
+int nvm_cmd_write(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		  const void *data, const void *meta, uint16_t flags,
+		  struct nvm_ret *ret)
+{
+	int err;
+
+	err = nvm_async_sched_hold(dev, NVM_DEV_STATS_WRITE, addrs, NULL,
+				   naddrs, data, meta, flags, ret);
+	if (err)
+		return err < 0 ? -1 : 0;
+
+	if ((flags & NVM_CMD_ASYNC) && nvm_async_seq_enabled(ret))
+		return nvm_async_seq_write(dev, addrs, naddrs, data, meta,
+					   flags, ret);
+
+	err = nvm_cmd_write_be(dev, addrs, naddrs, data, meta, flags, ret);
+	if (!err && !(flags & NVM_CMD_ASYNC)) {
+		nvm_chunk_tbl_advance(dev, addrs, naddrs,
+			nvm_cmd_addr_mode(dev, flags) == NVM_CMD_SCALAR);
+	}
+
+	return err;
 }
 
 int nvm_cmd_read(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
@@ -493,25 +647,69 @@ int nvm_cmd_read(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 		 struct nvm_ret *ret)
 {
 	int opt = flags & NVM_CMD_MASK_ADDR;
+	struct nvm_ret _ret = { 0 };
+	uint64_t tsc;
+	int err;
 
 	opt = opt ? opt : (dev->cmd_opts & NVM_CMD_MASK_ADDR);
+	ret = ret ? ret : &_ret;	// Status of failures for the stats
 
 	switch(opt) {
 	case NVM_CMD_SCALAR:
-		return dev->be->scalar_read(dev, *addrs, naddrs, data, meta,
-					    flags, ret);
+		if (nvm_async_qdc_enter(dev, addrs[0], flags, ret))
+			return -1;
+		nvm_async_sched_enter(dev, addrs[0], flags, ret);
+		tsc = nvm_stats_enter(dev, NVM_DEV_STATS_READ, addrs, naddrs,
+				      flags, ret);
+		err = dev->be->scalar_read(dev, *addrs, naddrs, data, meta,
+					   flags, ret);
+		break;
 	case NVM_CMD_VECTOR:
-		return dev->be->vector_read(dev, addrs, naddrs, data, meta,
-					    flags, ret);
+		if (nvm_async_qdc_enter(dev, addrs[0], flags, ret))
+			return -1;
+		nvm_async_sched_enter(dev, addrs[0], flags, ret);
+		tsc = nvm_stats_enter(dev, NVM_DEV_STATS_READ, addrs, naddrs,
+				      flags, ret);
+		err = dev->be->vector_read(dev, addrs, naddrs, data, meta,
+					   flags, ret);
+		break;
 	default:
 		errno = EINVAL;
 		return -1;
 	}
+
+	nvm_stats_leave(dev, NVM_DEV_STATS_READ, addrs, naddrs, flags, ret,
+			tsc, err);
+	nvm_async_qdc_leave(dev, addrs[0], flags, ret, err);
+	nvm_async_sched_leave(dev, addrs[0], flags, ret, err);
+
+	return err;
 }
 
 int nvm_cmd_copy(struct nvm_dev *dev, struct nvm_addr src[],
 		 struct nvm_addr dst[], int naddrs, uint16_t flags,
 		 struct nvm_ret *ret)
 {
-	return dev->be->vector_copy(dev, src, dst, naddrs, flags, ret);
+	struct nvm_ret _ret = { 0 };
+	uint64_t tsc;
+	int err;
+
+	ret = ret ? ret : &_ret;	// Status of failures for the stats
+
+	err = nvm_async_sched_hold(dev, NVM_DEV_STATS_COPY, dst, src, naddrs,
+				   NULL, NULL, flags, ret);
+	if (err)
+		return err < 0 ? -1 : 0;
+
+	if (nvm_async_qdc_enter(dev, src[0], flags, ret))
+		return -1;
+	tsc = nvm_stats_enter(dev, NVM_DEV_STATS_COPY, src, naddrs, flags, ret);
+	err = dev->be->vector_copy(dev, src, dst, naddrs, flags, ret);
+	nvm_stats_leave(dev, NVM_DEV_STATS_COPY, src, naddrs, flags, ret, tsc,
+			err);
+	nvm_async_qdc_leave(dev, src[0], flags, ret, err);
+	if (!err && !(flags & NVM_CMD_ASYNC))
+		nvm_chunk_tbl_advance(dev, dst, naddrs, 0);
+
+	return err;
 }
@@ -33,6 +33,11 @@
 #include <liblightnvm.h>
 #include <nvm_be.h>
 #include <nvm_dev.h>
+#include <nvm_chunk.h>
+#include <nvm_async.h>
+#include <nvm_stats.h>
+#include <nvm_bbt.h>
+#include <nvm_numa.h>
 
 const char *nvm_pmode_str(int pmode) {
 	switch (pmode) {
@@ -99,6 +104,8 @@ void nvm_dev_attr_pr(const struct nvm_dev *dev)
 	printf("  bbts_cached: %d\n", nvm_dev_get_bbts_cached(dev));
 	printf("  quirks: '"NVM_I8_FMT"'\n",
 	       NVM_I8_TO_STR(nvm_dev_get_quirks(dev)));
+	printf("  numa_node: %d\n", nvm_dev_get_numa_node(dev));
+	printf("  affinity: %d\n", nvm_dev_get_affinity(dev));
 }
 
 void nvm_dev_pr(const struct nvm_dev *dev)
@@ -395,6 +402,38 @@ int nvm_dev_set_bbts_cached(struct nvm_dev *dev, int bbts_cached)
 	return 0;
 }
 
+int nvm_dev_get_numa_node(const struct nvm_dev *dev)
+{
+	return dev->numa_node;
+}
+
+int nvm_dev_get_affinity(const struct nvm_dev *dev)
+{
+	return dev->affinity;
+}
+
+int nvm_dev_set_affinity(struct nvm_dev *dev, int affinity)
+{
+	switch (affinity) {
+	case NVM_DEV_AFFINITY_NONE:
+		break;
+	case NVM_DEV_AFFINITY_NODE:
+		if (!dev->numa_cpus) {
+			NVM_DEBUG("FAILED: unknown numa_node or its cpus");
+			errno = EINVAL;
+			return -1;
+		}
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	dev->affinity = affinity;
+
+	return 0;
+}
+
 struct nvm_dev * nvm_dev_openf(const char *dev_path, int flags) {
 	struct nvm_dev *dev = NULL;
 
@@ -408,15 +447,26 @@ struct nvm_dev * nvm_dev_openf(const char *dev_path, int flags) {
 
 	dev->bbts_cached = 0;
 	dev->nbbts = dev->geo.nchannels * dev->geo.nluns;
-	dev->bbts = malloc(sizeof(*dev->bbts) * dev->nbbts);
-	if (!dev->bbts) {
-		NVM_DEBUG("FAILED: malloc dev->bbts");
+	if (nvm_bbt_cache_init(dev)) {
+		NVM_DEBUG("FAILED: nvm_bbt_cache_init");
 		errno = ENOMEM;
 		return NULL;
 	}
 
-	for (size_t i = 0; i < dev->nbbts; ++i)
-		dev->bbts[i] = NULL;
+	dev->chunk_tbl = NULL;	// Allocated on first use by nvm_chunk_*
+	dev->sched = NULL;	// Allocated on first use by nvm_async_init
+	nvm_stats_init(dev);
+
+	if (nvm_numa_cpus_init(dev)) {
+		NVM_DEBUG("no cpus of numa_node: %d", dev->numa_node);
+	}
+
+	dev->affinity = NVM_DEV_AFFINITY_NONE;
+	if (getenv("NVM_DEV_AFFINITY") &&
+	    !strcmp(getenv("NVM_DEV_AFFINITY"), "node") &&
+	    nvm_dev_set_affinity(dev, NVM_DEV_AFFINITY_NODE)) {
+		NVM_DEBUG("FAILED: NVM_DEV_AFFINITY, numa_node unknown");
+	}
 
 	dev->cmd_opts = 0;	// Setup CMD options
 
@@ -463,6 +513,10 @@ void nvm_dev_close(struct nvm_dev *dev)
 
 	dev->be->close(dev);
 
-	free(dev->bbts);
+	nvm_chunk_tbl_free(dev);
+	nvm_async_sched_free(dev);
+	nvm_stats_free(dev);
+	nvm_bbt_cache_free(dev);
+	nvm_numa_cpus_free(dev);
 	free(dev);
 }
@@ -0,0 +1,806 @@
+/*
+ * nvm_dev_group - Groups of devices exposed as one logical device
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <liblightnvm.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_async.h>
+#include <nvm_bbt.h>
+#include <nvm_dev_group.h>
+#include <nvm_stats.h>
+#include <nvm_numa.h>
+
+/**
+ * Channel, and PUG, addresses are stored in 8 bits
+ */
+#define NVM_DEV_GROUP_NCHANNELS_MAX 256
+
+enum group_op {
+	GROUP_SCALAR_ERASE,
+	GROUP_VECTOR_ERASE,
+	GROUP_VECTOR_WRITE,
+	GROUP_VECTOR_READ,
+	GROUP_SBBT,
+};
+
+/**
+ * Map the group address 'addr' to the address of the member owning it,
+ * returns the index of the member or -1 when 'addr' is outside the group
+ *
+ * NOTE: 'g.ch' and 'l.pugrp' share bits, thus this works for both revisions
+ */
+static inline int group_map(const struct nvm_dev_group *group,
+			    struct nvm_addr *addr)
+{
+	const int member = addr->g.ch / group->nchannels;
+
+	if (member >= group->ndevs)
+		return -1;
+
+	addr->g.ch = addr->g.ch % group->nchannels;
+
+	return member;
+}
+
+static void group_async_cb(struct nvm_ret *ret, void *opaque);
+
+/**
+ * Redirect the ASYNC command in 'ret' to the ASYNC CTX of 'member', the
+ * command context of the group is restored by group_async_leave
+ */
+static int group_async_enter(struct nvm_ret *ret, int member)
+{
+	struct nvm_async_ctx *ctx = ret ? ret->async.ctx : NULL;
+	struct nvm_dev_group_async *actx;
+	struct nvm_dev_group_cmd *cmd;
+
+	if (!ctx) {
+		NVM_DEBUG("FAILED: ASYNC command without ASYNC CTX");
+		errno = EINVAL;
+		return -1;
+	}
+
+	actx = ctx->be_ctx;
+	if (!actx->nfree) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	cmd = actx->free[--actx->nfree];
+	cmd->ctx = ctx;
+	cmd->cb = ret->async.cb;
+	cmd->cb_arg = ret->async.cb_arg;
+
+	ret->async.ctx = actx->ctxs[member];
+	ret->async.cb = group_async_cb;
+	ret->async.cb_arg = cmd;
+
+	++(ctx->outstanding);
+
+	return 0;
+}
+
+static void group_async_leave(struct nvm_ret *ret)
+{
+	struct nvm_dev_group_cmd *cmd = ret->async.cb_arg;
+	struct nvm_dev_group_async *actx = cmd->ctx->be_ctx;
+
+	ret->async.ctx = cmd->ctx;
+	ret->async.cb = cmd->cb;
+	ret->async.cb_arg = cmd->cb_arg;
+
+	--(cmd->ctx->outstanding);
+	actx->free[actx->nfree++] = cmd;
+}
+
+static void group_async_cb(struct nvm_ret *ret, void *NVM_UNUSED(opaque))
+{
+	group_async_leave(ret);
+
+	ret->async.cb(ret, ret->async.cb_arg);
+}
+
+/**
+ * Submit the addresses of a vector command to the members in runs of
+ * consecutive addresses owned by the same member
+ *
+ * ASYNC commands complete once, thus they must not span members
+ */
+static int group_cmd(struct nvm_dev *dev, enum group_op op,
+		     struct nvm_addr addrs[], int naddrs, void *data,
+		     void *meta, uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	const size_t dnbytes = dev->geo.sector_nbytes;
+	const size_t mnbytes = dev->geo.meta_nbytes;
+	struct nvm_addr maddrs[NVM_NADDR_MAX];
+
+	if ((naddrs < 1) || (naddrs > NVM_NADDR_MAX)) {
+		NVM_DEBUG("FAILED: invalid naddrs: %d", naddrs);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (int bgn = 0, n = 0; bgn < naddrs; bgn += n) {
+		char *mdata = data ? (char *)data + bgn * dnbytes : NULL;
+		char *mmeta = meta ? (char *)meta + bgn * mnbytes : NULL;
+		// Erase meta holds a chunk descriptor per address, see vector_erase
+		char *emeta = meta ? (char *)meta +
+			bgn * sizeof(struct nvm_spec_rprt_descr) : NULL;
+		struct nvm_dev *mdev;
+		int member = -1;
+		int err = 0;
+
+		for (n = 0; (bgn + n) < naddrs; ++n) {
+			struct nvm_addr addr = addrs[bgn + n];
+			const int cur = group_map(group, &addr);
+
+			if (cur < 0) {
+				NVM_DEBUG("FAILED: addr outside group");
+				errno = EINVAL;
+				return -1;
+			}
+			if ((member >= 0) && (cur != member))
+				break;
+
+			member = cur;
+			maddrs[n] = addr;
+		}
+		mdev = group->devs[member];
+
+		if (flags & NVM_CMD_ASYNC) {
+			if (n != naddrs) {
+				NVM_DEBUG("FAILED: ASYNC command spans members");
+				errno = EINVAL;
+				return -1;
+			}
+			if (group_async_enter(ret, member))
+				return -1;
+		}
+
+		switch (op) {
+		case GROUP_SCALAR_ERASE:
+			err = mdev->be->scalar_erase(mdev, maddrs, n, flags,
+						     ret);
+			break;
+		case GROUP_VECTOR_ERASE:
+			err = mdev->be->vector_erase(mdev, maddrs, n, emeta,
+						     flags, ret);
+			break;
+		case GROUP_VECTOR_WRITE:
+			err = mdev->be->vector_write(mdev, maddrs, n, mdata,
+						     mmeta, flags, ret);
+			break;
+		case GROUP_VECTOR_READ:
+			err = mdev->be->vector_read(mdev, maddrs, n, mdata,
+						    mmeta, flags, ret);
+			break;
+		case GROUP_SBBT:
+			err = mdev->be->sbbt(mdev, maddrs, n, flags, ret);
+			break;
+		}
+
+		if (err) {
+			if (flags & NVM_CMD_ASYNC)
+				group_async_leave(ret);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void group_be_close(struct nvm_dev *dev)
+{
+	free(dev->be_state);
+	dev->be_state = NULL;
+}
+
+static struct nvm_spec_idfy *group_be_idfy(struct nvm_dev *dev,
+					   struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	struct nvm_dev *mdev = group->devs[0];
+	struct nvm_spec_idfy *idfy;
+
+	idfy = mdev->be->idfy(mdev, ret);
+	if (!idfy)
+		return NULL;
+
+	memcpy(idfy, &dev->idfy, sizeof(*idfy));
+
+	return idfy;
+}
+
+static struct nvm_spec_rprt *group_be_rprt(struct nvm_dev *dev,
+					   struct nvm_addr *addr, int opt,
+					   struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	struct nvm_spec_rprt *rprts[group->ndevs];
+	struct nvm_spec_rprt *rprt = NULL;
+	size_t ndescr = 0;
+
+	if (addr) {
+		struct nvm_addr maddr = *addr;
+		const int member = group_map(group, &maddr);
+		struct nvm_dev *mdev;
+
+		if (member < 0) {
+			NVM_DEBUG("FAILED: addr outside group");
+			errno = EINVAL;
+			return NULL;
+		}
+		mdev = group->devs[member];
+
+		return mdev->be->rprt(mdev, &maddr, opt, ret);
+	}
+
+	// Report of the entire group, concatenate those of the members
+	memset(rprts, 0, sizeof(rprts));
+	for (int i = 0; i < group->ndevs; ++i) {
+		struct nvm_dev *mdev = group->devs[i];
+
+		rprts[i] = mdev->be->rprt(mdev, NULL, opt, ret);
+		if (!rprts[i]) {
+			NVM_DEBUG("FAILED: rprt of member: %d", i);
+			goto exit;
+		}
+		ndescr += rprts[i]->ndescr;
+	}
+
+	rprt = nvm_buf_alloc(dev, sizeof(*rprt) + ndescr *
+			     sizeof(struct nvm_spec_rprt_descr), NULL);
+	if (!rprt) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		goto exit;
+	}
+
+	rprt->ndescr = 0;
+	for (int i = 0; i < group->ndevs; ++i) {
+		memcpy(&rprt->descr[rprt->ndescr], rprts[i]->descr,
+		       rprts[i]->ndescr * sizeof(struct nvm_spec_rprt_descr));
+		rprt->ndescr += rprts[i]->ndescr;
+	}
+
+exit:
+	for (int i = 0; i < group->ndevs; ++i)
+		nvm_buf_free(group->devs[i], rprts[i]);
+
+	return rprt;
+}
+
+static int group_be_gfeat(struct nvm_dev *dev, uint8_t id,
+			  union nvm_nvme_feat *feat, struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	struct nvm_dev *mdev = group->devs[0];
+
+	return mdev->be->gfeat(mdev, id, feat, ret);
+}
+
+static int group_be_sfeat(struct nvm_dev *dev, uint8_t id,
+			  const union nvm_nvme_feat *feat, struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+
+	for (int i = 0; i < group->ndevs; ++i) {
+		struct nvm_dev *mdev = group->devs[i];
+
+		if (mdev->be->sfeat(mdev, id, feat, ret)) {
+			NVM_DEBUG("FAILED: sfeat of member: %d", i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static struct nvm_spec_bbt *group_be_gbbt(struct nvm_dev *dev,
+					  struct nvm_addr addr,
+					  struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	const int member = group_map(group, &addr);
+	struct nvm_dev *mdev;
+
+	if (member < 0) {
+		NVM_DEBUG("FAILED: addr outside group");
+		errno = EINVAL;
+		return NULL;
+	}
+	mdev = group->devs[member];
+
+	return mdev->be->gbbt(mdev, addr, ret);
+}
+
+static int group_be_sbbt(struct nvm_dev *dev, struct nvm_addr *addrs,
+			 int naddrs, uint16_t flags, struct nvm_ret *ret)
+{
+	return group_cmd(dev, GROUP_SBBT, addrs, naddrs, NULL, NULL, flags,
+			 ret);
+}
+
+static int group_be_scalar_erase(struct nvm_dev *dev, struct nvm_addr addrs[],
+				 int naddrs, uint16_t flags,
+				 struct nvm_ret *ret)
+{
+	return group_cmd(dev, GROUP_SCALAR_ERASE, addrs, naddrs, NULL, NULL,
+			 flags, ret);
+}
+
+static int group_be_scalar_write(struct nvm_dev *dev, struct nvm_addr addr,
+				 int naddrs, const void *data,
+				 const void *meta, uint16_t flags,
+				 struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	const int member = group_map(group, &addr);
+	struct nvm_dev *mdev;
+
+	if (member < 0) {
+		NVM_DEBUG("FAILED: addr outside group");
+		errno = EINVAL;
+		return -1;
+	}
+	mdev = group->devs[member];
+
+	if ((flags & NVM_CMD_ASYNC) && group_async_enter(ret, member))
+		return -1;
+
+	if (mdev->be->scalar_write(mdev, addr, naddrs, data, meta, flags,
+				   ret)) {
+		if (flags & NVM_CMD_ASYNC)
+			group_async_leave(ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int group_be_scalar_read(struct nvm_dev *dev, struct nvm_addr addr,
+				int naddrs, void *data, void *meta,
+				uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	const int member = group_map(group, &addr);
+	struct nvm_dev *mdev;
+
+	if (member < 0) {
+		NVM_DEBUG("FAILED: addr outside group");
+		errno = EINVAL;
+		return -1;
+	}
+	mdev = group->devs[member];
+
+	if ((flags & NVM_CMD_ASYNC) && group_async_enter(ret, member))
+		return -1;
+
+	if (mdev->be->scalar_read(mdev, addr, naddrs, data, meta, flags,
+				  ret)) {
+		if (flags & NVM_CMD_ASYNC)
+			group_async_leave(ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int group_be_vector_erase(struct nvm_dev *dev, struct nvm_addr addrs[],
+				 int naddrs, void *meta, uint16_t flags,
+				 struct nvm_ret *ret)
+{
+	return group_cmd(dev, GROUP_VECTOR_ERASE, addrs, naddrs, NULL, meta,
+			 flags, ret);
+}
+
+static int group_be_vector_write(struct nvm_dev *dev, struct nvm_addr addrs[],
+				 int naddrs, const void *data,
+				 const void *meta, uint16_t flags,
+				 struct nvm_ret *ret)
+{
+	return group_cmd(dev, GROUP_VECTOR_WRITE, addrs, naddrs, (void *)data,
+			 (void *)meta, flags, ret);
+}
+
+static int group_be_vector_read(struct nvm_dev *dev, struct nvm_addr addrs[],
+				int naddrs, void *data, void *meta,
+				uint16_t flags, struct nvm_ret *ret)
+{
+	return group_cmd(dev, GROUP_VECTOR_READ, addrs, naddrs, data, meta,
+			 flags, ret);
+}
+
+/**
+ * Copies are carried out by the device, thus source and destination must
+ * belong to the same member
+ */
+static int group_be_vector_copy(struct nvm_dev *dev, struct nvm_addr src[],
+				struct nvm_addr dst[], int naddrs,
+				uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	struct nvm_addr msrc[NVM_NADDR_MAX];
+	struct nvm_addr mdst[NVM_NADDR_MAX];
+
+	if ((naddrs < 1) || (naddrs > NVM_NADDR_MAX)) {
+		NVM_DEBUG("FAILED: invalid naddrs: %d", naddrs);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (int bgn = 0, n = 0; bgn < naddrs; bgn += n) {
+		struct nvm_dev *mdev;
+		int member = -1;
+
+		for (n = 0; (bgn + n) < naddrs; ++n) {
+			struct nvm_addr s = src[bgn + n];
+			struct nvm_addr d = dst[bgn + n];
+			const int cur = group_map(group, &s);
+
+			if ((cur < 0) || (group_map(group, &d) != cur)) {
+				NVM_DEBUG("FAILED: src and dst of copy differ");
+				errno = EXDEV;
+				return -1;
+			}
+			if ((member >= 0) && (cur != member))
+				break;
+
+			member = cur;
+			msrc[n] = s;
+			mdst[n] = d;
+		}
+		mdev = group->devs[member];
+
+		if (flags & NVM_CMD_ASYNC) {
+			if (n != naddrs) {
+				NVM_DEBUG("FAILED: ASYNC command spans members");
+				errno = EINVAL;
+				return -1;
+			}
+			if (group_async_enter(ret, member))
+				return -1;
+		}
+
+		if (mdev->be->vector_copy(mdev, msrc, mdst, n, flags, ret)) {
+			if (flags & NVM_CMD_ASYNC)
+				group_async_leave(ret);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int group_be_async_term(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	struct nvm_dev_group_async *actx;
+	int err = 0;
+
+	if (!ctx) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	actx = ctx->be_ctx;
+	for (int i = 0; i < group->ndevs; ++i) {
+		struct nvm_dev *mdev = group->devs[i];
+
+		if (!actx->ctxs[i])
+			continue;
+
+		if (mdev->be->async_term(mdev, actx->ctxs[i])) {
+			NVM_DEBUG("FAILED: async_term of member: %d", i);
+			err = -1;
+		}
+	}
+
+	free(actx->cmds);
+	free(actx->free);
+	free(actx);
+	free(ctx);
+
+	return err;
+}
+
+/**
+ * Creates an ASYNC CTX per member, the depth of the group is the smallest of
+ * those given by the members
+ */
+static struct nvm_async_ctx *group_be_async_init(struct nvm_dev *dev,
+						 uint32_t depth,
+						 uint16_t flags)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	struct nvm_dev_group_async *actx;
+	struct nvm_async_ctx *ctx;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		NVM_DEBUG("FAILED: calloc ctx");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	actx = calloc(1, sizeof(*actx) + group->ndevs * sizeof(*actx->ctxs));
+	if (!actx) {
+		NVM_DEBUG("FAILED: calloc actx");
+		free(ctx);
+		errno = ENOMEM;
+		return NULL;
+	}
+	ctx->be_ctx = actx;
+	ctx->depth = depth;
+
+	for (int i = 0; i < group->ndevs; ++i) {
+		struct nvm_dev *mdev = group->devs[i];
+
+		actx->ctxs[i] = mdev->be->async_init(mdev, depth, flags);
+		if (!actx->ctxs[i]) {
+			NVM_DEBUG("FAILED: async_init of member: %d", i);
+			group_be_async_term(dev, ctx);
+			return NULL;
+		}
+
+		if (actx->ctxs[i]->depth < ctx->depth)
+			ctx->depth = actx->ctxs[i]->depth;
+	}
+
+	actx->cmds = calloc(ctx->depth, sizeof(*actx->cmds));
+	actx->free = calloc(ctx->depth, sizeof(*actx->free));
+	if ((!actx->cmds) || (!actx->free)) {
+		NVM_DEBUG("FAILED: calloc cmds");
+		group_be_async_term(dev, ctx);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < ctx->depth; ++i)
+		actx->free[actx->nfree++] = &actx->cmds[i];
+
+	return ctx;
+}
+
+static int group_be_async_poke(struct nvm_dev *dev, struct nvm_async_ctx *ctx,
+			       uint32_t max)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	struct nvm_dev_group_async *actx = ctx->be_ctx;
+	int nevents = 0;
+
+	for (int i = 0; i < group->ndevs; ++i) {
+		struct nvm_dev *mdev = group->devs[i];
+		int res;
+
+		if (max && ((uint32_t)nevents >= max))
+			break;
+
+		res = mdev->be->async_poke(mdev, actx->ctxs[i],
+					   max ? max - nevents : 0);
+		if (res < 0) {
+			NVM_DEBUG("FAILED: async_poke of member: %d", i);
+			return -1;
+		}
+
+		nevents += res;
+	}
+
+	return nevents;
+}
+
+static int group_be_async_wait(struct nvm_dev *dev, struct nvm_async_ctx *ctx)
+{
+	struct nvm_dev_group *group = dev->be_state;
+	struct nvm_dev_group_async *actx = ctx->be_ctx;
+	int nevents = 0;
+
+	for (int i = 0; i < group->ndevs; ++i) {
+		struct nvm_dev *mdev = group->devs[i];
+		int res;
+
+		res = mdev->be->async_wait(mdev, actx->ctxs[i]);
+		if (res < 0) {
+			NVM_DEBUG("FAILED: async_wait of member: %d", i);
+			return -1;
+		}
+
+		nevents += res;
+	}
+
+	return nevents;
+}
+
+static const struct nvm_be nvm_be_group = {
+	.name = "NVM_BE_GROUP",
+
+	.open = nvm_be_nosys_open,
+	.close = group_be_close,
+
+	.pass = nvm_be_nosys_pass,
+
+	.async_init = group_be_async_init,
+	.async_term = group_be_async_term,
+	.async_poke = group_be_async_poke,
+	.async_wait = group_be_async_wait,
+
+	.idfy = group_be_idfy,
+	.rprt = group_be_rprt,
+	.gfeat = group_be_gfeat,
+	.sfeat = group_be_sfeat,
+	.sbbt = group_be_sbbt,
+	.gbbt = group_be_gbbt,
+
+	.scalar_erase = group_be_scalar_erase,
+	.scalar_write = group_be_scalar_write,
+	.scalar_read = group_be_scalar_read,
+
+	.vector_erase = group_be_vector_erase,
+	.vector_write = group_be_vector_write,
+	.vector_read = group_be_vector_read,
+	.vector_copy = group_be_vector_copy,
+};
+
+struct nvm_dev_group *nvm_dev_group_open(struct nvm_dev *devs[], int ndevs)
+{
+	struct nvm_dev_group *group;
+	struct nvm_dev *dev;
+	int affinity;
+
+	if ((!devs) || (ndevs < 1) || (!devs[0])) {
+		NVM_DEBUG("FAILED: invalid devs / ndevs: %d", ndevs);
+		errno = EINVAL;
+		return NULL;
+	}
+	if ((devs[0]->geo.nchannels * ndevs) > NVM_DEV_GROUP_NCHANNELS_MAX) {
+		NVM_DEBUG("FAILED: too many channels in group");
+		errno = EINVAL;
+		return NULL;
+	}
+	for (int i = 1; i < ndevs; ++i) {
+		if ((!devs[i]) || (devs[i]->verid != devs[0]->verid) ||
+		    (devs[i]->be->id != devs[0]->be->id) ||
+		    memcmp(&devs[i]->geo, &devs[0]->geo, sizeof(devs[0]->geo))) {
+			NVM_DEBUG("FAILED: member: %d differs from member: 0",
+				  i);
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	group = calloc(1, sizeof(*group) + ndevs * sizeof(*group->devs));
+	if (!group) {
+		NVM_DEBUG("FAILED: calloc group");
+		errno = ENOMEM;
+		return NULL;
+	}
+	group->nchannels = devs[0]->geo.nchannels;
+	group->ndevs = ndevs;
+	for (int i = 0; i < ndevs; ++i)
+		group->devs[i] = devs[i];
+
+	// Commands are routed by the group, buffers are those of the members
+	group->be = nvm_be_group;
+	group->be.id = devs[0]->be->id;
+	for (int i = 0; i < ndevs; ++i) {
+		if (devs[i]->be->vector_copy == nvm_be_nosys_vector_copy)
+			group->be.vector_copy = nvm_be_nosys_vector_copy;
+	}
+
+	dev = malloc(sizeof(*dev));
+	if (!dev) {
+		NVM_DEBUG("FAILED: malloc dev");
+		free(group);
+		errno = ENOMEM;
+		return NULL;
+	}
+	memcpy(dev, devs[0], sizeof(*dev));
+
+	dev->fd = -1;
+	snprintf(dev->name, NVM_DEV_NAME_LEN, "group%d", ndevs);
+
+	// 'nchannels' is shared with 'npugrp'
+	dev->geo.nchannels *= ndevs;
+	dev->geo.tbytes *= ndevs;
+
+	switch (dev->verid) {
+	case NVM_SPEC_VERID_12:
+		dev->idfy.s12.grp[0].num_ch = dev->geo.nchannels;
+		break;
+
+	case NVM_SPEC_VERID_20:
+		dev->idfy.s20.lgeo.npugrp = dev->geo.nchannels;
+		break;
+	}
+
+	dev->be = &group->be;
+	dev->be_state = group;
+	dev->nbbts = dev->geo.nchannels * dev->geo.nluns;
+	dev->bbts_cached = 0;
+	dev->bbts = NULL;
+	atomic_init(&dev->chunk_tbl, NULL);
+	atomic_init(&dev->sched, NULL);
+
+	if (nvm_bbt_cache_init(dev)) {
+		NVM_DEBUG("FAILED: nvm_bbt_cache_init");
+		free(group);
+		free(dev);
+		return NULL;
+	}
+
+	nvm_stats_init(dev);
+
+	// The node common to the members, bound to when all of them are
+	dev->numa_node = devs[0]->numa_node;
+	dev->affinity = NVM_DEV_AFFINITY_NONE;
+	affinity = NVM_DEV_AFFINITY_NODE;
+	for (int i = 0; i < ndevs; ++i) {
+		if (devs[i]->numa_node != dev->numa_node)
+			dev->numa_node = -1;
+		if (devs[i]->affinity != NVM_DEV_AFFINITY_NODE)
+			affinity = NVM_DEV_AFFINITY_NONE;
+	}
+	if (!nvm_numa_cpus_init(dev))
+		dev->affinity = affinity;
+
+	group->dev = dev;
+
+	return group;
+}
+
+void nvm_dev_group_close(struct nvm_dev_group *group)
+{
+	if (!group)
+		return;
+
+	nvm_dev_close(group->dev);
+}
+
+struct nvm_dev *nvm_dev_group_get_dev(const struct nvm_dev_group *group)
+{
+	return group->dev;
+}
+
+int nvm_dev_group_get_ndevs(const struct nvm_dev_group *group)
+{
+	return group->ndevs;
+}
+
+struct nvm_dev *nvm_dev_group_get_member(const struct nvm_dev_group *group,
+					 int idx)
+{
+	if ((idx < 0) || (idx >= group->ndevs)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return group->devs[idx];
+}
@@ -0,0 +1,960 @@
+/*
+ * nvm_ftl - Host-side page-mapped FTL on top of OCSSD 2.0 chunks
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+
+#ifndef NVM_FTL_ENABLED
+
+struct nvm_ftl *nvm_ftl_open(struct nvm_dev *NVM_UNUSED(dev),
+			     int NVM_UNUSED(flags))
+{
+	NVM_DEBUG("FAILED: nvm_ftl is not enabled");
+	errno = ENOSYS;
+	return NULL;
+}
+
+void nvm_ftl_close(struct nvm_ftl *NVM_UNUSED(ftl))
+{
+	return;
+}
+
+int nvm_ftl_flush(struct nvm_ftl *NVM_UNUSED(ftl))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int nvm_ftl_read(struct nvm_ftl *NVM_UNUSED(ftl), uint64_t NVM_UNUSED(lba),
+		 size_t NVM_UNUSED(nlbas), void *NVM_UNUSED(buf))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int nvm_ftl_write(struct nvm_ftl *NVM_UNUSED(ftl), uint64_t NVM_UNUSED(lba),
+		  size_t NVM_UNUSED(nlbas), const void *NVM_UNUSED(buf))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int nvm_ftl_trim(struct nvm_ftl *NVM_UNUSED(ftl), uint64_t NVM_UNUSED(lba),
+		 size_t NVM_UNUSED(nlbas))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+uint64_t nvm_ftl_get_nlbas(const struct nvm_ftl *NVM_UNUSED(ftl))
+{
+	return 0;
+}
+
+struct nvm_gc *nvm_ftl_get_gc(const struct nvm_ftl *NVM_UNUSED(ftl))
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+#else
+#include <nvm_place.h>
+#include <nvm_gc.h>
+#include <nvm_ftl.h>
+
+static inline size_t ftl_npunits(const struct nvm_geo *geo)
+{
+	return geo->l.npugrp * geo->l.npunit;
+}
+
+/**
+ * Largest write issued as one command, a multiple of ws_min
+ */
+static inline int ftl_ws(const struct nvm_dev *dev)
+{
+	const int ws_min = nvm_dev_get_ws_min(dev);
+	const int ws_opt = nvm_dev_get_ws_opt(dev);
+
+	if ((ws_opt <= NVM_NADDR_MAX) && !(ws_opt % ws_min))
+		return ws_opt;
+
+	return (NVM_NADDR_MAX / ws_min) * ws_min;
+}
+
+/**
+ * The checkpoint slots are laid out on the lowest chunks of the device,
+ * striped over the parallel units
+ */
+static struct nvm_addr ftl_cp_chunk(const struct nvm_ftl *ftl, int slot,
+				    int idx)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	const size_t pos = slot * ftl->cp_nchunks + idx;
+	const size_t punit = pos % ftl_npunits(geo);
+	struct nvm_addr addr = { .val = 0 };
+
+	addr.l.pugrp = punit / geo->l.npunit;
+	addr.l.punit = punit % geo->l.npunit;
+	addr.l.chunk = pos / ftl_npunits(geo);
+
+	return addr;
+}
+
+static int ftl_cp_reserved(const struct nvm_ftl *ftl, struct nvm_addr addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	const size_t pos = addr.l.chunk * ftl_npunits(geo) +
+			   addr.l.pugrp * geo->l.npunit + addr.l.punit;
+
+	return pos < (size_t)(NVM_FTL_CP_NSLOTS * ftl->cp_nchunks);
+}
+
+static inline size_t ftl_sectr_idx(const struct nvm_geo *geo,
+				   struct nvm_addr addr)
+{
+	return (((addr.l.pugrp * geo->l.npunit + addr.l.punit) *
+		 geo->l.nchunk) + addr.l.chunk) * geo->l.nsectr + addr.l.sectr;
+}
+
+/**
+ * Drop the sector previously mapped to an LBA from the valid sectors
+ */
+static inline void ftl_invalidate(struct nvm_ftl *ftl, uint64_t val)
+{
+	struct nvm_addr addr = { .val = val };
+
+	if (val != NVM_FTL_UNMAPPED)
+		nvm_gc_mark(ftl->gc, addr, 1, 0);
+}
+
+/**
+ * Move the LBA of 'src' to 'dst', unless it was remapped meanwhile
+ */
+static int ftl_gc_reloc(void *arg, struct nvm_addr src, struct nvm_addr dst)
+{
+	struct nvm_ftl *ftl = arg;
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	const uint64_t lba = ftl->p2l[ftl_sectr_idx(geo, src)];
+	uint64_t expected = src.val;
+
+	if (lba >= ftl->nlbas)
+		return -1;
+
+	ftl->p2l[ftl_sectr_idx(geo, dst)] = lba;
+
+	if (!atomic_compare_exchange_strong(&ftl->map[lba], &expected, dst.val))
+		return 1;
+
+	// Unless stamped after the latest snapshot of the table, the relocation
+	// is neither in a checkpoint nor replayed by the scan
+	if ((!ftl->gc_seq) || (atomic_load(&ftl->cp_seq) >= ftl->gc_seq))
+		ftl->gc_dirty = 1;
+
+	return 0;
+}
+
+/**
+ * Relocations the scan does not replay, see ftl_gc_reloc, must be covered by
+ * a checkpoint before the victims are reset
+ */
+static int ftl_gc_sync(void *arg)
+{
+	struct nvm_ftl *ftl = arg;
+
+	if (!ftl->gc_dirty)
+		return 0;
+
+	if (nvm_ftl_flush(ftl))
+		return -1;
+
+	ftl->gc_dirty = 0;
+
+	return 0;
+}
+
+static inline size_t ftl_map_nsectr(const struct nvm_geo *geo, uint64_t nlbas)
+{
+	return (nlbas * sizeof(uint64_t) + geo->l.nbytes - 1) / geo->l.nbytes;
+}
+
+/**
+ * Determine the logical capacity and the size of the checkpoints, the
+ * checkpoint is sized for the capacity before subtracting its own chunks,
+ * which is an upper bound
+ */
+static int ftl_geometry(struct nvm_ftl *ftl)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	const size_t ws_min = nvm_dev_get_ws_min(ftl->dev);
+	const size_t nchunks = ftl_npunits(geo) * geo->l.nchunk;
+	uint64_t nlbas = nchunks * geo->l.nsectr * (100 - NVM_FTL_OP) / 100;
+	size_t cp_nsectr;
+
+	cp_nsectr = 2 + ftl_map_nsectr(geo, nlbas);
+	ftl->cp_nchunks = (cp_nsectr + geo->l.nsectr - 1) / geo->l.nsectr;
+	if (NVM_FTL_CP_NSLOTS * (size_t)ftl->cp_nchunks >= nchunks) {
+		NVM_DEBUG("FAILED: device too small, nchunks: %zu", nchunks);
+		errno = EINVAL;
+		return -1;
+	}
+
+	ftl->nlbas = (nchunks - NVM_FTL_CP_NSLOTS * ftl->cp_nchunks) *
+		     geo->l.nsectr * (100 - NVM_FTL_OP) / 100;
+
+	cp_nsectr = 2 + ftl_map_nsectr(geo, ftl->nlbas);
+	ftl->cp_nsectr = ((cp_nsectr + ws_min - 1) / ws_min) * ws_min;
+
+	return 0;
+}
+
+/**
+ * Hold back writers from entering the map-update section while a snapshot of
+ * the mapping table is taken, see ftl_gate_close
+ */
+static void ftl_writer_enter(struct nvm_ftl *ftl)
+{
+	for (;;) {
+		while (atomic_load(&ftl->gate))
+			sched_yield();
+
+		atomic_fetch_add(&ftl->nwriters, 1);
+		if (!atomic_load(&ftl->gate))
+			return;
+
+		atomic_fetch_sub(&ftl->nwriters, 1);
+	}
+}
+
+static void ftl_writer_exit(struct nvm_ftl *ftl)
+{
+	atomic_fetch_sub(&ftl->nwriters, 1);
+}
+
+/**
+ * Wait for the writers in the map-update section to leave it, such that every
+ * write with a sequence number below the current one is in the mapping table,
+ * checkpoints and GC may hold the gate closed at the same time
+ */
+static void ftl_gate_close(struct nvm_ftl *ftl)
+{
+	atomic_fetch_add(&ftl->gate, 1);
+	while (atomic_load(&ftl->nwriters))
+		sched_yield();
+}
+
+static void ftl_gate_open(struct nvm_ftl *ftl)
+{
+	atomic_fetch_sub(&ftl->gate, 1);
+}
+
+/**
+ * Give the relocated sectors a fresh sequence #, such that the scan replays
+ * them without a checkpoint. With the gate closed, every write with a lower
+ * sequence # is in the mapping table, a sector still mapped is thus only
+ * superseded by writes winning over its relocation. Sectors no longer mapped
+ * keep the sequence # of their original write.
+ */
+static int ftl_gc_stamp(void *arg, const struct nvm_addr src[], int nvalid,
+			void *meta)
+{
+	struct nvm_ftl *ftl = arg;
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	uint64_t seq;
+
+	ftl_gate_close(ftl);
+	seq = atomic_fetch_add(&ftl->seq, 1);
+	for (int i = 0; i < nvalid; ++i) {
+		char *buf = (char *)meta + i * geo->l.nbytes_oob;
+		struct nvm_ftl_oob oob;
+
+		memcpy(&oob, buf, sizeof(oob));
+		if ((oob.lba >= ftl->nlbas) ||
+		    (atomic_load(&ftl->map[oob.lba]) != src[i].val))
+			continue;
+
+		oob.seq = seq;
+		memcpy(buf, &oob, sizeof(oob));
+	}
+	ftl_gate_open(ftl);
+
+	ftl->gc_seq = seq + 1;
+
+	return 0;
+}
+
+static const struct nvm_gc_ops ftl_gc_ops = {
+	.reloc = ftl_gc_reloc,
+	.sync = ftl_gc_sync,
+	.stamp = ftl_gc_stamp,
+};
+
+static int ftl_range_check(const struct nvm_ftl *ftl, uint64_t lba,
+			   size_t nlbas)
+{
+	if ((!nlbas) || (lba >= ftl->nlbas) || (nlbas > ftl->nlbas - lba)) {
+		NVM_DEBUG("FAILED: lba: %"PRIu64", nlbas: %zu", lba, nlbas);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Write the checkpoint in 'buf' to the given slot, resetting the chunks of the
+ * slot first
+ */
+static int ftl_cp_write(struct nvm_ftl *ftl, const char *buf, int slot)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	const size_t ws = ftl_ws(ftl->dev);
+
+	for (int idx = 0; idx < ftl->cp_nchunks; ++idx) {
+		struct nvm_addr chunk = ftl_cp_chunk(ftl, slot, idx);
+		int wp = nvm_chunk_get_wp(ftl->dev, chunk);
+
+		if (wp < 0) {
+			NVM_DEBUG("FAILED: nvm_chunk_get_wp");
+			return -1;
+		}
+		if (wp && nvm_chunk_reset(ftl->dev, chunk, 0x0, NULL)) {
+			NVM_DEBUG("FAILED: nvm_chunk_reset");
+			return -1;
+		}
+	}
+
+	for (size_t sectr = 0; sectr < ftl->cp_nsectr; ) {
+		const int idx = sectr / geo->l.nsectr;
+		size_t nsectr = geo->l.nsectr - (sectr % geo->l.nsectr);
+
+		if (nsectr > ftl->cp_nsectr - sectr)
+			nsectr = ftl->cp_nsectr - sectr;
+		nsectr = NVM_MIN(nsectr, ws);
+
+		if (nvm_chunk_append(ftl->dev, ftl_cp_chunk(ftl, slot, idx),
+				     buf + sectr * geo->l.nbytes, NULL, nsectr,
+				     NULL, NVM_CMD_SYNC, NULL)) {
+			NVM_DEBUG("FAILED: nvm_chunk_append");
+			return -1;
+		}
+
+		sectr += nsectr;
+	}
+
+	return 0;
+}
+
+/**
+ * Read the checkpoint of the given slot into 'buf' and verify it
+ *
+ * @returns 0 when the slot holds a valid checkpoint, -1 otherwise
+ */
+static int ftl_cp_read(struct nvm_ftl *ftl, char *buf, int slot)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	const size_t map_nsectr = ftl_map_nsectr(geo, ftl->nlbas);
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_ftl_cp *hdr, *ftr;
+
+	for (size_t sectr = 0; sectr < ftl->cp_nsectr; ) {
+		const int idx = sectr / geo->l.nsectr;
+		struct nvm_addr chunk = ftl_cp_chunk(ftl, slot, idx);
+		size_t nsectr = geo->l.nsectr - (sectr % geo->l.nsectr);
+
+		if (nsectr > ftl->cp_nsectr - sectr)
+			nsectr = ftl->cp_nsectr - sectr;
+		nsectr = NVM_MIN(nsectr, NVM_NADDR_MAX);
+
+		if (nvm_chunk_get_wp(ftl->dev, chunk) <
+		    (int)((sectr % geo->l.nsectr) + nsectr)) {
+			errno = ENOENT;
+			return -1;
+		}
+
+		for (size_t i = 0; i < nsectr; ++i) {
+			addrs[i] = chunk;
+			addrs[i].l.sectr = (sectr % geo->l.nsectr) + i;
+		}
+
+		if (nvm_cmd_read(ftl->dev, addrs, nsectr,
+				 buf + sectr * geo->l.nbytes, NULL,
+				 NVM_CMD_SYNC, NULL)) {
+			NVM_DEBUG("FAILED: nvm_cmd_read");
+			return -1;
+		}
+
+		sectr += nsectr;
+	}
+
+	hdr = (struct nvm_ftl_cp *)buf;
+	ftr = (struct nvm_ftl_cp *)(buf + (1 + map_nsectr) * geo->l.nbytes);
+
+	if ((hdr->magic != NVM_FTL_CP_MAGIC) ||
+	    (hdr->version != NVM_FTL_CP_VERSION) ||
+	    (hdr->map_nsectr != map_nsectr) || (hdr->nlbas != ftl->nlbas) ||
+	    memcmp(hdr, ftr, sizeof(*hdr))) {
+		NVM_DEBUG("FAILED: invalid checkpoint in slot: %d", slot);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Load the newest valid checkpoint into the mapping table
+ *
+ * @returns 0 and the sequence # from which writes are not covered by the
+ * checkpoint in 'seq', which is 0 when there is no valid checkpoint
+ */
+static int ftl_cp_load(struct nvm_ftl *ftl, uint64_t *seq)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	char *buf;
+
+	buf = nvm_buf_alloc(ftl->dev, ftl->cp_nsectr * geo->l.nbytes, NULL);
+	if (!buf) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	*seq = 0;
+	ftl->cp_gen = 0;
+	ftl->cp_slot = NVM_FTL_CP_NSLOTS - 1;
+
+	for (int slot = 0; slot < NVM_FTL_CP_NSLOTS; ++slot) {
+		const struct nvm_ftl_cp *hdr = (struct nvm_ftl_cp *)buf;
+		const uint64_t *map;
+
+		if (ftl_cp_read(ftl, buf, slot) || (hdr->gen <= ftl->cp_gen))
+			continue;
+
+		map = (const uint64_t *)(buf + geo->l.nbytes);
+		for (uint64_t lba = 0; lba < ftl->nlbas; ++lba)
+			atomic_store_explicit(&ftl->map[lba], map[lba],
+					      memory_order_relaxed);
+
+		*seq = hdr->seq;
+		ftl->cp_gen = hdr->gen;
+		ftl->cp_slot = slot;
+	}
+
+	nvm_buf_free(ftl->dev, buf);
+
+	return 0;
+}
+
+/**
+ * Replay writes not covered by the checkpoint by scanning the out-of-bound
+ * meta-data of every written sector outside of the checkpoint slots, the
+ * newest write of an LBA wins
+ */
+static int ftl_scan(struct nvm_ftl *ftl, uint64_t seq_cp)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	uint64_t seq_max = seq_cp;
+	uint64_t *seqs;		// Sequence # + 1 of the replayed write of an LBA
+	char *data, *meta;
+	int err = 0;
+
+	seqs = calloc(ftl->nlbas, sizeof(*seqs));
+	data = nvm_buf_alloc(ftl->dev, NVM_NADDR_MAX * geo->l.nbytes, NULL);
+	meta = nvm_buf_alloc(ftl->dev, NVM_NADDR_MAX * geo->l.nbytes_oob, NULL);
+	if (!(seqs && data && meta)) {
+		NVM_DEBUG("FAILED: calloc / nvm_buf_alloc");
+		free(seqs);
+		nvm_buf_free(ftl->dev, data);
+		nvm_buf_free(ftl->dev, meta);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (size_t punit = 0; !err && punit < ftl_npunits(geo); ++punit) {
+		struct nvm_addr pu = { .val = 0 };
+		struct nvm_spec_rprt *rprt;
+
+		pu.l.pugrp = punit / geo->l.npunit;
+		pu.l.punit = punit % geo->l.npunit;
+
+		rprt = nvm_cmd_rprt(ftl->dev, &pu, 0x0, NULL);
+		if (!rprt) {
+			NVM_DEBUG("FAILED: nvm_cmd_rprt");
+			err = -1;
+			break;
+		}
+
+		for (uint32_t cidx = 0; !err && cidx < rprt->ndescr; ++cidx) {
+			const struct nvm_spec_rprt_descr *descr;
+			struct nvm_addr chunk = pu;
+
+			descr = &rprt->descr[cidx];
+			chunk.l.chunk = cidx;
+
+			if (ftl_cp_reserved(ftl, chunk))
+				continue;
+			if ((descr->cs != NVM_CHUNK_STATE_OPEN) &&
+			    (descr->cs != NVM_CHUNK_STATE_CLOSED))
+				continue;
+
+			for (uint64_t sectr = 0; sectr < descr->wp; ) {
+				const int naddrs = NVM_MIN(descr->wp - sectr,
+							   NVM_NADDR_MAX);
+
+				for (int i = 0; i < naddrs; ++i) {
+					addrs[i] = chunk;
+					addrs[i].l.sectr = sectr + i;
+				}
+
+				if (nvm_cmd_read(ftl->dev, addrs, naddrs, data,
+						 meta, NVM_CMD_SYNC, NULL)) {
+					NVM_DEBUG("FAILED: nvm_cmd_read");
+					err = -1;
+					break;
+				}
+
+				for (int i = 0; i < naddrs; ++i) {
+					struct nvm_ftl_oob oob;
+
+					memcpy(&oob, meta + i * geo->l.nbytes_oob,
+					       sizeof(oob));
+
+					if ((oob.lba >= ftl->nlbas) ||
+					    (oob.seq < seq_cp) ||
+					    (seqs[oob.lba] > oob.seq))
+						continue;
+
+					seqs[oob.lba] = oob.seq + 1;
+					atomic_store_explicit(&ftl->map[oob.lba],
+							      addrs[i].val,
+							      memory_order_relaxed);
+					if (oob.seq >= seq_max)
+						seq_max = oob.seq + 1;
+				}
+
+				sectr += naddrs;
+			}
+		}
+
+		nvm_buf_free(ftl->dev, rprt);
+	}
+
+	atomic_store(&ftl->seq, seq_max);
+
+	free(seqs);
+	nvm_buf_free(ftl->dev, data);
+	nvm_buf_free(ftl->dev, meta);
+
+	return err;
+}
+
+/**
+ * Reset every written chunk of the device, such that all chunks are free
+ */
+static int ftl_format(struct nvm_ftl *ftl)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+
+	for (size_t punit = 0; punit < ftl_npunits(geo); ++punit) {
+		struct nvm_addr pu = { .val = 0 };
+		struct nvm_spec_rprt *rprt;
+
+		pu.l.pugrp = punit / geo->l.npunit;
+		pu.l.punit = punit % geo->l.npunit;
+
+		rprt = nvm_cmd_rprt(ftl->dev, &pu, 0x0, NULL);
+		if (!rprt) {
+			NVM_DEBUG("FAILED: nvm_cmd_rprt");
+			return -1;
+		}
+
+		for (uint32_t cidx = 0; cidx < rprt->ndescr; ++cidx) {
+			struct nvm_addr chunk = pu;
+
+			if ((rprt->descr[cidx].cs != NVM_CHUNK_STATE_OPEN) &&
+			    (rprt->descr[cidx].cs != NVM_CHUNK_STATE_CLOSED))
+				continue;
+
+			chunk.l.chunk = cidx;
+			if (nvm_chunk_reset(ftl->dev, chunk, 0x0, NULL)) {
+				NVM_DEBUG("FAILED: nvm_chunk_reset");
+				nvm_buf_free(ftl->dev, rprt);
+				return -1;
+			}
+		}
+
+		nvm_buf_free(ftl->dev, rprt);
+	}
+
+	return 0;
+}
+
+void nvm_ftl_close(struct nvm_ftl *ftl)
+{
+	if (!ftl)
+		return;
+
+	if (ftl->place && nvm_ftl_flush(ftl)) {
+		NVM_DEBUG("FAILED: nvm_ftl_flush, recovery falls back to scan");
+	}
+
+	nvm_gc_free(ftl->gc);
+	nvm_place_free(ftl->place);
+	nvm_buf_free(ftl->dev, ftl->cp_buf);
+	free(ftl->p2l);
+	free(ftl->map);
+	free(ftl);
+}
+
+struct nvm_ftl *nvm_ftl_open(struct nvm_dev *dev, int flags)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_ftl *ftl;
+	uint64_t seq = 0;
+
+	if (nvm_dev_get_verid(dev) != NVM_SPEC_VERID_20) {
+		NVM_DEBUG("FAILED: unsupported verid: %d",
+			  nvm_dev_get_verid(dev));
+		errno = ENOSYS;
+		return NULL;
+	}
+
+	if (geo->l.nbytes_oob < sizeof(struct nvm_ftl_oob)) {
+		NVM_DEBUG("FAILED: nbytes_oob: %zu", geo->l.nbytes_oob);
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	ftl = calloc(1, sizeof(*ftl));
+	if (!ftl) {
+		NVM_DEBUG("FAILED: calloc ftl");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	ftl->dev = dev;
+	atomic_init(&ftl->seq, 0);
+	atomic_init(&ftl->nwriters, 0);
+	atomic_init(&ftl->gate, 0);
+	atomic_flag_clear(&ftl->cp_lock);
+	atomic_init(&ftl->cp_seq, 0);
+	ftl->cp_slot = NVM_FTL_CP_NSLOTS - 1;
+
+	if (ftl_geometry(ftl)) {
+		NVM_DEBUG("FAILED: ftl_geometry");
+		free(ftl);
+		return NULL;
+	}
+
+	ftl->map = malloc(ftl->nlbas * sizeof(*ftl->map));
+	ftl->p2l = malloc(ftl_npunits(geo) * geo->l.nchunk * geo->l.nsectr *
+			  sizeof(*ftl->p2l));
+	ftl->cp_buf = nvm_buf_alloc(dev, ftl->cp_nsectr * geo->l.nbytes, NULL);
+	if (!(ftl->map && ftl->p2l && ftl->cp_buf)) {
+		NVM_DEBUG("FAILED: malloc ftl->map / ftl->p2l / ftl->cp_buf");
+		nvm_buf_free(dev, ftl->cp_buf);
+		free(ftl->p2l);
+		free(ftl->map);
+		free(ftl);
+		errno = ENOMEM;
+		return NULL;
+	}
+	for (uint64_t lba = 0; lba < ftl->nlbas; ++lba)
+		atomic_init(&ftl->map[lba], NVM_FTL_UNMAPPED);
+
+	if ((flags & NVM_FTL_CREATE) && ftl_format(ftl)) {
+		NVM_DEBUG("FAILED: ftl_format");
+		nvm_ftl_close(ftl);
+		return NULL;
+	}
+
+	ftl->place = nvm_place_alloc(dev, NVM_FTL_STREAM_NR, 0);
+	if (!ftl->place) {
+		NVM_DEBUG("FAILED: nvm_place_alloc");
+		nvm_ftl_close(ftl);
+		return NULL;
+	}
+
+	// The checkpoint slots are written outside of the placement engine
+	for (int slot = 0; slot < NVM_FTL_CP_NSLOTS; ++slot) {
+		for (int idx = 0; idx < ftl->cp_nchunks; ++idx)
+			nvm_place_chunk_take(ftl->place,
+					     ftl_cp_chunk(ftl, slot, idx));
+	}
+
+	ftl->gc = nvm_gc_alloc(ftl->place, &ftl_gc_ops, ftl);
+	if (!ftl->gc) {
+		NVM_DEBUG("FAILED: nvm_gc_alloc");
+		nvm_place_free(ftl->place);
+		ftl->place = NULL;
+		nvm_ftl_close(ftl);
+		return NULL;
+	}
+
+	// Chunks left open, or superseded entirely, by a prior session are
+	// reclaimed by GC instead of leaking, the checkpoint slots are not
+	// among them as they were taken above
+	nvm_gc_adopt(ftl->gc);
+
+	if (flags & NVM_FTL_CREATE)
+		return ftl;
+
+	if (ftl_cp_load(ftl, &seq) || ftl_scan(ftl, seq)) {
+		NVM_DEBUG("FAILED: ftl_cp_load / ftl_scan");
+		nvm_place_free(ftl->place);
+		ftl->place = NULL;
+		nvm_ftl_close(ftl);
+		return NULL;
+	}
+
+	// Rebuild the reverse map and the validity of sectors
+	for (uint64_t lba = 0; lba < ftl->nlbas; ++lba) {
+		struct nvm_addr addr;
+
+		addr.val = atomic_load(&ftl->map[lba]);
+		if (addr.val == NVM_FTL_UNMAPPED)
+			continue;
+
+		ftl->p2l[ftl_sectr_idx(geo, addr)] = lba;
+		nvm_gc_mark(ftl->gc, addr, 1, 1);
+	}
+
+	return ftl;
+}
+
+int nvm_ftl_flush(struct nvm_ftl *ftl)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	const size_t map_nsectr = ftl_map_nsectr(geo, ftl->nlbas);
+	struct nvm_ftl_cp cp = { .magic = NVM_FTL_CP_MAGIC };
+	char *buf = ftl->cp_buf;
+	uint64_t *map = (uint64_t *)(buf + geo->l.nbytes);
+	int slot, err;
+
+	while (atomic_flag_test_and_set(&ftl->cp_lock))
+		sched_yield();
+
+	memset(buf, 0, ftl->cp_nsectr * geo->l.nbytes);
+
+	// Writers are only held back while the table is copied, not while the
+	// checkpoint is written
+	ftl_gate_close(ftl);
+	cp.seq = atomic_load(&ftl->seq);
+	atomic_store(&ftl->cp_seq, cp.seq);
+	atomic_thread_fence(memory_order_seq_cst);	// See ftl_gc_reloc
+	for (uint64_t lba = 0; lba < ftl->nlbas; ++lba)
+		map[lba] = atomic_load_explicit(&ftl->map[lba],
+						memory_order_relaxed);
+	ftl_gate_open(ftl);
+
+	cp.version = NVM_FTL_CP_VERSION;
+	cp.map_nsectr = map_nsectr;
+	cp.gen = ftl->cp_gen + 1;
+	cp.nlbas = ftl->nlbas;
+	memcpy(buf, &cp, sizeof(cp));
+	memcpy(buf + (1 + map_nsectr) * geo->l.nbytes, &cp, sizeof(cp));
+
+	slot = (ftl->cp_slot + 1) % NVM_FTL_CP_NSLOTS;
+	err = ftl_cp_write(ftl, buf, slot);
+	if (err) {
+		NVM_DEBUG("FAILED: ftl_cp_write");
+	} else {
+		ftl->cp_gen = cp.gen;
+		ftl->cp_slot = slot;
+	}
+
+	atomic_flag_clear(&ftl->cp_lock);
+
+	return err;
+}
+
+int nvm_ftl_read(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas, void *buf)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+
+	if (ftl_range_check(ftl, lba, nlbas))
+		return -1;
+
+	// Runs of mapped LBAs are read with one vector command, unmapped LBAs
+	// read as zeroes
+	for (size_t off = 0; off < nlbas; ) {
+		char *dst = (char *)buf + off * geo->l.nbytes;
+		int naddrs = 0, stale = 0, err;
+
+		while ((off + naddrs < nlbas) && (naddrs < NVM_NADDR_MAX)) {
+			const uint64_t val = atomic_load(&ftl->map[lba + off +
+								   naddrs]);
+
+			if (val == NVM_FTL_UNMAPPED)
+				break;
+
+			addrs[naddrs++].val = val;
+		}
+
+		if (!naddrs) {
+			memset(dst, 0, geo->l.nbytes);
+			++off;
+			continue;
+		}
+
+		err = nvm_cmd_read(ftl->dev, addrs, naddrs, dst, NULL,
+				   NVM_CMD_SYNC | NVM_CMD_VECTOR, NULL);
+
+		// A sector relocated by GC while being read might have been
+		// reset, the read is only good when the mapping is unchanged
+		for (int i = 0; i < naddrs; ++i)
+			stale |= atomic_load(&ftl->map[lba + off + i]) !=
+				 addrs[i].val;
+		if (stale)
+			continue;
+
+		if (err) {
+			NVM_DEBUG("FAILED: nvm_cmd_read");
+			return -1;
+		}
+
+		off += naddrs;
+	}
+
+	return 0;
+}
+
+int nvm_ftl_write(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas,
+		  const void *buf)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(ftl->dev);
+	const size_t ws = ftl_ws(ftl->dev);
+	char *meta;
+	int err = 0;
+
+	if (ftl_range_check(ftl, lba, nlbas))
+		return -1;
+
+	if (nlbas % nvm_dev_get_ws_min(ftl->dev)) {
+		NVM_DEBUG("FAILED: nlbas: %zu, not a multiple of ws_min", nlbas);
+		errno = EINVAL;
+		return -1;
+	}
+
+	meta = nvm_buf_alloc(ftl->dev, ws * geo->l.nbytes_oob, NULL);
+	if (!meta) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc");
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(meta, 0, ws * geo->l.nbytes_oob);
+
+	for (size_t off = 0; off < nlbas; ) {
+		const size_t nsectr = (nlbas - off) < ws ? nlbas - off : ws;
+		struct nvm_ftl_oob oob;
+		struct nvm_addr addr;
+
+		ftl_writer_enter(ftl);
+
+		oob.seq = atomic_fetch_add(&ftl->seq, 1);
+		for (size_t i = 0; i < nsectr; ++i) {
+			oob.lba = lba + off + i;
+			memcpy(meta + i * geo->l.nbytes_oob, &oob, sizeof(oob));
+		}
+
+		err = nvm_place_write(ftl->place, NVM_FTL_STREAM_USER,
+				      (const char *)buf + off * geo->l.nbytes,
+				      meta, nsectr, &addr, NVM_CMD_SYNC, NULL);
+		if (!err) {
+			for (size_t i = 0; i < nsectr; ++i) {
+				struct nvm_addr cur = addr;
+
+				cur.l.sectr += i;
+				ftl->p2l[ftl_sectr_idx(geo, cur)] = lba + off + i;
+			}
+			nvm_gc_mark(ftl->gc, addr, nsectr, 1);
+
+			for (size_t i = 0; i < nsectr; ++i) {
+				struct nvm_addr cur = addr;
+
+				cur.l.sectr += i;
+				ftl_invalidate(ftl, atomic_exchange(
+					&ftl->map[lba + off + i], cur.val));
+			}
+		}
+
+		err = err ? errno : 0;
+
+		ftl_writer_exit(ftl);
+
+		// Out of free chunks, reclaim some on behalf of the writer, which
+		// must be outside of the map-update section as GC checkpoints
+		if ((err == ENOSPC) &&
+		    (nvm_gc_run(ftl->gc, NVM_FTL_GC_NCHUNKS) > 0))
+			continue;
+
+		if (err) {
+			NVM_DEBUG("FAILED: nvm_place_write");
+			break;
+		}
+
+		off += nsectr;
+	}
+
+	nvm_buf_free(ftl->dev, meta);
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+int nvm_ftl_trim(struct nvm_ftl *ftl, uint64_t lba, size_t nlbas)
+{
+	if (ftl_range_check(ftl, lba, nlbas))
+		return -1;
+
+	for (size_t off = 0; off < nlbas; ++off)
+		ftl_invalidate(ftl, atomic_exchange(&ftl->map[lba + off],
+						    NVM_FTL_UNMAPPED));
+
+	return 0;
+}
+
+uint64_t nvm_ftl_get_nlbas(const struct nvm_ftl *ftl)
+{
+	return ftl->nlbas;
+}
+
+struct nvm_gc *nvm_ftl_get_gc(const struct nvm_ftl *ftl)
+{
+	return ftl->gc;
+}
+
+#endif
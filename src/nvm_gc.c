@@ -0,0 +1,736 @@
+/*
+ * nvm_gc - Garbage-collection of chunks via device-side vector copy
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <sched.h>
+#include <time.h>
+#include <liblightnvm.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_chunk.h>
+#include <nvm_place.h>
+#include <nvm_gc.h>
+
+static inline size_t gc_chunk_idx(const struct nvm_gc *gc,
+				  struct nvm_addr addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+
+	return (addr.l.pugrp * geo->l.npunit + addr.l.punit) * geo->l.nchunk +
+	       addr.l.chunk;
+}
+
+static inline struct nvm_addr gc_idx2chunk(const struct nvm_gc *gc,
+					   size_t idx)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+	const size_t punit = idx / geo->l.nchunk;
+	struct nvm_addr addr = { .val = 0 };
+
+	addr.l.pugrp = punit / geo->l.npunit;
+	addr.l.punit = punit % geo->l.npunit;
+	addr.l.chunk = idx % geo->l.nchunk;
+
+	return addr;
+}
+
+static inline int gc_is_chunk(struct nvm_addr addr, struct nvm_addr chunk)
+{
+	addr.l.sectr = 0;
+
+	return addr.val == chunk.val;
+}
+
+static inline uint64_t gc_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Token-bucket limiting the relocation bandwidth, the bucket holds at most a
+ * second worth of sectors
+ */
+static void gc_throttle(struct nvm_gc *gc, int nsectr)
+{
+	uint64_t now;
+
+	if (!gc->rate)
+		return;
+
+	now = gc_now();
+	gc->tokens += (now - gc->tstamp) * (double)gc->rate / 1000000000.0;
+	if (gc->tokens > gc->rate)
+		gc->tokens = gc->rate;
+	gc->tstamp = now;
+
+	if (gc->tokens < nsectr) {
+		const uint64_t nsec = (nsectr - gc->tokens) * 1000000000.0 /
+				      gc->rate;
+		struct timespec ts = {
+			.tv_sec = nsec / 1000000000ULL,
+			.tv_nsec = nsec % 1000000000ULL
+		};
+
+		nanosleep(&ts, NULL);
+		gc->tokens = nsectr;
+		gc->tstamp = gc_now();
+	}
+
+	gc->tokens -= nsectr;
+}
+
+/**
+ * Take a free chunk from the placement engine, round-robin over the PUs
+ */
+static int gc_chunk_get(struct nvm_gc *gc, struct nvm_addr *chunk)
+{
+	const size_t npunits = gc->place->npunits;
+
+	for (size_t i = 0; i < npunits; ++i) {
+		const int punit = (gc->cursor++) % npunits;
+
+		if (!nvm_place_chunk_get(gc->place, punit, chunk))
+			return 0;
+	}
+
+	errno = ENOSPC;
+	return -1;
+}
+
+/**
+ * Returns the # of sectors left in the destination chunk, replacing it when
+ * it is full, or -1 when no chunk is available
+ */
+static int gc_dst_room(struct nvm_gc *gc)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+	int wp;
+
+	if (gc->dst.val != NVM_PLACE_NONE) {
+		wp = nvm_chunk_get_wp(gc->dev, gc->dst);
+		if (wp < 0) {
+			NVM_DEBUG("FAILED: nvm_chunk_get_wp");
+			return -1;
+		}
+		if ((size_t)wp < geo->l.nsectr)
+			return geo->l.nsectr - wp;
+	}
+
+	gc->dst = gc->spare;
+	gc->spare.val = NVM_PLACE_NONE;
+
+	if ((gc->dst.val == NVM_PLACE_NONE) && gc_chunk_get(gc, &gc->dst)) {
+		NVM_DEBUG("FAILED: no free chunks for relocation");
+		return -1;
+	}
+
+	wp = nvm_chunk_get_wp(gc->dev, gc->dst);
+	if (wp < 0) {
+		NVM_DEBUG("FAILED: nvm_chunk_get_wp");
+		return -1;
+	}
+
+	return geo->l.nsectr - wp;
+}
+
+/**
+ * Returns the # of sectors relocation can fill without the spare chunk, the
+ * room left in the destination chunk plus the free chunks of the pools
+ */
+static size_t gc_room(struct nvm_gc *gc)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+	size_t room = nvm_place_get_nfree(gc->place) * geo->l.nsectr;
+	int wp;
+
+	if (gc->dst.val == NVM_PLACE_NONE)
+		return room;
+
+	wp = nvm_chunk_get_wp(gc->dev, gc->dst);
+	if ((wp >= 0) && ((size_t)wp < geo->l.nsectr))
+		room += geo->l.nsectr - wp;
+
+	return room;
+}
+
+/**
+ * Assign the next, at most 'cnt', sectors of the destination chunk to 'dst'
+ *
+ * @returns the # of sectors assigned, or -1 when no chunk is available
+ */
+static int gc_dst(struct nvm_gc *gc, struct nvm_addr dst[], int cnt)
+{
+	int room, wp;
+
+	room = gc_dst_room(gc);
+	if (room < 0)
+		return -1;
+
+	cnt = NVM_MIN(cnt, room);
+	wp = nvm_chunk_get_wp(gc->dev, gc->dst);
+	for (int i = 0; i < cnt; ++i) {
+		dst[i] = gc->dst;
+		dst[i].l.sectr = wp + i;
+	}
+
+	gc_throttle(gc, cnt);
+
+	return cnt;
+}
+
+/**
+ * Hand the first 'nvalid' sectors moved from 'src' to 'dst' to the relocation
+ * callback
+ */
+static void gc_reloc(struct nvm_gc *gc, const struct nvm_addr src[],
+		     const struct nvm_addr dst[], int nvalid)
+{
+	// Marked valid before the owner is told, such that an invalidation
+	// racing with the relocation is not lost
+	for (int i = 0; i < nvalid; ++i) {
+		nvm_gc_mark(gc, dst[i], 1, 1);
+		if (gc->ops.reloc(gc->arg, src[i], dst[i]))
+			nvm_gc_mark(gc, dst[i], 1, 0);
+	}
+}
+
+/**
+ * Copy the sectors in 'src' to the destination chunk, the first 'nvalid' are
+ * valid, the rest is padding
+ */
+static int gc_copy(struct nvm_gc *gc, struct nvm_addr src[], int naddrs,
+		   int nvalid)
+{
+	for (int off = 0; off < naddrs; ) {
+		struct nvm_addr dst[NVM_NADDR_MAX];
+		int cnt;
+
+		cnt = gc_dst(gc, dst, NVM_MIN(naddrs - off, gc->nbatch));
+		if (cnt < 0)
+			return -1;
+
+		if (nvm_cmd_copy(gc->dev, src + off, dst, cnt, NVM_CMD_SYNC,
+				 NULL)) {
+			NVM_DEBUG("FAILED: nvm_cmd_copy");
+			return -1;
+		}
+
+		gc_reloc(gc, src + off, dst,
+			 NVM_MAX(0, NVM_MIN(cnt, nvalid - off)));
+		off += cnt;
+	}
+
+	return 0;
+}
+
+/**
+ * Read the sectors in 'src' into the given half of the bounce buffers
+ */
+static int gc_read(struct nvm_gc *gc, struct nvm_addr src[], int naddrs,
+		   int half)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+	char *data = gc->data + half * gc->nbatch * geo->l.nbytes;
+	char *meta = NULL;
+
+	if (gc->meta)
+		meta = gc->meta + half * gc->nbatch * geo->l.nbytes_oob;
+
+	if (nvm_cmd_read(gc->dev, src, naddrs, data, meta,
+			 NVM_CMD_SYNC | NVM_CMD_VECTOR, NULL)) {
+		NVM_DEBUG("FAILED: nvm_cmd_read");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Write the sectors read from 'src' into the given half of the bounce buffers
+ * to the destination chunk, the first 'nvalid' are valid, the rest is padding
+ */
+static int gc_write(struct nvm_gc *gc, struct nvm_addr src[], int naddrs,
+		    int nvalid, int half)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+	char *data = gc->data + half * gc->nbatch * geo->l.nbytes;
+	char *meta = NULL;
+
+	if (gc->meta)
+		meta = gc->meta + half * gc->nbatch * geo->l.nbytes_oob;
+
+	if (nvalid && meta && gc->ops.stamp &&
+	    gc->ops.stamp(gc->arg, src, nvalid, meta)) {
+		NVM_DEBUG("FAILED: stamp");
+		return -1;
+	}
+
+	for (int off = 0; off < naddrs; ) {
+		struct nvm_addr dst[NVM_NADDR_MAX];
+		int cnt;
+
+		cnt = gc_dst(gc, dst, naddrs - off);
+		if (cnt < 0)
+			return -1;
+
+		if (nvm_chunk_append(gc->dev, gc->dst,
+				     data + off * geo->l.nbytes,
+				     meta ? meta + off * geo->l.nbytes_oob : NULL,
+				     cnt, NULL, NVM_CMD_SYNC, NULL)) {
+			NVM_DEBUG("FAILED: nvm_chunk_append");
+			return -1;
+		}
+
+		gc_reloc(gc, src + off, dst,
+			 NVM_MAX(0, NVM_MIN(cnt, nvalid - off)));
+		off += cnt;
+	}
+
+	return 0;
+}
+
+/**
+ * Move the sectors in 'src' through the host, in batches alternating between
+ * the halves of the bounce buffers, such that the read of a batch overlaps
+ * with the write of the previous one, the first 'nvalid' are valid
+ */
+static int gc_pipe(struct nvm_gc *gc, struct nvm_addr src[], int naddrs,
+		   int nvalid)
+{
+	int err, half = 0;
+
+	err = gc_read(gc, src, NVM_MIN(naddrs, gc->nbatch), half) ? errno : 0;
+
+	for (int off = 0; !err && (off < naddrs); half = !half) {
+		const int cnt = NVM_MIN(naddrs - off, gc->nbatch);
+		const int next = NVM_MIN(naddrs - off - cnt, gc->nbatch);
+		int err_rd = 0, err_wr = 0;
+
+		#pragma omp parallel sections num_threads(2) if(next)
+		{
+			#pragma omp section
+			err_wr = gc_write(gc, src + off, cnt,
+					  NVM_MAX(0, NVM_MIN(cnt, nvalid - off)),
+					  half) ? errno : 0;
+
+			#pragma omp section
+			if (next)
+				err_rd = gc_read(gc, src + off + cnt, next,
+						 !half) ? errno : 0;
+		}
+
+		err = err_wr ? err_wr : err_rd;
+		off += cnt;
+	}
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Relocate the valid sectors of the given victim, padded to a multiple of
+ * ws_min with invalid sectors of the victim below its write-pointer
+ */
+static int gc_relocate(struct nvm_gc *gc, struct nvm_addr victim)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+	const int ws_min = nvm_dev_get_ws_min(gc->dev);
+	atomic_uint_least64_t *words;
+	int nsrc = 0, nvalid, wp;
+
+	wp = nvm_chunk_get_wp(gc->dev, victim);
+	if (wp < 0) {
+		NVM_DEBUG("FAILED: nvm_chunk_get_wp");
+		return -1;
+	}
+
+	words = &gc->valid[gc_chunk_idx(gc, victim) * gc->nwords];
+
+	for (size_t sectr = 0; sectr < geo->l.nsectr; ++sectr) {
+		const uint64_t bit = 1ULL << (sectr % 64);
+
+		if (!(atomic_load(&words[sectr / 64]) & bit))
+			continue;
+
+		gc->src[nsrc] = victim;
+		gc->src[nsrc].l.sectr = sectr;
+		++nsrc;
+	}
+
+	if (!nsrc)
+		return 0;
+
+	nvalid = nsrc;
+	for (size_t sectr = 0; (nsrc % ws_min) && sectr < (size_t)wp;
+	     ++sectr) {
+		const uint64_t bit = 1ULL << (sectr % 64);
+		int dup = 0;
+
+		if (atomic_load(&words[sectr / 64]) & bit)
+			continue;
+
+		// Might have been invalidated after it was collected
+		for (int i = 0; !dup && i < nvalid; ++i)
+			dup = gc->src[i].l.sectr == sectr;
+		if (dup)
+			continue;
+
+		gc->src[nsrc] = victim;
+		gc->src[nsrc].l.sectr = sectr;
+		++nsrc;
+	}
+
+	if (nsrc % ws_min) {
+		NVM_DEBUG("FAILED: cannot pad to ws_min, nsrc: %d", nsrc);
+		errno = EIO;
+		return -1;
+	}
+
+	if (gc->copy)
+		return gc_copy(gc, gc->src, nsrc, nvalid);
+
+	return gc_pipe(gc, gc->src, nsrc, nvalid);
+}
+
+/**
+ * Select the victim with the highest benefit-to-cost ratio, (1 - u) * age /
+ * (1 + u), among the written chunks that are neither open nor fully valid,
+ * chunks left partially written by a prior session included
+ */
+static int gc_victim(struct nvm_gc *gc, struct nvm_addr *victim)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+	const uint64_t now = atomic_load(&gc->clock);
+	double best = -1.0;
+
+	for (size_t idx = 0; idx < gc->nchunks; ++idx) {
+		const uint64_t stamp = atomic_load(&gc->chunks[idx].stamp);
+		const uint32_t nvalid = atomic_load(&gc->chunks[idx].nvalid);
+		struct nvm_chunk_wp *chk;
+		struct nvm_addr chunk;
+		double u, score;
+
+		if ((!stamp) || (nvalid >= geo->l.nsectr))
+			continue;
+
+		u = (double)nvalid / geo->l.nsectr;
+		score = nvalid ? (1.0 - u) * (now - stamp) / (1.0 + u) : DBL_MAX;
+		if (score <= best)
+			continue;
+
+		chunk = gc_idx2chunk(gc, idx);
+		if (gc_is_chunk(gc->dst, chunk) ||
+		    (nvm_chunk_get_wp(gc->dev, chunk) <= 0) ||
+		    nvm_place_chunk_is_open(gc->place, chunk))
+			continue;
+
+		// Full, thus no longer open, with the last appends in flight
+		chk = nvm_chunk_wp_get(gc->dev, chunk);
+		if (!chk || (atomic_load(&chk->sub) != atomic_load(&chk->wp)))
+			continue;
+
+		best = score;
+		*victim = chunk;
+	}
+
+	if (best < 0) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return 0;
+}
+
+void nvm_gc_free(struct nvm_gc *gc)
+{
+	if (!gc)
+		return;
+
+	nvm_buf_free(gc->dev, gc->data);
+	nvm_buf_free(gc->dev, gc->meta);
+	free(gc->src);
+	free(gc->valid);
+	free(gc->chunks);
+	free(gc);
+}
+
+struct nvm_gc *nvm_gc_alloc(struct nvm_place *place,
+			    const struct nvm_gc_ops *ops, void *arg)
+{
+	struct nvm_dev *dev = place->dev;
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const int ws_min = nvm_dev_get_ws_min(dev);
+	struct nvm_gc *gc;
+
+	if (!(ops && ops->reloc)) {
+		NVM_DEBUG("FAILED: missing reloc callback");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	gc = calloc(1, sizeof(*gc));
+	if (!gc) {
+		NVM_DEBUG("FAILED: calloc gc");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	gc->dev = dev;
+	gc->place = place;
+	gc->ops = *ops;
+	gc->arg = arg;
+	gc->nchunks = place->npunits * geo->l.nchunk;
+	gc->nwords = (geo->l.nsectr + 63) / 64;
+	gc->copy = dev->be->vector_copy != nvm_be_nosys_vector_copy;
+	gc->nbatch = (NVM_NADDR_MAX / ws_min) * ws_min;
+	gc->dst.val = NVM_PLACE_NONE;
+	gc->spare.val = NVM_PLACE_NONE;
+	gc->tstamp = gc_now();
+	atomic_init(&gc->clock, 0);
+	atomic_flag_clear(&gc->lock);
+
+	gc->chunks = calloc(gc->nchunks, sizeof(*gc->chunks));
+	gc->valid = calloc(gc->nchunks * gc->nwords, sizeof(*gc->valid));
+	gc->src = calloc(geo->l.nsectr, sizeof(*gc->src));
+	if (!(gc->chunks && gc->valid && gc->src)) {
+		NVM_DEBUG("FAILED: calloc gc->chunks / gc->valid / gc->src");
+		nvm_gc_free(gc);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (!gc->copy) {
+		gc->data = nvm_buf_alloc(dev, 2 * gc->nbatch * geo->l.nbytes,
+					 NULL);
+		if (geo->l.nbytes_oob)
+			gc->meta = nvm_buf_alloc(dev, 2 * gc->nbatch *
+						 geo->l.nbytes_oob, NULL);
+		if (!gc->data || (geo->l.nbytes_oob && !gc->meta)) {
+			NVM_DEBUG("FAILED: nvm_buf_alloc");
+			nvm_gc_free(gc);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	// Relocation needs a chunk to make progress when the pools are empty
+	if (gc_chunk_get(gc, &gc->spare)) {
+		NVM_DEBUG("FAILED: no free chunk for relocation");
+		nvm_gc_free(gc);
+		return NULL;
+	}
+
+	return gc;
+}
+
+int nvm_gc_mark(struct nvm_gc *gc, struct nvm_addr addr, int nsectr,
+		int valid)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+	atomic_uint_least64_t *words;
+	struct nvm_gc_chunk *chk;
+	struct nvm_addr chunk = addr;
+
+	chunk.l.sectr = 0;
+	if (nvm_addr_check(chunk, gc->dev) || (nsectr < 1) ||
+	    (addr.l.sectr + nsectr > geo->l.nsectr)) {
+		NVM_DEBUG("FAILED: invalid addr or nsectr: %d", nsectr);
+		errno = EINVAL;
+		return -1;
+	}
+
+	chk = &gc->chunks[gc_chunk_idx(gc, addr)];
+	words = &gc->valid[gc_chunk_idx(gc, addr) * gc->nwords];
+
+	for (int i = 0; i < nsectr; ++i) {
+		const size_t sectr = addr.l.sectr + i;
+		const uint64_t bit = 1ULL << (sectr % 64);
+
+		if (valid) {
+			if (!(atomic_fetch_or(&words[sectr / 64], bit) & bit))
+				atomic_fetch_add(&chk->nvalid, 1);
+		} else {
+			if (atomic_fetch_and(&words[sectr / 64], ~bit) & bit)
+				atomic_fetch_sub(&chk->nvalid, 1);
+		}
+	}
+
+	if (valid)
+		atomic_store(&chk->stamp, atomic_fetch_add(&gc->clock, 1) + 1);
+
+	return 0;
+}
+
+void nvm_gc_adopt(struct nvm_gc *gc)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+
+	for (size_t punit = 0; punit < gc->place->npunits; ++punit) {
+		struct nvm_place_pu *pu = &gc->place->pus[punit];
+		struct nvm_addr chunk = { .val = 0 };
+
+		chunk.l.pugrp = punit / geo->l.npunit;
+		chunk.l.punit = punit % geo->l.npunit;
+
+		while (atomic_flag_test_and_set(&pu->lock))
+			;
+		for (uint32_t idx = 0; idx < pu->nleft; ++idx) {
+			struct nvm_gc_chunk *chk;
+
+			chunk.l.chunk = pu->left[idx];
+			chk = &gc->chunks[gc_chunk_idx(gc, chunk)];
+			if (!atomic_load(&chk->stamp))
+				atomic_store(&chk->stamp,
+					     atomic_fetch_add(&gc->clock, 1) + 1);
+		}
+		pu->nleft = 0;
+		atomic_flag_clear(&pu->lock);
+	}
+}
+
+int nvm_gc_run(struct nvm_gc *gc, int nchunks)
+{
+	const int ws_min = nvm_dev_get_ws_min(gc->dev);
+	struct nvm_addr *victims;
+	int nvictims = 0, err = 0;
+
+	if (nchunks < 1) {
+		NVM_DEBUG("FAILED: nchunks: %d", nchunks);
+		errno = EINVAL;
+		return -1;
+	}
+
+	victims = calloc(nchunks, sizeof(*victims));
+	if (!victims) {
+		NVM_DEBUG("FAILED: calloc victims");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	while (atomic_flag_test_and_set(&gc->lock))
+		sched_yield();
+
+	while ((nvictims < nchunks) && !gc_victim(gc, &victims[nvictims])) {
+		struct nvm_gc_chunk *chk;
+		uint32_t nvalid;
+
+		// Further victims share the sync of the run, as long as their
+		// valid sectors, and the padding, fit without the spare chunk
+		chk = &gc->chunks[gc_chunk_idx(gc, victims[nvictims])];
+		nvalid = atomic_load(&chk->nvalid);
+		if (nvictims && nvalid && (nvalid + ws_min > gc_room(gc)))
+			break;
+
+		if (gc_relocate(gc, victims[nvictims])) {
+			NVM_DEBUG("FAILED: gc_relocate");
+			err = errno;
+			break;
+		}
+
+		// Not a candidate for the remainder of the run
+		atomic_store(&chk->stamp, 0);
+		++nvictims;
+	}
+
+	// The owner must persist the relocations before the victims are reset
+	if (nvictims && gc->ops.sync && gc->ops.sync(gc->arg)) {
+		NVM_DEBUG("FAILED: sync");
+		err = errno;
+		for (int i = 0; i < nvictims; ++i) {
+			struct nvm_gc_chunk *chk;
+
+			chk = &gc->chunks[gc_chunk_idx(gc, victims[i])];
+			atomic_store(&chk->stamp,
+				     atomic_fetch_add(&gc->clock, 1) + 1);
+		}
+		nvictims = 0;
+	}
+
+	for (int i = 0; i < nvictims; ++i) {
+		const size_t idx = gc_chunk_idx(gc, victims[i]);
+
+		for (size_t w = 0; w < gc->nwords; ++w)
+			atomic_store(&gc->valid[idx * gc->nwords + w], 0);
+		atomic_store(&gc->chunks[idx].nvalid, 0);
+
+		if (nvm_place_chunk_put(gc->place, victims[i])) {
+			NVM_DEBUG("FAILED: nvm_place_chunk_put");
+			err = errno;
+		}
+	}
+
+	if (gc->spare.val == NVM_PLACE_NONE)
+		gc_chunk_get(gc, &gc->spare);
+
+	atomic_flag_clear(&gc->lock);
+
+	free(victims);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return nvictims;
+}
+
+void nvm_gc_set_rate(struct nvm_gc *gc, uint64_t nbytes)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(gc->dev);
+
+	while (atomic_flag_test_and_set(&gc->lock))
+		sched_yield();
+
+	gc->rate = nbytes / geo->l.nbytes;
+	gc->tokens = 0;
+	gc->tstamp = gc_now();
+
+	atomic_flag_clear(&gc->lock);
+}
+
+int nvm_gc_get_nvalid(struct nvm_gc *gc, struct nvm_addr chunk)
+{
+	chunk.l.sectr = 0;
+	if (nvm_addr_check(chunk, gc->dev)) {
+		NVM_DEBUG("FAILED: invalid chunk address");
+		errno = EINVAL;
+		return -1;
+	}
+
+	return atomic_load(&gc->chunks[gc_chunk_idx(gc, chunk)].nvalid);
+}
@@ -0,0 +1,246 @@
+/*
+ * nvm_numa - NUMA placement of buffers and threads
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_omp.h>
+#include <nvm_numa.h>
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#define NVM_NUMA_NODES_MAX 1024
+#define NVM_NUMA_ULONG_NBITS (8 * sizeof(unsigned long))
+
+static int sysfs_read_int(const char *path, int *val)
+{
+	FILE *fp;
+	int err;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	err = fscanf(fp, "%d", val) != 1;
+	fclose(fp);
+
+	return err ? -1 : 0;
+}
+
+int nvm_numa_node_sysfs(const char *name)
+{
+	// The controller of the namespace, or the PCIe function of it
+	const char *fmts[] = {
+		"/sys/class/block/%s/device/numa_node",
+		"/sys/class/block/%s/device/device/numa_node",
+	};
+	char path[128];
+
+	for (size_t i = 0; i < sizeof(fmts) / sizeof(*fmts); ++i) {
+		int node;
+
+		snprintf(path, sizeof(path), fmts[i], name);
+		if (!sysfs_read_int(path, &node))
+			return node < 0 ? -1 : node;
+	}
+
+	NVM_DEBUG("no numa_node for name: %s", name);
+
+	return -1;
+}
+
+int nvm_numa_bind(void *buf, size_t nbytes, int node)
+{
+	unsigned long mask[NVM_NUMA_NODES_MAX / NVM_NUMA_ULONG_NBITS] = { 0 };
+	const uintptr_t psize = sysconf(_SC_PAGESIZE);
+	const uintptr_t bgn = ((uintptr_t)buf + psize - 1) & ~(psize - 1);
+	const uintptr_t end = ((uintptr_t)buf + nbytes) & ~(psize - 1);
+
+	if ((node < 0) || (node >= NVM_NUMA_NODES_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (end <= bgn)
+		return 0;
+
+	mask[node / NVM_NUMA_ULONG_NBITS] = 1UL << (node % NVM_NUMA_ULONG_NBITS);
+
+#ifdef SYS_mbind
+	if (syscall(SYS_mbind, bgn, end - bgn, MPOL_PREFERRED, mask,
+		    NVM_NUMA_NODES_MAX + 1, 0)) {
+		NVM_DEBUG("FAILED: mbind node: %d", node);
+		return -1;
+	}
+
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/**
+ * Fill 'cpus' with the CPUs of 'node' from its sysfs cpulist e.g. "0-7,16-23"
+ */
+static int node_cpus(int node, cpu_set_t *cpus)
+{
+	char path[64];
+	char list[4096];
+	char *save = NULL;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+		 node);
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		NVM_DEBUG("FAILED: fopen path: %s", path);
+		return -1;
+	}
+	if (!fgets(list, sizeof(list), fp)) {
+		NVM_DEBUG("FAILED: fgets path: %s", path);
+		fclose(fp);
+		errno = EIO;
+		return -1;
+	}
+	fclose(fp);
+
+	CPU_ZERO(cpus);
+	for (char *tok = strtok_r(list, ",\n", &save); tok;
+	     tok = strtok_r(NULL, ",\n", &save)) {
+		unsigned int bgn, end;
+
+		switch (sscanf(tok, "%u-%u", &bgn, &end)) {
+		case 1:
+			end = bgn;
+			break;
+		case 2:
+			break;
+		default:
+			continue;
+		}
+
+		for (unsigned int cpu = bgn; (cpu <= end) && (cpu < CPU_SETSIZE);
+		     ++cpu)
+			CPU_SET(cpu, cpus);
+	}
+
+	if (!CPU_COUNT(cpus)) {
+		NVM_DEBUG("FAILED: no cpus on node: %d", node);
+		errno = ENODEV;
+		return -1;
+	}
+
+	return 0;
+}
+
+struct nvm_numa_cpus {
+	cpu_set_t set;
+};
+
+int nvm_numa_cpus_init(struct nvm_dev *dev)
+{
+	struct nvm_numa_cpus *cpus;
+
+	dev->numa_cpus = NULL;
+	if (dev->numa_node < 0) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	cpus = malloc(sizeof(*cpus));
+	if (!cpus) {
+		NVM_DEBUG("FAILED: malloc cpus");
+		errno = ENOMEM;
+		return -1;
+	}
+	if (node_cpus(dev->numa_node, &cpus->set)) {
+		NVM_DEBUG("FAILED: node_cpus node: %d", dev->numa_node);
+		free(cpus);
+		return -1;
+	}
+	dev->numa_cpus = cpus;
+
+	return 0;
+}
+
+void nvm_numa_cpus_free(struct nvm_dev *dev)
+{
+	free(dev->numa_cpus);
+	dev->numa_cpus = NULL;
+}
+
+static _Thread_local int bound = -1;	// Node of the calling thread
+static _Thread_local cpu_set_t bound_orig;	// Mask from before the binding
+
+int nvm_numa_affinity_apply(const struct nvm_dev *dev)
+{
+	if ((dev->affinity != NVM_DEV_AFFINITY_NODE) || (!dev->numa_cpus))
+		return 0;
+	if (!omp_get_thread_num())
+		return 0;
+	if (bound == dev->numa_node)
+		return 0;
+
+	if ((bound < 0) &&
+	    sched_getaffinity(0, sizeof(bound_orig), &bound_orig)) {
+		NVM_DEBUG("FAILED: sched_getaffinity");
+		return -1;
+	}
+
+	if (sched_setaffinity(0, sizeof(dev->numa_cpus->set),
+			      &dev->numa_cpus->set)) {
+		NVM_DEBUG("FAILED: sched_setaffinity node: %d", dev->numa_node);
+		return -1;
+	}
+	bound = dev->numa_node;
+
+	return 0;
+}
+
+int nvm_numa_affinity_restore(void)
+{
+	if (bound < 0)
+		return 0;
+
+	if (sched_setaffinity(0, sizeof(bound_orig), &bound_orig)) {
+		NVM_DEBUG("FAILED: sched_setaffinity");
+		return -1;
+	}
+	bound = -1;
+
+	return 0;
+}
@@ -0,0 +1,409 @@
+/*
+ * nvm_place - Placement of writes on per-stream append points
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_place.h>
+
+static inline void place_pu_lock(struct nvm_place_pu *pu)
+{
+	while (atomic_flag_test_and_set_explicit(&pu->lock,
+						 memory_order_acquire))
+		;
+}
+
+static inline void place_pu_unlock(struct nvm_place_pu *pu)
+{
+	atomic_flag_clear_explicit(&pu->lock, memory_order_release);
+}
+
+static inline struct nvm_addr place_pu2addr(const struct nvm_place *place,
+					    size_t punit)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(place->dev);
+	struct nvm_addr addr = { .val = 0 };
+
+	addr.l.pugrp = punit / geo->l.npunit;
+	addr.l.punit = punit % geo->l.npunit;
+
+	return addr;
+}
+
+static inline size_t place_addr2pu(const struct nvm_place *place,
+				   struct nvm_addr addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(place->dev);
+
+	return addr.l.pugrp * geo->l.npunit + addr.l.punit;
+}
+
+/**
+ * Take a free chunk from the pool of the given parallel unit
+ */
+static int place_pu_pop(struct nvm_place *place, size_t punit,
+			struct nvm_addr *chunk)
+{
+	struct nvm_place_pu *pu = &place->pus[punit];
+	int err = 0;
+
+	place_pu_lock(pu);
+	if (pu->nfree) {
+		*chunk = place_pu2addr(place, punit);
+		chunk->l.chunk = pu->free[--(pu->nfree)];
+	} else {
+		err = -1;
+	}
+	place_pu_unlock(pu);
+
+	if (err)
+		errno = ENOSPC;
+
+	return err;
+}
+
+static void place_pu_push(struct nvm_place *place, struct nvm_addr chunk)
+{
+	struct nvm_place_pu *pu = &place->pus[place_addr2pu(place, chunk)];
+
+	place_pu_lock(pu);
+	pu->free[(pu->nfree)++] = chunk.l.chunk;
+	place_pu_unlock(pu);
+}
+
+/**
+ * Load the free chunks of the given parallel unit into its pool, and record
+ * the chunks holding data from before, e.g. left open by a prior session,
+ * such that they can be reclaimed instead of leaking
+ */
+static int place_pu_load(struct nvm_place *place, size_t punit)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(place->dev);
+	struct nvm_place_pu *pu = &place->pus[punit];
+	struct nvm_addr addr = place_pu2addr(place, punit);
+	struct nvm_spec_rprt *rprt;
+
+	atomic_flag_clear(&pu->lock);
+
+	pu->free = calloc(geo->l.nchunk, sizeof(*pu->free));
+	pu->left = calloc(geo->l.nchunk, sizeof(*pu->left));
+	if (!(pu->free && pu->left)) {
+		NVM_DEBUG("FAILED: calloc pu->free / pu->left");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	rprt = nvm_cmd_rprt(place->dev, &addr, 0x0, NULL);
+	if (!rprt) {
+		NVM_DEBUG("FAILED: nvm_cmd_rprt");
+		return -1;
+	}
+
+	// Pushed in reverse such that the lowest chunk is handed out first
+	for (uint32_t idx = rprt->ndescr; idx-- > 0; ) {
+		switch (rprt->descr[idx].cs) {
+		case NVM_CHUNK_STATE_FREE:
+			pu->free[(pu->nfree)++] = idx;
+			break;
+
+		case NVM_CHUNK_STATE_OPEN:
+		case NVM_CHUNK_STATE_CLOSED:
+			pu->left[(pu->nleft)++] = idx;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	nvm_buf_free(place->dev, rprt);
+
+	return 0;
+}
+
+void nvm_place_free(struct nvm_place *place)
+{
+	if (!place)
+		return;
+
+	for (int sid = 0; place->streams && sid < place->nstreams; ++sid) {
+		free(place->streams[sid].punits);
+		free(place->streams[sid].open);
+	}
+	free(place->streams);
+
+	for (size_t punit = 0; place->pus && punit < place->npunits; ++punit) {
+		free(place->pus[punit].free);
+		free(place->pus[punit].left);
+	}
+	free(place->pus);
+
+	free(place);
+}
+
+struct nvm_place *nvm_place_alloc(struct nvm_dev *dev, int nstreams,
+				  int width)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_place *place;
+
+	if (nvm_dev_get_verid(dev) != NVM_SPEC_VERID_20) {
+		NVM_DEBUG("FAILED: unsupported verid: %d",
+			  nvm_dev_get_verid(dev));
+		errno = ENOSYS;
+		return NULL;
+	}
+
+	if ((nstreams < 1) || (width < 0) ||
+	    ((size_t)width > geo->l.npugrp * geo->l.npunit)) {
+		NVM_DEBUG("FAILED: nstreams: %d, width: %d", nstreams, width);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	place = calloc(1, sizeof(*place));
+	if (!place) {
+		NVM_DEBUG("FAILED: calloc place");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	place->dev = dev;
+	place->nstreams = nstreams;
+	place->npunits = geo->l.npugrp * geo->l.npunit;
+	place->width = width ? width : (int)place->npunits;
+
+	place->pus = calloc(place->npunits, sizeof(*place->pus));
+	place->streams = calloc(nstreams, sizeof(*place->streams));
+	if (!(place->pus && place->streams)) {
+		NVM_DEBUG("FAILED: calloc place->pus / place->streams");
+		nvm_place_free(place);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (size_t punit = 0; punit < place->npunits; ++punit) {
+		if (place_pu_load(place, punit)) {
+			NVM_DEBUG("FAILED: place_pu_load");
+			nvm_place_free(place);
+			return NULL;
+		}
+	}
+
+	// Streams are laid out on consecutive PUs, wrapping around the device,
+	// such that streams overlap as little as the width permits
+	for (int sid = 0; sid < nstreams; ++sid) {
+		struct nvm_place_stream *stream = &place->streams[sid];
+
+		stream->punits = calloc(place->width, sizeof(*stream->punits));
+		stream->open = calloc(place->width, sizeof(*stream->open));
+		if (!(stream->punits && stream->open)) {
+			NVM_DEBUG("FAILED: calloc stream");
+			nvm_place_free(place);
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		atomic_init(&stream->cursor, 0);
+		for (int idx = 0; idx < place->width; ++idx) {
+			stream->punits[idx] = (sid * place->width + idx) %
+					      place->npunits;
+			atomic_init(&stream->open[idx], NVM_PLACE_NONE);
+		}
+	}
+
+	return place;
+}
+
+/**
+ * Replace the open chunk 'cur' of slot 'idx', which is either full or
+ * missing, by a chunk from the pool of the PU of the slot
+ *
+ * @returns 0 when the slot holds a chunk, which might have been installed by
+ * another thread, -1 when the pool of the PU is exhausted
+ */
+static int place_stream_refill(struct nvm_place *place,
+			       struct nvm_place_stream *stream, int idx,
+			       uint64_t cur)
+{
+	struct nvm_addr chunk;
+
+	if (place_pu_pop(place, stream->punits[idx], &chunk)) {
+		if (atomic_compare_exchange_strong(&stream->open[idx], &cur,
+						   NVM_PLACE_NONE))
+			return -1;
+
+		return cur == NVM_PLACE_NONE ? -1 : 0;
+	}
+
+	if (!atomic_compare_exchange_strong(&stream->open[idx], &cur,
+					    chunk.val))
+		place_pu_push(place, chunk);	// Replaced by another thread
+
+	return 0;
+}
+
+int nvm_place_write(struct nvm_place *place, int sid, const void *data,
+		    const void *meta, int nsectr, struct nvm_addr *addr,
+		    uint16_t flags, struct nvm_ret *ret)
+{
+	struct nvm_place_stream *stream;
+	int nexhausted = 0;
+
+	if ((sid < 0) || (sid >= place->nstreams)) {
+		NVM_DEBUG("FAILED: invalid stream: %d", sid);
+		errno = EINVAL;
+		return -1;
+	}
+
+	stream = &place->streams[sid];
+
+	// Give up when a full round over the PUs of the stream found no room
+	while (nexhausted < place->width) {
+		const int idx = atomic_fetch_add(&stream->cursor, 1) %
+				place->width;
+		uint64_t cur = atomic_load(&stream->open[idx]);
+		struct nvm_addr chunk;
+
+		if (cur == NVM_PLACE_NONE) {
+			if (place_stream_refill(place, stream, idx, cur))
+				++nexhausted;
+			continue;
+		}
+
+		chunk.val = cur;
+		if (!nvm_chunk_append(place->dev, chunk, data, meta, nsectr,
+				      addr, flags, ret))
+			return 0;
+
+		if (errno != ENOSPC) {
+			NVM_DEBUG("FAILED: nvm_chunk_append");
+			return -1;
+		}
+
+		if (place_stream_refill(place, stream, idx, cur))
+			++nexhausted;
+	}
+
+	NVM_DEBUG("FAILED: no free chunks in stream: %d", sid);
+	errno = ENOSPC;
+	return -1;
+}
+
+int nvm_place_chunk_get(struct nvm_place *place, int punit,
+			struct nvm_addr *chunk)
+{
+	if ((punit < 0) || ((size_t)punit >= place->npunits)) {
+		NVM_DEBUG("FAILED: invalid punit: %d", punit);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return place_pu_pop(place, punit, chunk);
+}
+
+int nvm_place_chunk_put(struct nvm_place *place, struct nvm_addr chunk)
+{
+	chunk.l.sectr = 0;
+
+	if (nvm_chunk_reset(place->dev, chunk, 0x0, NULL)) {
+		NVM_DEBUG("FAILED: nvm_chunk_reset");
+		return -1;
+	}
+
+	place_pu_push(place, chunk);
+
+	return 0;
+}
+
+int nvm_place_chunk_take(struct nvm_place *place, struct nvm_addr chunk)
+{
+	struct nvm_place_pu *pu = &place->pus[place_addr2pu(place, chunk)];
+	int err = -1;
+
+	place_pu_lock(pu);
+	for (uint32_t idx = 0; idx < pu->nfree; ++idx) {
+		if (pu->free[idx] != chunk.l.chunk)
+			continue;
+
+		// Keep the order such that the lowest chunk is handed out first
+		memmove(&pu->free[idx], &pu->free[idx + 1],
+			(pu->nfree - idx - 1) * sizeof(*pu->free));
+		--(pu->nfree);
+		err = 0;
+		break;
+	}
+	for (uint32_t idx = 0; err && idx < pu->nleft; ++idx) {
+		if (pu->left[idx] != chunk.l.chunk)
+			continue;
+
+		pu->left[idx] = pu->left[--(pu->nleft)];
+		err = 0;
+	}
+	place_pu_unlock(pu);
+
+	if (err)
+		errno = ENOENT;
+
+	return err;
+}
+
+int nvm_place_chunk_is_open(struct nvm_place *place, struct nvm_addr chunk)
+{
+	chunk.l.sectr = 0;
+
+	for (int sid = 0; sid < place->nstreams; ++sid) {
+		for (int idx = 0; idx < place->width; ++idx) {
+			if (atomic_load(&place->streams[sid].open[idx]) ==
+			    chunk.val)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+int nvm_place_get_nstreams(const struct nvm_place *place)
+{
+	return place->nstreams;
+}
+
+int nvm_place_get_nfree(struct nvm_place *place)
+{
+	int nfree = 0;
+
+	for (size_t punit = 0; punit < place->npunits; ++punit) {
+		struct nvm_place_pu *pu = &place->pus[punit];
+
+		place_pu_lock(pu);
+		nfree += pu->nfree;
+		place_pu_unlock(pu);
+	}
+
+	return nfree;
+}
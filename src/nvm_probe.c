@@ -0,0 +1,189 @@
+/*
+ * nvm_probe - Host CPU cost of commands broken down by phase
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <liblightnvm.h>
+#include <nvm_dev.h>
+#include <nvm_stats.h>
+#include <nvm_probe.h>
+
+#ifdef NVM_PROBES_ENABLED
+
+_Thread_local uint64_t nvm_probe_acct;
+
+static uint64_t probe_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void nvm_probe_init(struct nvm_dev *dev)
+{
+	dev->probes = aligned_alloc(64, sizeof(*dev->probes));
+	if (!dev->probes) {
+		NVM_DEBUG("FAILED: aligned_alloc probes");
+		return;
+	}
+
+	nvm_probe_reset(dev);
+}
+
+void nvm_probe_reset(struct nvm_dev *dev)
+{
+	struct nvm_probes *probes = dev->probes;
+
+	if (!probes)
+		return;
+
+	for (size_t i = 0; i < NVM_PROBE_NSLOTS; ++i) {
+		for (size_t phase = 0; phase < NVM_DEV_PROBE_NPHASES; ++phase) {
+			atomic_store(&probes->slots[i].count[phase], 0);
+			atomic_store(&probes->slots[i].ticks[phase], 0);
+		}
+	}
+
+	probes->tsc0 = nvm_stats_tsc();
+	probes->ns0 = probe_ns();
+}
+
+void nvm_probe_free(struct nvm_dev *dev)
+{
+	free(dev->probes);
+	dev->probes = NULL;
+}
+
+int nvm_dev_probe_get(struct nvm_dev *dev, int phase,
+		      struct nvm_dev_probe *probe)
+{
+	struct nvm_probes *probes = dev->probes;
+	uint64_t count = 0, ticks = 0;
+	double ns_tick = 1.0;
+
+	if ((phase < 0) || (phase >= NVM_DEV_PROBE_NPHASES)) {
+		NVM_DEBUG("FAILED: invalid phase: %d", phase);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!probes) {
+		NVM_DEBUG("FAILED: probes are not allocated");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (size_t i = 0; i < NVM_PROBE_NSLOTS; ++i) {
+		count += atomic_load_explicit(&probes->slots[i].count[phase],
+					      memory_order_relaxed);
+		ticks += atomic_load_explicit(&probes->slots[i].ticks[phase],
+					      memory_order_relaxed);
+	}
+
+	// Ticks to nanoseconds, calibrated since the probes were reset
+	{
+		const uint64_t tsc = nvm_stats_tsc() - probes->tsc0;
+		const uint64_t ns = probe_ns() - probes->ns0;
+
+		if (tsc && ns)
+			ns_tick = (double)ns / (double)tsc;
+	}
+
+	memset(probe, 0, sizeof(*probe));
+	probe->phase = phase;
+	probe->count = count;
+	probe->cycles = ticks;
+	probe->ns = ticks * ns_tick;
+
+	return 0;
+}
+
+#else
+
+void nvm_probe_init(struct nvm_dev *dev)
+{
+	dev->probes = NULL;
+}
+
+void nvm_probe_reset(struct nvm_dev *NVM_UNUSED(dev))
+{
+}
+
+void nvm_probe_free(struct nvm_dev *dev)
+{
+	dev->probes = NULL;
+}
+
+int nvm_dev_probe_get(struct nvm_dev *NVM_UNUSED(dev), int NVM_UNUSED(phase),
+		      struct nvm_dev_probe *NVM_UNUSED(probe))
+{
+	NVM_DEBUG("FAILED: built without NVM_PROBES_ENABLED");
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
+
+static const char *probe_phase_str(int phase)
+{
+	switch (phase) {
+	case NVM_DEV_PROBE_ADDR:
+		return "addr";
+	case NVM_DEV_PROBE_WRAP:
+		return "wrap";
+	case NVM_DEV_PROBE_DMA:
+		return "dma";
+	case NVM_DEV_PROBE_SUBMIT:
+		return "submit";
+	case NVM_DEV_PROBE_CPL:
+		return "cpl";
+	case NVM_DEV_PROBE_CB:
+		return "cb";
+	}
+
+	return "unknown";
+}
+
+void nvm_dev_probe_pr(const struct nvm_dev_probe *probe)
+{
+	printf("probe:");
+
+	if (!probe) {
+		printf(" ~\n");
+		return;
+	}
+
+	printf("\n");
+	printf("  phase: '%s'\n", probe_phase_str(probe->phase));
+	printf("  count: %"PRIu64"\n", probe->count);
+	printf("  cycles: %"PRIu64"\n", probe->cycles);
+	printf("  ns: %"PRIu64"\n", probe->ns);
+}
@@ -0,0 +1,209 @@
+/*
+ * nvm_rcu - Deferred reclamation of versions published to lock-free readers
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_rcu.h>
+
+void nvm_rcu_init(struct nvm_rcu *rcu)
+{
+	for (int slot = 0; slot < NVM_THRD_NSLOTS; ++slot) {
+		atomic_init(&rcu->held[slot], NULL);
+		atomic_init(&rcu->gens[slot], 0);
+	}
+	atomic_init(&rcu->recs, NULL);
+	atomic_init(&rcu->retired, NULL);
+}
+
+/**
+ * Returns the record of the calling reader, claiming a free one or pushing a
+ * new one on first use
+ */
+static struct nvm_rcu_rec *rcu_rec(struct nvm_rcu *rcu)
+{
+	struct nvm_thrd_life *life = nvm_thrd_life();
+	struct nvm_rcu_rec *head = atomic_load(&rcu->recs);
+	struct nvm_rcu_rec *rec;
+
+	if (!life) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (rec = head; rec; rec = rec->next) {
+		if (atomic_load(&rec->owner) == life)
+			return rec;
+	}
+
+	nvm_thrd_life_get(life);		// Dropped when released
+
+	for (rec = head; rec; rec = rec->next) {
+		struct nvm_thrd_life *none = NULL;
+
+		if (atomic_compare_exchange_strong(&rec->owner, &none, life))
+			return rec;
+	}
+
+	rec = malloc(sizeof(*rec));
+	if (!rec) {
+		NVM_DEBUG("FAILED: malloc rec");
+		nvm_thrd_life_put(life);
+		errno = ENOMEM;
+		return NULL;
+	}
+	atomic_init(&rec->owner, life);
+	atomic_init(&rec->held, NULL);
+
+	// Records are only ever pushed, thus no ABA
+	do {
+		rec->next = head;
+	} while (!atomic_compare_exchange_weak(&rcu->recs, &head, rec));
+
+	return rec;
+}
+
+int nvm_rcu_protect(struct nvm_rcu *rcu, struct nvm_rcu_node *node)
+{
+	const int slot = nvm_thrd_slot_excl();
+	struct nvm_rcu_rec *rec;
+
+	if (slot >= 0) {
+		// The generation is stored first, thus current for 'node'
+		atomic_store(&rcu->gens[slot], atomic_load(&nvm_thrd_gens[slot]));
+		atomic_store(&rcu->held[slot], node);
+		return 0;
+	}
+
+	rec = rcu_rec(rcu);
+	if (!rec) {
+		NVM_DEBUG("FAILED: rcu_rec");
+		return -1;
+	}
+	atomic_store(&rec->held, node);
+
+	return 0;
+}
+
+static void rcu_push(struct nvm_rcu *rcu, struct nvm_rcu_node *node)
+{
+	struct nvm_rcu_node *head = atomic_load(&rcu->retired);
+
+	// Nodes are only ever pushed or detached all at once, thus no ABA
+	do {
+		node->next = head;
+	} while (!atomic_compare_exchange_weak(&rcu->retired, &head, node));
+}
+
+void nvm_rcu_retire(struct nvm_rcu *rcu, struct nvm_rcu_node *node)
+{
+	rcu_push(rcu, node);
+}
+
+static int rcu_held(struct nvm_rcu *rcu, struct nvm_rcu_node *node)
+{
+	for (int slot = 0; slot < NVM_THRD_NSLOTS; ++slot) {
+		if (atomic_load(&rcu->held[slot]) != node)
+			continue;
+
+		// Left behind by an exited thread
+		if (atomic_load(&rcu->gens[slot]) !=
+		    atomic_load(&nvm_thrd_gens[slot]))
+			continue;
+
+		return 1;
+	}
+
+	for (struct nvm_rcu_rec *rec = atomic_load(&rcu->recs); rec;
+	     rec = rec->next) {
+		if (atomic_load(&rec->held) == node)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Release the records of exited readers for reuse, only the serialized
+ * reclaim drops the references of records, thus their owners are not freed
+ * while being inspected
+ */
+static void rcu_recs_release(struct nvm_rcu *rcu)
+{
+	for (struct nvm_rcu_rec *rec = atomic_load(&rcu->recs); rec;
+	     rec = rec->next) {
+		struct nvm_thrd_life *owner = atomic_load(&rec->owner);
+
+		if ((!owner) || atomic_load(&owner->alive))
+			continue;
+
+		atomic_store(&rec->held, NULL);
+		atomic_store(&rec->owner, NULL);
+		nvm_thrd_life_put(owner);
+	}
+}
+
+void nvm_rcu_reclaim(struct nvm_rcu *rcu)
+{
+	struct nvm_rcu_node *node = atomic_exchange(&rcu->retired, NULL);
+
+	rcu_recs_release(rcu);
+
+	while (node) {
+		struct nvm_rcu_node *next = node->next;
+
+		if (rcu_held(rcu, node))
+			rcu_push(rcu, node);
+		else
+			node->dtor(node);
+
+		node = next;
+	}
+}
+
+void nvm_rcu_term(struct nvm_rcu *rcu)
+{
+	struct nvm_rcu_node *node = atomic_exchange(&rcu->retired, NULL);
+	struct nvm_rcu_rec *rec = atomic_exchange(&rcu->recs, NULL);
+
+	while (node) {
+		struct nvm_rcu_node *next = node->next;
+
+		node->dtor(node);
+		node = next;
+	}
+
+	while (rec) {
+		struct nvm_rcu_rec *next = rec->next;
+		struct nvm_thrd_life *owner = atomic_load(&rec->owner);
+
+		if (owner)
+			nvm_thrd_life_put(owner);
+		free(rec);
+		rec = next;
+	}
+}
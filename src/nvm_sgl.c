@@ -27,21 +27,231 @@
  */
 
 #include <stdlib.h>
-#include <bsd/sys/queue.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
 
 #include <liblightnvm_spec.h>
 #include <nvm_dev.h>
 #include <nvm_sgl.h>
 #include <nvm_cmd.h>
 
+static inline void spin_lock(atomic_flag *lock)
+{
+	while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire))
+		sched_yield();
+}
+
+static inline void spin_unlock(atomic_flag *lock)
+{
+	atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+static inline struct nvm_sgl_mag *pool_mag(struct nvm_sgl_pool *pool)
+{
+	return &pool->mags[nvm_thrd_slot()];
+}
+
+/**
+ * Allocate a slab of segments onto the depot, the caller holds the lock
+ */
+static int pool_slab_alloc(struct nvm_sgl_pool *pool)
+{
+	const size_t nbytes = NVM_SGL_SEG_NDESCR *
+			      sizeof(struct nvm_nvme_sgl_descriptor);
+	struct nvm_sgl_slab *slab;
+
+	slab = calloc(1, sizeof(*slab));
+	if (!slab) {
+		NVM_DEBUG("FAILED: calloc slab");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	slab->pages = nvm_buf_alloc(pool->dev, NVM_SGL_POOL_SLAB_NSEGS * nbytes,
+				    NULL);
+	if (!slab->pages) {
+		NVM_DEBUG("FAILED: nvm_buf_alloc slab");
+		free(slab);
+		return -1;
+	}
+
+	for (int i = 0; i < NVM_SGL_POOL_SLAB_NSEGS; ++i) {
+		struct nvm_sgl_seg *seg = &slab->segs[i];
+
+		seg->descr = (void *)((char *)slab->pages + i * nbytes);
+
+		// Without DMA memory 'phys' is unused, nvm_sgl_add fails
+		if (nvm_buf_vtophys(pool->dev, seg->descr, &seg->phys))
+			seg->phys = 0;
+
+		seg->next = pool->segs;
+		pool->segs = seg;
+	}
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	return 0;
+}
+
+/**
+ * Get a segment from the magazine of the calling thread, exchanging half a
+ * magazine with the depot when empty
+ */
+static struct nvm_sgl_seg *pool_seg_get(struct nvm_sgl_pool *pool)
+{
+	struct nvm_sgl_mag *mag = pool_mag(pool);
+	struct nvm_sgl_seg *seg;
+
+	spin_lock(&mag->lock);
+	if (!mag->segs) {
+		spin_lock(&pool->lock);
+		if ((!pool->segs) && pool_slab_alloc(pool)) {
+			spin_unlock(&pool->lock);
+			spin_unlock(&mag->lock);
+			return NULL;
+		}
+		while (pool->segs && (mag->nsegs < NVM_SGL_POOL_MAG_LEN / 2)) {
+			seg = pool->segs;
+			pool->segs = seg->next;
+			seg->next = mag->segs;
+			mag->segs = seg;
+			++mag->nsegs;
+		}
+		spin_unlock(&pool->lock);
+	}
+
+	seg = mag->segs;
+	mag->segs = seg->next;
+	--mag->nsegs;
+	spin_unlock(&mag->lock);
+
+	seg->next = NULL;
+
+	return seg;
+}
+
+/**
+ * Put the chain of segments starting at 'seg' into the magazine of the
+ * calling thread, moving half a magazine to the depot when full
+ */
+static void pool_seg_put(struct nvm_sgl_pool *pool, struct nvm_sgl_seg *seg)
+{
+	struct nvm_sgl_mag *mag = pool_mag(pool);
+
+	spin_lock(&mag->lock);
+	while (seg) {
+		struct nvm_sgl_seg *next = seg->next;
+
+		if (mag->nsegs == NVM_SGL_POOL_MAG_LEN) {
+			spin_lock(&pool->lock);
+			while (mag->nsegs > NVM_SGL_POOL_MAG_LEN / 2) {
+				struct nvm_sgl_seg *spill = mag->segs;
+
+				mag->segs = spill->next;
+				--mag->nsegs;
+				spill->next = pool->segs;
+				pool->segs = spill;
+			}
+			spin_unlock(&pool->lock);
+		}
+
+		seg->next = mag->segs;
+		mag->segs = seg;
+		++mag->nsegs;
+
+		seg = next;
+	}
+	spin_unlock(&mag->lock);
+}
+
+/**
+ * Allocate a segment for an SGL without a pool
+ */
+static struct nvm_sgl_seg *seg_alloc(struct nvm_dev *dev)
+{
+	struct nvm_sgl_seg *seg;
+
+	seg = calloc(1, sizeof(*seg));
+	if (!seg)
+		return NULL;
+
+	seg->descr = nvm_buf_alloc(dev, NVM_SGL_SEG_NDESCR *
+				   sizeof(struct nvm_nvme_sgl_descriptor),
+				   &seg->phys);
+	if (!seg->descr) {
+		free(seg);
+		return NULL;
+	}
+
+	return seg;
+}
+
+/**
+ * Append a segment to the chain of 'sgl'
+ */
+static struct nvm_sgl_seg *sgl_seg_append(struct nvm_sgl *sgl)
+{
+	struct nvm_sgl_seg *seg;
+	struct nvm_sgl_seg **tail = &sgl->segs;
+
+	seg = sgl->pool ? pool_seg_get(sgl->pool) : seg_alloc(sgl->dev);
+	if (!seg) {
+		NVM_DEBUG("FAILED: no segment for SGL");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	while (*tail)
+		tail = &(*tail)->next;
+	*tail = seg;
+
+	return seg;
+}
+
+static struct nvm_sgl *sgl_create(struct nvm_dev *dev,
+				  struct nvm_sgl_pool *pool)
+{
+	struct nvm_sgl *sgl;
+
+	sgl = calloc(1, sizeof(*sgl));
+	if (!sgl)
+		return NULL;
+
+	sgl->dev = dev;
+	sgl->pool = pool;
+	sgl->indirect = nvm_buf_alloc(dev,
+				      sizeof(struct nvm_nvme_sgl_descriptor),
+				      NULL);
+	if (!sgl->indirect) {
+		free(sgl);
+		return NULL;
+	}
+
+	return sgl;
+}
+
 struct nvm_sgl_pool *nvm_sgl_pool_create(struct nvm_dev *dev)
 {
-	struct nvm_sgl_pool *pool = calloc(1, sizeof(*pool));
+	struct nvm_sgl_pool *pool;
+
+	pool = aligned_alloc(_Alignof(struct nvm_sgl_pool), sizeof(*pool));
 	if (!pool) {
+		errno = ENOMEM;
 		return NULL;
 	}
+	memset(pool, 0, sizeof(*pool));
 
 	pool->dev = dev;
+	atomic_flag_clear(&pool->lock);
+	for (int i = 0; i < NVM_SGL_POOL_NMAGS; ++i)
+		atomic_flag_clear(&pool->mags[i].lock);
+
+	if (pool_slab_alloc(pool)) {	// Descriptor pages up front
+		free(pool);
+		return NULL;
+	}
 
 	return pool;
 }
@@ -49,113 +259,263 @@ struct nvm_sgl_pool *nvm_sgl_pool_create(struct nvm_dev *dev)
 void nvm_sgl_pool_destroy(struct nvm_sgl_pool *pool)
 {
 	struct nvm_dev *dev = pool->dev;
-	struct nvm_sgl *sgl;
 
-	while (!SLIST_EMPTY(&pool->free_list)) {
-		sgl = SLIST_FIRST(&pool->free_list);
-		SLIST_REMOVE_HEAD(&pool->free_list, free_list);
-		nvm_sgl_destroy(dev, sgl);
+	for (int i = 0; i < NVM_SGL_POOL_NMAGS; ++i) {
+		while (pool->mags[i].sgls) {
+			struct nvm_sgl *sgl = pool->mags[i].sgls;
+
+			pool->mags[i].sgls = sgl->next;
+			nvm_buf_free(dev, sgl->indirect);
+			free(sgl);
+		}
 	}
+	while (pool->sgls) {
+		struct nvm_sgl *sgl = pool->sgls;
 
-	free(pool);
+		pool->sgls = sgl->next;
+		nvm_buf_free(dev, sgl->indirect);
+		free(sgl);
+	}
 
+	while (pool->slabs) {
+		struct nvm_sgl_slab *slab = pool->slabs;
+
+		pool->slabs = slab->next;
+		nvm_buf_free(dev, slab->pages);
+		free(slab);
+	}
+
+	free(pool);
 }
 
 struct nvm_sgl *nvm_sgl_create(struct nvm_dev *dev, int hint)
 {
-	size_t dsize = sizeof(struct nvm_nvme_sgl_descriptor);
-
 	struct nvm_sgl *sgl;
-	if (NULL == (sgl = calloc(1, sizeof(*sgl)))) {
+
+	sgl = sgl_create(dev, NULL);
+	if (!sgl)
 		return NULL;
-	}
 
-	if (hint) {
-		sgl->descriptors = nvm_buf_alloc(dev, hint * dsize, NULL);
-		if (!sgl->descriptors) {
-			free(sgl);
+	for (int i = 0; i < hint; i += NVM_SGL_SEG_NDATA) {
+		if (!sgl_seg_append(sgl)) {
+			nvm_sgl_destroy(dev, sgl);
 			return NULL;
 		}
 	}
 
-	sgl->nalloc = hint;
-	sgl->indirect = nvm_buf_alloc(dev, dsize, NULL);
-
 	return sgl;
 }
 
 struct nvm_sgl *nvm_sgl_alloc(struct nvm_sgl_pool *pool)
 {
+	struct nvm_sgl_mag *mag = pool_mag(pool);
 	struct nvm_sgl *sgl;
 
-	if (NULL != (sgl = SLIST_FIRST(&pool->free_list))) {
-		SLIST_REMOVE_HEAD(&pool->free_list, free_list);
+	spin_lock(&mag->lock);
+	if (!mag->sgls) {
+		spin_lock(&pool->lock);
+		while (pool->sgls && (mag->nsgls < NVM_SGL_POOL_MAG_LEN / 2)) {
+			sgl = pool->sgls;
+			pool->sgls = sgl->next;
+			sgl->next = mag->sgls;
+			mag->sgls = sgl;
+			++mag->nsgls;
+		}
+		spin_unlock(&pool->lock);
+	}
+
+	sgl = mag->sgls;
+	if (sgl) {
+		mag->sgls = sgl->next;
+		--mag->nsgls;
+	}
+	spin_unlock(&mag->lock);
+
+	if (sgl) {
+		sgl->next = NULL;
 		return sgl;
 	}
 
-	return nvm_sgl_create(pool->dev, 1);
+	sgl = sgl_create(pool->dev, pool);
+	if (!sgl)
+		return NULL;
+
+	if (!sgl_seg_append(sgl)) {
+		nvm_sgl_destroy(pool->dev, sgl);
+		return NULL;
+	}
+
+	return sgl;
 }
 
 void nvm_sgl_destroy(struct nvm_dev *dev, struct nvm_sgl *sgl)
 {
-	nvm_buf_free(dev, sgl->descriptors);
+	if (!sgl)
+		return;
+
+	if (sgl->pool) {
+		pool_seg_put(sgl->pool, sgl->segs);
+	} else {
+		while (sgl->segs) {
+			struct nvm_sgl_seg *seg = sgl->segs;
+
+			sgl->segs = seg->next;
+			nvm_buf_free(dev, seg->descr);
+			free(seg);
+		}
+	}
+
 	nvm_buf_free(dev, sgl->indirect);
 	free(sgl);
 }
 
 void nvm_sgl_reset(struct nvm_sgl *sgl)
 {
+	sgl->cur = NULL;
 	sgl->ndescr = 0;
 	sgl->len = 0;
 }
 
 void nvm_sgl_free(struct nvm_sgl_pool *pool, struct nvm_sgl *sgl)
 {
-	sgl->ndescr = 0;
-	sgl->len = 0;
-	SLIST_INSERT_HEAD(&pool->free_list, sgl, free_list);
+	struct nvm_sgl_mag *mag;
+
+	if (sgl->pool != pool) {	// Not backed by the pool, cannot keep it
+		nvm_sgl_destroy(pool->dev, sgl);
+		return;
+	}
+
+	nvm_sgl_reset(sgl);
+
+	// Keep a single segment, return those chained for large SGLs
+	if (sgl->segs && sgl->segs->next) {
+		pool_seg_put(pool, sgl->segs->next);
+		sgl->segs->next = NULL;
+	}
+
+	mag = pool_mag(pool);
+	spin_lock(&mag->lock);
+	if (mag->nsgls == NVM_SGL_POOL_MAG_LEN) {
+		spin_lock(&pool->lock);
+		while (mag->nsgls > NVM_SGL_POOL_MAG_LEN / 2) {
+			struct nvm_sgl *spill = mag->sgls;
+
+			mag->sgls = spill->next;
+			--mag->nsgls;
+			spill->next = pool->sgls;
+			pool->sgls = spill;
+		}
+		spin_unlock(&pool->lock);
+	}
+	sgl->next = mag->sgls;
+	mag->sgls = sgl;
+	++mag->nsgls;
+	spin_unlock(&mag->lock);
 }
 
+/**
+ * Returns the next free descriptor of 'sgl', moving on to the next segment,
+ * and chaining another one when needed
+ */
+static struct nvm_nvme_sgl_descriptor *sgl_descr_next(struct nvm_sgl *sgl)
+{
+	if ((!sgl->cur) || (!(sgl->ndescr % NVM_SGL_SEG_NDATA))) {
+		struct nvm_sgl_seg *next = sgl->cur ? sgl->cur->next : sgl->segs;
+
+		if (!next) {
+			next = sgl_seg_append(sgl);
+			if (!next) {
+				return NULL;
+			}
+		}
+		sgl->cur = next;
+	}
+
+	return &sgl->cur->descr[sgl->ndescr % NVM_SGL_SEG_NDATA];
+}
 
 int nvm_sgl_add(struct nvm_dev *dev, struct nvm_sgl *sgl, void *addr,
 	size_t len)
 {
 	struct nvm_nvme_sgl_descriptor *d;
+	uint64_t phys;
 
-	/**
-	 * FIXME(klaus.jensen): currently we only support one Last Segment
-	 *  descriptor (one 4K page).
-	 */
-	if (sgl->ndescr == 256) {
-		NVM_DEBUG("max 256 SGL descriptors supported");
-		errno = EINVAL;
+	if (nvm_buf_vtophys(dev, addr, &phys)) {
 		return -1;
 	}
 
-	if (sgl->ndescr == sgl->nalloc) {
-		size_t nbytes;
-		sgl->nalloc = sgl->nalloc ? 2 * sgl->nalloc : 1;
-		nbytes = sgl->nalloc * sizeof(struct nvm_nvme_sgl_descriptor);
-		sgl->descriptors = nvm_buf_realloc(dev, sgl->descriptors, nbytes, NULL);
-		if (!sgl->descriptors) {
-			return -1;
-		}
+	d = sgl_descr_next(sgl);
+	if (!d) {
+		return -1;
 	}
-
-	d = &sgl->descriptors[sgl->ndescr];
 	d->unkeyed.type = NVM_NVME_SGL_DESCR_TYPE_DATA_BLOCK;
+	d->unkeyed.subtype = 0;
 	d->unkeyed.len = len;
+	d->addr = phys;
 
-	uint64_t phys;
+	sgl->len += len;
+	++sgl->ndescr;
 
-	if (nvm_buf_vtophys(dev, addr, &phys)) {
+	return 0;
+}
+
+int nvm_sgl_add_skip(struct nvm_sgl *sgl, size_t nbytes)
+{
+	struct nvm_nvme_sgl_descriptor *d;
+
+	if ((!nbytes) || (nbytes > UINT32_MAX)) {
+		NVM_DEBUG("FAILED: invalid nbytes: %zu", nbytes);
+		errno = EINVAL;
 		return -1;
 	}
 
-	d->addr = phys;
+	// Merge with a preceding bit bucket, saving a descriptor
+	if (sgl->ndescr && (sgl->ndescr % NVM_SGL_SEG_NDATA)) {
+		d = &sgl->cur->descr[sgl->ndescr % NVM_SGL_SEG_NDATA - 1];
+		if ((d->unkeyed.type == NVM_NVME_SGL_DESCR_TYPE_BIT_BUCKET) &&
+		    (d->unkeyed.len + nbytes <= UINT32_MAX)) {
+			d->unkeyed.len += nbytes;
+			return 0;
+		}
+	}
+
+	d = sgl_descr_next(sgl);
+	if (!d) {
+		return -1;
+	}
+	d->unkeyed.type = NVM_NVME_SGL_DESCR_TYPE_BIT_BUCKET;
+	d->unkeyed.subtype = 0;
+	d->unkeyed.len = nbytes;
+	d->addr = 0;
 
-	sgl->len += len;
 	++sgl->ndescr;
 
 	return 0;
 }
+
+void nvm_sgl_dptr(struct nvm_sgl *sgl, struct nvm_nvme_sgl_descriptor *dptr)
+{
+	struct nvm_nvme_sgl_descriptor *ptr = dptr;
+	size_t left = sgl->ndescr;
+
+	if (sgl->ndescr == 1) {
+		*dptr = sgl->segs->descr[0];
+		return;
+	}
+
+	memset(dptr, 0, sizeof(*dptr));
+
+	for (struct nvm_sgl_seg *seg = sgl->segs; left; seg = seg->next) {
+		const int last = left <= NVM_SGL_SEG_NDATA;
+		const size_t ndescr = last ? left : NVM_SGL_SEG_NDESCR;
+
+		ptr->addr = seg->phys;
+		ptr->unkeyed.type = last ? NVM_NVME_SGL_DESCR_TYPE_LAST_SEGMENT :
+					   NVM_NVME_SGL_DESCR_TYPE_SEGMENT;
+		ptr->unkeyed.subtype = 0;
+		ptr->unkeyed.len = ndescr * sizeof(*ptr);
+
+		ptr = &seg->descr[NVM_SGL_SEG_NDATA];
+		left -= last ? left : NVM_SGL_SEG_NDATA;
+	}
+}
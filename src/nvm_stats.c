@@ -0,0 +1,760 @@
+/*
+ * nvm_stats - Per-command latency histograms
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <liblightnvm.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_async.h>
+#include <nvm_cmd.h>
+#include <nvm_stats.h>
+#include <nvm_probe.h>
+#include <nvm_trace.h>
+#include <nvm_usdt.h>
+
+static uint64_t stats_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stats_hist_reset(struct nvm_stats_hist *hist)
+{
+	atomic_store(&hist->count, 0);
+	atomic_store(&hist->sum, 0);
+	atomic_store(&hist->min, UINT64_MAX);
+	atomic_store(&hist->max, 0);
+	for (size_t idx = 0; idx < NVM_STATS_NBUCKETS; ++idx)
+		atomic_store(&hist->buckets[idx], 0);
+}
+
+static struct nvm_stats *stats_alloc(const struct nvm_geo *geo)
+{
+	const size_t npus = geo->l.npugrp * geo->l.npunit;
+	const size_t nhists = npus * NVM_DEV_STATS_NOPS;
+	struct nvm_stats *stats;
+
+	stats = malloc(sizeof(*stats) + nhists * sizeof(*stats->hists));
+	if (!stats) {
+		NVM_DEBUG("FAILED: malloc stats");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	stats->npus = npus;
+	for (size_t idx = 0; idx < nhists; ++idx)
+		stats_hist_reset(&stats->hists[idx]);
+
+	stats->tsc0 = nvm_stats_tsc();
+	stats->ns0 = stats_ns();
+
+	return stats;
+}
+
+/**
+ * Returns the statistics of the given device, allocating them on first use.
+ * Concurrent first users race on a compare-and-swap, the loser frees its copy
+ */
+static struct nvm_stats *stats_get(struct nvm_dev *dev)
+{
+	struct nvm_stats *stats = atomic_load(&dev->stats);
+	struct nvm_stats *cur = NULL;
+
+	if (stats)
+		return stats;
+
+	stats = stats_alloc(nvm_dev_get_geo(dev));
+	if (!stats)
+		return NULL;
+
+	if (!atomic_compare_exchange_strong(&dev->stats, &cur, stats)) {
+		free(stats);
+		return cur;
+	}
+
+	return stats;
+}
+
+static atomic_uint stats_shm_seq;	///< Sequence # of the next segment
+
+static void stats_shm_name(char *name, size_t len, int pid, uint32_t seq,
+			   const char *dev_name)
+{
+	snprintf(name, len, "/%s%d-%u-%s", NVM_STATS_SHM_PREFIX, pid, seq,
+		 dev_name);
+
+	for (char *c = name + 1; *c; ++c) {
+		if (*c == '/')
+			*c = '_';
+	}
+}
+
+static size_t stats_shm_nbytes(size_t npus)
+{
+	return sizeof(struct nvm_stats_shm) +
+	       npus * sizeof(struct nvm_stats_shm_pu);
+}
+
+static int stats_shm_create(struct nvm_dev *dev)
+{
+	const size_t npus = dev->geo.l.npugrp * dev->geo.l.npunit;
+	const size_t nbytes = stats_shm_nbytes(npus);
+	char name[NVM_DEV_NAME_LEN + 48];
+	struct nvm_stats_shm *shm;
+	uint32_t seq;
+	int fd;
+
+	// Each handle gets a segment of its own, also when opening the same
+	// device twice, and a segment left by an exited process is never reused
+	for (int retry = 0; ; ++retry) {
+		seq = atomic_fetch_add(&stats_shm_seq, 1);
+		stats_shm_name(name, sizeof(name), getpid(), seq, dev->name);
+
+		fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+		if ((fd >= 0) || (errno != EEXIST) ||
+		    (retry == NVM_STATS_SHM_NRETRIES))
+			break;
+	}
+	if (fd < 0) {
+		NVM_DEBUG("FAILED: shm_open name: %s", name);
+		return -1;
+	}
+
+	if (ftruncate(fd, nbytes)) {
+		NVM_DEBUG("FAILED: ftruncate nbytes: %zu", nbytes);
+		close(fd);
+		shm_unlink(name);
+		return -1;
+	}
+
+	shm = mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		NVM_DEBUG("FAILED: mmap nbytes: %zu", nbytes);
+		shm_unlink(name);
+		return -1;
+	}
+
+	// Counters are zero-filled by ftruncate
+	shm->version = NVM_STATS_SHM_VERSION;
+	shm->pid = getpid();
+	shm->be_id = dev->be->id;
+	memcpy(shm->name, dev->name, sizeof(shm->name) - 1);
+	shm->seq = seq;
+	shm->npus = npus;
+	shm->nctxs = NVM_STATS_SHM_NCTXS;
+
+	atomic_thread_fence(memory_order_release);
+	shm->magic = NVM_STATS_SHM_MAGIC;
+
+	dev->stats_shm = shm;
+
+	return 0;
+}
+
+static void stats_shm_destroy(struct nvm_dev *dev)
+{
+	struct nvm_stats_shm *shm = dev->stats_shm;
+	char name[NVM_DEV_NAME_LEN + 48];
+
+	if (!shm)
+		return;
+
+	dev->stats_shm = NULL;
+
+	// A forked child leaves the segment of its parent alone
+	if (shm->pid == getpid()) {
+		stats_shm_name(name, sizeof(name), shm->pid, shm->seq,
+			       dev->name);
+		shm_unlink(name);
+	}
+
+	munmap(shm, stats_shm_nbytes(shm->npus));
+}
+
+void nvm_stats_init(struct nvm_dev *dev)
+{
+	atomic_init(&dev->stats, NULL);		// Allocated on first use
+	dev->stats_shm = NULL;
+	dev->trace = NULL;
+	nvm_probe_init(dev);
+
+	// One file per device, as every device of the process sees the variable
+	if (getenv("NVM_DEV_TRACE")) {
+		char path[NVM_TRACE_PATH_LEN];
+
+		if (snprintf(path, sizeof(path), "%s.%s",
+			     getenv("NVM_DEV_TRACE"), dev->name) >=
+		    (int)sizeof(path)) {
+			NVM_DEBUG("FAILED: NVM_DEV_TRACE, path too long");
+		} else if (nvm_dev_set_trace(dev, path)) {
+			NVM_DEBUG("FAILED: NVM_DEV_TRACE, nvm_dev_set_trace");
+		}
+	}
+
+	if (getenv("NVM_DEV_STATS_SHM") &&
+	    !strcmp(getenv("NVM_DEV_STATS_SHM"), "1") &&
+	    stats_shm_create(dev)) {
+		NVM_DEBUG("FAILED: NVM_DEV_STATS_SHM, stats_shm_create");
+	}
+}
+
+void nvm_stats_free(struct nvm_dev *dev)
+{
+	if (nvm_trace_close(dev->trace)) {
+		NVM_DEBUG("FAILED: nvm_trace_close");
+	}
+	dev->trace = NULL;
+	stats_shm_destroy(dev);
+	nvm_probe_free(dev);
+	free(atomic_exchange(&dev->stats, NULL));
+}
+
+int nvm_stats_shm_ctx_claim(struct nvm_dev *dev, uint32_t depth)
+{
+	struct nvm_stats_shm *shm = dev->stats_shm;
+
+	if (!shm)
+		return -1;
+
+	for (int slot = 0; slot < NVM_STATS_SHM_NCTXS; ++slot) {
+		struct nvm_stats_shm_ctx *ctx = &shm->ctxs[slot];
+		int free = 0;
+
+		if (!atomic_compare_exchange_strong(&ctx->in_use, &free, 1))
+			continue;
+
+		ctx->depth = depth;
+		atomic_store(&ctx->outstanding, 0);
+		atomic_store(&ctx->ncmds, 0);
+
+		return slot;
+	}
+
+	NVM_DEBUG("FAILED: no free ctx slot");
+	return -1;
+}
+
+void nvm_stats_shm_ctx_release(struct nvm_dev *dev, int slot)
+{
+	if (!dev->stats_shm || (slot < 0))
+		return;
+
+	atomic_store(&dev->stats_shm->ctxs[slot].in_use, 0);
+}
+
+const struct nvm_stats_shm *nvm_stats_shm_attach(const char *name,
+						 size_t *nbytes)
+{
+	const struct nvm_stats_shm *shm;
+	char path[NAME_MAX + 2];
+	struct stat st;
+	int fd;
+
+	snprintf(path, sizeof(path), "/%s", name);
+
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0) {
+		NVM_DEBUG("FAILED: shm_open path: %s", path);
+		return NULL;
+	}
+
+	if (fstat(fd, &st) || ((size_t)st.st_size < sizeof(*shm))) {
+		NVM_DEBUG("FAILED: fstat or too small");
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	shm = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		NVM_DEBUG("FAILED: mmap");
+		return NULL;
+	}
+
+	if ((shm->magic != NVM_STATS_SHM_MAGIC) ||
+	    (shm->version != NVM_STATS_SHM_VERSION) ||
+	    (stats_shm_nbytes(shm->npus) > (size_t)st.st_size)) {
+		NVM_DEBUG("FAILED: invalid segment: %s", path);
+		munmap((void *)shm, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	*nbytes = st.st_size;
+
+	return shm;
+}
+
+void nvm_stats_shm_detach(const struct nvm_stats_shm *shm, size_t nbytes)
+{
+	if (shm)
+		munmap((void *)shm, nbytes);
+}
+
+int nvm_dev_set_stats_shm(struct nvm_dev *dev, int enabled)
+{
+	if (!enabled) {
+		stats_shm_destroy(dev);
+		return 0;
+	}
+
+	if (dev->stats_shm)
+		return 0;
+
+	return stats_shm_create(dev);
+}
+
+int nvm_dev_get_stats_shm(const struct nvm_dev *dev)
+{
+	return dev->stats_shm != NULL;
+}
+
+static inline size_t stats_bucket(uint64_t ticks)
+{
+	int msb;
+
+	if (ticks < NVM_STATS_SUB)
+		return ticks;
+
+	msb = 63 - __builtin_clzll(ticks);
+	if (msb >= NVM_STATS_MAG)
+		return NVM_STATS_NBUCKETS - 1;
+
+	return (msb - NVM_STATS_SUB_BITS + 1) * NVM_STATS_SUB +
+	       ((ticks >> (msb - NVM_STATS_SUB_BITS)) - NVM_STATS_SUB);
+}
+
+/**
+ * Returns the largest value accounted in the given bucket
+ */
+static inline uint64_t stats_bucket_max(size_t bucket)
+{
+	const size_t shift = bucket / NVM_STATS_SUB - 1;
+	const uint64_t sub = bucket % NVM_STATS_SUB;
+
+	if (bucket < NVM_STATS_SUB)
+		return bucket;
+
+	return ((NVM_STATS_SUB + sub + 1) << shift) - 1;
+}
+
+static void stats_hist_add(struct nvm_stats_hist *hist, uint64_t ticks)
+{
+	uint64_t cur;
+
+	atomic_fetch_add_explicit(&hist->buckets[stats_bucket(ticks)], 1,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&hist->sum, ticks, memory_order_relaxed);
+
+	cur = atomic_load_explicit(&hist->min, memory_order_relaxed);
+	while (ticks < cur && !atomic_compare_exchange_weak(&hist->min, &cur,
+							     ticks))
+		;
+
+	cur = atomic_load_explicit(&hist->max, memory_order_relaxed);
+	while (ticks > cur && !atomic_compare_exchange_weak(&hist->max, &cur,
+							     ticks))
+		;
+}
+
+static void stats_account(struct nvm_dev *dev, int op, int pu, uint64_t ticks)
+{
+	struct nvm_stats *stats = stats_get(dev);
+
+	if (!stats)
+		return;
+
+	stats_hist_add(&stats->hists[pu * NVM_DEV_STATS_NOPS + op], ticks);
+}
+
+static void stats_shm_submit(struct nvm_stats_shm *shm, int pu, int slot,
+			     uint64_t tsc)
+{
+	if (atomic_fetch_add(&shm->pus[pu].outstanding, 1) == 0)
+		atomic_store(&shm->pus[pu].busy_bgn, tsc);
+
+	if (slot >= 0)
+		atomic_fetch_add(&shm->ctxs[slot].outstanding, 1);
+}
+
+static void stats_shm_leave(struct nvm_stats_shm *shm, int pu, int slot,
+			    uint64_t tsc)
+{
+	if (atomic_fetch_sub(&shm->pus[pu].outstanding, 1) == 1) {
+		const uint64_t bgn = atomic_load(&shm->pus[pu].busy_bgn);
+
+		if (tsc > bgn)
+			atomic_fetch_add(&shm->pus[pu].busy, tsc - bgn);
+	}
+
+	if (slot >= 0)
+		atomic_fetch_sub(&shm->ctxs[slot].outstanding, 1);
+}
+
+static void stats_shm_cpl(struct nvm_dev *dev, int op, int pu, int slot,
+			  int naddrs, uint64_t tsc, int err)
+{
+	struct nvm_stats_shm *shm = dev->stats_shm;
+	struct nvm_stats_shm_op *sop = &shm->ops[op];
+
+	stats_shm_leave(shm, pu, slot, tsc);
+
+	atomic_fetch_add_explicit(&sop->ncmds, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&shm->pus[pu].ncmds, 1,
+				  memory_order_relaxed);
+	if (op != NVM_DEV_STATS_ERASE) {
+		atomic_fetch_add_explicit(&sop->nbytes,
+					  naddrs * dev->geo.l.nbytes,
+					  memory_order_relaxed);
+	}
+	if (err) {
+		atomic_fetch_add_explicit(&sop->nerrs, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&shm->pus[pu].nerrs, 1,
+					  memory_order_relaxed);
+	}
+	if (slot >= 0) {
+		atomic_fetch_add_explicit(&shm->ctxs[slot].ncmds, 1,
+					  memory_order_relaxed);
+	}
+}
+
+static void stats_trace(struct nvm_dev *dev, int op, uint64_t addr,
+			uint32_t digest, int naddrs, uint16_t flags,
+			uint16_t status, uint64_t tsc, uint64_t now)
+{
+	struct nvm_trace_rec rec = { 0 };
+
+	rec.tsc = tsc;
+	rec.ticks = now - tsc;
+	rec.addr = addr;
+	rec.digest = digest;
+	rec.flags = (flags & ~NVM_CMD_MASK_ADDR) |
+		    nvm_cmd_addr_mode(dev, flags);
+	rec.status = status;
+	rec.op = op;
+	rec.naddrs = naddrs;
+
+	nvm_trace_rec(dev->trace, &rec);
+}
+
+/**
+ * Digest of the addresses of a command, a scalar command has one address
+ */
+static uint32_t stats_digest(const struct nvm_dev *dev,
+			     const struct nvm_addr addrs[], int naddrs,
+			     uint16_t flags)
+{
+	if (nvm_cmd_addr_mode(dev, flags) == NVM_CMD_SCALAR)
+		naddrs = 1;
+
+	return nvm_trace_digest(addrs, naddrs);
+}
+
+static void stats_async_cb(struct nvm_ret *ret, void *NVM_UNUSED(opaque))
+{
+	struct nvm_dev *dev = ret->stats.dev;
+	const uint64_t tsc = nvm_stats_tsc();
+
+	ret->async.cb = ret->stats.cb;
+	ret->async.cb_arg = ret->stats.cb_arg;
+
+	NVM_USDT6(cmd__complete, dev->name,
+		  nvm_cmd_opcode(dev, ret->stats.op, ret->stats.flags),
+		  ret->stats.addr, ret->stats.naddrs, ret->status,
+		  tsc - ret->stats.tsc);
+
+	if (ret->async.ctx && ret->async.ctx->qdc) {
+		nvm_async_qdc_cpl(ret->async.ctx, ret->stats.pu,
+				  tsc - ret->stats.tsc);
+	}
+	if (ret->async.ctx && ret->async.ctx->sched &&
+	    (ret->stats.op == NVM_DEV_STATS_READ))
+		nvm_async_sched_cpl(ret->async.ctx, ret->stats.pu);
+
+	stats_account(dev, ret->stats.op, ret->stats.pu, tsc - ret->stats.tsc);
+	if (dev->stats_shm) {
+		stats_shm_cpl(dev, ret->stats.op, ret->stats.pu,
+			      ret->stats.slot, ret->stats.naddrs, tsc,
+			      ret->status != 0);
+	}
+	if (dev->trace) {
+		stats_trace(dev, ret->stats.op, ret->stats.addr,
+			    ret->stats.digest, ret->stats.naddrs,
+			    ret->stats.flags, ret->status, ret->stats.tsc, tsc);
+	}
+
+	ret->async.cb(ret, ret->async.cb_arg);
+}
+
+uint64_t nvm_stats_enter(struct nvm_dev *dev, int op,
+			 const struct nvm_addr addrs[], int naddrs,
+			 uint16_t flags, struct nvm_ret *ret)
+{
+	const uint64_t tsc = nvm_stats_tsc();
+	const int pu = nvm_stats_pu(dev, addrs[0]);
+	int slot = -1;
+
+	NVM_USDT5(cmd__submit, dev->name, nvm_cmd_opcode(dev, op, flags),
+		  addrs[0].val, naddrs, flags);
+
+	if (pu < 0)
+		return tsc;
+
+	if (!(flags & NVM_CMD_ASYNC)) {
+		if (dev->stats_shm)
+			stats_shm_submit(dev->stats_shm, pu, slot, tsc);
+		return tsc;
+	}
+
+	if (!(ret && ret->async.cb))	// Completion cannot be observed
+		return tsc;
+
+	if (dev->stats_shm) {
+		slot = ret->async.ctx ? ret->async.ctx->stats_slot : -1;
+		stats_shm_submit(dev->stats_shm, pu, slot, tsc);
+	}
+
+	ret->stats.tsc = tsc;
+	ret->stats.cb = ret->async.cb;
+	ret->stats.cb_arg = ret->async.cb_arg;
+	ret->stats.dev = dev;
+	ret->stats.pu = pu;
+	ret->stats.op = op;
+	ret->stats.naddrs = naddrs;
+	ret->stats.slot = slot;
+	ret->stats.addr = addrs[0].val;
+	ret->stats.flags = flags;
+	if (dev->trace)
+		ret->stats.digest = stats_digest(dev, addrs, naddrs, flags);
+
+	ret->async.cb = stats_async_cb;
+	ret->async.cb_arg = NULL;
+
+	return tsc;
+}
+
+void nvm_stats_leave(struct nvm_dev *dev, int op,
+		     const struct nvm_addr addrs[], int naddrs,
+		     uint16_t flags, struct nvm_ret *ret, uint64_t tsc,
+		     int err)
+{
+	const int pu = nvm_stats_pu(dev, addrs[0]);
+	const uint64_t now = nvm_stats_tsc();
+
+	if (err && (errno == EAGAIN)) {		// Back-pressure of ASYNC
+		NVM_USDT4(cmd__eagain, dev->name,
+			  nvm_cmd_opcode(dev, op, flags), addrs[0].val, naddrs);
+	}
+
+	if (pu < 0)
+		return;
+
+	if (flags & NVM_CMD_ASYNC) {	// Accounted by stats_async_cb
+		if (!err || !(ret && ret->async.cb == stats_async_cb))
+			return;
+
+		ret->async.cb = ret->stats.cb;
+		ret->async.cb_arg = ret->stats.cb_arg;
+		if (dev->stats_shm)
+			stats_shm_leave(dev->stats_shm, pu, ret->stats.slot, now);
+		return;
+	}
+
+	if (err && !ret->status) {		// Not submitted
+		if (dev->stats_shm)
+			stats_shm_leave(dev->stats_shm, pu, -1, now);
+		return;
+	}
+
+	NVM_USDT6(cmd__complete, dev->name, nvm_cmd_opcode(dev, op, flags),
+		  addrs[0].val, naddrs, ret->status, now - tsc);
+
+	stats_account(dev, op, pu, now - tsc);
+	if (dev->stats_shm)
+		stats_shm_cpl(dev, op, pu, -1, naddrs, now, err);
+	if (dev->trace) {
+		stats_trace(dev, op, addrs[0].val,
+			    stats_digest(dev, addrs, naddrs, flags), naddrs,
+			    flags, ret->status, tsc, now);
+	}
+}
+
+int nvm_dev_stats_get(struct nvm_dev *dev, int op, int pu,
+		      struct nvm_dev_stats *stats)
+{
+	const uint64_t qs[] = {5000, 9000, 9900, 9990, 9999};
+	uint64_t *ps[] = {
+		&stats->p50_ns, &stats->p90_ns, &stats->p99_ns,
+		&stats->p999_ns, &stats->p9999_ns
+	};
+	uint64_t buckets[NVM_STATS_NBUCKETS] = { 0 };
+	uint64_t sum = 0, min = UINT64_MAX, max = 0, count = 0, seen = 0;
+	size_t pu_bgn, pu_end, qi = 0;
+	struct nvm_stats *st;
+	double ns_tick = 1.0;
+
+	if ((op < 0) || (op >= NVM_DEV_STATS_NOPS)) {
+		NVM_DEBUG("FAILED: invalid op: %d", op);
+		errno = EINVAL;
+		return -1;
+	}
+
+	st = stats_get(dev);
+	if (!st) {
+		NVM_DEBUG("FAILED: stats_get");
+		return -1;
+	}
+
+	if ((pu < -1) || (pu >= (int)st->npus)) {
+		NVM_DEBUG("FAILED: invalid pu: %d", pu);
+		errno = EINVAL;
+		return -1;
+	}
+
+	pu_bgn = pu < 0 ? 0 : (size_t)pu;
+	pu_end = pu < 0 ? st->npus : (size_t)pu + 1;
+	for (size_t i = pu_bgn; i < pu_end; ++i) {
+		struct nvm_stats_hist *hist;
+		uint64_t val;
+
+		hist = &st->hists[i * NVM_DEV_STATS_NOPS + op];
+		for (size_t idx = 0; idx < NVM_STATS_NBUCKETS; ++idx) {
+			val = atomic_load_explicit(&hist->buckets[idx],
+						   memory_order_relaxed);
+			buckets[idx] += val;
+			count += val;
+		}
+		sum += atomic_load(&hist->sum);
+
+		val = atomic_load(&hist->min);
+		min = val < min ? val : min;
+		val = atomic_load(&hist->max);
+		max = val > max ? val : max;
+	}
+
+	// Ticks to nanoseconds, calibrated over the lifetime of the stats
+	{
+		const uint64_t ticks = nvm_stats_tsc() - st->tsc0;
+		const uint64_t ns = stats_ns() - st->ns0;
+
+		if (ticks && ns)
+			ns_tick = (double)ns / (double)ticks;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	stats->be_id = dev->be->id;
+	stats->op = op;
+	stats->pu = pu;
+	stats->count = count;
+	if (!count)
+		return 0;
+
+	stats->min_ns = min * ns_tick;
+	stats->max_ns = max * ns_tick;
+	stats->mean_ns = (sum / count) * ns_tick;
+
+	for (size_t idx = 0; (idx < NVM_STATS_NBUCKETS) && (qi < 5); ++idx) {
+		seen += buckets[idx];
+
+		while ((qi < 5) && (seen * 10000 >= qs[qi] * count)) {
+			uint64_t val = stats_bucket_max(idx);
+
+			val = val > max ? max : val;
+			*ps[qi++] = val * ns_tick;
+		}
+	}
+
+	return 0;
+}
+
+void nvm_dev_stats_reset(struct nvm_dev *dev)
+{
+	struct nvm_stats *stats = atomic_load(&dev->stats);
+
+	nvm_probe_reset(dev);
+
+	if (!stats)
+		return;
+
+	for (size_t idx = 0; idx < stats->npus * NVM_DEV_STATS_NOPS; ++idx)
+		stats_hist_reset(&stats->hists[idx]);
+}
+
+static const char *stats_op_str(int op)
+{
+	switch (op) {
+	case NVM_DEV_STATS_ERASE:
+		return "erase";
+	case NVM_DEV_STATS_WRITE:
+		return "write";
+	case NVM_DEV_STATS_READ:
+		return "read";
+	case NVM_DEV_STATS_COPY:
+		return "copy";
+	}
+
+	return "unknown";
+}
+
+void nvm_dev_stats_pr(const struct nvm_dev_stats *stats)
+{
+	printf("stats:");
+
+	if (!stats) {
+		printf(" ~\n");
+		return;
+	}
+
+	printf("\n");
+	printf("  be_id: 0x%02x\n", stats->be_id);
+	printf("  op: '%s'\n", stats_op_str(stats->op));
+	printf("  pu: %d\n", stats->pu);
+	printf("  count: %"PRIu64"\n", stats->count);
+	printf("  min_ns: %"PRIu64"\n", stats->min_ns);
+	printf("  max_ns: %"PRIu64"\n", stats->max_ns);
+	printf("  mean_ns: %"PRIu64"\n", stats->mean_ns);
+	printf("  p50_ns: %"PRIu64"\n", stats->p50_ns);
+	printf("  p90_ns: %"PRIu64"\n", stats->p90_ns);
+	printf("  p99_ns: %"PRIu64"\n", stats->p99_ns);
+	printf("  p999_ns: %"PRIu64"\n", stats->p999_ns);
+	printf("  p9999_ns: %"PRIu64"\n", stats->p9999_ns);
+}
@@ -0,0 +1,136 @@
+/*
+ * nvm_thrd - Per-thread slots, released when threads exit
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include <nvm_thrd.h>
+
+_Thread_local int nvm_thrd_excl = -1;
+_Thread_local int nvm_thrd_any = -1;
+atomic_uint nvm_thrd_gens[NVM_THRD_NSLOTS];
+
+static atomic_uint_least64_t thrd_used;		// Bit per exclusive slot
+static atomic_uint thrd_nshared;		// Threads assigned shared slots
+static pthread_key_t thrd_key;			// Releases the slot at exit
+static pthread_key_t thrd_life_key;		// Ends the life at exit
+static pthread_once_t thrd_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct nvm_thrd_life *thrd_life;
+
+_Static_assert(NVM_THRD_NSLOTS <= 64, "thrd_used has a bit per slot");
+
+static void thrd_release(void *val)
+{
+	const int slot = (int)(intptr_t)val - 1;
+
+	atomic_fetch_add(&nvm_thrd_gens[slot], 1);
+	atomic_fetch_and(&thrd_used, ~(1ULL << slot));
+}
+
+static void thrd_life_release(void *val)
+{
+	struct nvm_thrd_life *life = val;
+
+	atomic_store(&life->alive, 0);
+	nvm_thrd_life_put(life);
+}
+
+static void thrd_key_create(void)
+{
+	if (pthread_key_create(&thrd_key, thrd_release)) {
+		NVM_DEBUG("FAILED: pthread_key_create, slots are not released");
+	}
+	if (pthread_key_create(&thrd_life_key, thrd_life_release)) {
+		NVM_DEBUG("FAILED: pthread_key_create, lives do not end");
+	}
+}
+
+struct nvm_thrd_life *nvm_thrd_life(void)
+{
+	struct nvm_thrd_life *life = thrd_life;
+
+	if (life)
+		return life;
+
+	pthread_once(&thrd_once, thrd_key_create);
+
+	life = malloc(sizeof(*life));
+	if (!life) {
+		NVM_DEBUG("FAILED: malloc life");
+		return NULL;
+	}
+	atomic_init(&life->nrefs, 1);
+	atomic_init(&life->alive, 1);
+
+	if (pthread_setspecific(thrd_life_key, life)) {
+		NVM_DEBUG("FAILED: pthread_setspecific, life does not end");
+	}
+	thrd_life = life;
+
+	return life;
+}
+
+void nvm_thrd_life_get(struct nvm_thrd_life *life)
+{
+	atomic_fetch_add(&life->nrefs, 1);
+}
+
+void nvm_thrd_life_put(struct nvm_thrd_life *life)
+{
+	if (atomic_fetch_sub(&life->nrefs, 1) == 1)
+		free(life);
+}
+
+void nvm_thrd_claim(void)
+{
+	uint64_t used = atomic_load(&thrd_used);
+
+	pthread_once(&thrd_once, thrd_key_create);
+
+	while (~used) {
+		const int slot = __builtin_ctzll(~used);
+
+		if (slot >= NVM_THRD_NSLOTS)
+			break;
+
+		if (!atomic_compare_exchange_weak(&thrd_used, &used,
+						  used | (1ULL << slot)))
+			continue;
+
+		if (pthread_setspecific(thrd_key, (void *)(intptr_t)(slot + 1))) {
+			NVM_DEBUG("FAILED: pthread_setspecific, slot kept");
+		}
+
+		nvm_thrd_excl = slot;
+		nvm_thrd_any = slot;
+		return;
+	}
+
+	nvm_thrd_excl = -1;
+	nvm_thrd_any = atomic_fetch_add(&thrd_nshared, 1) % NVM_THRD_NSLOTS;
+}
@@ -0,0 +1,393 @@
+/*
+ * nvm_trace - Binary command trace
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <liblightnvm.h>
+#include <nvm_be.h>
+#include <nvm_dev.h>
+#include <nvm_stats.h>
+#include <nvm_trace.h>
+
+#define TRACE_RING_MASK (NVM_TRACE_RING_NRECS - 1)
+#define TRACE_FLUSH_NRECS 256			// Records per write
+
+static uint64_t trace_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint32_t nvm_trace_digest(const struct nvm_addr addrs[], int naddrs)
+{
+	uint32_t digest = 2166136261U;
+
+	for (int i = 0; i < naddrs; ++i) {
+		for (int byte = 0; byte < 8; ++byte) {
+			digest ^= (addrs[i].val >> (byte * 8)) & 0xFF;
+			digest *= 16777619U;
+		}
+	}
+
+	return digest;
+}
+
+static int trace_write(struct nvm_trace *trace, const void *buf,
+		       size_t nbytes)
+{
+	const char *cur = buf;
+
+	while (nbytes) {
+		ssize_t res = write(trace->fd, cur, nbytes);
+
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			NVM_DEBUG("FAILED: write");
+			return -1;
+		}
+
+		cur += res;
+		nbytes -= res;
+	}
+
+	return 0;
+}
+
+/**
+ * Drain all rings to file, the caller is the single consumer of the rings
+ */
+static void trace_flush(struct nvm_trace *trace)
+{
+	struct nvm_trace_rec recs[TRACE_FLUSH_NRECS];
+
+	for (int r = 0; r < NVM_TRACE_NRINGS; ++r) {
+		struct nvm_trace_ring *ring = &trace->rings[r];
+		size_t nrecs = 0;
+
+		for (;;) {
+			struct nvm_trace_cell *cell;
+
+			cell = &ring->cells[ring->tail & TRACE_RING_MASK];
+			if (atomic_load_explicit(&cell->seq,
+						 memory_order_acquire) !=
+			    ring->tail + 1)
+				break;
+
+			recs[nrecs++] = cell->rec;
+			atomic_store_explicit(&cell->seq,
+					      ring->tail + NVM_TRACE_RING_NRECS,
+					      memory_order_release);
+			++ring->tail;
+
+			if (nrecs == TRACE_FLUSH_NRECS) {
+				if (!trace_write(trace, recs,
+						 nrecs * sizeof(*recs)))
+					atomic_fetch_add(&trace->nrecs, nrecs);
+				nrecs = 0;
+			}
+		}
+
+		if (nrecs && !trace_write(trace, recs, nrecs * sizeof(*recs)))
+			atomic_fetch_add(&trace->nrecs, nrecs);
+	}
+}
+
+void nvm_trace_rec(struct nvm_trace *trace, const struct nvm_trace_rec *rec)
+{
+	struct nvm_trace_ring *ring;
+	struct nvm_trace_cell *cell;
+	uint64_t pos;
+
+	ring = &trace->rings[nvm_thrd_slot()];
+	pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	for (;;) {
+		uint64_t seq;
+
+		cell = &ring->cells[pos & TRACE_RING_MASK];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		if (seq < pos) {		// Full, the flusher is behind
+			atomic_fetch_add(&trace->ndropped, 1);
+			return;
+		}
+		if ((seq == pos) &&
+		    atomic_compare_exchange_weak(&ring->head, &pos, pos + 1))
+			break;
+		if (seq > pos)
+			pos = atomic_load_explicit(&ring->head,
+						   memory_order_relaxed);
+	}
+
+	cell->rec = *rec;
+	cell->rec.tsc -= trace->tsc0;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+	if ((pos + 1) & (NVM_TRACE_RING_NRECS / 2 - 1))
+		return;
+
+	pthread_mutex_lock(&trace->mutex);
+	trace->kick = 1;
+	pthread_cond_signal(&trace->cond);
+	pthread_mutex_unlock(&trace->mutex);
+}
+
+/**
+ * Flusher thread, drains the rings when kicked by nvm_trace_rec, or every
+ * NVM_TRACE_FLUSH_MS, until the trace is closed
+ */
+static void *trace_flusher(void *arg)
+{
+	struct nvm_trace *trace = arg;
+
+	pthread_mutex_lock(&trace->mutex);
+	while (!trace->stop) {
+		if (!trace->kick) {
+			struct timespec ts;
+
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ts.tv_nsec += NVM_TRACE_FLUSH_MS * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait(&trace->cond, &trace->mutex,
+					       &ts);
+		}
+		trace->kick = 0;
+		pthread_mutex_unlock(&trace->mutex);
+
+		trace_flush(trace);
+
+		pthread_mutex_lock(&trace->mutex);
+	}
+	pthread_mutex_unlock(&trace->mutex);
+
+	return NULL;
+}
+
+static int trace_flusher_start(struct nvm_trace *trace)
+{
+	pthread_condattr_t attr;
+	int err;
+
+	trace->kick = 0;
+	trace->stop = 0;
+
+	err = pthread_condattr_init(&attr);
+	if (!err)
+		err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (!err)
+		err = pthread_cond_init(&trace->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	if (err) {
+		NVM_DEBUG("FAILED: pthread_cond_init");
+		errno = err;
+		return -1;
+	}
+
+	err = pthread_mutex_init(&trace->mutex, NULL);
+	if (err) {
+		NVM_DEBUG("FAILED: pthread_mutex_init");
+		pthread_cond_destroy(&trace->cond);
+		errno = err;
+		return -1;
+	}
+
+	err = pthread_create(&trace->flusher, NULL, trace_flusher, trace);
+	if (err) {
+		NVM_DEBUG("FAILED: pthread_create");
+		pthread_mutex_destroy(&trace->mutex);
+		pthread_cond_destroy(&trace->cond);
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void trace_flusher_stop(struct nvm_trace *trace)
+{
+	pthread_mutex_lock(&trace->mutex);
+	trace->stop = 1;
+	pthread_cond_signal(&trace->cond);
+	pthread_mutex_unlock(&trace->mutex);
+
+	pthread_join(trace->flusher, NULL);
+	pthread_mutex_destroy(&trace->mutex);
+	pthread_cond_destroy(&trace->cond);
+}
+
+static void trace_hdr_setup(const struct nvm_dev *dev,
+			    struct nvm_trace_hdr *hdr)
+{
+	const struct nvm_geo *geo = &dev->geo;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = NVM_TRACE_MAGIC;
+	hdr->version = NVM_TRACE_VERSION;
+	hdr->rec_nbytes = sizeof(struct nvm_trace_rec);
+	memcpy(hdr->name, dev->name, NVM_DEV_NAME_LEN - 1);
+	hdr->be_id = dev->be->id;
+	hdr->verid = dev->verid;
+	hdr->npugrp = geo->l.npugrp;
+	hdr->npunit = geo->l.npunit;
+	hdr->nchunk = geo->l.nchunk;
+	hdr->nsectr = geo->l.nsectr;
+	if (dev->verid == NVM_SPEC_VERID_12) {
+		hdr->nplanes = geo->nplanes;
+		hdr->nsectors = geo->nsectors;
+	}
+}
+
+struct nvm_trace *nvm_trace_open(const struct nvm_dev *dev, const char *path)
+{
+	struct nvm_trace *trace;
+
+	if (strlen(path) >= NVM_TRACE_PATH_LEN) {
+		NVM_DEBUG("FAILED: path too long");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	trace = calloc(1, sizeof(*trace));
+	if (!trace) {
+		NVM_DEBUG("FAILED: calloc trace");
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (int r = 0; r < NVM_TRACE_NRINGS; ++r) {
+		struct nvm_trace_ring *ring = &trace->rings[r];
+
+		atomic_init(&ring->head, 0);
+		ring->tail = 0;
+		for (uint64_t pos = 0; pos < NVM_TRACE_RING_NRECS; ++pos)
+			atomic_init(&ring->cells[pos].seq, pos);
+	}
+	atomic_init(&trace->nrecs, 0);
+	atomic_init(&trace->ndropped, 0);
+	strcpy(trace->path, path);
+
+	trace->fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (trace->fd < 0) {
+		NVM_DEBUG("FAILED: open path: %s", path);
+		free(trace);
+		return NULL;
+	}
+
+	trace_hdr_setup(dev, &trace->hdr);
+	if (trace_write(trace, &trace->hdr, sizeof(trace->hdr))) {
+		NVM_DEBUG("FAILED: trace_write hdr");
+		close(trace->fd);
+		free(trace);
+		return NULL;
+	}
+
+	trace->tsc0 = nvm_stats_tsc();
+	trace->ns0 = trace_ns();
+
+	if (trace_flusher_start(trace)) {
+		NVM_DEBUG("FAILED: trace_flusher_start");
+		close(trace->fd);
+		free(trace);
+		return NULL;
+	}
+
+	return trace;
+}
+
+int nvm_trace_close(struct nvm_trace *trace)
+{
+	struct nvm_trace_hdr *hdr;
+	uint64_t ticks, ns;
+	int err = 0;
+
+	if (!trace)
+		return 0;
+
+	ticks = nvm_stats_tsc() - trace->tsc0;
+	ns = trace_ns() - trace->ns0;
+
+	trace_flusher_stop(trace);
+	trace_flush(trace);		// Records of after the last flush
+
+	// Complete the header written by nvm_trace_open
+	hdr = &trace->hdr;
+	hdr->tps = ns ? (uint64_t)(ticks * (1e9 / ns)) : 1000000000ULL;
+	hdr->nrecs = atomic_load(&trace->nrecs);
+	hdr->ndropped = atomic_load(&trace->ndropped);
+	if (pwrite(trace->fd, hdr, sizeof(*hdr), 0) != sizeof(*hdr)) {
+		NVM_DEBUG("FAILED: pwrite hdr");
+		err = errno ? errno : EIO;
+	}
+
+	if (close(trace->fd) && !err) {
+		NVM_DEBUG("FAILED: close");
+		err = errno;
+	}
+	free(trace);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+int nvm_dev_set_trace(struct nvm_dev *dev, const char *path)
+{
+	struct nvm_trace *trace = NULL;
+
+	if (path) {
+		trace = nvm_trace_open(dev, path);
+		if (!trace) {
+			NVM_DEBUG("FAILED: nvm_trace_open");
+			return -1;
+		}
+	}
+
+	if (nvm_trace_close(dev->trace)) {
+		NVM_DEBUG("FAILED: nvm_trace_close");
+		dev->trace = trace;
+		return -1;
+	}
+	dev->trace = trace;
+
+	return 0;
+}
+
+const char *nvm_dev_get_trace(const struct nvm_dev *dev)
+{
+	return dev->trace ? dev->trace->path : NULL;
+}
@@ -31,18 +31,48 @@
 #include <errno.h>
 #include <liblightnvm.h>
 #include <nvm_dev.h>
+#include <nvm_async.h>
+#include <nvm_cmd.h>
 #include <nvm_vblk.h>
 #include <nvm_omp.h>
+#include <nvm_numa.h>
+#include <nvm_probe.h>
+#include <nvm_usdt.h>
 
 #define NVM_VBLK_CMD_OPTS (NVM_CMD_SYNC | NVM_CMD_VECTOR | NVM_CMD_PRP)
 
-int nvm_vblk_set_async(struct nvm_vblk *vblk, uint32_t depth)
+/**
+ * Fires the vblk__dispatch probe of a command of class 'op' about to be
+ * submitted on behalf of 'vblk'
+ */
+#ifdef NVM_USDT_ENABLED
+static inline void vblk_usdt_dispatch(struct nvm_vblk *vblk, int op,
+				      const struct nvm_addr addrs[], int naddrs,
+				      uint16_t flags)
+{
+	NVM_USDT5(vblk__dispatch, vblk->dev->name,
+		  nvm_cmd_opcode(vblk->dev, op, flags), addrs[0].val, naddrs,
+		  vblk);
+}
+#else
+#define vblk_usdt_dispatch(vblk, op, addrs, naddrs, flags)
+#endif
+
+int nvm_vblk_set_async_opts(struct nvm_vblk *vblk, uint32_t depth,
+			    uint16_t opts)
 {
+	if ((opts & NVM_ASYNC_SEQ) &&
+	    (nvm_dev_get_verid(vblk->dev) != NVM_SPEC_VERID_20)) {
+		NVM_DEBUG("FAILED: NVM_ASYNC_SEQ requires OCSSD 2.0");
+		errno = EINVAL;
+		return -1;
+	}
+
 	vblk->flags &= ~NVM_CMD_SYNC;
 	vblk->flags |= NVM_CMD_ASYNC;
 
 	if (!vblk->async_ctx) {
-		if (NULL == (vblk->async_ctx = nvm_async_init(vblk->dev, depth, 0))) {
+		if (NULL == (vblk->async_ctx = nvm_async_init(vblk->dev, depth, opts))) {
 			NVM_DEBUG("FAILED: nvm_async_init");
 			return -1;
 		}
@@ -60,6 +90,11 @@ int nvm_vblk_set_async(struct nvm_vblk *vblk, uint32_t depth)
 	return 0;
 }
 
+int nvm_vblk_set_async(struct nvm_vblk *vblk, uint32_t depth)
+{
+	return nvm_vblk_set_async_opts(vblk, depth, 0x0);
+}
+
 int nvm_vblk_set_scalar(struct nvm_vblk *vblk)
 {
 	vblk->flags &= ~NVM_CMD_VECTOR;
@@ -236,12 +271,17 @@ static inline ssize_t vblk_erase_s12(struct nvm_vblk *vblk)
 
 		struct nvm_addr addrs[naddrs];
 
+		NVM_PROBE_BGN(clk_addr);
 		for (int i = 0; i < naddrs; ++i) {
 			const int idx = off + (i / BLK_NADDRS);
 
 			addrs[i].ppa = vblk->blks[idx].ppa;
 			addrs[i].g.pl = i % geo->nplanes;
 		}
+		NVM_PROBE_END(vblk->dev, NVM_DEV_PROBE_ADDR, clk_addr);
+
+		vblk_usdt_dispatch(vblk, NVM_DEV_STATS_ERASE,
+				   addrs, naddrs, pmode | NVM_VBLK_CMD_OPTS);
 
 		err = nvm_cmd_erase(vblk->dev, addrs, naddrs, NULL,
 				    pmode | NVM_VBLK_CMD_OPTS, &ret);
@@ -273,8 +313,12 @@ static inline ssize_t vblk_erase_s20(struct nvm_vblk *vblk)
 
 		struct nvm_addr addrs[naddrs];
 
+		NVM_PROBE_BGN(clk_addr);
 		for (int i = 0; i < naddrs; ++i)
 			addrs[i].ppa = vblk->blks[off + i].ppa;
+		NVM_PROBE_END(vblk->dev, NVM_DEV_PROBE_ADDR, clk_addr);
+
+		vblk_usdt_dispatch(vblk, NVM_DEV_STATS_ERASE, addrs, naddrs, 0x0);
 
 		if (nvm_cmd_erase(vblk->dev, addrs, naddrs, NULL, 0x0, &ret))
 			++nerr;
@@ -349,6 +393,7 @@ static inline int vblk_io_async(struct nvm_vblk *vblk, const size_t vsectr_bgn,
 	const size_t nsectrs = count / sectr_nbytes;
 	const size_t stripe_nsectrs = nvm_dev_get_ws_opt(vblk->dev);
 	const size_t nstripes = nsectrs / stripe_nsectrs;
+	const int seq = vblk->async_ctx->flags & NVM_ASYNC_SEQ;
 
 	int err;
 	uint64_t nerr = 0;
@@ -368,10 +413,12 @@ static inline int vblk_io_async(struct nvm_vblk *vblk, const size_t vsectr_bgn,
 			(char *)buf + (sectr_nbytes * stripe_nsectrs * stripe);
 
 		struct nvm_addr addrs[stripe_nsectrs];
+		NVM_PROBE_BGN(clk_addr);
 		for (size_t i = 0; i < stripe_nsectrs; i++) {
 			addrs[i].val = vblk->blks[cnk_idx].val;
 			addrs[i].l.sectr = cnk_off + i;
 		}
+		NVM_PROBE_END(vblk->dev, NVM_DEV_PROBE_ADDR, clk_addr);
 
 		// this basically makes sure we never hit an EAGAIN below in
 		// the nvm_cmd_read/write call.
@@ -393,6 +440,10 @@ static inline int vblk_io_async(struct nvm_vblk *vblk, const size_t vsectr_bgn,
 		ret->async.cb = vblk_async_callback;
 		ret->async.cb_arg = &state;
 
+		vblk_usdt_dispatch(vblk,
+				   write ? NVM_DEV_STATS_WRITE : NVM_DEV_STATS_READ,
+				   addrs, stripe_nsectrs, vblk->flags);
+
 		while(1) {
 			err = write ?
 				nvm_cmd_write(vblk->dev, addrs, stripe_nsectrs,
@@ -420,7 +471,9 @@ static inline int vblk_io_async(struct nvm_vblk *vblk, const size_t vsectr_bgn,
 		}
 
 
-		if (((stripe + 1) % vblk->nblks) == 0) {
+		// Without the sequencer, keep at most one stripe per chunk
+		// outstanding to preserve write-pointer order
+		if (!seq && (((stripe + 1) % vblk->nblks) == 0)) {
 			if (nvm_async_wait(vblk->dev, vblk->async_ctx) < 0) {
 				NVM_DEBUG("FAILED: nvm_async_wait");
 				return -1;
@@ -589,30 +642,42 @@ static inline ssize_t vblk_sync_pread_s20(struct nvm_vblk *vblk, void *buf,
 
 	const int VBLK_FLAGS = vblk->flags;
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t sectr_ofz = sectr_bgn; sectr_ofz <= sectr_end; sectr_ofz += cmd_nsectr) {
-		struct nvm_addr addrs[cmd_nsectr];
-		char *buf_off = (char*)buf + (sectr_ofz - sectr_bgn) * sectr_nbytes;
+	#pragma omp parallel num_threads(NTHREADS) if(NTHREADS>1)
+	{
+		nvm_numa_affinity_apply(vblk->dev);
 
-		for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
-			const size_t sectr = sectr_ofz + idx;
-			const size_t wunit = sectr / WS_OPT;
-			const size_t rnd = wunit / nchunks;
+		#pragma omp for schedule(static,1) reduction(+:nerr) ordered
+		for (size_t sectr_ofz = sectr_bgn; sectr_ofz <= sectr_end; sectr_ofz += cmd_nsectr) {
+			struct nvm_addr addrs[cmd_nsectr];
+			char *buf_off = (char*)buf + (sectr_ofz - sectr_bgn) * sectr_nbytes;
 
-			const size_t chunk = wunit % nchunks;
-			const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
+			NVM_PROBE_BGN(clk_addr);
+			for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
+				const size_t sectr = sectr_ofz + idx;
+				const size_t wunit = sectr / WS_OPT;
+				const size_t rnd = wunit / nchunks;
+
+				const size_t chunk = wunit % nchunks;
+				const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
+
+				addrs[idx].val = vblk->blks[chunk].val;
+				addrs[idx].l.sectr = chunk_sectr;
+
+				if (VBLK_FLAGS & NVM_CMD_SCALAR) break;
+			}
+			NVM_PROBE_END(vblk->dev, NVM_DEV_PROBE_ADDR, clk_addr);
 
-			addrs[idx].val = vblk->blks[chunk].val;
-			addrs[idx].l.sectr = chunk_sectr;
+			vblk_usdt_dispatch(vblk, NVM_DEV_STATS_READ,
+					   addrs, cmd_nsectr, VBLK_FLAGS);
 
-			if (VBLK_FLAGS & NVM_CMD_SCALAR) break;
+			const ssize_t err = nvm_cmd_read(vblk->dev, addrs, cmd_nsectr,
+							 buf_off, NULL,
+							 VBLK_FLAGS, NULL);
+			if (err)
+				++nerr;
 		}
 
-		const ssize_t err = nvm_cmd_read(vblk->dev, addrs, cmd_nsectr,
-						 buf_off, NULL,
-						 VBLK_FLAGS, NULL);
-		if (err)
-			++nerr;
+		nvm_numa_affinity_restore();
 	}
 
 	if (nerr) {
@@ -699,38 +764,50 @@ static inline ssize_t vblk_sync_pwrite_s20(struct nvm_vblk *vblk,
 
 	const int VBLK_FLAGS = vblk->flags;
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t sectr_ofz = sectr_bgn; sectr_ofz <= sectr_end; sectr_ofz += cmd_nsectr) {
-		struct nvm_ret ret = { 0 };
+	#pragma omp parallel num_threads(NTHREADS) if(NTHREADS>1)
+	{
+		nvm_numa_affinity_apply(vblk->dev);
 
-		struct nvm_addr addrs[cmd_nsectr];
-		char *buf_off;
+		#pragma omp for schedule(static,1) reduction(+:nerr) ordered
+		for (size_t sectr_ofz = sectr_bgn; sectr_ofz <= sectr_end; sectr_ofz += cmd_nsectr) {
+			struct nvm_ret ret = { 0 };
 
-		if (pad_buf)
-			buf_off = pad_buf;
-		else
-			buf_off = (char*)buf + (sectr_ofz - sectr_bgn) * sectr_nbytes;
+			struct nvm_addr addrs[cmd_nsectr];
+			char *buf_off;
 
-		for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
-			const size_t sectr = sectr_ofz + idx;
-			const size_t wunit = sectr / WS_OPT;
-			const size_t rnd = wunit / nchunks;
+			if (pad_buf)
+				buf_off = pad_buf;
+			else
+				buf_off = (char*)buf + (sectr_ofz - sectr_bgn) * sectr_nbytes;
 
-			const size_t chunk = wunit % nchunks;
-			const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
+			NVM_PROBE_BGN(clk_addr);
+			for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
+				const size_t sectr = sectr_ofz + idx;
+				const size_t wunit = sectr / WS_OPT;
+				const size_t rnd = wunit / nchunks;
 
-			addrs[idx].ppa = vblk->blks[chunk].ppa;
-			addrs[idx].l.sectr = chunk_sectr;
-		}
+				const size_t chunk = wunit % nchunks;
+				const size_t chunk_sectr = sectr % WS_OPT + rnd * WS_OPT;
 
-		const ssize_t err = nvm_cmd_write(vblk->dev, addrs, cmd_nsectr,
-						  buf_off, meta_buf,
-						  VBLK_FLAGS, &ret);
-		if (err)
-			++nerr;
+				addrs[idx].ppa = vblk->blks[chunk].ppa;
+				addrs[idx].l.sectr = chunk_sectr;
+			}
+			NVM_PROBE_END(vblk->dev, NVM_DEV_PROBE_ADDR, clk_addr);
+
+			vblk_usdt_dispatch(vblk, NVM_DEV_STATS_WRITE,
+					   addrs, cmd_nsectr, VBLK_FLAGS);
 
-		#pragma omp ordered
-		{}
+			const ssize_t err = nvm_cmd_write(vblk->dev, addrs, cmd_nsectr,
+							  buf_off, meta_buf,
+							  VBLK_FLAGS, &ret);
+			if (err)
+				++nerr;
+
+			#pragma omp ordered
+			{}
+		}
+
+		nvm_numa_affinity_restore();
 	}
 
 	nvm_buf_free(vblk->dev, pad_buf);
@@ -812,39 +889,50 @@ static inline ssize_t vblk_pwrite_s12(struct nvm_vblk *vblk, const void *buf,
 		}
 	}
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
-		struct nvm_ret ret = { 0 };
+	#pragma omp parallel num_threads(NTHREADS) if(NTHREADS>1)
+	{
+		nvm_numa_affinity_apply(vblk->dev);
 
-		const int nspages = NVM_MIN(CMD_NSPAGES, (int)(end - off));
-		const int naddrs = nspages * SPAGE_NADDRS;
+		#pragma omp for schedule(static,1) reduction(+:nerr) ordered
+		for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
+			struct nvm_ret ret = { 0 };
 
-		struct nvm_addr addrs[naddrs];
-		const char *buf_off;
+			const int nspages = NVM_MIN(CMD_NSPAGES, (int)(end - off));
+			const int naddrs = nspages * SPAGE_NADDRS;
 
-		if (padding_buf)
-			buf_off = padding_buf;
-		else
-			buf_off = (const char*)buf + (off - bgn) * geo->sector_nbytes * SPAGE_NADDRS;
+			struct nvm_addr addrs[naddrs];
+			const char *buf_off;
 
-		for (int i = 0; i < naddrs; ++i) {
-			const int spg = off + (i / SPAGE_NADDRS);
-			const int idx = spg % vblk->nblks;
-			const int pg = (spg / vblk->nblks) % geo->npages;
+			if (padding_buf)
+				buf_off = padding_buf;
+			else
+				buf_off = (const char*)buf + (off - bgn) * geo->sector_nbytes * SPAGE_NADDRS;
 
-			addrs[i].ppa = vblk->blks[idx].ppa;
-			addrs[i].g.pg = pg;
-			addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
-			addrs[i].g.sec = i % geo->nsectors;
-		}
+			NVM_PROBE_BGN(clk_addr);
+			for (int i = 0; i < naddrs; ++i) {
+				const int spg = off + (i / SPAGE_NADDRS);
+				const int idx = spg % vblk->nblks;
+				const int pg = (spg / vblk->nblks) % geo->npages;
 
-		const ssize_t err = nvm_cmd_write(vblk->dev, addrs, naddrs,
-						   buf_off, meta, PMODE, &ret);
-		if (err)
-			++nerr;
+				addrs[i].ppa = vblk->blks[idx].ppa;
+				addrs[i].g.pg = pg;
+				addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+				addrs[i].g.sec = i % geo->nsectors;
+			}
+			NVM_PROBE_END(vblk->dev, NVM_DEV_PROBE_ADDR, clk_addr);
+
+			vblk_usdt_dispatch(vblk, NVM_DEV_STATS_WRITE, addrs, naddrs, PMODE);
 
-		#pragma omp ordered
-		{}
+			const ssize_t err = nvm_cmd_write(vblk->dev, addrs, naddrs,
+							   buf_off, meta, PMODE, &ret);
+			if (err)
+				++nerr;
+
+			#pragma omp ordered
+			{}
+		}
+
+		nvm_numa_affinity_restore();
 	}
 
 	nvm_buf_free(vblk->dev, padding_buf);
@@ -926,36 +1014,47 @@ static inline ssize_t vblk_pread_s12(struct nvm_vblk *vblk, void *buf,
 		return -1;
 	}
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
-		struct nvm_ret ret = { 0 };
+	#pragma omp parallel num_threads(NTHREADS) if(NTHREADS>1)
+	{
+		nvm_numa_affinity_apply(vblk->dev);
 
-		const int nspages = NVM_MIN(CMD_NSPAGES, (int)(end - off));
-		const int naddrs = nspages * SPAGE_NADDRS;
+		#pragma omp for schedule(static,1) reduction(+:nerr) ordered
+		for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
+			struct nvm_ret ret = { 0 };
 
-		struct nvm_addr addrs[naddrs];
-		char *buf_off;
+			const int nspages = NVM_MIN(CMD_NSPAGES, (int)(end - off));
+			const int naddrs = nspages * SPAGE_NADDRS;
 
-		buf_off = (char*)buf + (off - bgn) * geo->sector_nbytes * SPAGE_NADDRS;
+			struct nvm_addr addrs[naddrs];
+			char *buf_off;
 
-		for (int i = 0; i < naddrs; ++i) {
-			const int spg = off + (i / SPAGE_NADDRS);
-			const int idx = spg % vblk->nblks;
-			const int pg = (spg / vblk->nblks) % geo->npages;
+			buf_off = (char*)buf + (off - bgn) * geo->sector_nbytes * SPAGE_NADDRS;
 
-			addrs[i].ppa = vblk->blks[idx].ppa;
-			addrs[i].g.pg = pg;
-			addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
-			addrs[i].g.sec = i % geo->nsectors;
-		}
+			NVM_PROBE_BGN(clk_addr);
+			for (int i = 0; i < naddrs; ++i) {
+				const int spg = off + (i / SPAGE_NADDRS);
+				const int idx = spg % vblk->nblks;
+				const int pg = (spg / vblk->nblks) % geo->npages;
 
-		const ssize_t err = nvm_cmd_read(vblk->dev, addrs, naddrs,
-						 buf_off, NULL, PMODE, &ret);
-		if (err)
-			++nerr;
+				addrs[i].ppa = vblk->blks[idx].ppa;
+				addrs[i].g.pg = pg;
+				addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+				addrs[i].g.sec = i % geo->nsectors;
+			}
+			NVM_PROBE_END(vblk->dev, NVM_DEV_PROBE_ADDR, clk_addr);
+
+			vblk_usdt_dispatch(vblk, NVM_DEV_STATS_READ, addrs, naddrs, PMODE);
 
-		#pragma omp ordered
-		{}
+			const ssize_t err = nvm_cmd_read(vblk->dev, addrs, naddrs,
+							 buf_off, NULL, PMODE, &ret);
+			if (err)
+				++nerr;
+
+			#pragma omp ordered
+			{}
+		}
+
+		nvm_numa_affinity_restore();
 	}
 
 	if (nerr) {
@@ -1040,6 +1139,7 @@ static inline ssize_t vblk_copy_s20(struct nvm_vblk *src, struct nvm_vblk *dst)
 		struct nvm_addr addrs_src[cmd_nsectr];
 		struct nvm_addr addrs_dst[cmd_nsectr];
 
+		NVM_PROBE_BGN(clk_addr);
 		for (size_t idx = 0; idx < cmd_nsectr; ++idx) {
 			const size_t sectr = sectr_ofz + idx;
 			const size_t wunit = sectr / WS_MIN;
@@ -1054,6 +1154,10 @@ static inline ssize_t vblk_copy_s20(struct nvm_vblk *src, struct nvm_vblk *dst)
 			addrs_dst[idx].val = dst->blks[chunk].val;
 			addrs_dst[idx].l.sectr = chunk_sectr;
 		}
+		NVM_PROBE_END(src->dev, NVM_DEV_PROBE_ADDR, clk_addr);
+
+		vblk_usdt_dispatch(src, NVM_DEV_STATS_COPY,
+				   addrs_src, cmd_nsectr, NVM_VBLK_CMD_OPTS);
 
 		const ssize_t err = nvm_cmd_copy(src->dev, addrs_src,
 						 addrs_dst, cmd_nsectr,
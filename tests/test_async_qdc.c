@@ -0,0 +1,185 @@
+/*
+ * test_async_qdc.c - verify the per-PU queue-depth controller of ASYNC
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include <errno.h>
+
+#include "test_util.h"
+#include "test_intf.c"
+
+#include <CUnit/Basic.h>
+
+#define QDC_DEPTH 8
+
+static void callback(struct nvm_ret *NVM_UNUSED(ret), void *cb_arg)
+{
+	int *ncpls = cb_arg;
+
+	++(*ncpls);
+}
+
+/**
+ * Limits start out below the depth of the context, unknown parallel units
+ * have none, and without the controller the limit is the depth
+ */
+static void test_async_qdc_limits(void)
+{
+	const int npus = GEO->l.npugrp * GEO->l.npunit;
+	struct nvm_async_ctx *ctx;
+
+	SPEC_20_ONLY;
+
+	ctx = nvm_async_init(DEV, QDC_DEPTH, NVM_ASYNC_QDC);
+	if (!ctx) {
+		CU_PASS("ASYNC not supported by backend; skipping test");
+		return;
+	}
+
+	for (int pu = 0; pu < npus; ++pu) {
+		const uint32_t limit = nvm_async_get_pu_limit(ctx, pu);
+
+		CU_ASSERT(limit >= 1);
+		CU_ASSERT(limit < QDC_DEPTH);
+	}
+	CU_ASSERT_EQUAL(nvm_async_get_pu_limit(ctx, -1), 0);
+	CU_ASSERT_EQUAL(nvm_async_get_pu_limit(ctx, npus), 0);
+
+	CU_ASSERT(!nvm_async_term(DEV, ctx));
+
+	ctx = nvm_async_init(DEV, QDC_DEPTH, 0x0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+	CU_ASSERT_EQUAL(nvm_async_get_pu_limit(ctx, 0), QDC_DEPTH);
+	CU_ASSERT(!nvm_async_term(DEV, ctx));
+}
+
+/**
+ * Reads beyond the limit of a parallel unit are refused with EAGAIN, until
+ * completions make room, while other parallel units are unaffected
+ */
+static void test_async_qdc_admission(void)
+{
+	struct nvm_ret rets[QDC_DEPTH];
+	struct nvm_async_ctx *ctx;
+	struct nvm_addr addr, other;
+	struct nvm_ret ret = { 0 };
+	uint32_t limit;
+	int ncpls = 0;
+	char *buf;
+
+	SPEC_20_ONLY;
+
+	ctx = nvm_async_init(DEV, QDC_DEPTH, NVM_ASYNC_QDC);
+	if (!ctx) {
+		CU_PASS("ASYNC not supported by backend; skipping test");
+		return;
+	}
+
+	buf = nvm_buf_alloc(DEV, (QDC_DEPTH + 1) * SECTOR_SIZE, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+
+	memset(rets, 0, sizeof(rets));
+
+	addr.val = 0;
+	limit = nvm_async_get_pu_limit(ctx, 0);
+
+	for (uint32_t idx = 0; idx < limit; ++idx) {
+		rets[idx].async.ctx = ctx;
+		rets[idx].async.cb = callback;
+		rets[idx].async.cb_arg = &ncpls;
+
+		CU_ASSERT(!nvm_cmd_read(DEV, &addr, 1,
+					buf + idx * SECTOR_SIZE, NULL,
+					NVM_CMD_VECTOR | NVM_CMD_ASYNC,
+					&rets[idx]));
+	}
+
+	ret.async.ctx = ctx;
+	ret.async.cb = callback;
+	ret.async.cb_arg = &ncpls;
+
+	if (!ncpls) {			// Not completed during submission
+		errno = 0;
+		CU_ASSERT(nvm_cmd_read(DEV, &addr, 1,
+				       buf + QDC_DEPTH * SECTOR_SIZE, NULL,
+				       NVM_CMD_VECTOR | NVM_CMD_ASYNC, &ret));
+		CU_ASSERT_EQUAL(errno, EAGAIN);
+	}
+
+	if (GEO->l.npunit > 1) {
+		other.val = 0;
+		other.l.punit = 1;
+
+		CU_ASSERT(!nvm_cmd_read(DEV, &other, 1,
+					buf + QDC_DEPTH * SECTOR_SIZE, NULL,
+					NVM_CMD_VECTOR | NVM_CMD_ASYNC, &ret));
+	}
+
+	CU_ASSERT(nvm_async_wait(DEV, ctx) >= 0);
+	CU_ASSERT_EQUAL(nvm_async_get_outstanding(ctx), 0);
+
+	CU_ASSERT(!nvm_cmd_read(DEV, &addr, 1, buf, NULL,
+				NVM_CMD_VECTOR | NVM_CMD_ASYNC, &rets[0]));
+	CU_ASSERT(nvm_async_wait(DEV, ctx) >= 0);
+
+	CU_ASSERT(!nvm_async_term(DEV, ctx));
+
+	nvm_buf_free(DEV, buf);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_async_qdc", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "nvm_async_qdc limits", test_async_qdc_limits))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_async_qdc admission", test_async_qdc_admission))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
@@ -0,0 +1,165 @@
+/*
+ * test_async_sched.c - verify read-priority scheduling of ASYNC
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <errno.h>
+
+#include "test_util.h"
+#include "test_intf.c"
+
+#include <CUnit/Basic.h>
+
+#define SCHED_DEPTH 4
+
+static void callback(struct nvm_ret *NVM_UNUSED(ret), void *cb_arg)
+{
+	int *ncpls = cb_arg;
+
+	++(*ncpls);
+}
+
+static void test_async_sched_prio(void)
+{
+	struct nvm_async_ctx *ctx;
+
+	ctx = nvm_async_init(DEV, SCHED_DEPTH, NVM_ASYNC_SCHED);
+	if (!ctx) {
+		CU_PASS("ASYNC not supported by backend; skipping test");
+		return;
+	}
+
+	CU_ASSERT_EQUAL(nvm_async_get_prio(ctx), NVM_ASYNC_PRIO_NORMAL);
+
+	CU_ASSERT(!nvm_async_set_prio(ctx, NVM_ASYNC_PRIO_LOW));
+	CU_ASSERT_EQUAL(nvm_async_get_prio(ctx), NVM_ASYNC_PRIO_LOW);
+
+	CU_ASSERT(nvm_async_set_prio(ctx, NVM_ASYNC_PRIO_LOW + 1));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+	CU_ASSERT(nvm_async_set_prio(ctx, -1));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+	CU_ASSERT_EQUAL(nvm_async_get_prio(ctx), NVM_ASYNC_PRIO_LOW);
+
+	CU_ASSERT(!nvm_async_term(DEV, ctx));
+}
+
+/**
+ * An erase submitted while a read of a context of higher priority is in
+ * flight on its parallel unit is held back until the read has completed
+ */
+static void test_async_sched_erase(void)
+{
+	struct nvm_async_ctx *rctx, *ectx;
+	struct nvm_ret rret = { 0 };
+	struct nvm_ret eret = { 0 };
+	struct nvm_addr chunk;
+	int nrcpls = 0;
+	int necpls = 0;
+	char *buf;
+
+	SPEC_20_ONLY;
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 1, &chunk)) {
+		CU_FAIL("nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	rctx = nvm_async_init(DEV, SCHED_DEPTH, NVM_ASYNC_SCHED);
+	if (!rctx) {
+		CU_PASS("ASYNC not supported by backend; skipping test");
+		return;
+	}
+	ectx = nvm_async_init(DEV, SCHED_DEPTH, NVM_ASYNC_SCHED);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ectx);
+
+	CU_ASSERT(!nvm_async_set_prio(rctx, NVM_ASYNC_PRIO_HIGH));
+	CU_ASSERT(!nvm_async_set_prio(ectx, NVM_ASYNC_PRIO_LOW));
+
+	buf = nvm_buf_alloc(DEV, SECTOR_SIZE, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+
+	rret.async.ctx = rctx;
+	rret.async.cb = callback;
+	rret.async.cb_arg = &nrcpls;
+
+	eret.async.ctx = ectx;
+	eret.async.cb = callback;
+	eret.async.cb_arg = &necpls;
+
+	CU_ASSERT(!nvm_cmd_read(DEV, &chunk, 1, buf, NULL,
+				NVM_CMD_VECTOR | NVM_CMD_ASYNC, &rret));
+	CU_ASSERT(!nvm_cmd_erase(DEV, &chunk, 1, NULL,
+				 NVM_CMD_VECTOR | NVM_CMD_ASYNC, &eret));
+
+	if (!nrcpls)			// Not completed during submission
+		CU_ASSERT_EQUAL(nvm_async_get_outstanding(ectx), 0);
+
+	CU_ASSERT(nvm_async_wait(DEV, rctx) >= 0);
+	CU_ASSERT_EQUAL(nrcpls, 1);
+
+	CU_ASSERT(nvm_async_wait(DEV, ectx) >= 0);
+	CU_ASSERT_EQUAL(necpls, 1);
+	CU_ASSERT_EQUAL(eret.status, 0);
+	CU_ASSERT_EQUAL(nvm_async_get_outstanding(ectx), 0);
+
+	CU_ASSERT(!nvm_async_term(DEV, ectx));
+	CU_ASSERT(!nvm_async_term(DEV, rctx));
+
+	nvm_buf_free(DEV, buf);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_async_sched", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "nvm_async_sched prio", test_async_sched_prio))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_async_sched erase held back", test_async_sched_erase))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
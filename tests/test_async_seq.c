@@ -0,0 +1,218 @@
+/*
+ * test_async_seq.c - verify per-chunk sequencing of ASYNC writes
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include <errno.h>
+
+#include "test_util.h"
+#include "test_intf.c"
+
+#include <CUnit/Basic.h>
+
+static void callback(struct nvm_ret *ret, void *cb_arg)
+{
+	int *nerr = cb_arg;
+
+	if (ret->status)
+		++(*nerr);
+}
+
+/**
+ * Submit the writes of a chunk in reverse order, with the sequencer they must
+ * reach the device in write-pointer order
+ */
+static void test_async_seq_reverse(void)
+{
+	const uint32_t nstripes = NSECTR / WS_MIN;
+	const size_t nbytes = NSECTR * SECTOR_SIZE;
+	struct nvm_async_ctx *ctx;
+	struct nvm_ret *rets;
+	struct nvm_addr chunk;
+	char *buf_w, *buf_r;
+	int nerr = 0;
+
+	SPEC_20_ONLY;
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 1, &chunk)) {
+		CU_FAIL("nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	ctx = nvm_async_init(DEV, nstripes, NVM_ASYNC_SEQ);
+	if (!ctx) {
+		CU_PASS("ASYNC not supported by backend; skipping test");
+		return;
+	}
+
+	rets = calloc(nstripes, sizeof(*rets));
+	buf_w = nvm_buf_alloc(DEV, nbytes, NULL);
+	buf_r = nvm_buf_alloc(DEV, nbytes, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rets);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf_w);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf_r);
+
+	nvm_buf_fill(buf_w, nbytes);
+	memset(buf_r, 0, nbytes);
+
+	for (uint32_t stripe = nstripes; stripe-- > 0; ) {
+		struct nvm_addr addrs[WS_MIN];
+		struct nvm_ret *ret = &rets[stripe];
+
+		for (uint32_t idx = 0; idx < WS_MIN; ++idx) {
+			addrs[idx].val = chunk.val;
+			addrs[idx].l.sectr = stripe * WS_MIN + idx;
+		}
+
+		ret->async.ctx = ctx;
+		ret->async.cb = callback;
+		ret->async.cb_arg = &nerr;
+
+		CU_ASSERT(!nvm_cmd_write(DEV, addrs, WS_MIN,
+					 buf_w + stripe * WS_MIN * SECTOR_SIZE,
+					 NULL, NVM_CMD_VECTOR | NVM_CMD_ASYNC,
+					 ret));
+	}
+
+	CU_ASSERT(nvm_async_wait(DEV, ctx) >= 0);
+	CU_ASSERT_EQUAL(nvm_async_get_outstanding(ctx), 0);
+	CU_ASSERT_EQUAL(nerr, 0);
+
+	nvm_test_rprt_assert_wp(chunk, NSECTR);
+	nvm_test_rprt_assert_state(chunk, NVM_CHUNK_STATE_CLOSED);
+
+	nvm_test_vector_read_ok(chunk, NSECTR, buf_r, buf_w);
+
+	CU_ASSERT(!nvm_async_term(DEV, ctx));
+
+	nvm_buf_free(DEV, buf_r);
+	nvm_buf_free(DEV, buf_w);
+	free(rets);
+}
+
+/**
+ * Submit all but the first write of a chunk, the predecessor never arrives,
+ * thus wait must fail the held back writes instead of waiting forever
+ */
+static void test_async_seq_gap(void)
+{
+	const uint32_t nstripes = NSECTR / WS_MIN;
+	const size_t nbytes = NSECTR * SECTOR_SIZE;
+	struct nvm_async_ctx *ctx;
+	struct nvm_ret *rets;
+	struct nvm_addr chunk;
+	struct nvm_ret ret = { 0 };
+	char *buf_w;
+	int nerr = 0;
+
+	SPEC_20_ONLY;
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 1, &chunk)) {
+		CU_FAIL("nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	ctx = nvm_async_init(DEV, nstripes, NVM_ASYNC_SEQ);
+	if (!ctx) {
+		CU_PASS("ASYNC not supported by backend; skipping test");
+		return;
+	}
+
+	rets = calloc(nstripes, sizeof(*rets));
+	buf_w = nvm_buf_alloc(DEV, nbytes, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rets);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf_w);
+
+	nvm_buf_fill(buf_w, nbytes);
+
+	for (uint32_t stripe = 1; stripe < nstripes; ++stripe) {
+		struct nvm_addr addrs[WS_MIN];
+		struct nvm_ret *ret = &rets[stripe];
+
+		for (uint32_t idx = 0; idx < WS_MIN; ++idx) {
+			addrs[idx].val = chunk.val;
+			addrs[idx].l.sectr = stripe * WS_MIN + idx;
+		}
+
+		ret->async.ctx = ctx;
+		ret->async.cb = callback;
+		ret->async.cb_arg = &nerr;
+
+		CU_ASSERT(!nvm_cmd_write(DEV, addrs, WS_MIN,
+					 buf_w + stripe * WS_MIN * SECTOR_SIZE,
+					 NULL, NVM_CMD_VECTOR | NVM_CMD_ASYNC,
+					 ret));
+	}
+
+	CU_ASSERT_EQUAL(nvm_async_wait(DEV, ctx), (int)(nstripes - 1));
+	CU_ASSERT_EQUAL(nvm_async_get_outstanding(ctx), 0);
+	CU_ASSERT_EQUAL(nerr, (int)(nstripes - 1));
+
+	nvm_test_rprt_assert_wp(chunk, 0);
+	nvm_test_rprt_assert_state(chunk, NVM_CHUNK_STATE_FREE);
+
+	CU_ASSERT(!nvm_async_term(DEV, ctx));
+
+	// Erasing the chunk clears its failure
+	CU_ASSERT(!nvm_cmd_erase(DEV, &chunk, 1, NULL, NVM_CMD_VECTOR, &ret));
+
+	nvm_buf_free(DEV, buf_w);
+	free(rets);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_async_seq", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "nvm_async_seq reverse submission", test_async_seq_reverse))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_async_seq missing predecessor", test_async_seq_gap))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
@@ -200,6 +200,21 @@ static void bbt_mark_naddr(unsigned int naddr_pr_call, int bbts_cached)
 			}
 		}
 	}
+
+	if (bbts_cached && (nstates > 1)) {
+		const struct nvm_bbt *bbt;
+		struct nvm_addr bad[2] = { addrs[0], addrs[0] };
+		const int idx = addrs[0].g.blk * GEO->nplanes + addrs[0].g.pl;
+
+		// An invalid address fails the call before any table changes
+		bad[1].g.blk = GEO->nblocks;
+		CU_ASSERT(nvm_bbt_mark(DEV, bad, 2, states[0], &ret));
+		CU_ASSERT_EQUAL(errno, EINVAL);
+
+		bbt = nvm_bbt_get(DEV, lun_addr, &ret);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(bbt);
+		CU_ASSERT_EQUAL(bbt->blks[idx], states[nstates - 1]);
+	}
 }
 
 void test_BBT_MARK_NADDR_MAX(void)
@@ -383,6 +398,140 @@ void test_BBT_SET_CACHED(void)
 	bbt_set(1);
 }
 
+/**
+ * Test that all tables can be fetched, saved to and loaded from a snapshot
+ */
+void test_BBT_SNAPSHOT(void)
+{
+	const char *path = "/tmp/nvm_test_bbt.snap";
+	struct nvm_addr lun_addr = arb_lun_addr();
+	struct nvm_ret ret = { 0 };
+	struct nvm_bbt *bbt_exp;
+	const struct nvm_bbt *bbt;
+
+	if (NVM_SPEC_VERID_12 != nvm_dev_get_verid(DEV)) {
+		CU_FAIL("FAILED: device is NOT spec. 1.2");
+		return;
+	}
+
+	nvm_dev_set_bbts_cached(DEV, 1);
+	if (nvm_bbt_flush_all(DEV, &ret) || nvm_bbt_get_all(DEV, &ret)) {
+		CU_FAIL("FAILED: nvm_bbt_flush_all / nvm_bbt_get_all");
+		goto out;
+	}
+
+	bbt_exp = nvm_bbt_alloc_cp(nvm_bbt_get(DEV, lun_addr, &ret));
+	if (!bbt_exp) {
+		CU_FAIL("FAILED: nvm_bbt_get");
+		goto out;
+	}
+
+	CU_ASSERT(!nvm_bbt_save(DEV, path, 1));
+	CU_ASSERT(!nvm_bbt_flush_all(DEV, &ret));
+
+	// Another generation is rejected
+	CU_ASSERT(nvm_bbt_load(DEV, path, 2));
+	CU_ASSERT_EQUAL(errno, ESTALE);
+
+	CU_ASSERT(!nvm_bbt_load(DEV, path, 1));
+
+	bbt = nvm_bbt_get(DEV, lun_addr, &ret);
+	CU_ASSERT_PTR_NOT_NULL(bbt);
+	if (bbt) {
+		CU_ASSERT_EQUAL(bbt->nblks, bbt_exp->nblks);
+		CU_ASSERT(!memcmp(bbt->blks, bbt_exp->blks,
+				  bbt->nblks * sizeof(*bbt->blks)));
+		verify_counters(bbt);
+	}
+
+	CU_ASSERT(!nvm_bbt_flush_all(DEV, &ret));
+	nvm_bbt_free(bbt_exp);
+
+out:
+	nvm_dev_set_bbts_cached(DEV, 0);
+	remove(path);
+}
+
+/**
+ * Test that the tables loaded from a snapshot are cached for the LUN they were
+ * taken of, for every LUN of every channel
+ */
+void test_BBT_SNAPSHOT_ALL(void)
+{
+	const char *path = "/tmp/nvm_test_bbt_all.snap";
+	const size_t nluns = GEO->nchannels * GEO->nluns;
+	struct nvm_ret ret = { 0 };
+	struct nvm_bbt **bbts_exp;
+
+	if (NVM_SPEC_VERID_12 != nvm_dev_get_verid(DEV)) {
+		CU_FAIL("FAILED: device is NOT spec. 1.2");
+		return;
+	}
+
+	bbts_exp = calloc(nluns, sizeof(*bbts_exp));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(bbts_exp);
+
+	nvm_dev_set_bbts_cached(DEV, 1);
+	if (nvm_bbt_flush_all(DEV, &ret) || nvm_bbt_get_all(DEV, &ret)) {
+		CU_FAIL("FAILED: nvm_bbt_flush_all / nvm_bbt_get_all");
+		goto out;
+	}
+
+	for (size_t ch = 0; ch < GEO->nchannels; ++ch) {
+		for (size_t lun = 0; lun < GEO->nluns; ++lun) {
+			struct nvm_addr addr = { .val = 0 };
+			const struct nvm_bbt *bbt;
+
+			addr.g.ch = ch;
+			addr.g.lun = lun;
+
+			bbt = nvm_bbt_get(DEV, addr, &ret);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(bbt);
+			CU_ASSERT_EQUAL(bbt->addr.ppa, addr.ppa);
+
+			bbts_exp[ch * GEO->nluns + lun] = nvm_bbt_alloc_cp(bbt);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(bbts_exp[ch * GEO->nluns + lun]);
+		}
+	}
+
+	CU_ASSERT_FATAL(!nvm_bbt_save(DEV, path, 1));
+	CU_ASSERT(!nvm_bbt_flush_all(DEV, &ret));
+	CU_ASSERT_FATAL(!nvm_bbt_load(DEV, path, 1));
+
+	for (size_t ch = 0; ch < GEO->nchannels; ++ch) {
+		for (size_t lun = 0; lun < GEO->nluns; ++lun) {
+			const struct nvm_bbt *exp = bbts_exp[ch * GEO->nluns + lun];
+			struct nvm_addr addr = { .val = 0 };
+			const struct nvm_bbt *bbt;
+
+			addr.g.ch = ch;
+			addr.g.lun = lun;
+
+			bbt = nvm_bbt_get(DEV, addr, &ret);
+			CU_ASSERT_PTR_NOT_NULL(bbt);
+			if (!bbt)
+				continue;
+
+			CU_ASSERT_EQUAL(bbt->addr.ppa, addr.ppa);
+			CU_ASSERT_EQUAL(bbt->nblks, exp->nblks);
+			CU_ASSERT(!memcmp(bbt->blks, exp->blks,
+					  bbt->nblks * sizeof(*bbt->blks)));
+			CU_ASSERT_EQUAL(bbt->nbad, exp->nbad);
+			CU_ASSERT_EQUAL(bbt->ngbad, exp->ngbad);
+		}
+	}
+
+	CU_ASSERT(!nvm_bbt_flush_all(DEV, &ret));
+
+out:
+	for (size_t i = 0; i < nluns; ++i)
+		nvm_bbt_free(bbts_exp[i]);
+	free(bbts_exp);
+
+	nvm_dev_set_bbts_cached(DEV, 0);
+	remove(path);
+}
+
 int main(int argc, char **argv)
 {
 	int err = 0;
@@ -416,6 +565,10 @@ int main(int argc, char **argv)
 		goto out;
 	if (!CU_add_test(pSuite, "nvm_bbt_set CACHED", test_BBT_SET_CACHED))
 		goto out;
+	if (!CU_add_test(pSuite, "nvm_bbt_{get_all,save,load}", test_BBT_SNAPSHOT))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_bbt_load all LUNs", test_BBT_SNAPSHOT_ALL))
+		goto out;
 
 	switch(RMODE) {
 	case NVM_TEST_RMODE_AUTO:
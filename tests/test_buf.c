@@ -44,6 +44,32 @@ static void test_BUF_SET(void) {
 	}
 }
 
+static void test_BUF_POOL(void) {
+	const size_t count = 64;
+	struct nvm_buf_pool *pool;
+	void *bufs[64];
+
+	pool = nvm_buf_pool_create(DEV, SECTOR_SIZE, count);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+	CU_ASSERT_EQUAL(nvm_buf_pool_get_count(pool), count);
+
+	for (size_t i = 0; i < count; ++i) {
+		bufs[i] = nvm_buf_pool_get(pool);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(bufs[i]);
+		nvm_buf_fill(bufs[i], nvm_buf_pool_get_obj_size(pool));
+	}
+
+	CU_ASSERT_PTR_NULL(nvm_buf_pool_get(pool));
+	CU_ASSERT_EQUAL(errno, ENOMEM);
+
+	for (size_t i = 0; i < count; ++i)
+		nvm_buf_pool_put(pool, bufs[i]);
+
+	CU_ASSERT_PTR_NOT_NULL(nvm_buf_pool_get(pool));
+
+	nvm_buf_pool_destroy(pool);
+}
+
 int main(int argc, char **argv)
 {
 	int err = 0;
@@ -61,6 +87,9 @@ int main(int argc, char **argv)
 	if (!CU_add_test(pSuite, "BUF_SET", test_BUF_SET))
 		goto out;
 
+	if (!CU_add_test(pSuite, "BUF_POOL", test_BUF_POOL))
+		goto out;
+
 	switch(RMODE) {
 	case NVM_TEST_RMODE_AUTO:
 		CU_automated_run_tests();
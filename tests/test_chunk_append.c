@@ -0,0 +1,232 @@
+/*
+ * test_chunk_append.c - verify host-side chunk append
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+
+#include "test_util.h"
+#include "test_intf.c"
+
+#include <CUnit/Basic.h>
+
+#define NTHREADS 4
+
+static struct nvm_addr chunk;
+
+struct append_arg {
+	int tid;
+	int nappends;
+	int nerr;
+	struct nvm_addr *assigned;
+};
+
+static void *append_thread(void *argp)
+{
+	struct append_arg *arg = argp;
+	char *buf;
+
+	buf = nvm_buf_alloc(DEV, WS_MIN * SECTOR_SIZE, NULL);
+	if (!buf) {
+		arg->nerr = arg->nappends;
+		return NULL;
+	}
+	memset(buf, 'A' + arg->tid, WS_MIN * SECTOR_SIZE);
+
+	for (int i = 0; i < arg->nappends; ++i) {
+		if (nvm_chunk_append(DEV, chunk, buf, NULL, WS_MIN,
+				     &arg->assigned[i], NVM_CMD_SYNC, NULL))
+			++arg->nerr;
+	}
+
+	nvm_buf_free(DEV, buf);
+
+	return NULL;
+}
+
+static void test_append_seq(void)
+{
+	struct nvm_addr addr;
+	char *buf;
+
+	SPEC_20_ONLY;
+
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 1, &chunk)) {
+		CU_FAIL("nvm_cmd_rprt_arbs");
+		return;
+	}
+
+	buf = nvm_buf_alloc(DEV, WS_MIN * SECTOR_SIZE, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+	nvm_buf_fill(buf, WS_MIN * SECTOR_SIZE);
+
+	CU_ASSERT_EQUAL(nvm_chunk_get_wp(DEV, chunk), 0);
+
+	for (uint32_t i = 0; i < 2; ++i) {
+		CU_ASSERT(!nvm_chunk_append(DEV, chunk, buf, NULL, WS_MIN,
+					    &addr, NVM_CMD_SYNC, NULL));
+		CU_ASSERT_EQUAL(addr.l.sectr, i * WS_MIN);
+		CU_ASSERT_EQUAL(addr.l.chunk, chunk.l.chunk);
+	}
+
+	CU_ASSERT_EQUAL(nvm_chunk_get_wp(DEV, chunk), (int)(2 * WS_MIN));
+	nvm_test_rprt_assert_wp(chunk, 2 * WS_MIN);
+
+	// nsectr must be a multiple of ws_min
+	if (WS_MIN > 1) {
+		CU_ASSERT(nvm_chunk_append(DEV, chunk, buf, NULL, 1, &addr,
+					   NVM_CMD_SYNC, NULL));
+		CU_ASSERT_EQUAL(errno, EINVAL);
+	}
+
+	nvm_buf_free(DEV, buf);
+}
+
+static void test_append_reset(void)
+{
+	SPEC_20_ONLY;
+
+	CU_ASSERT(!nvm_chunk_reset(DEV, chunk, 0x0, NULL));
+	CU_ASSERT_EQUAL(nvm_chunk_get_wp(DEV, chunk), 0);
+	nvm_test_rprt_assert_wp(chunk, 0);
+}
+
+static void test_append_mt(void)
+{
+	const int nappends = NSECTR / WS_MIN / NTHREADS;
+	struct append_arg args[NTHREADS];
+	pthread_t threads[NTHREADS];
+	char *buf;
+
+	SPEC_20_ONLY;
+
+	for (int tid = 0; tid < NTHREADS; ++tid) {
+		args[tid].tid = tid;
+		args[tid].nappends = nappends;
+		args[tid].nerr = 0;
+		args[tid].assigned = calloc(nappends, sizeof(struct nvm_addr));
+		CU_ASSERT_PTR_NOT_NULL_FATAL(args[tid].assigned);
+	}
+
+	for (int tid = 0; tid < NTHREADS; ++tid)
+		pthread_create(&threads[tid], NULL, append_thread, &args[tid]);
+	for (int tid = 0; tid < NTHREADS; ++tid)
+		pthread_join(threads[tid], NULL);
+
+	nvm_test_rprt_assert_wp(chunk, NTHREADS * nappends * WS_MIN);
+
+	buf = nvm_buf_alloc(DEV, WS_MIN * SECTOR_SIZE, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+
+	// Each reservation must hold the data of the thread it was assigned to
+	for (int tid = 0; tid < NTHREADS; ++tid) {
+		CU_ASSERT_EQUAL(args[tid].nerr, 0);
+
+		for (int i = 0; i < nappends; ++i) {
+			struct nvm_addr addrs[NVM_NADDR_MAX];
+
+			for (uint32_t s = 0; s < WS_MIN; ++s) {
+				addrs[s] = args[tid].assigned[i];
+				addrs[s].l.sectr += s;
+			}
+
+			CU_ASSERT(!nvm_cmd_read(DEV, addrs, WS_MIN, buf, NULL,
+						0x0, NULL));
+			CU_ASSERT_EQUAL(buf[0], 'A' + tid);
+			CU_ASSERT_EQUAL(buf[WS_MIN * SECTOR_SIZE - 1], 'A' + tid);
+		}
+
+		free(args[tid].assigned);
+	}
+
+	nvm_buf_free(DEV, buf);
+}
+
+static void test_append_full(void)
+{
+	struct nvm_addr addr;
+	char *buf;
+	int err = 0;
+
+	SPEC_20_ONLY;
+
+	buf = nvm_buf_alloc(DEV, WS_MIN * SECTOR_SIZE, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+	nvm_buf_fill(buf, WS_MIN * SECTOR_SIZE);
+
+	while (!err) {
+		err = nvm_chunk_append(DEV, chunk, buf, NULL, WS_MIN, &addr,
+				       NVM_CMD_SYNC, NULL);
+	}
+
+	CU_ASSERT_EQUAL(errno, ENOSPC);
+	CU_ASSERT_EQUAL(nvm_chunk_get_wp(DEV, chunk), (int)NSECTR);
+	nvm_test_rprt_assert_state(chunk, NVM_CHUNK_STATE_CLOSED);
+
+	CU_ASSERT(!nvm_chunk_reset(DEV, chunk, 0x0, NULL));
+
+	nvm_buf_free(DEV, buf);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_chunk_append", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	// DO NOT REORDER; the tests share the chunk
+	if (!CU_add_test(pSuite, "nvm_chunk_append sequential", test_append_seq))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_chunk_reset", test_append_reset))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_chunk_append multi-threaded", test_append_mt))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_chunk_append until full", test_append_full))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
@@ -1,4 +1,5 @@
 #include "test_intf.c"
+#include <nvm_trace.h>
 
 // Verify that the device can be opened
 void test_DEV_OPEN_CLOSE(void)
@@ -47,6 +48,191 @@ void test_DEV_OPEN_CLOSE_MULTI_N(void)
 	}
 }
 
+// Verify NUMA node and affinity of worker threads
+void test_DEV_AFFINITY(void)
+{
+	struct nvm_dev *dev;
+
+	dev = nvm_dev_open(NVM_DEV_PATH);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+	CU_ASSERT(nvm_dev_get_numa_node(dev) >= -1);
+
+	CU_ASSERT(nvm_dev_set_affinity(dev, 0x42));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+	if (nvm_dev_get_numa_node(dev) >= 0) {
+		CU_ASSERT(!nvm_dev_set_affinity(dev, NVM_DEV_AFFINITY_NODE));
+		CU_ASSERT_EQUAL(nvm_dev_get_affinity(dev),
+				NVM_DEV_AFFINITY_NODE);
+	}
+
+	CU_ASSERT(!nvm_dev_set_affinity(dev, NVM_DEV_AFFINITY_NONE));
+	CU_ASSERT_EQUAL(nvm_dev_get_affinity(dev), NVM_DEV_AFFINITY_NONE);
+
+	nvm_dev_close(dev);
+}
+
+// Verify that reads are accounted in the latency statistics of their PU
+void test_DEV_STATS(void)
+{
+	const struct nvm_geo *geo;
+	struct nvm_dev_stats stats;
+	struct nvm_addr addr = { .val = 0 };
+	struct nvm_ret ret = { 0 };
+	struct nvm_dev *dev;
+	char *buf;
+	int err;
+
+	dev = nvm_dev_open(NVM_DEV_PATH);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+	geo = nvm_dev_get_geo(dev);
+
+	CU_ASSERT(nvm_dev_stats_get(dev, NVM_DEV_STATS_NOPS, -1, &stats));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+	CU_ASSERT(nvm_dev_stats_get(dev, NVM_DEV_STATS_READ,
+				    geo->l.npugrp * geo->l.npunit, &stats));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+	CU_ASSERT(!nvm_dev_stats_get(dev, NVM_DEV_STATS_READ, -1, &stats));
+	CU_ASSERT_EQUAL(stats.count, 0);
+
+	buf = nvm_buf_alloc(dev, geo->l.nbytes, NULL);
+	if (!buf) {
+		CU_FAIL("nvm_buf_alloc");
+		goto out;
+	}
+
+	err = nvm_cmd_read(dev, &addr, 1, buf, NULL, 0x0, &ret);
+	if (!err || ret.status) {
+		CU_ASSERT(!nvm_dev_stats_get(dev, NVM_DEV_STATS_READ, 0,
+					     &stats));
+		CU_ASSERT_EQUAL(stats.count, 1);
+		CU_ASSERT(stats.min_ns <= stats.p99_ns);
+		CU_ASSERT(stats.p99_ns <= stats.max_ns);
+
+		CU_ASSERT(!nvm_dev_stats_get(dev, NVM_DEV_STATS_WRITE, 0,
+					     &stats));
+		CU_ASSERT_EQUAL(stats.count, 0);
+	}
+
+	nvm_dev_stats_reset(dev);
+	CU_ASSERT(!nvm_dev_stats_get(dev, NVM_DEV_STATS_READ, -1, &stats));
+	CU_ASSERT_EQUAL(stats.count, 0);
+
+	nvm_buf_free(dev, buf);
+out:
+	nvm_dev_close(dev);
+}
+
+// Verify that live counters can be published and removed
+void test_DEV_STATS_SHM(void)
+{
+	struct nvm_dev *dev;
+
+	dev = nvm_dev_open(NVM_DEV_PATH);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+	CU_ASSERT(!nvm_dev_set_stats_shm(dev, 1));
+	CU_ASSERT_EQUAL(nvm_dev_get_stats_shm(dev), 1);
+
+	CU_ASSERT(!nvm_dev_set_stats_shm(dev, 0));
+	CU_ASSERT_EQUAL(nvm_dev_get_stats_shm(dev), 0);
+
+	CU_ASSERT(!nvm_dev_set_stats_shm(dev, 1));	// Removed on close
+	nvm_dev_close(dev);
+}
+
+void test_DEV_TRACE(void)
+{
+	const char path[] = "/tmp/liblightnvm_test_dev.trace";
+	const int ncmds = 8;
+	struct nvm_trace_hdr hdr = { 0 };
+	struct nvm_trace_rec rec;
+	struct nvm_addr addr = { .val = 0 };
+	struct nvm_dev *dev;
+	uint64_t nrecs = 0;
+	FILE *fp;
+	char *buf;
+
+	dev = nvm_dev_open(NVM_DEV_PATH);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+	buf = nvm_buf_alloc(dev, nvm_dev_get_geo(dev)->l.nbytes, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+
+	CU_ASSERT(!nvm_dev_set_trace(dev, path));
+	CU_ASSERT_STRING_EQUAL(nvm_dev_get_trace(dev), path);
+
+	// Traced regardless of their outcome
+	for (int i = 0; i < ncmds; ++i)
+		nvm_cmd_read(dev, &addr, 1, buf, NULL, 0x0, NULL);
+
+	CU_ASSERT(!nvm_dev_set_trace(dev, NULL));
+	CU_ASSERT_PTR_NULL(nvm_dev_get_trace(dev));
+
+	// The header is completed on close, followed by one record per cmd.
+	fp = fopen(path, "rb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+
+	CU_ASSERT_EQUAL(fread(&hdr, sizeof(hdr), 1, fp), 1);
+	CU_ASSERT_EQUAL(hdr.magic, NVM_TRACE_MAGIC);
+	CU_ASSERT_EQUAL(hdr.version, NVM_TRACE_VERSION);
+	CU_ASSERT_EQUAL(hdr.rec_nbytes, sizeof(struct nvm_trace_rec));
+	CU_ASSERT_STRING_EQUAL(hdr.name, nvm_dev_get_name(dev));
+	CU_ASSERT(hdr.tps > 0);
+	CU_ASSERT_EQUAL(hdr.nrecs, (uint64_t)ncmds);
+	CU_ASSERT_EQUAL(hdr.ndropped, 0);
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		CU_ASSERT_EQUAL(rec.op, NVM_DEV_STATS_READ);
+		CU_ASSERT_EQUAL(rec.addr, addr.val);
+		CU_ASSERT_EQUAL(rec.naddrs, 1);
+		++nrecs;
+	}
+	CU_ASSERT_EQUAL(nrecs, hdr.nrecs);
+
+	fclose(fp);
+	nvm_buf_free(dev, buf);
+	nvm_dev_close(dev);
+	unlink(path);
+}
+
+void test_DEV_PROBE(void)
+{
+	struct nvm_dev_probe probe = { 0 };
+	struct nvm_addr addr = { .val = 0 };
+	struct nvm_dev *dev;
+	char *buf;
+
+	dev = nvm_dev_open(NVM_DEV_PATH);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dev);
+
+	CU_ASSERT(nvm_dev_probe_get(dev, NVM_DEV_PROBE_NPHASES, &probe));
+	if (nvm_dev_probe_get(dev, NVM_DEV_PROBE_SUBMIT, &probe)) {
+		CU_ASSERT_EQUAL(errno, ENOSYS);	// Built without probes
+		goto out;
+	}
+
+	buf = nvm_buf_alloc(dev, nvm_dev_get_geo(dev)->l.nbytes, NULL);
+	if (!buf) {
+		CU_FAIL("nvm_buf_alloc");
+		goto out;
+	}
+
+	nvm_cmd_read(dev, &addr, 1, buf, NULL, 0x0, NULL);
+	CU_ASSERT(!nvm_dev_probe_get(dev, NVM_DEV_PROBE_SUBMIT, &probe));
+	CU_ASSERT(probe.count >= 1);
+
+	nvm_dev_stats_reset(dev);
+	CU_ASSERT(!nvm_dev_probe_get(dev, NVM_DEV_PROBE_SUBMIT, &probe));
+	CU_ASSERT_EQUAL(probe.count, 0);
+
+	nvm_buf_free(dev, buf);
+out:
+	nvm_dev_close(dev);
+}
+
 int main(int argc, char **argv)
 {
 	int err = 0;
@@ -61,6 +247,16 @@ int main(int argc, char **argv)
 		goto out;
 	if (!CU_add_test(pSuite, "nvm_dev_[open|close] multi-n", test_DEV_OPEN_CLOSE_MULTI_N))
 		goto out;
+	if (!CU_add_test(pSuite, "nvm_dev_{get,set}_affinity", test_DEV_AFFINITY))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_dev_stats_{get,reset}", test_DEV_STATS))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_dev_{get,set}_stats_shm", test_DEV_STATS_SHM))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_dev_{get,set}_trace", test_DEV_TRACE))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_dev_probe_get", test_DEV_PROBE))
+		goto out;
 
 	switch(RMODE) {
 	case NVM_TEST_RMODE_AUTO:
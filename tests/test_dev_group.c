@@ -0,0 +1,210 @@
+#include "test_util.h"
+#include "test_intf.c"
+
+#include <CUnit/Basic.h>
+
+static void test_dev_group_geo(void)
+{
+	struct nvm_dev_group *group;
+	const struct nvm_geo *geo;
+	struct nvm_dev *devs[1] = { DEV };
+
+	group = nvm_dev_group_open(devs, 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(group);
+
+	CU_ASSERT_EQUAL(nvm_dev_group_get_ndevs(group), 1);
+	CU_ASSERT(nvm_dev_group_get_member(group, 0) == DEV);
+	CU_ASSERT_PTR_NULL(nvm_dev_group_get_member(group, 1));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+	geo = nvm_dev_get_geo(nvm_dev_group_get_dev(group));
+	CU_ASSERT_EQUAL(geo->nchannels, GEO->nchannels);
+	CU_ASSERT_EQUAL(geo->nluns, GEO->nluns);
+	CU_ASSERT_EQUAL(geo->tbytes, GEO->tbytes);
+
+	nvm_dev_group_close(group);
+
+	CU_ASSERT_PTR_NULL(nvm_dev_group_open(devs, 0));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+}
+
+static void test_dev_group_vblk(void)
+{
+	struct nvm_addr addrs[0x1000] = { 0 };
+	struct nvm_buf_set *bufs = NULL;
+	struct nvm_dev *devs[1] = { DEV };
+	struct nvm_dev_group *group;
+	struct nvm_vblk *vblk = NULL;
+	size_t naddrs, nbytes;
+
+	SPEC_20_ONLY;
+
+	naddrs = GEO->l.npugrp * GEO->l.npunit;
+	CU_ASSERT_FATAL(!nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs,
+					   addrs));
+
+	group = nvm_dev_group_open(devs, 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(group);
+
+	vblk = nvm_vblk_alloc(nvm_dev_group_get_dev(group), addrs, naddrs);
+	if (!vblk) {
+		CU_FAIL("FAILED: nvm_vblk_alloc");
+		goto out;
+	}
+	nbytes = nvm_vblk_get_nbytes(vblk);
+
+	bufs = nvm_buf_set_alloc(nvm_dev_group_get_dev(group), nbytes, 0);
+	if (!bufs) {
+		CU_FAIL("FAILED: nvm_buf_set_alloc");
+		goto out;
+	}
+	nvm_buf_set_fill(bufs);
+
+	CU_ASSERT(nvm_vblk_write(vblk, bufs->write, nbytes) >= 0);
+	CU_ASSERT(nvm_vblk_read(vblk, bufs->read, nbytes) >= 0);
+	CU_ASSERT(!nvm_buf_diff(bufs->write, bufs->read, nbytes));
+	CU_ASSERT(nvm_vblk_erase(vblk) >= 0);
+
+out:
+	nvm_vblk_free(vblk);
+	nvm_buf_set_free(bufs);
+	nvm_dev_group_close(group);
+}
+
+/**
+ * Commands spanning two members, the second member is another view of DEV,
+ * its chunks are addressed with the PU groups following those of DEV. The
+ * data, and the chunk descriptors returned by the erase, of each member must
+ * be those of its addresses
+ */
+static void test_dev_group_span(void)
+{
+	struct nvm_dev *devs[2] = { DEV, DEV };
+	struct nvm_spec_rprt_descr primes[2];
+	struct nvm_spec_rprt_descr *descrs = NULL;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_addr chunks[2], gchunks[2];
+	struct nvm_dev_group *group;
+	struct nvm_ret ret = { 0 };
+	struct nvm_dev *gdev;
+	char *buf_w = NULL, *buf_r = NULL;
+	const int naddrs = 2 * WS_MIN;
+	const size_t nbytes = naddrs * SECTOR_SIZE;
+
+	SPEC_20_ONLY;
+
+	if (naddrs > NVM_NADDR_MAX) {
+		CU_PASS("ws_min too large for a spanning command; skipping");
+		return;
+	}
+
+	CU_ASSERT_FATAL(!nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, 2,
+					   chunks));
+	CU_ASSERT_FATAL(chunks[0].val != chunks[1].val);
+
+	for (int i = 0; i < 2; ++i) {
+		struct nvm_addr lun = { .val = 0 };
+		struct nvm_spec_rprt *rprt;
+
+		lun.l.pugrp = chunks[i].l.pugrp;
+		lun.l.punit = chunks[i].l.punit;
+
+		rprt = nvm_cmd_rprt(DEV, &lun, 0, NULL);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rprt);
+		primes[i] = rprt->descr[chunks[i].l.chunk];
+		nvm_buf_free(DEV, rprt);
+
+		gchunks[i] = chunks[i];
+		gchunks[i].l.pugrp += i * GEO->l.npugrp;
+	}
+
+	group = nvm_dev_group_open(devs, 2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(group);
+	gdev = nvm_dev_group_get_dev(group);
+
+	buf_w = nvm_buf_alloc(gdev, nbytes, NULL);
+	buf_r = nvm_buf_alloc(gdev, nbytes, NULL);
+	descrs = nvm_buf_alloc(gdev, 2 * sizeof(*descrs), NULL);
+	if (!(buf_w && buf_r && descrs)) {
+		CU_FAIL("FAILED: nvm_buf_alloc");
+		goto out;
+	}
+	nvm_buf_fill(buf_w, nbytes);
+	memset(buf_r, 0, nbytes);
+	memset(descrs, 0, 2 * sizeof(*descrs));
+
+	// The first WS_MIN sectors go to member 0, the rest to member 1
+	for (int idx = 0; idx < naddrs; ++idx) {
+		addrs[idx] = gchunks[idx / WS_MIN];
+		addrs[idx].l.sectr = idx % WS_MIN;
+	}
+
+	CU_ASSERT(!nvm_cmd_write(gdev, addrs, naddrs, buf_w, NULL,
+				 NVM_CMD_VECTOR, &ret));
+	CU_ASSERT(!nvm_cmd_read(gdev, addrs, naddrs, buf_r, NULL,
+				NVM_CMD_VECTOR, &ret));
+	CU_ASSERT(!nvm_buf_diff(buf_w, buf_r, nbytes));
+
+	// Each member wrote its own chunk of DEV
+	for (int i = 0; i < 2; ++i) {
+		nvm_test_rprt_assert_wp(chunks[i], WS_MIN);
+		nvm_test_vector_read_ok(chunks[i], WS_MIN, buf_r,
+					buf_w + i * WS_MIN * SECTOR_SIZE);
+	}
+
+	CU_ASSERT(!nvm_cmd_erase(gdev, gchunks, 2, descrs, NVM_CMD_VECTOR,
+				 &ret));
+
+	for (int i = 0; i < 2; ++i) {
+		CU_ASSERT_EQUAL(descrs[i].cs, NVM_CHUNK_STATE_FREE);
+		CU_ASSERT_EQUAL(descrs[i].ct, primes[i].ct);
+		CU_ASSERT_EQUAL(descrs[i].addr, primes[i].addr);
+		CU_ASSERT_EQUAL(descrs[i].naddrs, primes[i].naddrs);
+		CU_ASSERT_EQUAL(descrs[i].wp, 0);
+
+		nvm_test_rprt_assert_state(chunks[i], NVM_CHUNK_STATE_FREE);
+	}
+
+out:
+	nvm_buf_free(gdev, descrs);
+	nvm_buf_free(gdev, buf_r);
+	nvm_buf_free(gdev, buf_w);
+	nvm_dev_group_close(group);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_dev_group", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "nvm_dev_group geometry", test_dev_group_geo))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_dev_group vblk", test_dev_group_vblk))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_dev_group spanning members", test_dev_group_span))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
@@ -0,0 +1,243 @@
+/*
+ * test_ftl.c - verify the logical-block interface and recovery of nvm_ftl
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "test_intf.c"
+
+#include <CUnit/Basic.h>
+
+static void test_ftl_write_read_trim(void)
+{
+	const size_t nbytes = WS_MIN * SECTOR_SIZE;
+	struct nvm_ftl *ftl;
+	char *wbuf, *rbuf, *zero;
+
+	SPEC_20_ONLY;
+
+	ftl = nvm_ftl_open(DEV, NVM_FTL_CREATE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ftl);
+	CU_ASSERT(nvm_ftl_get_nlbas(ftl) > (uint64_t)WS_MIN);
+
+	wbuf = nvm_buf_alloc(DEV, nbytes, NULL);
+	rbuf = nvm_buf_alloc(DEV, nbytes, NULL);
+	zero = calloc(1, nbytes);
+	CU_ASSERT_FATAL(wbuf && rbuf && zero);
+	nvm_buf_fill(wbuf, nbytes);
+
+	// Unwritten LBAs read as zeroes
+	memset(rbuf, 0xff, nbytes);
+	CU_ASSERT(!nvm_ftl_read(ftl, 0, WS_MIN, rbuf));
+	CU_ASSERT(!memcmp(rbuf, zero, nbytes));
+
+	CU_ASSERT(!nvm_ftl_write(ftl, 0, WS_MIN, wbuf));
+	CU_ASSERT(!nvm_ftl_read(ftl, 0, WS_MIN, rbuf));
+	CU_ASSERT(!nvm_buf_diff(wbuf, rbuf, nbytes));
+
+	// Overwrites are remapped
+	memset(wbuf, 0xab, nbytes);
+	CU_ASSERT(!nvm_ftl_write(ftl, 0, WS_MIN, wbuf));
+	CU_ASSERT(!nvm_ftl_read(ftl, 0, WS_MIN, rbuf));
+	CU_ASSERT(!nvm_buf_diff(wbuf, rbuf, nbytes));
+
+	CU_ASSERT(!nvm_ftl_trim(ftl, 0, WS_MIN));
+	CU_ASSERT(!nvm_ftl_read(ftl, 0, WS_MIN, rbuf));
+	CU_ASSERT(!memcmp(rbuf, zero, nbytes));
+
+	CU_ASSERT(nvm_ftl_write(ftl, nvm_ftl_get_nlbas(ftl), WS_MIN, wbuf));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+	free(zero);
+	nvm_buf_free(DEV, rbuf);
+	nvm_buf_free(DEV, wbuf);
+	nvm_ftl_close(ftl);
+}
+
+static void test_ftl_recovery(void)
+{
+	const size_t nbytes = WS_MIN * SECTOR_SIZE;
+	struct nvm_ftl *ftl;
+	char *wbuf[2], *rbuf;
+
+	SPEC_20_ONLY;
+
+	ftl = nvm_ftl_open(DEV, NVM_FTL_CREATE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ftl);
+
+	wbuf[0] = nvm_buf_alloc(DEV, nbytes, NULL);
+	wbuf[1] = nvm_buf_alloc(DEV, nbytes, NULL);
+	rbuf = nvm_buf_alloc(DEV, nbytes, NULL);
+	CU_ASSERT_FATAL(wbuf[0] && wbuf[1] && rbuf);
+	nvm_buf_fill(wbuf[0], nbytes);
+	memset(wbuf[1], 0xcd, nbytes);
+
+	CU_ASSERT(!nvm_ftl_write(ftl, 0, WS_MIN, wbuf[0]));
+	CU_ASSERT(!nvm_ftl_flush(ftl));
+
+	// Overwritten after the first checkpoint, the newer one written on
+	// close must win when re-opening
+	CU_ASSERT(!nvm_ftl_write(ftl, WS_MIN, WS_MIN, wbuf[1]));
+	CU_ASSERT(!nvm_ftl_write(ftl, 0, WS_MIN, wbuf[1]));
+	nvm_ftl_close(ftl);
+
+	ftl = nvm_ftl_open(DEV, 0x0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ftl);
+
+	for (int i = 0; i < 2; ++i) {
+		CU_ASSERT(!nvm_ftl_read(ftl, i * WS_MIN, WS_MIN, rbuf));
+		CU_ASSERT(!nvm_buf_diff(wbuf[1], rbuf, nbytes));
+	}
+
+	nvm_buf_free(DEV, rbuf);
+	nvm_buf_free(DEV, wbuf[1]);
+	nvm_buf_free(DEV, wbuf[0]);
+	nvm_ftl_close(ftl);
+}
+
+/**
+ * Collect the chunks of the device in the given state, returns the # found
+ */
+static int ftl_chunks_in(int cs, struct nvm_addr *chunks, int max)
+{
+	int nchunks = 0;
+
+	for (size_t punit = 0; punit < GEO->l.npugrp * GEO->l.npunit; ++punit) {
+		struct nvm_addr pu = { .val = 0 };
+		struct nvm_spec_rprt *rprt;
+
+		pu.l.pugrp = punit / GEO->l.npunit;
+		pu.l.punit = punit % GEO->l.npunit;
+
+		rprt = nvm_cmd_rprt(DEV, &pu, 0x0, NULL);
+		CU_ASSERT_PTR_NOT_NULL_FATAL(rprt);
+
+		for (uint32_t cidx = 0; cidx < rprt->ndescr; ++cidx) {
+			if ((rprt->descr[cidx].cs != cs) || (nchunks == max))
+				continue;
+
+			chunks[nchunks] = pu;
+			chunks[nchunks].l.chunk = cidx;
+			++nchunks;
+		}
+
+		nvm_buf_free(DEV, rprt);
+	}
+
+	return nchunks;
+}
+
+static void test_ftl_crash(void)
+{
+	const size_t nbytes = WS_MIN * SECTOR_SIZE;
+	struct nvm_addr chunks[16];
+	struct nvm_ftl *ftl;
+	char *wbuf[2], *rbuf;
+	int nopen;
+
+	SPEC_20_ONLY;
+
+	wbuf[0] = nvm_buf_alloc(DEV, nbytes, NULL);
+	wbuf[1] = nvm_buf_alloc(DEV, nbytes, NULL);
+	rbuf = nvm_buf_alloc(DEV, nbytes, NULL);
+	CU_ASSERT_FATAL(wbuf[0] && wbuf[1] && rbuf);
+	nvm_buf_fill(wbuf[0], nbytes);
+	memset(wbuf[1], 0xef, nbytes);
+
+	ftl = nvm_ftl_open(DEV, NVM_FTL_CREATE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ftl);
+
+	CU_ASSERT(!nvm_ftl_write(ftl, 0, WS_MIN, wbuf[0]));
+	CU_ASSERT(!nvm_ftl_write(ftl, WS_MIN, WS_MIN, wbuf[1]));
+	CU_ASSERT(!nvm_ftl_write(ftl, 0, WS_MIN, wbuf[1]));
+
+	// Dropped without nvm_ftl_close, as when crashing, such that no
+	// checkpoint exists and the mapping is rebuilt by the scan alone. The
+	// handle is deliberately leaked.
+	ftl = NULL;
+
+	// The format left nothing written, so the open chunks are those of the
+	// streams of the crashed FTL
+	nopen = ftl_chunks_in(NVM_CHUNK_STATE_OPEN, chunks, 16);
+	CU_ASSERT_FATAL(nopen > 0);
+
+	ftl = nvm_ftl_open(DEV, 0x0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ftl);
+
+	for (int i = 0; i < 2; ++i) {
+		CU_ASSERT(!nvm_ftl_read(ftl, i * WS_MIN, WS_MIN, rbuf));
+		CU_ASSERT(!nvm_buf_diff(wbuf[1], rbuf, nbytes));
+	}
+
+	// Left open by the crashed FTL, they are reclaimed once superseded
+	CU_ASSERT(!nvm_ftl_trim(ftl, 0, 2 * WS_MIN));
+	CU_ASSERT_EQUAL(nvm_gc_run(nvm_ftl_get_gc(ftl), nopen), nopen);
+	for (int i = 0; i < nopen; ++i)
+		CU_ASSERT_EQUAL(nvm_chunk_get_wp(DEV, chunks[i]), 0);
+
+	nvm_buf_free(DEV, rbuf);
+	nvm_buf_free(DEV, wbuf[1]);
+	nvm_buf_free(DEV, wbuf[0]);
+	nvm_ftl_close(ftl);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_ftl", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "nvm_ftl_{write,read,trim}", test_ftl_write_read_trim))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_ftl_{flush,open} recovery", test_ftl_recovery))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_ftl_open scan after crash", test_ftl_crash))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
@@ -0,0 +1,131 @@
+/*
+ * test_gc.c - verify relocation and reclamation of chunks by nvm_gc
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <errno.h>
+
+#include "test_util.h"
+#include "test_intf.c"
+
+#include <CUnit/Basic.h>
+
+static int nrelocs;
+
+static int reloc(void *arg, struct nvm_addr src, struct nvm_addr dst)
+{
+	struct nvm_addr *victim = arg;
+
+	src.l.sectr = 0;
+	CU_ASSERT_EQUAL(src.val, victim->val);
+	dst.l.sectr = 0;
+	CU_ASSERT_NOT_EQUAL(dst.val, victim->val);
+
+	++nrelocs;
+
+	return 0;
+}
+
+static void test_gc_run(void)
+{
+	const struct nvm_gc_ops ops = { .reloc = reloc };
+	const int nvalid = GEO->l.nsectr / 2;
+	struct nvm_addr victim, addr;
+	struct nvm_place *place;
+	struct nvm_gc *gc;
+	char *buf;
+
+	SPEC_20_ONLY;
+
+	place = nvm_place_alloc(DEV, 1, 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(place);
+
+	gc = nvm_gc_alloc(place, &ops, &victim);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(gc);
+
+	buf = nvm_buf_alloc(DEV, WS_MIN * SECTOR_SIZE, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+	nvm_buf_fill(buf, WS_MIN * SECTOR_SIZE);
+
+	// Fill a chunk, the following write moves the stream to the next one
+	for (size_t sectr = 0; sectr < GEO->l.nsectr; sectr += WS_MIN) {
+		CU_ASSERT_FATAL(!nvm_place_write(place, 0, buf, NULL, WS_MIN,
+						 &addr, NVM_CMD_SYNC, NULL));
+		if (!sectr)
+			victim = addr;
+		CU_ASSERT(!nvm_gc_mark(gc, addr, WS_MIN, 1));
+	}
+	CU_ASSERT_FATAL(!nvm_place_write(place, 0, buf, NULL, WS_MIN, &addr,
+					 NVM_CMD_SYNC, NULL));
+	CU_ASSERT(!nvm_gc_mark(gc, addr, WS_MIN, 1));
+
+	// Invalidate all but the first half of the victim
+	addr = victim;
+	addr.l.sectr = nvalid;
+	CU_ASSERT(!nvm_gc_mark(gc, addr, GEO->l.nsectr - nvalid, 0));
+	CU_ASSERT_EQUAL(nvm_gc_get_nvalid(gc, victim), nvalid);
+
+	nrelocs = 0;
+	CU_ASSERT_EQUAL(nvm_gc_run(gc, 1), 1);
+	CU_ASSERT_EQUAL(nrelocs, nvalid);
+	CU_ASSERT_EQUAL(nvm_gc_get_nvalid(gc, victim), 0);
+	CU_ASSERT_EQUAL(nvm_chunk_get_wp(DEV, victim), 0);
+
+	nvm_buf_free(DEV, buf);
+	nvm_gc_free(gc);
+	nvm_place_free(place);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_gc", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "nvm_gc_{mark,run}", test_gc_run))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
@@ -0,0 +1,133 @@
+/*
+ * test_place.c - verify stream placement of writes
+ *
+ * Copyright (C) 2015-2018 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <errno.h>
+
+#include "test_util.h"
+#include "test_intf.c"
+
+#include <CUnit/Basic.h>
+
+static void test_place_streams(void)
+{
+	struct nvm_addr addr[2][2];
+	struct nvm_place *place;
+	char *buf;
+
+	SPEC_20_ONLY;
+
+	place = nvm_place_alloc(DEV, 2, 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(place);
+	CU_ASSERT_EQUAL(nvm_place_get_nstreams(place), 2);
+
+	buf = nvm_buf_alloc(DEV, WS_MIN * SECTOR_SIZE, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+	nvm_buf_fill(buf, WS_MIN * SECTOR_SIZE);
+
+	for (int sid = 0; sid < 2; ++sid) {
+		for (int i = 0; i < 2; ++i) {
+			CU_ASSERT(!nvm_place_write(place, sid, buf, NULL,
+						   WS_MIN, &addr[sid][i],
+						   NVM_CMD_SYNC, NULL));
+		}
+
+		// Consecutive writes of a stream land in the same chunk
+		CU_ASSERT_EQUAL(addr[sid][1].l.sectr,
+				addr[sid][0].l.sectr + WS_MIN);
+		addr[sid][1].l.sectr = addr[sid][0].l.sectr;
+		CU_ASSERT_EQUAL(addr[sid][0].val, addr[sid][1].val);
+	}
+
+	// Streams do not share chunks
+	addr[1][0].l.sectr = addr[0][0].l.sectr;
+	CU_ASSERT_NOT_EQUAL(addr[0][0].val, addr[1][0].val);
+
+	CU_ASSERT(nvm_place_write(place, 2, buf, NULL, WS_MIN, NULL,
+				  NVM_CMD_SYNC, NULL));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+	nvm_buf_free(DEV, buf);
+	nvm_place_free(place);
+}
+
+static void test_place_chunk_get_put(void)
+{
+	struct nvm_place *place;
+	struct nvm_addr chunk;
+	int nfree;
+
+	SPEC_20_ONLY;
+
+	place = nvm_place_alloc(DEV, 1, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(place);
+
+	nfree = nvm_place_get_nfree(place);
+
+	CU_ASSERT(!nvm_place_chunk_get(place, 0, &chunk));
+	CU_ASSERT_EQUAL(nvm_place_get_nfree(place), nfree - 1);
+	CU_ASSERT_EQUAL(chunk.l.pugrp, 0);
+	CU_ASSERT_EQUAL(chunk.l.punit, 0);
+
+	CU_ASSERT(!nvm_place_chunk_put(place, chunk));
+	CU_ASSERT_EQUAL(nvm_place_get_nfree(place), nfree);
+
+	nvm_place_free(place);
+}
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	CU_pSuite pSuite = suite_create("nvm_place", argc, argv, 0);
+	if (!pSuite)
+		goto out;
+
+	if (!CU_add_test(pSuite, "nvm_place_write streams", test_place_streams))
+		goto out;
+	if (!CU_add_test(pSuite, "nvm_place_chunk_{get,put}", test_place_chunk_get_put))
+		goto out;
+
+	switch(RMODE) {
+	case NVM_TEST_RMODE_AUTO:
+		CU_automated_run_tests();
+		break;
+
+	default:
+		CU_basic_set_mode(RMODE);
+		CU_basic_run_tests();
+		break;
+	}
+
+out:
+	err = CU_get_error() || \
+	      CU_get_number_of_suites_failed() || \
+	      CU_get_number_of_tests_failed() || \
+	      CU_get_number_of_failures();
+
+	CU_cleanup_registry();
+
+	return err;
+}
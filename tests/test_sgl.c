@@ -1,5 +1,6 @@
 #include "test_util.h"
 #include "test_intf.c"
+#include <nvm_sgl.h>
 
 static void _test_sgl_rw(struct nvm_addr slba, char *buf, char *meta,
 	size_t nsectr, uint16_t flags, uint8_t write)
@@ -132,6 +133,114 @@ static void _test_sgl(size_t nsectr_w, size_t nsectr_r, uint16_t flags)
 MAKE_TESTS(ws_opt, WS_OPT + MW_CUNITS, WS_OPT)
 MAKE_TESTS(nsectr, NSECTR, NSECTR)
 
+// Build SGLs exceeding a single segment, reusing them through the pool
+static void test_sgl_chain(void)
+{
+	const size_t ndescr = 4 * 256;
+	const size_t nbytes = 512;
+	struct nvm_sgl_pool *pool;
+	char *buf;
+
+	pool = nvm_sgl_pool_create(DEV);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+
+	buf = nvm_buf_alloc(DEV, ndescr * nbytes, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+
+	for (int round = 0; round < 2; ++round) {
+		struct nvm_sgl *sgl = nvm_sgl_alloc(pool);
+
+		CU_ASSERT_PTR_NOT_NULL_FATAL(sgl);
+
+		for (size_t i = 0; i < ndescr; ++i)
+			CU_ASSERT(!nvm_sgl_add(DEV, sgl, buf + i * nbytes,
+					       nbytes));
+
+		nvm_sgl_free(pool, sgl);
+	}
+
+	nvm_buf_free(DEV, buf);
+	nvm_sgl_pool_destroy(pool);
+}
+
+/**
+ * Assert that descriptor 'idx' of 'sgl' is a data block of 'nbytes' at 'buf',
+ * or a bit bucket of 'nbytes' when 'buf' is NULL
+ */
+static void sgl_descr_assert(struct nvm_sgl *sgl, int idx, void *buf,
+			     size_t nbytes)
+{
+	const struct nvm_nvme_sgl_descriptor *d = &sgl->segs->descr[idx];
+	uint64_t phys = 0;
+
+	if (!buf) {
+		CU_ASSERT_EQUAL(d->unkeyed.type,
+				NVM_NVME_SGL_DESCR_TYPE_BIT_BUCKET);
+		CU_ASSERT_EQUAL(d->unkeyed.len, nbytes);
+		CU_ASSERT_EQUAL(d->addr, 0);
+		return;
+	}
+
+	CU_ASSERT_FATAL(!nvm_buf_vtophys(DEV, buf, &phys));
+	CU_ASSERT_EQUAL(d->unkeyed.type, NVM_NVME_SGL_DESCR_TYPE_DATA_BLOCK);
+	CU_ASSERT_EQUAL(d->unkeyed.len, nbytes);
+	CU_ASSERT_EQUAL(d->addr, phys);
+}
+
+// Interleave data blocks with bit buckets, as done for sparse reads
+static void test_sgl_skip(void)
+{
+	struct nvm_sgl_pool *pool;
+	struct nvm_sgl *sgl;
+	size_t ndata = 0;
+	char *buf;
+	int ndescr;
+
+	pool = nvm_sgl_pool_create(DEV);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+	sgl = nvm_sgl_alloc(pool);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(sgl);
+
+	buf = nvm_buf_alloc(DEV, WS_OPT * SECTOR_SIZE, NULL);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+
+	for (size_t sectr = 0; sectr < WS_OPT; ++sectr) {
+		if (sectr % 2) {
+			CU_ASSERT(!nvm_sgl_add_skip(sgl, SECTOR_SIZE));
+			continue;
+		}
+		CU_ASSERT(!nvm_sgl_add(DEV, sgl, buf + sectr * SECTOR_SIZE,
+				       SECTOR_SIZE));
+		++ndata;
+	}
+
+	// One descriptor per sector, a bit bucket is not merged across data
+	CU_ASSERT_EQUAL_FATAL(sgl->ndescr, (int)WS_OPT);
+	CU_ASSERT_EQUAL(sgl->len, ndata * SECTOR_SIZE);
+	for (size_t sectr = 0; sectr < WS_OPT; ++sectr) {
+		sgl_descr_assert(sgl, sectr,
+				 sectr % 2 ? NULL : buf + sectr * SECTOR_SIZE,
+				 SECTOR_SIZE);
+	}
+
+	// Adjacent skips merge into a single bit bucket
+	CU_ASSERT(!nvm_sgl_add(DEV, sgl, buf, SECTOR_SIZE));
+	CU_ASSERT(!nvm_sgl_add_skip(sgl, SECTOR_SIZE));
+	CU_ASSERT(!nvm_sgl_add_skip(sgl, 2 * SECTOR_SIZE));
+	ndescr = WS_OPT + 2;
+	CU_ASSERT_EQUAL_FATAL(sgl->ndescr, ndescr);
+	sgl_descr_assert(sgl, ndescr - 2, buf, SECTOR_SIZE);
+	sgl_descr_assert(sgl, ndescr - 1, NULL, 3 * SECTOR_SIZE);
+
+	CU_ASSERT(nvm_sgl_add_skip(sgl, 0));
+	CU_ASSERT_EQUAL(errno, EINVAL);
+	CU_ASSERT_EQUAL(sgl->ndescr, ndescr);
+
+	nvm_buf_free(DEV, buf);
+	nvm_sgl_free(pool, sgl);
+	nvm_sgl_pool_destroy(pool);
+}
+
 int main(int argc, char **argv)
 {
 	int err = 0;
@@ -152,6 +261,11 @@ int main(int argc, char **argv)
 			goto out;
 		if (!CU_add_test(pSuite, "simple: {mode: VECTOR; nsectr: NSECTR; metadata: ON}", test_sgl_vector_nsectr_meta))
 			goto out;
+
+		if (!CU_add_test(pSuite, "chained segments", test_sgl_chain))
+			goto out;
+		if (!CU_add_test(pSuite, "bit buckets", test_sgl_skip))
+			goto out;
 	}
 
 	switch(RMODE) {
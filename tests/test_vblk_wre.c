@@ -1,6 +1,6 @@
 #include "test_intf.c"
 
-int vblk_ewr(struct nvm_addr *addrs, int naddrs, int mode)
+int vblk_ewr(struct nvm_addr *addrs, int naddrs, int mode, uint16_t opts)
 {
 	struct nvm_buf_set *bufs = NULL;
 	struct nvm_vblk *vblk = NULL;
@@ -24,8 +24,8 @@ int vblk_ewr(struct nvm_addr *addrs, int naddrs, int mode)
 	nvm_buf_set_fill(bufs);
 
 	if (mode & NVM_CMD_ASYNC) {
-		if (nvm_vblk_set_async(vblk, 0)) {
-			CU_FAIL("FAILED: nvm_vblk_set_async");
+		if (nvm_vblk_set_async_opts(vblk, 0, opts)) {
+			CU_FAIL("FAILED: nvm_vblk_set_async_opts");
 			goto out;
 		}
 	}
@@ -83,7 +83,7 @@ void test_VBLK_EWR_VECTOR_SYNC(void)
 		break;
 	}
 
-	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_VECTOR | NVM_CMD_SYNC));
+	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_VECTOR | NVM_CMD_SYNC, 0x0));
 }
 
 void test_VBLK_EWR_VECTOR_ASYNC(void)
@@ -105,7 +105,7 @@ void test_VBLK_EWR_VECTOR_ASYNC(void)
 		break;
 	}
 
-	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_VECTOR | NVM_CMD_ASYNC));
+	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_VECTOR | NVM_CMD_ASYNC, 0x0));
 }
 
 void test_VBLK_EWR_SCALAR_SYNC(void)
@@ -127,7 +127,7 @@ void test_VBLK_EWR_SCALAR_SYNC(void)
 		break;
 	}
 
-	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_SCALAR | NVM_CMD_SYNC));
+	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_SCALAR | NVM_CMD_SYNC, 0x0));
 }
 
 void test_VBLK_EWR_SCALAR_ASYNC(void)
@@ -149,7 +149,25 @@ void test_VBLK_EWR_SCALAR_ASYNC(void)
 		break;
 	}
 
-	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_SCALAR | NVM_CMD_ASYNC));
+	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_SCALAR | NVM_CMD_ASYNC, 0x0));
+}
+
+void test_VBLK_EWR_VECTOR_ASYNC_SEQ(void)
+{
+	struct nvm_addr addrs[0x1000] = { 0 };
+	size_t naddrs = 0;
+
+	if (nvm_dev_get_verid(DEV) != NVM_SPEC_VERID_20) {
+		CU_PASS("NVM_ASYNC_SEQ requires OCSSD 2.0; skipping test");
+		return;
+	}
+
+	naddrs = GEO->l.npugrp * GEO->l.npunit;
+	if (nvm_cmd_rprt_arbs(DEV, NVM_CHUNK_STATE_FREE, naddrs, addrs))
+		CU_FAIL("FAILED: nvm_cmd_rprt_arbs");
+
+	CU_ASSERT(!vblk_ewr(addrs, naddrs, NVM_CMD_VECTOR | NVM_CMD_ASYNC,
+			    NVM_ASYNC_SEQ | NVM_ASYNC_QDC));
 }
 
 int main(int argc, char **argv)
@@ -165,6 +183,8 @@ int main(int argc, char **argv)
 		case NVM_BE_SPDK:
 			if (!CU_add_test(pSuite, "VBLK EWR S20 VECTOR/ASYNC", test_VBLK_EWR_VECTOR_ASYNC))
 				goto out;
+			if (!CU_add_test(pSuite, "VBLK EWR S20 VECTOR/ASYNC/SEQ", test_VBLK_EWR_VECTOR_ASYNC_SEQ))
+				goto out;
 			/* fallthrough */
 		case NVM_BE_LBD:
 			if (!CU_add_test(pSuite, "VBLK EWR S20 SCALAR/ASYNC", test_VBLK_EWR_SCALAR_ASYNC))